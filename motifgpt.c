@@ -12,6 +12,7 @@
 #include <Xm/Text.h>
 #include <Xm/TextF.h>
 #include <Xm/ScrolledW.h>
+#include <Xm/ScrollBar.h>
 #include <Xm/PanedW.h>
 #include <Xm/CascadeB.h>
 #include <Xm/Separator.h>
@@ -48,7 +49,14 @@
 #include "motifgpt_config.h"
 #include "motifgpt_history.h"
 #include "motifgpt_chat.h"
-#include "buffer_utils.h"
+#include "motifgpt_workers.h"
+#include "motifgpt_context.h"
+#include "motifgpt_stream.h"
+#include "motifgpt_transcript.h"
+#include "motifgpt_render.h"
+#include "motifgpt_attach.h"
+#include "motifgpt_convfile.h"
+#include "motifgpt_journal.h"
 
 // --- Configuration ---
 #define DEFAULT_PROVIDER DP_PROVIDER_GOOGLE_GEMINI
@@ -62,6 +70,14 @@
 #define USER_NICKNAME "User"
 #define ASSISTANT_NICKNAME "Assistant"
 #define DEFAULT_MAX_HISTORY_MESSAGES 100
+// Longest image side each provider is sent; larger attachments are downscaled
+#define DEFAULT_GEMINI_IMAGE_MAX_DIMENSION 3072
+#define DEFAULT_OPENAI_IMAGE_MAX_DIMENSION 2048
+#define DEFAULT_ANTHROPIC_IMAGE_MAX_DIMENSION 1568
+// Image formats each provider takes as they are; others are converted before upload
+#define GEMINI_IMAGE_FORMATS (IMAGE_FORMAT_PNG | IMAGE_FORMAT_JPEG | IMAGE_FORMAT_GIF | IMAGE_FORMAT_WEBP | IMAGE_FORMAT_HEIC | IMAGE_FORMAT_HEIF)
+#define OPENAI_IMAGE_FORMATS (IMAGE_FORMAT_PNG | IMAGE_FORMAT_JPEG | IMAGE_FORMAT_GIF | IMAGE_FORMAT_WEBP)
+#define ANTHROPIC_IMAGE_FORMATS (IMAGE_FORMAT_PNG | IMAGE_FORMAT_JPEG | IMAGE_FORMAT_GIF | IMAGE_FORMAT_WEBP)
 #define INTERNAL_MAX_HISTORY_CAPACITY 10000
 #define CONFIG_DIR_MODE 0755
 #define CONFIG_FILE_NAME "settings.conf"
@@ -80,6 +96,12 @@
 #define KEY_HISTORY_LIMITS_DISABLED "history_limits_disabled"
 #define KEY_ENTER_SENDS_MESSAGE "enter_sends_message"
 #define KEY_APPEND_DEFAULT_SYSTEM_PROMPT "append_default_system_prompt"
+#define KEY_STREAM_FLUSH_MS "stream_flush_ms"
+#define KEY_STREAM_FLUSH_BYTES "stream_flush_bytes"
+#define KEY_GEMINI_IMAGE_MAX_DIMENSION "gemini_image_max_dimension"
+#define KEY_OPENAI_IMAGE_MAX_DIMENSION "openai_image_max_dimension"
+#define KEY_ANTHROPIC_IMAGE_MAX_DIMENSION "anthropic_image_max_dimension"
+#define KEY_IMAGE_JPEG_QUALITY "image_jpeg_quality"
 
 #define VAL_PROVIDER_GEMINI "gemini"
 #define VAL_PROVIDER_OPENAI "openai"
@@ -102,17 +124,20 @@
 #define DISPLAY_MSG_BUF_SIZE (2048 + PATH_MAX)
 #define DEFAULT_MAX_TOKENS 2048
 
+// Conversation view: the widget holds a window of this many transcript lines,
+// and is rebuilt from the transcript once the tail grows past it by the slack.
+#define TRANSCRIPT_VIEW_LINES 400
+#define TRANSCRIPT_VIEW_SLACK 200
+
 // --- End Configuration ---
 
 #include <dlfcn.h>
 #include <dirent.h>
 #include <cjson/cJSON.h>
 #include "motifgpt_plugin.h"
+#include "motifgpt_tools.h"
 
-// Global registry for tools
-#define MAX_TOOLS 64
-motifgpt_tool_t* registry_tools[MAX_TOOLS];
-int num_registry_tools = 0;
+tool_registry_t tool_registry; // Every tool the plugins provide
 
 void load_plugins(const char* plugin_dir) {
     DIR *dir;
@@ -125,16 +150,25 @@ void load_plugins(const char* plugin_dir) {
                 snprintf(path, sizeof(path), "%s/%s", plugin_dir, ent->d_name);
                 void* handle = dlopen(path, RTLD_LAZY);
                 if (handle) {
+                    // Plugins from before the ABI was versioned export no version
+                    const int* abi_version_sym = (const int*)dlsym(handle, "motifgpt_plugin_abi_version");
+                    int abi_version = abi_version_sym ? *abi_version_sym : 1;
                     motifgpt_plugin_init_func init_func = (motifgpt_plugin_init_func)dlsym(handle, "motifgpt_plugin_init");
-                    if (init_func) {
+                    if (abi_version < 1 || abi_version > MOTIFGPT_PLUGIN_ABI_VERSION) {
+                        fprintf(stderr, "Skipping %s: built for plugin ABI version %d, but this build supports 1 to %d.\n", path, abi_version, MOTIFGPT_PLUGIN_ABI_VERSION);
+                        dlclose(handle);
+                    } else if (init_func) {
                         motifgpt_plugin_t* plugin = init_func();
-                        if (plugin) {
+                        const motifgpt_tool_t* tools = plugin ? tool_registry_adapt_tools(&tool_registry, plugin->tools, plugin->num_tools, abi_version) : NULL;
+                        if (tools) {
                             printf("Loaded plugin: %s\n", plugin->plugin_name);
                             for (int i = 0; i < plugin->num_tools; i++) {
-                                if (num_registry_tools < MAX_TOOLS) {
-                                    registry_tools[num_registry_tools++] = &plugin->tools[i];
-                                }
+                                int added = tool_registry_add(&tool_registry, &tools[i]);
+                                if (added == 1) fprintf(stderr, "Plugin %s: tool %s is already provided by another plugin; ignoring it.\n", plugin->plugin_name, tools[i].name);
+                                else if (added != 0) fprintf(stderr, "Plugin %s: could not register tool %s.\n", plugin->plugin_name, tools[i].name);
                             }
+                        } else if (plugin) {
+                            fprintf(stderr, "Plugin %s: could not load its tools.\n", plugin->plugin_name);
                         }
                     } else {
                         fprintf(stderr, "Failed to find motifgpt_plugin_init in %s: %s\n", path, dlerror());
@@ -151,25 +185,50 @@ void load_plugins(const char* plugin_dir) {
 }
 
 void append_tools_to_system_prompt(char* buffer, size_t buffer_size) {
-    if (num_registry_tools == 0) return;
+    if (tool_registry.count == 0) return;
     
-    const char* header = "\n\nYou have access to the following tools. To call a tool, you MUST output a JSON block inside a <tool_call> tag. Wait for the user to provide the tool result in a <tool_result> tag. DO NOT output anything else when calling a tool.\nFormat:\n<tool_call>{\"name\": \"tool_name\", \"args\": {\"arg1\": \"val1\"}}</tool_call>\n\nAvailable tools:\n";
+    const char* header = "\n\nYou have access to the following tools. To call a tool, you MUST output a JSON block inside a <tool_call> tag. Independent calls may be made together, each in its own <tool_call> tag; they run at the same time. Wait for the user to provide the results in a <tool_result> tag: the result itself for one call, or a JSON array of {\"name\", \"result\"} objects in call order for several. DO NOT output anything else when calling a tool.\nFormat:\n<tool_call>{\"name\": \"tool_name\", \"args\": {\"arg1\": \"val1\"}}</tool_call>\n\nAvailable tools:\n";
     strncat(buffer, header, buffer_size - strlen(buffer) - 1);
     
-    for (int i = 0; i < num_registry_tools; i++) {
+    for (int i = 0; i < tool_registry.count; i++) {
+        const motifgpt_tool_t* tool = tool_registry.tools[i];
         char tool_desc[2048];
-        snprintf(tool_desc, sizeof(tool_desc), "- %s: %s\n  Parameters: %s\n", registry_tools[i]->name, registry_tools[i]->description, registry_tools[i]->parameters_schema);
+        snprintf(tool_desc, sizeof(tool_desc), "- %s: %s\n  Parameters: %s\n", tool->name, tool->description, tool->parameters_schema);
         strncat(buffer, tool_desc, buffer_size - strlen(buffer) - 1);
     }
 }
 
 void start_llm_request_internal(bool from_tool_call); // forward declaration
+static void update_send_button();
+
+tool_batch_t tool_batch; // The calls from the current reply; the conversation continues once all are done
+
+// Hands the batch's results to the model as the next user turn.
+static void continue_with_tool_results() {
+    char* result_msg = tool_batch_join(&tool_batch);
+    tool_batch_clear(&tool_batch);
+    if (!result_msg) return;
+    add_message_to_history(DP_ROLE_USER, result_msg, NULL, NULL);
+    append_to_conversation(result_msg);
+    append_to_conversation("\n");
+    free(result_msg);
+    start_llm_request_internal(true);
+}
 
-void execute_tool_call_and_continue(const char* tool_call_json) {
+void cancel_tool_call() {
+    tool_batch_clear(&tool_batch);
+    update_send_button();
+}
+
+// Starts one call from the reply, or records why it could not be started.
+static void dispatch_tool_call(const char* tool_call_json) {
+    if (!tool_call_json[0]) {
+        tool_batch_add_result(&tool_batch, NULL, "{\"error\": \"Empty or oversized tool call\"}");
+        return;
+    }
     cJSON* json = cJSON_Parse(tool_call_json);
     if (!json) {
-        add_message_to_history(DP_ROLE_USER, "<tool_result>{\"error\": \"Invalid JSON\"}</tool_result>", NULL, NULL);
-        start_llm_request_internal(true);
+        tool_batch_add_result(&tool_batch, NULL, "{\"error\": \"Invalid JSON\"}");
         return;
     }
     
@@ -177,43 +236,68 @@ void execute_tool_call_and_continue(const char* tool_call_json) {
     cJSON* args_node = cJSON_GetObjectItemCaseSensitive(json, "args");
     
     if (!cJSON_IsString(name_node)) {
-        add_message_to_history(DP_ROLE_USER, "<tool_result>{\"error\": \"Missing tool name\"}</tool_result>", NULL, NULL);
         cJSON_Delete(json);
-        start_llm_request_internal(true);
+        tool_batch_add_result(&tool_batch, NULL, "{\"error\": \"Missing tool name\"}");
         return;
     }
     
-    const char* tool_name = name_node->valuestring;
+    const motifgpt_tool_t* tool = tool_registry_find(&tool_registry, name_node->valuestring);
+    if (!tool) {
+        cJSON_Delete(json);
+        tool_batch_add_result(&tool_batch, NULL, "{\"error\": \"Unknown tool\"}");
+        return;
+    }
+
     char* args_str = args_node ? cJSON_PrintUnformatted(args_node) : strdup("{}");
-    
-    char* result = NULL;
-    for (int i = 0; i < num_registry_tools; i++) {
-        if (strcmp(registry_tools[i]->name, tool_name) == 0) {
-            result = registry_tools[i]->execute(args_str);
-            break;
-        }
+    cJSON_Delete(json);
+    tool_call_t* call = args_str ? tool_call_create(tool, args_str) : NULL;
+    free(args_str);
+    if (!call) {
+        tool_batch_add_result(&tool_batch, tool->name, "{\"error\": \"Out of memory\"}");
+    } else if (tool_call_submit(call) != 0) {
+        tool_call_release(call);
+        tool_batch_add_result(&tool_batch, tool->name, "{\"error\": \"Too many requests in flight\"}");
+    } else if (tool_batch_add_call(&tool_batch, call) != 0) {
+        tool_call_cancel(call);
     }
-    
-    char result_msg[8192];
-    if (result) {
-        snprintf(result_msg, sizeof(result_msg), "<tool_result>%s</tool_result>", result);
-        free(result);
-    } else {
-        snprintf(result_msg, sizeof(result_msg), "<tool_result>{\"error\": \"Unknown tool\"}</tool_result>");
+}
+
+// Starts a call the moment its closing tag streams in; the batch is answered once the reply ends and all are done.
+void start_streamed_tool_call(const char* tool_call_json) {
+    if (!tool_batch.streaming) {
+        cancel_tool_call();
+        tool_batch.streaming = true;
     }
-    
-    free(args_str);
-    cJSON_Delete(json);
-    
-    add_message_to_history(DP_ROLE_USER, result_msg, NULL, NULL);
-    append_to_conversation(result_msg);
-    append_to_conversation("\n");
-    start_llm_request_internal(true);
+    dispatch_tool_call(tool_call_json);
+}
+
+// The reply is complete: say what is still running, or answer at once if nothing is.
+static void seal_tool_calls() {
+    if (!tool_batch.streaming) return;
+    tool_batch.streaming = false;
+    for (int i = 0; i < tool_batch.count; i++) {
+        if (!tool_batch.slots[i].call) continue;
+        char running_msg[256];
+        snprintf(running_msg, sizeof(running_msg), "[Running tool %s...]\n", tool_batch.slots[i].name);
+        append_to_conversation(running_msg);
+    }
+    if (tool_batch.pending == 0) continue_with_tool_results();
+}
+
+void finish_tool_call(unsigned long id) {
+    if (!tool_batch_finish_call(&tool_batch, id)) return; // Superseded or cancelled
+    if (tool_batch.pending == 0 && !tool_batch.streaming) continue_with_tool_results();
+    update_send_button();
 }
 
 // Globals
 Widget app_shell;
 Widget conversation_text;
+Widget transcript_scrollbar;
+transcript_t transcript;
+render_cache_t render_cache;
+size_t view_first_line = 0;
+Boolean view_following = True;
 Widget input_text;
 Widget send_button;
 Widget attach_image_button;
@@ -247,18 +331,21 @@ bool history_limits_disabled = false;
 Boolean enter_key_sends_message = True;
 char current_system_prompt[SYSTEM_PROMPT_BUF_SIZE] = "";
 Boolean append_default_system_prompt = True;
-
-char attached_image_path[PATH_MAX] = "";
-char attached_image_mime_type[64] = "";
-char *attached_image_base64_data = NULL;
-
-dp_context_t *dp_ctx = NULL;
-pthread_mutex_t dp_mutex = PTHREAD_MUTEX_INITIALIZER;
-char current_assistant_prefix[64];
+int stream_flush_ms = STREAM_FLUSH_DEFAULT_MS;
+int stream_flush_bytes = STREAM_FLUSH_DEFAULT_BYTES;
+int gemini_image_max_dimension = DEFAULT_GEMINI_IMAGE_MAX_DIMENSION; // 0 sends images at full size
+int openai_image_max_dimension = DEFAULT_OPENAI_IMAGE_MAX_DIMENSION;
+int anthropic_image_max_dimension = DEFAULT_ANTHROPIC_IMAGE_MAX_DIMENSION;
+int image_jpeg_quality = IMAGE_SCALE_DEFAULT_QUALITY;
+
+attach_batch_t attachments; // Images for the next message, loading or ready
+convfile_job_t *open_job = NULL; // Conversation file being read, if any
+bool open_job_shown = false;     // Whether its messages have replaced the old conversation yet
+convfile_job_t *save_job = NULL; // Conversation file being written, if any
 
 Pixel normal_fg_color, grey_fg_color;
 
-typedef struct { dp_request_config_t config; char system_prompt_buffer[THREAD_SYSTEM_PROMPT_BUF_SIZE]; char temp_history_filename[PATH_MAX]; } llm_thread_data_t;
+typedef struct { dp_request_config_t config; char system_prompt_buffer[THREAD_SYSTEM_PROMPT_BUF_SIZE]; history_snapshot_t *history; llm_context_t *llm; stream_state_t *stream; } llm_thread_data_t;
 typedef struct { dp_provider_type_t provider; char api_key_for_list[API_KEY_BUF_SIZE]; char base_url_for_list[API_URL_BUF_SIZE]; } get_models_thread_data_t;
 
 // Function Prototypes
@@ -274,16 +361,19 @@ static void settings_text_field_focus_in_cb(Widget, XtPointer, XtPointer);
 static void settings_text_field_focus_out_cb(Widget, XtPointer, XtPointer);
 static int ends_with_ignore_case(const char *str, const char *suffix);
 void clear_chat_callback(Widget, XtPointer, XtPointer);
-void *perform_llm_request_thread(void*);
+void perform_llm_request_job(worker_t*, void*);
 void initialize_dp_context();
 void load_settings();
 void save_settings();
 void attach_image_callback(Widget, XtPointer, XtPointer);
 void file_selection_ok_callback(Widget, XtPointer, XtPointer);
+void clear_attachments(); void show_attach_progress(unsigned long, unsigned int); void finish_attach(unsigned long);
 void open_chat_callback(Widget, XtPointer, XtPointer);
 void save_chat_as_callback(Widget, XtPointer, XtPointer);
 void file_selection_open_ok_callback(Widget, XtPointer, XtPointer);
 void file_selection_save_as_ok_callback(Widget, XtPointer, XtPointer);
+void take_conversation_batches(unsigned long); void finish_conversation_job(unsigned long); void cancel_conversation_load();
+void finish_tool_call(unsigned long); void cancel_tool_call();
 void render_all_history();
 void append_to_conversation(const char* text);
 void append_to_conversation_ex(const char* text, Boolean scroll);
@@ -299,7 +389,7 @@ void settings_callback(Widget, XtPointer, XtPointer); void settings_tab_change_c
 Boolean apply_settings_safe();
 void settings_apply_callback(Widget, XtPointer, XtPointer); void settings_ok_callback(Widget, XtPointer, XtPointer);
 void settings_cancel_callback(Widget, XtPointer, XtPointer); void settings_get_models_callback(Widget, XtPointer, XtPointer);
-void *perform_get_models_thread(void*); void settings_use_selected_model_callback(Widget, XtPointer, XtPointer);
+void perform_get_models_job(worker_t*, void*); void settings_use_selected_model_callback(Widget, XtPointer, XtPointer);
 void populate_settings_dialog(); void retrieve_settings_from_dialog();
 Widget create_provider_settings_tab(Widget parent, const char *prefix,
                                     Widget *api_key_text_w, const char *api_key_placeholder,
@@ -312,129 +402,159 @@ void settings_disable_history_limit_toggle_cb(Widget, XtPointer, XtPointer);
 void setup_ui(void);
 
 
+static void update_transcript_scrollbar() {
+    if (!transcript_scrollbar) return;
+    size_t total = transcript_line_count(&transcript);
+    int maximum = total > 0 ? (int)total : 1;
+    int slider = total < TRANSCRIPT_VIEW_LINES ? maximum : TRANSCRIPT_VIEW_LINES;
+    int value = (int)view_first_line;
+    if (value > maximum - slider) value = maximum - slider;
+    XtVaSetValues(transcript_scrollbar, XmNmaximum, maximum, XmNsliderSize, slider, XmNvalue, value, XmNpageIncrement, slider, NULL);
+}
+
+// Hands the widget transcript lines [first_line, first_line + TRANSCRIPT_VIEW_LINES).
+static void show_transcript_window(size_t first_line, Boolean at_end) {
+    char *window = transcript_copy_lines(&transcript, first_line, TRANSCRIPT_VIEW_LINES, NULL);
+    XmTextSetString(conversation_text, window ? window : "");
+    free(window);
+    view_first_line = first_line;
+    XmTextShowPosition(conversation_text, at_end ? XmTextGetLastPosition(conversation_text) : 0);
+    update_transcript_scrollbar();
+}
+
+static void show_transcript_tail() {
+    size_t total = transcript_line_count(&transcript);
+    view_following = True;
+    show_transcript_window(total > TRANSCRIPT_VIEW_LINES ? total - TRANSCRIPT_VIEW_LINES : 0, True);
+}
+
+static void transcript_scroll_callback(Widget w, XtPointer client_data, XtPointer call_data) {
+    XmScrollBarCallbackStruct *cbs = (XmScrollBarCallbackStruct *)call_data;
+    size_t first_line = cbs->value > 0 ? (size_t)cbs->value : 0;
+    if (first_line + TRANSCRIPT_VIEW_LINES >= transcript_line_count(&transcript)) {
+        show_transcript_tail();
+    } else {
+        view_following = False;
+        show_transcript_window(first_line, False);
+    }
+}
+
 void append_to_conversation_ex(const char* text, Boolean scroll) {
     if (!conversation_text || !XtIsManaged(conversation_text)) return;
+    transcript_append(&transcript, text, strlen(text));
+    // While the user is reading older lines the widget is left alone.
+    if (!view_following) { update_transcript_scrollbar(); return; }
+    if (transcript_line_count(&transcript) - view_first_line > TRANSCRIPT_VIEW_LINES + TRANSCRIPT_VIEW_SLACK) {
+        show_transcript_tail();
+        return;
+    }
     XmTextPosition pos = XmTextGetLastPosition(conversation_text);
     XmTextInsert(conversation_text, pos, (char*)text);
     if (scroll) {
         XmTextShowPosition(conversation_text, XmTextGetLastPosition(conversation_text));
     }
+    update_transcript_scrollbar();
 }
 
 void append_to_conversation(const char* text) {
     append_to_conversation_ex(text, True);
 }
 
-void handle_pipe_input(XtPointer client_data, int *source, XtInputId *id) {
-    pipe_message_t msg;
-    char batch_buffer[8192];
-    size_t batch_len = 0;
-    const size_t BATCH_CAPACITY = sizeof(batch_buffer) - 1; // Leave room for null terminator
+static pipe_reader_t ui_pipe_reader;
+static bool reply_streaming = false; // A reply is on its way; one request at a time per conversation
 
-    batch_buffer[0] = '\0';
+// A turn lasts until its reply has streamed in and every tool call it made has been answered.
+static bool reply_in_progress() {
+    return reply_streaming || tool_batch.streaming || tool_batch.pending > 0;
+}
 
-    // Safety break to prevent infinite loop if pipe is flooded faster than we can read
-    int max_reads = 1000;
+static void update_send_button() {
+    if (send_button) XtSetSensitive(send_button, !reply_in_progress());
+}
 
-    while (max_reads-- > 0) {
-        ssize_t nbytes = read(pipe_fds[0], &msg, sizeof(pipe_message_t));
-
-        if (nbytes == sizeof(pipe_message_t)) {
-             if (msg.type == PIPE_MSG_TOKEN) {
-                 if (assistant_is_replying && !prefix_already_added_for_current_reply) {
-                     size_t prefix_len = strlen(current_assistant_prefix);
-                     if (batch_len + prefix_len > BATCH_CAPACITY) {
-                         if (batch_len > 0) {
-                             append_to_conversation(batch_buffer);
-                             batch_buffer[0] = '\0';
-                             batch_len = 0;
-                         }
-                     }
-                     if (batch_len + prefix_len <= BATCH_CAPACITY) {
-                         strcpy(batch_buffer + batch_len, current_assistant_prefix);
-                         batch_len += prefix_len;
-                     } else {
-                         append_to_conversation(current_assistant_prefix);
-                     }
-                     prefix_already_added_for_current_reply = true;
-                 }
+// Collects conversation text so each wakeup inserts it with as few XmText calls as possible
+typedef struct {
+    char buf[8192];
+    size_t len;
+} conversation_batch_t;
+
+static void batch_flush(conversation_batch_t *batch) {
+    if (batch->len == 0) return;
+    append_to_conversation(batch->buf);
+    batch->buf[0] = '\0';
+    batch->len = 0;
+}
 
-                 size_t token_len = strlen(msg.data);
-                 if (batch_len + token_len > BATCH_CAPACITY) {
-                     append_to_conversation(batch_buffer);
-                     batch_buffer[0] = '\0';
-                     batch_len = 0;
-                 }
+// `text` must be NUL-terminated at `len`.
+static void batch_append(conversation_batch_t *batch, const char *text, size_t len) {
+    const size_t capacity = sizeof(batch->buf) - 1; // Leave room for null terminator
+    if (batch->len + len > capacity) batch_flush(batch);
+    if (len > capacity) {
+        append_to_conversation(text);
+        return;
+    }
+    memcpy(batch->buf + batch->len, text, len + 1);
+    batch->len += len;
+}
 
-                 if (token_len > BATCH_CAPACITY) {
-                     append_to_conversation(msg.data);
-                 } else {
-                     strcpy(batch_buffer + batch_len, msg.data);
-                     batch_len += token_len;
-                 }
-             } else {
-                 if (batch_len > 0) {
-                     append_to_conversation(batch_buffer);
-                     batch_buffer[0] = '\0';
-                     batch_len = 0;
-                 }
+static void finish_stream_reply(stream_state_t *stream) {
+    if (stream->started && !stream->prefix_added && stream->response_len == 0) {
+        append_to_conversation(stream->prefix);
+    }
+    append_to_conversation("\n");
 
-                 switch (msg.type) {
-                     case PIPE_MSG_STREAM_END:
-                        if (assistant_is_replying && !prefix_already_added_for_current_reply && current_assistant_response_len == 0) {
-                            append_to_conversation(current_assistant_prefix);
-                        }
-                        append_to_conversation("\n");
-                        
-                        bool is_tool_call = false;
-                        char tool_call_json[8192] = "";
-                        if (current_assistant_response_buffer && current_assistant_response_len > 0) {
-                            add_message_to_history(DP_ROLE_ASSISTANT, current_assistant_response_buffer, NULL, NULL);
-                            
-                            const char* tc_start = strstr(current_assistant_response_buffer, "<tool_call>");
-                            const char* tc_end = strstr(current_assistant_response_buffer, "</tool_call>");
-                            if (tc_start && tc_end && tc_end > tc_start) {
-                                is_tool_call = true;
-                                size_t tc_len = tc_end - tc_start - 11;
-                                if (tc_len < sizeof(tool_call_json)) {
-                                    strncpy(tool_call_json, tc_start + 11, tc_len);
-                                    tool_call_json[tc_len] = '\0';
-                                }
-                            }
-                        } else if (assistant_is_replying && current_assistant_response_len == 0) {
-                            add_message_to_history(DP_ROLE_ASSISTANT, "", NULL, NULL);
-                        }
-                        if (current_assistant_response_buffer) current_assistant_response_buffer[0] = '\0';
-                        current_assistant_response_len = 0;
-                        assistant_is_replying = false; prefix_already_added_for_current_reply = false;
-                        
-                        if (is_tool_call) {
-                            execute_tool_call_and_continue(tool_call_json);
-                        }
-                        break;
-                     case PIPE_MSG_ERROR:
-                        show_error_dialog(msg.data); append_to_conversation(msg.data); append_to_conversation("\n");
-                        assistant_is_replying = false; prefix_already_added_for_current_reply = false;
-                        break;
-                     case PIPE_MSG_MODEL_LIST_ITEM:
-                        if (settings_shell && XtIsManaged(settings_shell)) {
-                            Widget list_to_update = NULL;
-                            if (settings_current_tab_content == settings_gemini_tab_content) list_to_update = gemini_model_list;
-                            else if (settings_current_tab_content == settings_openai_tab_content) list_to_update = openai_model_list;
-                            else if (settings_current_tab_content == settings_anthropic_tab_content) list_to_update = anthropic_model_list;
-
-                            if (list_to_update) {
-                                XmString item = XmStringCreateLocalized(msg.data);
-                                XmListAddItemUnselected(list_to_update, item, 0); XmStringFree(item);
-                            }
-                        }
-                        break;
-                     case PIPE_MSG_MODEL_LIST_END: printf("Model listing complete.\n"); break;
-                     case PIPE_MSG_MODEL_LIST_ERROR: show_error_dialog(msg.data); break;
-                     default: break;
-                 }
-             }
-        } else if (nbytes == -1) {
+    if (stream->response && stream->response_len > 0) {
+        add_message_to_history(DP_ROLE_ASSISTANT, stream->response, NULL, NULL);
+    } else if (stream->started) {
+        add_message_to_history(DP_ROLE_ASSISTANT, "", NULL, NULL);
+    }
+    // The calls already started as they streamed in
+    seal_tool_calls();
+}
+
+// Drains everything the stream's producer has queued since its doorbell last rang.
+static void handle_stream_records(stream_state_t *stream, conversation_batch_t *batch) {
+    pipe_message_type_t type;
+    const char *data;
+    size_t len;
+    while (stream_next_record(stream, &type, &data, &len)) {
+        if (type == PIPE_MSG_TOKEN) {
+            if (!stream->prefix_added) {
+                batch_append(batch, stream->prefix, strlen(stream->prefix));
+                stream->prefix_added = true;
+            }
+            batch_append(batch, data, len);
+            continue;
+        }
+        if (type == PIPE_MSG_TOOL_CALL) {
+            start_streamed_tool_call(data);
+            continue;
+        }
+        batch_flush(batch);
+        reply_streaming = false; // Before finishing, which may start the follow-up request
+        if (type == PIPE_MSG_STREAM_END) {
+            finish_stream_reply(stream);
+        } else if (type == PIPE_MSG_ERROR) {
+            cancel_tool_call(); // The reply broke off, so its calls have nobody to answer
+            show_error_dialog(data); append_to_conversation(data); append_to_conversation("\n");
+        }
+        stream_close(stream);
+        update_send_button();
+        return;
+    }
+}
+
+void handle_pipe_input(XtPointer client_data, int *source, XtInputId *id) {
+    conversation_batch_t batch;
+    batch.buf[0] = '\0';
+    batch.len = 0;
+
+    // Safety break to prevent infinite loop if pipe is flooded faster than we can read
+    int max_reads = 64;
+
+    while (max_reads-- > 0) {
+        ssize_t nbytes = pipe_reader_fill(&ui_pipe_reader, pipe_fds[0]);
+        if (nbytes == -1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 break;
             } else {
@@ -446,39 +566,100 @@ void handle_pipe_input(XtPointer client_data, int *source, XtInputId *id) {
              fprintf(stderr, "handle_pipe_input: EOF on pipe.\n");
              XtRemoveInput(*id);
              break;
-        } else {
-             fprintf(stderr, "handle_pipe_input: Partial read from pipe (%ld bytes).\n", nbytes);
-             break;
         }
-    }
 
-    if (batch_len > 0) {
-        append_to_conversation(batch_buffer);
+        pipe_message_type_t msg_type;
+        const char *msg_data;
+        size_t msg_len;
+        while (pipe_reader_next(&ui_pipe_reader, &msg_type, &msg_data, &msg_len)) {
+             if (msg_type == PIPE_MSG_STREAM_READY) {
+                 unsigned long stream_id;
+                 if (msg_len != sizeof(stream_id)) continue;
+                 memcpy(&stream_id, msg_data, sizeof(stream_id));
+                 stream_state_t *stream = stream_claim(stream_id);
+                 if (stream) handle_stream_records(stream, &batch);
+                 continue;
+             }
+
+             batch_flush(&batch);
+             switch (msg_type) {
+                 case PIPE_MSG_ATTACH_PROGRESS:
+                 case PIPE_MSG_ATTACH_DONE: {
+                    attach_progress_t progress;
+                    if (msg_len != sizeof(progress)) break;
+                    memcpy(&progress, msg_data, sizeof(progress));
+                    if (msg_type == PIPE_MSG_ATTACH_DONE) finish_attach(progress.id);
+                    else show_attach_progress(progress.id, progress.percent);
+                    break;
+                 }
+                 case PIPE_MSG_CONVERSATION_BATCH:
+                 case PIPE_MSG_CONVERSATION_DONE: {
+                    unsigned long job_id;
+                    if (msg_len != sizeof(job_id)) break;
+                    memcpy(&job_id, msg_data, sizeof(job_id));
+                    if (msg_type == PIPE_MSG_CONVERSATION_DONE) finish_conversation_job(job_id);
+                    else take_conversation_batches(job_id);
+                    break;
+                 }
+                 case PIPE_MSG_TOOL_DONE: {
+                    unsigned long call_id;
+                    if (msg_len != sizeof(call_id)) break;
+                    memcpy(&call_id, msg_data, sizeof(call_id));
+                    finish_tool_call(call_id);
+                    break;
+                 }
+                 case PIPE_MSG_MODEL_LIST_ITEM:
+                    if (settings_shell && XtIsManaged(settings_shell)) {
+                        Widget list_to_update = NULL;
+                        if (settings_current_tab_content == settings_gemini_tab_content) list_to_update = gemini_model_list;
+                        else if (settings_current_tab_content == settings_openai_tab_content) list_to_update = openai_model_list;
+                        else if (settings_current_tab_content == settings_anthropic_tab_content) list_to_update = anthropic_model_list;
+
+                        if (list_to_update) {
+                            XmString item = XmStringCreateLocalized((char*)msg_data);
+                            XmListAddItemUnselected(list_to_update, item, 0); XmStringFree(item);
+                        }
+                    }
+                    break;
+                 case PIPE_MSG_MODEL_LIST_END: printf("Model listing complete.\n"); break;
+                 case PIPE_MSG_MODEL_LIST_ERROR: show_error_dialog(msg_data); break;
+                 default: break;
+             }
+        }
     }
+
+    batch_flush(&batch);
+}
+
+// Frees a request that never reached a worker.
+static void discard_llm_request_job(void *arg) {
+    llm_thread_data_t *thread_data = (llm_thread_data_t *)arg;
+    stream_close(thread_data->stream);
+    stream_release(thread_data->stream);
+    history_snapshot_release(thread_data->history);
+    llm_context_release(thread_data->llm);
+    free(thread_data);
 }
 
-void *perform_llm_request_thread(void *arg) {
+void perform_llm_request_job(worker_t *self, void *arg) {
     llm_thread_data_t *thread_data = (llm_thread_data_t *)arg;
     dp_response_t response_status = {0};
 
-    // Deserialize chat history from temp file
-    if (strlen(thread_data->temp_history_filename) > 0) {
-        dp_message_t *loaded_messages = NULL;
-        size_t num_loaded = 0;
-        if (dp_deserialize_messages_from_file(thread_data->temp_history_filename, &loaded_messages, &num_loaded) == 0) {
-            thread_data->config.messages = loaded_messages;
-            thread_data->config.num_messages = num_loaded;
-            unlink(thread_data->temp_history_filename); // Remove file immediately after loading
-        } else {
-             write_pipe_message(PIPE_MSG_ERROR, "Failed to load chat history for request.");
-             unlink(thread_data->temp_history_filename);
-             free(thread_data);
-             pthread_detach(pthread_self());
-             return NULL;
-        }
+    // Stored images are read back only now, on the worker
+    dp_message_t *payload = NULL;
+    if (history_snapshot_expand(thread_data->history, &payload) != 0) {
+        stream_end(thread_data->stream, "LLM Request Failed: an attached image is missing from the image cache.");
+        stream_release(thread_data->stream);
+        history_snapshot_release(thread_data->history);
+        llm_context_release(thread_data->llm);
+        free(thread_data);
+        return;
     }
+    thread_data->config.messages = payload;
+    thread_data->config.num_messages = thread_data->history->count;
+    thread_data->config.model = thread_data->llm->model;
 
-    printf("Thread: LLM request with %d messages.\n", (int)thread_data->config.num_messages);
+    printf("Worker: LLM request with %d messages, context v%lu (queued %.1f ms).\n", (int)thread_data->config.num_messages, thread_data->llm->version, worker_job_wait_ms(self));
 
     // Point the config's system_prompt to the buffer inside the struct
     if (strlen(thread_data->system_prompt_buffer) > 0) {
@@ -487,12 +668,12 @@ void *perform_llm_request_thread(void *arg) {
         thread_data->config.system_prompt = NULL;
     }
 
-    pthread_mutex_lock(&dp_mutex);
+    llm_context_t *llm = thread_data->llm;
+    dp_context_t *ctx = worker_get_context(self, llm->provider, llm->api_key, llm->base_url);
     int ret = -1;
-    if (dp_ctx) {
-        ret = dp_perform_streaming_completion(dp_ctx, &thread_data->config, stream_handler, NULL, &response_status);
+    if (ctx) {
+        ret = dp_perform_streaming_completion(ctx, &thread_data->config, stream_handler, thread_data->stream, &response_status);
     }
-    pthread_mutex_unlock(&dp_mutex);
 
     if (ret != 0) {
         char err_buf[1024];
@@ -502,24 +683,39 @@ void *perform_llm_request_thread(void *arg) {
              snprintf(err_buf, sizeof(err_buf), "LLM Request Failed (Thread) (HTTP %ld): %s",
                  response_status.http_status_code, response_status.error_message ? response_status.error_message : "DP error in thread.");
         }
-        write_pipe_message(PIPE_MSG_ERROR, err_buf);
+        stream_end(thread_data->stream, err_buf);
+    } else {
+        stream_end(thread_data->stream, NULL);
     }
     dp_free_response_content(&response_status);
 
-    // Free the thread-specific history
-    if (thread_data->config.messages) {
-        dp_free_messages(thread_data->config.messages, thread_data->config.num_messages);
-        free(thread_data->config.messages);
-    }
-
+    stream_release(thread_data->stream);
+    history_payload_free(thread_data->history, payload);
+    history_snapshot_release(thread_data->history);
+    llm_context_release(thread_data->llm);
     free(thread_data);
-    pthread_detach(pthread_self());
-    return NULL;
+}
+
+// Hands the ready attachments to history as one message, then empties the batch.
+static void add_user_message_with_attachments(const char *text) {
+    history_image_ref_t images[ATTACH_MAX_IMAGES];
+    size_t num_images = 0;
+    for (int i = 0; i < attachments.count; i++) {
+        attach_job_t *job = attachments.jobs[i];
+        history_image_ref_t *image = &images[num_images++];
+        snprintf(image->key, sizeof(image->key), "%s", job->image_key);
+        snprintf(image->mime_type, sizeof(image->mime_type), "%s", job->mime_type);
+        image->data = job->base64; // NULL when the store has it; otherwise history takes it over
+        job->base64 = NULL;
+    }
+    add_image_message_to_history(DP_ROLE_USER, text, images, num_images);
+    clear_attachments();
 }
 
 void start_llm_request() {
+    if (reply_in_progress()) return; // Send stays disabled until the current turn is done
     char *input_string_raw = XmTextGetString(input_text);
-    if ((!input_string_raw || strlen(input_string_raw) == 0) && !attached_image_base64_data) {
+    if ((!input_string_raw || strlen(input_string_raw) == 0) && attachments.count == 0) {
         XtFree(input_string_raw); return;
     }
     if (input_string_raw && input_string_raw[strlen(input_string_raw)-1] == '\n') {
@@ -527,17 +723,21 @@ void start_llm_request() {
     }
     if (input_string_raw && strlen(input_string_raw) == 0) {
         XtFree(input_string_raw); input_string_raw = NULL;
-        if (!attached_image_base64_data) return;
+        if (attachments.count == 0) return;
+    }
+    if (attach_batch_pending(&attachments) > 0) {
+        append_to_conversation("[Images still loading; send again once they are ready]\n");
+        if (input_string_raw) XtFree(input_string_raw);
+        return;
     }
 
-    pthread_mutex_lock(&dp_mutex);
-    if (!dp_ctx) {
+    llm_context_t *llm = llm_context_acquire();
+    if (!llm) {
         show_error_dialog("LLM context not initialized. Please check API Key and Model ID in Settings.");
         if(input_string_raw) XtFree(input_string_raw);
-        pthread_mutex_unlock(&dp_mutex);
         return;
     }
-    pthread_mutex_unlock(&dp_mutex);
+    llm_context_release(llm);
 
     char display_msg_text_part[1024] = "";
     if (input_string_raw) {
@@ -546,22 +746,22 @@ void start_llm_request() {
          snprintf(display_msg_text_part, sizeof(display_msg_text_part), "%s: ", USER_NICKNAME);
     }
     char full_display_msg[DISPLAY_MSG_BUF_SIZE]; strcpy(full_display_msg, display_msg_text_part);
-    if (attached_image_base64_data) {
-        char path_copy[PATH_MAX]; strncpy(path_copy, attached_image_path, PATH_MAX); path_copy[PATH_MAX-1] = '\0';
-        snprintf(full_display_msg, sizeof(full_display_msg), "%s [Image Attached: %s]\n", display_msg_text_part, basename(path_copy));
+    if (attachments.count > 0) {
+        char names[DISPLAY_MSG_BUF_SIZE] = "";
+        size_t used = 0;
+        for (int i = 0; i < attachments.count && used < sizeof(names); i++) {
+            char path_copy[PATH_MAX]; strncpy(path_copy, attachments.jobs[i]->path, PATH_MAX); path_copy[PATH_MAX-1] = '\0';
+            used += snprintf(names + used, sizeof(names) - used, "%s%s", i > 0 ? ", " : "", basename(path_copy));
+        }
+        snprintf(full_display_msg, sizeof(full_display_msg), "%s [%s Attached: %s]\n", display_msg_text_part,
+                 attachments.count > 1 ? "Images" : "Image", names);
     } else {
         snprintf(full_display_msg, sizeof(full_display_msg), "%s\n", display_msg_text_part);
     }
     append_to_conversation(full_display_msg);
-    add_message_to_history(DP_ROLE_USER, input_string_raw ? input_string_raw : "",
-                           attached_image_base64_data ? attached_image_mime_type : NULL,
-                           attached_image_base64_data);
+    add_user_message_with_attachments(input_string_raw ? input_string_raw : "");
     XmTextSetString(input_text, "");
     if (input_string_raw) XtFree(input_string_raw);
-    if (attached_image_base64_data) {
-        free(attached_image_base64_data); attached_image_base64_data = NULL;
-        attached_image_path[0] = '\0'; attached_image_mime_type[0] = '\0';
-    }
 
     start_llm_request_internal(false);
 }
@@ -570,13 +770,11 @@ void start_llm_request_internal(bool from_tool_call) {
     llm_thread_data_t *thread_data = malloc(sizeof(llm_thread_data_t));
     if (!thread_data) { perror("malloc llm_thread_data"); return; }
     thread_data->system_prompt_buffer[0] = '\0';
-
-    if (current_api_provider == DP_PROVIDER_GOOGLE_GEMINI) {
-        thread_data->config.model = current_gemini_model;
-    } else if (current_api_provider == DP_PROVIDER_OPENAI_COMPATIBLE) {
-        thread_data->config.model = current_openai_model;
-    } else if (current_api_provider == DP_PROVIDER_ANTHROPIC) {
-        thread_data->config.model = current_anthropic_model;
+    thread_data->llm = llm_context_acquire();
+    if (!thread_data->llm) {
+        free(thread_data);
+        show_error_dialog("LLM context not initialized. Please check API Key and Model ID in Settings.");
+        return;
     }
 
     generate_system_prompt(thread_data->system_prompt_buffer, sizeof(thread_data->system_prompt_buffer), current_system_prompt, append_default_system_prompt);
@@ -585,55 +783,54 @@ void start_llm_request_internal(bool from_tool_call) {
     thread_data->config.temperature = 0.7; thread_data->config.max_tokens = DEFAULT_MAX_TOKENS;
     thread_data->config.stream = true;
 
-    char temp_filename[PATH_MAX];
-    strcpy(temp_filename, "/tmp/motifgpt_hist_XXXXXX");
-    int fd = mkstemp(temp_filename);
-    if (fd != -1) {
-        close(fd);
-        if (dp_serialize_messages_to_file(chat_history, chat_history_count, temp_filename) == 0) {
-             strncpy(thread_data->temp_history_filename, temp_filename, PATH_MAX - 1);
-             thread_data->temp_history_filename[PATH_MAX - 1] = '\0';
-             thread_data->config.messages = NULL; 
-             thread_data->config.num_messages = 0;
-        } else {
-             perror("dp_serialize_messages_to_file");
-             unlink(temp_filename);
-             free(thread_data);
-             show_error_dialog("Failed to serialize chat history for thread.");
-             return;
-        }
-    } else {
-        perror("mkstemp");
+    thread_data->history = history_snapshot_acquire();
+    if (!thread_data->history) {
+        llm_context_release(thread_data->llm);
         free(thread_data);
-        show_error_dialog("Failed to create temp file for history.");
+        show_error_dialog("Failed to snapshot chat history for thread.");
         return;
     }
 
+    char prefix[STREAM_PREFIX_BUF_SIZE];
     if (!from_tool_call) {
-        snprintf(current_assistant_prefix, sizeof(current_assistant_prefix), "%s: ", ASSISTANT_NICKNAME);
+        snprintf(prefix, sizeof(prefix), "%s: ", ASSISTANT_NICKNAME);
     } else {
-        snprintf(current_assistant_prefix, sizeof(current_assistant_prefix), "%s (tool result): ", USER_NICKNAME);
+        snprintf(prefix, sizeof(prefix), "%s (tool result): ", USER_NICKNAME);
     }
-    
-    pthread_t tid;
-    if (pthread_create(&tid, NULL, perform_llm_request_thread, thread_data) != 0) {
-        perror("pthread_create llm_request");
-        if (strlen(thread_data->temp_history_filename) > 0) unlink(thread_data->temp_history_filename);
+    thread_data->stream = stream_open(prefix);
+    if (!thread_data->stream) {
+        history_snapshot_release(thread_data->history);
+        llm_context_release(thread_data->llm);
         free(thread_data);
-        show_error_dialog("Failed to start LLM request thread.");
+        show_error_dialog("Failed to allocate a reply stream.");
+        return;
+    }
+
+    if (worker_pool_submit(perform_llm_request_job, thread_data, discard_llm_request_job) != 0) {
+        discard_llm_request_job(thread_data);
+        show_error_dialog("Failed to queue LLM request: too many requests in flight.");
+        return;
     }
+    reply_streaming = true;
+    update_send_button();
 }
 
 void send_message_callback(Widget w, XtPointer client_data, XtPointer call_data) {
     start_llm_request();
 }
 
+void print_worker_pool_stats() {
+    worker_pool_stats_t stats;
+    worker_pool_get_stats(&stats);
+    printf("Worker pool: %lu jobs submitted, %lu completed, %lu rejected; queue depth %zu (peak %zu); wait avg %.1f ms, max %.1f ms.\n",
+           stats.jobs_submitted, stats.jobs_completed, stats.jobs_rejected, stats.queue_depth, stats.max_queue_depth,
+           stats.jobs_completed ? stats.total_wait_ms / stats.jobs_completed : 0.0, stats.max_wait_ms);
+}
+
 void quit_callback(Widget w, XtPointer client_data, XtPointer call_data) {
-    printf("Exiting MotifGPT...\n"); save_settings(); free_chat_history();
-    if (current_assistant_response_buffer) free(current_assistant_response_buffer);
-    pthread_mutex_lock(&dp_mutex);
-    if (dp_ctx) dp_destroy_context(dp_ctx);
-    pthread_mutex_unlock(&dp_mutex);
+    printf("Exiting MotifGPT...\n"); clear_attachments(); cancel_conversation_load(); cancel_tool_call(); tool_executor_stop(); convfile_job_release(save_job); print_worker_pool_stats(); worker_pool_shutdown(); stream_coalescer_stop();
+    save_settings(); journal_close(true); free_chat_history(); transcript_free(&transcript); render_cache_free(&render_cache);
+    llm_context_publish(NULL);
     curl_global_cleanup();
     if (pipe_fds[0] != -1) close(pipe_fds[0]); if (pipe_fds[1] != -1) close(pipe_fds[1]);
     if (settings_shell) XtDestroyWidget(settings_shell);
@@ -641,11 +838,9 @@ void quit_callback(Widget w, XtPointer client_data, XtPointer call_data) {
 }
 
 void clear_chat_callback(Widget w, XtPointer client_data, XtPointer call_data) {
-    XmTextSetString(conversation_text, ""); free_chat_history();
+    cancel_conversation_load(); cancel_tool_call();
+    transcript_clear(&transcript); show_transcript_tail(); free_chat_history(); journal_reset();
     append_to_conversation("Chat cleared. Welcome to MotifGPT!\n");
-    assistant_is_replying = false; prefix_already_added_for_current_reply = false;
-    if (current_assistant_response_buffer) current_assistant_response_buffer[0] = '\0';
-    current_assistant_response_len = 0;
 }
 
 void show_error_dialog(const char* message) {
@@ -895,8 +1090,18 @@ void load_settings() {
             else if (strcmp(key, KEY_HISTORY_LIMITS_DISABLED) == 0) history_limits_disabled = (strcmp(value, VAL_TRUE) == 0);
             else if (strcmp(key, KEY_ENTER_SENDS_MESSAGE) == 0) enter_key_sends_message = (strcmp(value, VAL_TRUE) == 0);
             else if (strcmp(key, KEY_APPEND_DEFAULT_SYSTEM_PROMPT) == 0) append_default_system_prompt = (strcmp(value, VAL_TRUE) == 0);
+            else if (strcmp(key, KEY_STREAM_FLUSH_MS) == 0) stream_flush_ms = atoi(value);
+            else if (strcmp(key, KEY_STREAM_FLUSH_BYTES) == 0) stream_flush_bytes = atoi(value);
+            else if (strcmp(key, KEY_GEMINI_IMAGE_MAX_DIMENSION) == 0) gemini_image_max_dimension = atoi(value);
+            else if (strcmp(key, KEY_OPENAI_IMAGE_MAX_DIMENSION) == 0) openai_image_max_dimension = atoi(value);
+            else if (strcmp(key, KEY_ANTHROPIC_IMAGE_MAX_DIMENSION) == 0) anthropic_image_max_dimension = atoi(value);
+            else if (strcmp(key, KEY_IMAGE_JPEG_QUALITY) == 0) image_jpeg_quality = atoi(value);
         }
     }
+    if (stream_flush_ms < 0) stream_flush_ms = 0;
+    if (stream_flush_bytes < 1) stream_flush_bytes = STREAM_FLUSH_DEFAULT_BYTES;
+    if (image_jpeg_quality < 1 || image_jpeg_quality > 100) image_jpeg_quality = IMAGE_SCALE_DEFAULT_QUALITY;
+    stream_set_flush_budget(stream_flush_ms, (size_t)stream_flush_bytes);
     fclose(fp); printf("Settings loaded from %s\n", settings_file);
 }
 
@@ -934,6 +1139,12 @@ void save_settings() {
     fprintf(fp, "%s=%s\n", KEY_APPEND_DEFAULT_SYSTEM_PROMPT, append_default_system_prompt ? VAL_TRUE : VAL_FALSE);
     fprintf(fp, "%s=%s\n", KEY_HISTORY_LIMITS_DISABLED, history_limits_disabled ? VAL_TRUE : VAL_FALSE);
     fprintf(fp, "%s=%s\n", KEY_ENTER_SENDS_MESSAGE, enter_key_sends_message ? VAL_TRUE : VAL_FALSE);
+    fprintf(fp, "%s=%d\n", KEY_STREAM_FLUSH_MS, stream_flush_ms);
+    fprintf(fp, "%s=%d\n", KEY_STREAM_FLUSH_BYTES, stream_flush_bytes);
+    fprintf(fp, "%s=%d\n", KEY_GEMINI_IMAGE_MAX_DIMENSION, gemini_image_max_dimension);
+    fprintf(fp, "%s=%d\n", KEY_OPENAI_IMAGE_MAX_DIMENSION, openai_image_max_dimension);
+    fprintf(fp, "%s=%d\n", KEY_ANTHROPIC_IMAGE_MAX_DIMENSION, anthropic_image_max_dimension);
+    fprintf(fp, "%s=%d\n", KEY_IMAGE_JPEG_QUALITY, image_jpeg_quality);
     fclose(fp); printf("Settings saved to %s\n", settings_file);
 }
 
@@ -956,51 +1167,116 @@ static int ends_with_ignore_case(const char *str, const char *suffix) {
     return 1;
 }
 
-void file_selection_ok_callback(Widget w, XtPointer client_data, XtPointer call_data) {
-    XmFileSelectionBoxCallbackStruct *cbs = (XmFileSelectionBoxCallbackStruct *)call_data;
-    char *filename = NULL; XmStringGetLtoR(cbs->value, XmFONTLIST_DEFAULT_TAG, &filename);
-    if (!filename || strlen(filename) == 0) { XtFree(filename); return; }
-
-    size_t file_size;
-    unsigned char *file_buffer = read_file_to_buffer(filename, &file_size);
-
-    if (!file_buffer) {
-        show_error_dialog("Could not read image file.");
-        XtFree(filename);
-        attached_image_path[0] = '\0';
-        return;
-    }
+void set_attach_button_label(const char *text) {
+    XmString label = XmStringCreateLocalized((char *)text);
+    XtVaSetValues(attach_image_button, XmNlabelString, label, NULL);
+    XmStringFree(label);
+}
 
-    const char* mime_type = get_image_mime_type(file_buffer, file_size);
-    if (!mime_type) {
-        show_error_dialog("Unsupported image type or invalid file content (PNG, JPG, GIF required).");
-        free(file_buffer);
-        XtFree(filename);
-        attached_image_path[0] = '\0';
-        return;
+// Shows batch progress on the attach button, or how many images are ready.
+static void update_attach_button_label() {
+    char label[64];
+    int pending = attach_batch_pending(&attachments);
+    if (pending > 0) {
+        snprintf(label, sizeof(label), "Loading %d/%d (%u%%)", attachments.count - pending, attachments.count,
+                 attach_batch_progress(&attachments));
+    } else if (attachments.count > 1) {
+        snprintf(label, sizeof(label), "Attach Image... (%d)", attachments.count);
+    } else {
+        snprintf(label, sizeof(label), "Attach Image...");
     }
+    set_attach_button_label(label);
+}
 
-    strncpy(attached_image_path, filename, PATH_MAX -1);
-    attached_image_path[PATH_MAX-1] = '\0';
-    strncpy(attached_image_mime_type, mime_type, sizeof(attached_image_mime_type) - 1);
-    attached_image_mime_type[sizeof(attached_image_mime_type) - 1] = '\0';
-    XtFree(filename);
+void clear_attachments() {
+    attach_batch_clear(&attachments);
+    update_attach_button_label();
+}
 
-    if (attached_image_base64_data) free(attached_image_base64_data);
-    attached_image_base64_data = base64_encode(file_buffer, file_size);
-    free(file_buffer);
+void show_attach_progress(unsigned long id, unsigned int percent) {
+    int index = attach_batch_find(&attachments, id);
+    if (index < 0) return;
+    attachments.percent[index] = percent;
+    update_attach_button_label();
+}
 
-    if (!attached_image_base64_data) {
-        show_error_dialog("Could not Base64 encode image.");
-        attached_image_path[0] = '\0';
+void finish_attach(unsigned long id) {
+    int index = attach_batch_find(&attachments, id);
+    if (index < 0) return; // Superseded or cancelled
+    attach_job_t *job = attachments.jobs[index];
+    attachments.ready[index] = true;
+    char path_copy[PATH_MAX]; strncpy(path_copy, job->path, PATH_MAX); path_copy[PATH_MAX-1] = '\0';
+    if (job->error[0] || (!job->base64 && !job->image_key[0])) {
+        char err_msg[ATTACH_ERROR_BUF_SIZE + PATH_MAX];
+        snprintf(err_msg, sizeof(err_msg), "%s: %s", basename(path_copy), job->error[0] ? job->error : "Could not Base64 encode image.");
+        attach_batch_remove(&attachments, index);
+        update_attach_button_label();
+        show_error_dialog(err_msg);
         return;
     }
+    update_attach_button_label();
 
     char status_msg[PATH_MAX + 50];
-    char path_copy[PATH_MAX]; strncpy(path_copy, attached_image_path, PATH_MAX); path_copy[PATH_MAX-1] = '\0';
     snprintf(status_msg, sizeof(status_msg), "[Image ready: %s]", basename(path_copy));
     append_to_conversation(status_msg); append_to_conversation("\n");
-    XtUnmanageChild(w);
+}
+
+static void discard_attach_job(void *arg) { attach_job_release((attach_job_t *)arg); }
+
+// Starts loading one image of a selection. Returns false if it could not be queued.
+static bool queue_attachment(const char *filename, const image_scale_options_t *scale) {
+    if (attachments.count >= ATTACH_MAX_IMAGES) {
+        char err_msg[128];
+        snprintf(err_msg, sizeof(err_msg), "At most %d images can be attached to one message.", ATTACH_MAX_IMAGES);
+        show_error_dialog(err_msg);
+        return false;
+    }
+    attach_job_t *job = attach_job_create(filename, scale);
+    if (!job) { show_error_dialog("Could not read image file."); return false; }
+    if (worker_pool_submit(attach_job_run, job, discard_attach_job) != 0) {
+        attach_job_release(job); attach_job_release(job);
+        show_error_dialog("Failed to queue image load: too many requests in flight.");
+        return false;
+    }
+    attach_batch_add(&attachments, job);
+    return true;
+}
+
+void file_selection_ok_callback(Widget w, XtPointer client_data, XtPointer call_data) {
+    XmFileSelectionBoxCallbackStruct *cbs = (XmFileSelectionBoxCallbackStruct *)call_data;
+    XmStringTable selected = NULL; int num_selected = 0;
+    XtVaGetValues(XmFileSelectionBoxGetChild(w, XmDIALOG_LIST), XmNselectedItems, &selected, XmNselectedItemCount, &num_selected, NULL);
+
+    // A new selection replaces both finished attachments and ones still loading
+    clear_attachments();
+
+    // Prepared for the provider selected now; switching later resends them as they were prepared
+    image_scale_options_t scale = { 0, image_jpeg_quality, 0 };
+    if (current_api_provider == DP_PROVIDER_GOOGLE_GEMINI) {
+        scale.max_dimension = gemini_image_max_dimension; scale.accepted_formats = GEMINI_IMAGE_FORMATS;
+    } else if (current_api_provider == DP_PROVIDER_OPENAI_COMPATIBLE) {
+        scale.max_dimension = openai_image_max_dimension; scale.accepted_formats = OPENAI_IMAGE_FORMATS;
+    } else if (current_api_provider == DP_PROVIDER_ANTHROPIC) {
+        scale.max_dimension = anthropic_image_max_dimension; scale.accepted_formats = ANTHROPIC_IMAGE_FORMATS;
+    }
+
+    // Files picked together in the list each get a job, so they load in parallel.
+    // Otherwise use the selection field, which may also hold a typed path.
+    if (num_selected > 1) {
+        for (int i = 0; i < num_selected; i++) {
+            char *filename = NULL; XmStringGetLtoR(selected[i], XmFONTLIST_DEFAULT_TAG, &filename);
+            bool queued = !filename || !filename[0] || queue_attachment(filename, &scale);
+            XtFree(filename);
+            if (!queued) break;
+        }
+    } else {
+        char *filename = NULL; XmStringGetLtoR(cbs->value, XmFONTLIST_DEFAULT_TAG, &filename);
+        if (!filename || strlen(filename) == 0) { XtFree(filename); return; }
+        queue_attachment(filename, &scale);
+        XtFree(filename);
+    }
+    update_attach_button_label();
+    if (attachments.count > 0) XtUnmanageChild(w);
 }
 
 void attach_image_callback(Widget w, XtPointer client_data, XtPointer call_data) {
@@ -1010,27 +1286,97 @@ void attach_image_callback(Widget w, XtPointer client_data, XtPointer call_data)
         XtAddCallback(file_selector, XmNokCallback, file_selection_ok_callback, NULL);
         XtAddCallback(file_selector, XmNcancelCallback, (XtCallbackProc)XtUnmanageChild, NULL);
         XtUnmanageChild(XmFileSelectionBoxGetChild(file_selector, XmDIALOG_HELP_BUTTON));
+        // Shift/Ctrl-click picks several images for one message
+        XtVaSetValues(XmFileSelectionBoxGetChild(file_selector, XmDIALOG_LIST), XmNselectionPolicy, XmEXTENDED_SELECT, NULL);
     }
     XtManageChild(file_selector);
 }
 
+void cancel_conversation_load() {
+    convfile_job_cancel(open_job);
+    open_job = NULL;
+}
+
+// The old conversation stays until the new one has something to show.
+static void show_loaded_conversation() {
+    if (open_job_shown) return;
+    transcript_clear(&transcript); free_chat_history(); journal_reset();
+    open_job_shown = true;
+}
+
+void take_conversation_batches(unsigned long id) {
+    if (!open_job || open_job->id != id) return; // Superseded or cancelled
+    convfile_batch_t *batches = convfile_job_take_batches(open_job);
+    if (!batches) return;
+    show_loaded_conversation();
+    for (convfile_batch_t *batch = batches; batch; batch = batch->next) {
+        for (size_t i = 0; i < batch->count; i++) {
+            convfile_message_t *m = &batch->messages[i];
+            // History takes over the image data, so the batch must not free it
+            add_image_message_to_history(m->role, m->text, m->images, m->num_images);
+            m->num_images = 0;
+        }
+    }
+    convfile_batch_free(batches);
+    render_all_history();
+}
+
+void finish_conversation_job(unsigned long id) {
+    if (open_job && open_job->id == id) {
+        take_conversation_batches(id);
+        convfile_job_t *job = open_job;
+        open_job = NULL;
+        if (!job->error[0]) {
+            show_loaded_conversation();
+            render_all_history();
+        }
+        if (open_job_shown && job->num_skipped > 0) {
+            char loaded_msg[128];
+            snprintf(loaded_msg, sizeof(loaded_msg), "\n--- Conversation Loaded (last %zu of %zu messages) ---\n",
+                     job->num_messages, job->num_messages + job->num_skipped);
+            append_to_conversation(loaded_msg);
+        } else if (open_job_shown) {
+            append_to_conversation("\n--- Conversation Loaded ---\n");
+        }
+        if (job->error[0]) show_error_dialog(job->error);
+        convfile_job_release(job);
+    } else if (save_job && save_job->id == id) {
+        convfile_job_t *job = save_job;
+        save_job = NULL;
+        if (!job->error[0]) {
+            char path_copy[PATH_MAX]; snprintf(path_copy, sizeof(path_copy), "%s", job->path);
+            char success_msg[PATH_MAX + 50];
+            snprintf(success_msg, sizeof(success_msg), "\n--- Conversation Saved to: %s ---\n", basename(path_copy));
+            append_to_conversation(success_msg);
+        } else {
+            show_error_dialog(job->error);
+        }
+        convfile_job_release(job);
+    }
+}
+
+static void discard_convfile_job(void *arg) { convfile_job_release((convfile_job_t *)arg); }
+
 void file_selection_open_ok_callback(Widget w, XtPointer client_data, XtPointer call_data) {
     XmFileSelectionBoxCallbackStruct *cbs = (XmFileSelectionBoxCallbackStruct *)call_data;
     char *filename = NULL;
     XmStringGetLtoR(cbs->value, XmFONTLIST_DEFAULT_TAG, &filename);
     if (!filename || strlen(filename) == 0) { if(filename) XtFree(filename); return; }
 
-    dp_message_t* loaded_messages = NULL;
-    size_t num_loaded = 0;
-    if (dp_deserialize_messages_from_file(filename, &loaded_messages, &num_loaded) == 0) {
-        free_chat_history(); // Clear existing history
-        chat_history = loaded_messages;
-        chat_history_count = num_loaded;
-        chat_history_capacity = num_loaded; // Set capacity to what was loaded
-        render_all_history();
-        append_to_conversation("\n--- Conversation Loaded ---\n");
-    } else {
+    // Read on a worker; messages appear in batches as they are parsed. A newer open replaces one still reading.
+    // A binary file is read from the end, so messages the history would evict are never decoded.
+    cancel_conversation_load(); cancel_tool_call();
+    convfile_job_t *job = convfile_job_create(filename, NULL);
+    int history_limit = history_limits_disabled ? INTERNAL_MAX_HISTORY_CAPACITY : current_max_history_messages;
+    if (job && history_limit > 0) job->max_messages = (size_t)history_limit;
+    if (!job) {
         show_error_dialog("Failed to load or parse conversation file.");
+    } else if (worker_pool_submit(convfile_open_run, job, discard_convfile_job) != 0) {
+        convfile_job_release(job); convfile_job_release(job);
+        show_error_dialog("Failed to queue conversation load: too many requests in flight.");
+    } else {
+        open_job = job;
+        open_job_shown = false;
     }
 
     if(filename) XtFree(filename);
@@ -1042,13 +1388,19 @@ void file_selection_save_as_ok_callback(Widget w, XtPointer client_data, XtPoint
     char *filename = NULL;
     XmStringGetLtoR(cbs->value, XmFONTLIST_DEFAULT_TAG, &filename);
     if (!filename || strlen(filename) == 0) { if(filename) XtFree(filename); return; }
+    if (save_job) { XtFree(filename); show_error_dialog("The conversation is still being saved."); return; }
 
-    if (dp_serialize_messages_to_file(chat_history, chat_history_count, filename) == 0) {
-        char success_msg[PATH_MAX + 50];
-        snprintf(success_msg, sizeof(success_msg), "\n--- Conversation Saved to: %s ---\n", basename(filename));
-        append_to_conversation(success_msg);
-    } else {
+    // The snapshot pins the history as it is now; the worker expands and writes it
+    history_snapshot_t *snap = history_snapshot_acquire();
+    convfile_job_t *job = snap ? convfile_job_create(filename, snap) : NULL;
+    if (!job) {
+        history_snapshot_release(snap);
         show_error_dialog("Failed to save conversation to file.");
+    } else if (worker_pool_submit(convfile_save_run, job, discard_convfile_job) != 0) {
+        convfile_job_release(job); convfile_job_release(job);
+        show_error_dialog("Failed to queue conversation save: too many requests in flight.");
+    } else {
+        save_job = job;
     }
 
     if(filename) XtFree(filename);
@@ -1086,8 +1438,8 @@ void save_chat_as_callback(Widget w, XtPointer client_data, XtPointer call_data)
 }
 
 
-void initialize_dp_context_unsafe() {
-    if (dp_ctx) { dp_destroy_context(dp_ctx); dp_ctx = NULL; }
+void initialize_dp_context() {
+    llm_context_publish(NULL);
     const char* key_to_use = NULL;
     const char* model_to_use = NULL;
 
@@ -1174,21 +1526,16 @@ void initialize_dp_context_unsafe() {
          fprintf(stderr, "Model ID not set or is placeholder. LLM disabled until configured in Settings.\n"); return;
     }
 
-    dp_ctx = dp_init_context(current_api_provider, key_to_use, base_url_to_use);
-    if (!dp_ctx) { fprintf(stderr, "Failed to init LLM context with current settings.\n"); }
-    else {
-        printf("LLM context (re)initialized. Provider: %s, Model: %s, Base URL: %s\n",
-               (current_api_provider == DP_PROVIDER_GOOGLE_GEMINI ? "Gemini" : "OpenAI"),
-               model_to_use,
-               base_url_to_use ? base_url_to_use : "(default by disasterparty)");
-               }
-               }
-
-               void initialize_dp_context() {
-               pthread_mutex_lock(&dp_mutex);
-               initialize_dp_context_unsafe();
-               pthread_mutex_unlock(&dp_mutex);
-               }
+    llm_context_t *new_ctx = llm_context_create(current_api_provider, key_to_use, model_to_use, base_url_to_use);
+    if (!new_ctx) { fprintf(stderr, "Failed to init LLM context with current settings.\n"); return; }
+    unsigned long version = llm_context_publish(new_ctx);
+    printf("LLM context (re)initialized (v%lu). Provider: %s, Model: %s, Base URL: %s\n",
+           version,
+           (current_api_provider == DP_PROVIDER_GOOGLE_GEMINI ? "Gemini" : current_api_provider == DP_PROVIDER_ANTHROPIC ? "Anthropic" : "OpenAI"),
+           model_to_use,
+           base_url_to_use ? base_url_to_use : "(default by disasterparty)");
+}
+
 void settings_disable_history_limit_toggle_cb(Widget w, XtPointer client_data, XtPointer call_data) {
     Boolean set = XmToggleButtonGetState(w);
     XtSetSensitive(history_length_text, !set);
@@ -1294,14 +1641,10 @@ void retrieve_settings_from_dialog() {
 }
 
 Boolean apply_settings_safe() {
-    if (pthread_mutex_trylock(&dp_mutex) != 0) {
-        show_error_dialog("Cannot apply settings while an LLM request is in progress.");
-        return False;
-    }
+    // Requests already queued or streaming keep the context version they pinned.
     retrieve_settings_from_dialog();
-    initialize_dp_context_unsafe();
+    initialize_dp_context();
     save_settings();
-    pthread_mutex_unlock(&dp_mutex);
     return True;
 }
 
@@ -1319,14 +1662,14 @@ void settings_cancel_callback(Widget w, XtPointer client_data, XtPointer call_da
     XtUnmanageChild(settings_shell);
 }
 
-void *perform_get_models_thread(void *arg) {
+void perform_get_models_job(worker_t *self, void *arg) {
     get_models_thread_data_t *data = (get_models_thread_data_t *)arg;
-    dp_context_t *temp_ctx = dp_init_context(data->provider, data->api_key_for_list, (strlen(data->base_url_for_list) > 0 ? data->base_url_for_list : NULL) );
-    if (!temp_ctx) {
-        write_pipe_message(PIPE_MSG_MODEL_LIST_ERROR, "GetModels: Failed temp context.");
-        free(data); pthread_detach(pthread_self()); return NULL;
+    dp_context_t *list_ctx = worker_get_context(self, data->provider, data->api_key_for_list, data->base_url_for_list);
+    if (!list_ctx) {
+        write_pipe_message(PIPE_MSG_MODEL_LIST_ERROR, "GetModels: Failed to create context.");
+        free(data); return;
     }
-    dp_model_list_t *model_list_struct = NULL; int result = dp_list_models(temp_ctx, &model_list_struct);
+    dp_model_list_t *model_list_struct = NULL; int result = dp_list_models(list_ctx, &model_list_struct);
     if (result == 0 && model_list_struct) {
         if (model_list_struct->error_message) {
              char err_buf[512]; snprintf(err_buf, sizeof(err_buf), "API Error (Get Models): %s", model_list_struct->error_message);
@@ -1345,8 +1688,8 @@ void *perform_get_models_thread(void *arg) {
         write_pipe_message(PIPE_MSG_MODEL_LIST_ERROR, err_buf);
     }
     write_pipe_message(PIPE_MSG_MODEL_LIST_END, NULL);
-    dp_free_model_list(model_list_struct); dp_destroy_context(temp_ctx);
-    free(data); pthread_detach(pthread_self()); return NULL;
+    dp_free_model_list(model_list_struct);
+    free(data);
 }
 
 void settings_get_models_callback(Widget w, XtPointer client_data, XtPointer call_data) {
@@ -1392,10 +1735,9 @@ void settings_get_models_callback(Widget w, XtPointer client_data, XtPointer cal
         thread_data->base_url_for_list[0] = '\0';
     }
     XtFree(api_key_str); if(base_url_str) XtFree(base_url_str);
-    pthread_t tid;
-    if (pthread_create(&tid, NULL, perform_get_models_thread, thread_data) != 0) {
-        perror("pthread_create get_models"); free(thread_data);
-        show_error_dialog("Failed to start Get Models thread.");
+    if (worker_pool_submit(perform_get_models_job, thread_data, free) != 0) {
+        free(thread_data);
+        show_error_dialog("Failed to queue Get Models request: too many requests in flight.");
     }
 }
 
@@ -1435,96 +1777,14 @@ static void numeric_verify_cb(Widget w, XtPointer client_data, XtPointer call_da
 
 void render_all_history() {
     if (!conversation_text) return;
-
-    static const size_t user_nick_len = sizeof(USER_NICKNAME) - 1;
-    static const size_t assistant_nick_len = sizeof(ASSISTANT_NICKNAME) - 1;
-    static const char img_msg[] = " [Image Attached]";
-    static const size_t img_msg_len = sizeof(img_msg) - 1;
-
-    // 1. Calculate required buffer size and store part lengths
-    size_t total_len = 0;
-    size_t total_parts = 0;
-    for (int i = 0; i < chat_history_count; i++) {
-        total_parts += chat_history[i].num_parts;
-    }
-
-    size_t *part_lengths = NULL;
-    if (total_parts > 0) {
-        part_lengths = malloc(total_parts * sizeof(size_t));
-        if (!part_lengths) {
-            perror("malloc part_lengths");
-            return;
-        }
-    }
-
-    size_t part_idx = 0;
-    for (int i = 0; i < chat_history_count; i++) {
-        size_t nick_len = (chat_history[i].role == DP_ROLE_USER) ? user_nick_len : assistant_nick_len;
-        total_len += nick_len + 2; // "Nick: "
-
-        for (size_t j = 0; j < chat_history[i].num_parts; j++) {
-            dp_content_part_t* part = &chat_history[i].parts[j];
-            if (part->type == DP_CONTENT_PART_TEXT) {
-                if (part->text) {
-                    size_t len = strlen(part->text);
-                    part_lengths[part_idx] = len;
-                    total_len += len;
-                } else {
-                    part_lengths[part_idx] = 0;
-                }
-            } else if (part->type == DP_CONTENT_PART_IMAGE_BASE64) {
-                part_lengths[part_idx] = img_msg_len;
-                total_len += img_msg_len;
-            }
-            part_idx++;
-        }
-        total_len += 1; // "\n"
-    }
-
-    // 2. Allocate buffer
-    char* full_history = malloc(total_len + 1);
-    if (!full_history) {
-        perror("malloc render_all_history");
-        free(part_lengths);
-        return;
-    }
-
-    // 3. Construct string
-    char* current_pos = full_history;
-    part_idx = 0;
-    for (int i = 0; i < chat_history_count; i++) {
-        const char* nick = (chat_history[i].role == DP_ROLE_USER) ? USER_NICKNAME : ASSISTANT_NICKNAME;
-        size_t nick_len = (chat_history[i].role == DP_ROLE_USER) ? user_nick_len : assistant_nick_len;
-
-        memcpy(current_pos, nick, nick_len);
-        current_pos += nick_len;
-        memcpy(current_pos, ": ", 2);
-        current_pos += 2;
-
-        for (size_t j = 0; j < chat_history[i].num_parts; j++) {
-            dp_content_part_t* part = &chat_history[i].parts[j];
-            size_t len = (part_lengths != NULL) ? part_lengths[part_idx] : 0;
-            if (part->type == DP_CONTENT_PART_TEXT && part->text) {
-                memcpy(current_pos, part->text, len);
-                current_pos += len;
-            } else if (part->type == DP_CONTENT_PART_IMAGE_BASE64) {
-                 memcpy(current_pos, img_msg, len);
-                 current_pos += len;
-            }
-            part_idx++;
-        }
-        *current_pos = '\n';
-        current_pos++;
-    }
-    *current_pos = '\0';
-
-    // 4. Update UI once
-    XmTextSetString(conversation_text, full_history);
-    XmTextShowPosition(conversation_text, XmTextGetLastPosition(conversation_text));
-
-    // 5. Cleanup
-    free(full_history);
-    free(part_lengths);
+    // Messages that were already rendered keep their text; only the changed ends are redone.
+    render_stats_t stats;
+    history_snapshot_t *snap = history_snapshot_acquire();
+    if (snap && render_history(&transcript, &render_cache, snap->messages, snap->count, &stats) == 0) {
+        printf("Rendered history: %zu messages reused, %zu rendered, %zu dropped.\n", stats.reused, stats.rendered, stats.dropped);
+    }
+    history_snapshot_release(snap);
+    show_transcript_tail();
 }
 
 
@@ -1744,11 +2004,15 @@ void setup_ui(void) {
 
     main_form = XtVaCreateWidget("mainForm", xmFormWidgetClass, main_window, XmNwidth, 600, XmNheight, 450, NULL); XtManageChild(main_form);
     chat_area_paned = XtVaCreateManagedWidget("chatAreaPaned", xmPanedWindowWidgetClass, main_form, XmNtopAttachment, XmATTACH_FORM, XmNbottomAttachment, XmATTACH_FORM, XmNleftAttachment, XmATTACH_FORM, XmNrightAttachment, XmATTACH_FORM, XmNsashWidth, 1, XmNsashHeight, 1, NULL);
-    Widget scrolled_conv_win = XmCreateScrolledWindow(chat_area_paned, "scrolledConvWin", NULL, 0);
-    XtVaSetValues(scrolled_conv_win, XmNpaneMinimum, 100, XmNpaneMaximum, 1000, XmNscrollingPolicy, XmAUTOMATIC, NULL);
+    Widget conv_form = XtVaCreateWidget("convForm", xmFormWidgetClass, chat_area_paned, XmNpaneMinimum, 100, XmNpaneMaximum, 1000, NULL);
+    transcript_scrollbar = XtVaCreateManagedWidget("transcriptScrollBar", xmScrollBarWidgetClass, conv_form, XmNorientation, XmVERTICAL, XmNminimum, 0, XmNmaximum, 1, XmNsliderSize, 1, XmNtopAttachment, XmATTACH_FORM, XmNbottomAttachment, XmATTACH_FORM, XmNrightAttachment, XmATTACH_FORM, NULL);
+    XtAddCallback(transcript_scrollbar, XmNvalueChangedCallback, transcript_scroll_callback, NULL);
+    XtAddCallback(transcript_scrollbar, XmNdragCallback, transcript_scroll_callback, NULL);
+    Widget scrolled_conv_win = XmCreateScrolledWindow(conv_form, "scrolledConvWin", NULL, 0);
+    XtVaSetValues(scrolled_conv_win, XmNscrollingPolicy, XmAUTOMATIC, XmNtopAttachment, XmATTACH_FORM, XmNbottomAttachment, XmATTACH_FORM, XmNleftAttachment, XmATTACH_FORM, XmNrightAttachment, XmATTACH_WIDGET, XmNrightWidget, transcript_scrollbar, NULL);
     conversation_text = XmCreateText(scrolled_conv_win, "conversationText", NULL, 0);
     XtVaSetValues(conversation_text, XmNeditMode, XmMULTI_LINE_EDIT, XmNeditable, False, XmNcursorPositionVisible, False, XmNwordWrap, True, XmNscrollHorizontal, False, XmNrows, 15, XmNbackground, WhitePixelOfScreen(XtScreen(conversation_text)), XmNresizeWidth, False, NULL);
-    XtManageChild(conversation_text); XtManageChild(scrolled_conv_win);
+    XtManageChild(conversation_text); XtManageChild(scrolled_conv_win); XtManageChild(conv_form);
     XmScrolledWindowSetAreas(scrolled_conv_win, NULL, NULL, conversation_text);
     XtAddCallback(conversation_text, XmNfocusCallback, focus_callback, NULL);
     XtAddEventHandler(conversation_text, ButtonPressMask, False, popup_handler, NULL);
@@ -1785,20 +2049,42 @@ int main(int argc, char **argv) {
     if (ensure_config_dir_exists() != 0) {
         fprintf(stderr, "Warning: Could not create/access config directory. Settings may not persist.\n");
     }
+    char *image_dir = get_config_path(CACHE_DIR_NAME "/" IMAGE_STORE_SUBDIR);
+    if (!image_dir || image_store_init(image_dir) != 0) {
+        fprintf(stderr, "Warning: Image cache unavailable; attached images are kept in memory.\n");
+    }
     load_settings();
-
-    init_assistant_buffer();
+    transcript_init(&transcript);
+    // Whatever an unclean exit left in the journal comes back before anything new is added
+    char *journal_file = get_config_path(CACHE_DIR_NAME "/" JOURNAL_FILE_NAME);
+    int recovered = journal_file ? journal_open(journal_file) : -1;
+    if (recovered < 0) fprintf(stderr, "Warning: Session journal unavailable; the conversation is not autosaved.\n");
 
     if (curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK) { fprintf(stderr, "Fatal: curl_global_init failed.\n"); return 1; }
     initialize_dp_context();
 
+    // One worker per core, so a batch of attached images is encoded in parallel
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int pool_size = num_cpus > WORKER_POOL_SIZE ? (int)(num_cpus < WORKER_POOL_MAX_SIZE ? num_cpus : WORKER_POOL_MAX_SIZE) : WORKER_POOL_SIZE;
+    if (worker_pool_start(pool_size) != 0) {
+        fprintf(stderr, "Fatal: could not start worker threads.\n");
+        llm_context_publish(NULL); curl_global_cleanup(); return 1;
+    }
+
     if (pipe(pipe_fds) == -1) {
         perror("Fatal: pipe failed");
-        if(dp_ctx) dp_destroy_context(dp_ctx); curl_global_cleanup(); return 1;
+        llm_context_publish(NULL); curl_global_cleanup(); return 1;
     }
     if (fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK) == -1) {
         perror("Fatal: fcntl failed"); close(pipe_fds[0]); close(pipe_fds[1]);
-        if(dp_ctx) dp_destroy_context(dp_ctx); curl_global_cleanup(); return 1;
+        llm_context_publish(NULL); curl_global_cleanup(); return 1;
+    }
+    if (tool_executor_start() != 0) {
+        fprintf(stderr, "Warning: tool watchdog unavailable; tool calls run without a timeout.\n");
+    }
+    if (stream_coalescer_start() != 0) {
+        fprintf(stderr, "Warning: token flusher unavailable; tokens are sent as they arrive.\n");
+        stream_set_flush_budget(0, (size_t)stream_flush_bytes);
     }
 
     app_shell = XtAppInitialize(&app_context, "MotifGPT", NULL, 0, &argc, argv, NULL, NULL, 0);
@@ -1824,14 +2110,33 @@ int main(int argc, char **argv) {
     XtAppAddInput(app_context, pipe_fds[0], (XtPointer)XtInputReadMask, handle_pipe_input, NULL);
     XtRealizeWidget(app_shell);
     focused_text_widget = input_text;
-    append_to_conversation("Welcome to MotifGPT! Type message, Shift+Enter for newline, Enter to send.\n");
+    if (recovered > 0) {
+        render_all_history();
+        char recovered_msg[96];
+        snprintf(recovered_msg, sizeof(recovered_msg), "\n--- Recovered %d messages from the last session ---\n", recovered);
+        append_to_conversation(recovered_msg);
+    } else {
+        append_to_conversation("Welcome to MotifGPT! Type message, Shift+Enter for newline, Enter to send.\n");
+    }
     XtAppMainLoop(app_context);
 
-    free_assistant_buffer();
+    attach_batch_clear(&attachments);
+    cancel_conversation_load();
+    cancel_tool_call();
+    tool_executor_stop();
+    tool_registry_free(&tool_registry);
+    convfile_job_release(save_job);
+    worker_pool_shutdown();
+    tool_cache_clear();
+    stream_coalescer_stop();
+    journal_close(true);
     free_chat_history();
-    if (dp_ctx) dp_destroy_context(dp_ctx);
+    transcript_free(&transcript);
+    render_cache_free(&render_cache);
+    llm_context_publish(NULL);
     curl_global_cleanup();
     if (pipe_fds[0] != -1) close(pipe_fds[0]); if (pipe_fds[1] != -1) close(pipe_fds[1]);
+    pipe_reader_free(&ui_pipe_reader);
     if (settings_shell) XtDestroyWidget(settings_shell);
     return 0;
 }
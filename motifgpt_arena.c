@@ -0,0 +1,65 @@
+#include "motifgpt_arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+static size_t live_slabs = 0;
+static size_t reserved_bytes = 0;
+static size_t allocated_bytes = 0;
+
+static arena_slab_t *arena_slab_new(size_t size) {
+    arena_slab_t *slab = malloc(sizeof(arena_slab_t) + size);
+    if (!slab) { perror("malloc arena_slab"); return NULL; }
+    slab->refcount = 1; slab->size = size; slab->used = 0;
+    __atomic_add_fetch(&live_slabs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&reserved_bytes, size, __ATOMIC_RELAXED);
+    return slab;
+}
+
+void arena_init(arena_t *arena, size_t slab_size) {
+    arena->current = NULL;
+    arena->slab_size = slab_size ? slab_size : ARENA_SLAB_SIZE;
+}
+
+void *arena_alloc(arena_t *arena, size_t size, arena_slab_t **slab) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    arena_slab_t *target;
+    if (size > arena->slab_size / 4) {
+        // Would waste too much of a shared slab; the slab starts out held by this allocation.
+        if (!(target = arena_slab_new(size))) return NULL;
+    } else {
+        if (!arena->current || arena->current->size - arena->current->used < size) {
+            arena_slab_t *fresh = arena_slab_new(arena->slab_size);
+            if (!fresh) return NULL;
+            arena_release(arena->current, 1);
+            arena->current = fresh;
+        }
+        target = arena->current;
+        __atomic_add_fetch(&target->refcount, 1, __ATOMIC_RELAXED);
+    }
+    void *mem = target->data + target->used;
+    target->used += size;
+    __atomic_add_fetch(&allocated_bytes, size, __ATOMIC_RELAXED);
+    *slab = target;
+    return mem;
+}
+
+void arena_release(arena_slab_t *slab, int count) {
+    if (!slab || __atomic_sub_fetch(&slab->refcount, count, __ATOMIC_ACQ_REL) > 0) return;
+    __atomic_sub_fetch(&live_slabs, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&reserved_bytes, slab->size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&allocated_bytes, slab->used, __ATOMIC_RELAXED);
+    free(slab);
+}
+
+void arena_destroy(arena_t *arena) {
+    arena_release(arena->current, 1);
+    arena->current = NULL;
+}
+
+void arena_get_stats(arena_stats_t *stats) {
+    stats->live_slabs = __atomic_load_n(&live_slabs, __ATOMIC_RELAXED);
+    stats->reserved_bytes = __atomic_load_n(&reserved_bytes, __ATOMIC_RELAXED);
+    stats->allocated_bytes = __atomic_load_n(&allocated_bytes, __ATOMIC_RELAXED);
+}
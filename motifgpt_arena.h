@@ -0,0 +1,75 @@
+#ifndef MOTIFGPT_ARENA_H
+#define MOTIFGPT_ARENA_H
+
+#include <stddef.h>
+#include <stdalign.h>
+
+#define ARENA_SLAB_SIZE (64 * 1024)
+
+/**
+ * A slab of bump-allocated memory. Every allocation carved from it holds one
+ * reference, and the arena holds another while the slab is the one it carves
+ * from, so a slab is freed in one go once everything in it has been released.
+ */
+typedef struct arena_slab {
+    int refcount;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) char data[];
+} arena_slab_t;
+
+/**
+ * A bump allocator over reference-counted slabs. Allocation is single-threaded;
+ * releases may come from any thread.
+ */
+typedef struct {
+    arena_slab_t *current;
+    size_t slab_size;
+} arena_t;
+
+/**
+ * Occupancy across all arenas, for diagnostics.
+ */
+typedef struct {
+    size_t live_slabs;
+    size_t reserved_bytes; // Sum of the sizes of live slabs
+    size_t allocated_bytes; // Bytes handed out from live slabs
+} arena_stats_t;
+
+/**
+ * Initialises an empty arena. No memory is reserved until the first allocation.
+ * @param arena The arena.
+ * @param slab_size Size of a regular slab; 0 selects ARENA_SLAB_SIZE.
+ */
+void arena_init(arena_t *arena, size_t slab_size);
+
+/**
+ * Carves `size` bytes out of the current slab, starting a new slab when it is
+ * full. Requests larger than a quarter of a slab get a slab of their own.
+ * @param arena The arena.
+ * @param size The number of bytes; the result is aligned for any object.
+ * @param slab Receives the slab the memory belongs to; pass it to arena_release().
+ * @return The memory, or NULL on allocation failure.
+ */
+void *arena_alloc(arena_t *arena, size_t size, arena_slab_t **slab);
+
+/**
+ * Drops references to a slab, freeing it when none are left. May be called from any thread.
+ * @param slab The slab; NULL is ignored.
+ * @param count The number of allocations from it being released.
+ */
+void arena_release(arena_slab_t *slab, int count);
+
+/**
+ * Stops allocating from the arena. Slabs with outstanding allocations stay
+ * alive until those are released.
+ * @param arena The arena; it is left empty and may be reused.
+ */
+void arena_destroy(arena_t *arena);
+
+/**
+ * @param stats Receives the current totals.
+ */
+void arena_get_stats(arena_stats_t *stats);
+
+#endif /* MOTIFGPT_ARENA_H */
@@ -0,0 +1,183 @@
+#include "motifgpt_attach.h"
+#include "motifgpt_chat.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static unsigned long last_attach_id = 0;
+
+attach_job_t *attach_job_create(const char *path, const image_scale_options_t *scale) {
+    attach_job_t *job = calloc(1, sizeof(attach_job_t));
+    if (!job) { perror("calloc attach_job"); return NULL; }
+    job->refcount = 2;
+    job->id = __atomic_add_fetch(&last_attach_id, 1, __ATOMIC_RELAXED);
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    if (scale) job->scale = *scale;
+    return job;
+}
+
+static bool attach_is_cancelled(attach_job_t *job) {
+    return __atomic_load_n(&job->cancelled, __ATOMIC_ACQUIRE);
+}
+
+static void attach_post(attach_job_t *job, pipe_message_type_t type, unsigned int percent) {
+    attach_progress_t progress = { job->id, percent };
+    write_pipe_frame(type, &progress, sizeof(progress));
+}
+
+// The bytes being encoded are either the mapped file or a scaled copy.
+static void attach_drop_source(unsigned char *data, size_t size, bool owned) {
+    if (owned) free(data);
+    else munmap(data, size);
+}
+
+static void attach_encode(attach_job_t *job) {
+    int fd = open(job->path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        snprintf(job->error, sizeof(job->error), "Could not open image file: %s", strerror(errno));
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        snprintf(job->error, sizeof(job->error), "Could not read image file.");
+        close(fd); return;
+    }
+    if (st.st_size == 0 || st.st_size > MAX_FILE_SIZE_BYTES) {
+        snprintf(job->error, sizeof(job->error), "Image file is empty or too large (max %dMB).", (int)(MAX_FILE_SIZE_BYTES / (1024 * 1024)));
+        close(fd); return;
+    }
+    size_t size = (size_t)st.st_size;
+    unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        snprintf(job->error, sizeof(job->error), "Could not map image file: %s", strerror(errno));
+        return;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    // Only the first page is touched to reject files that are not images
+    image_format_t format = get_image_format(data, size < ATTACH_SNIFF_BYTES ? size : ATTACH_SNIFF_BYTES);
+    if (format == IMAGE_FORMAT_UNKNOWN) {
+        snprintf(job->error, sizeof(job->error), "Unsupported image type or invalid file content (PNG, JPEG, GIF, WebP, BMP, HEIC or AVIF required).");
+        munmap(data, size); return;
+    }
+    const char *mime_type = image_format_mime_type(format);
+    snprintf(job->mime_type, sizeof(job->mime_type), "%s", mime_type);
+
+    // Encode the downscaled or converted copy instead of the file when there is one
+    unsigned char *scaled = NULL;
+    size_t scaled_len = 0;
+    const char *scaled_mime = NULL;
+    if (image_scale(data, size, mime_type, &job->scale, &scaled, &scaled_len, &scaled_mime) == 1) {
+        munmap(data, size);
+        if (attach_is_cancelled(job)) { free(scaled); return; }
+        data = scaled;
+        size = scaled_len;
+        snprintf(job->mime_type, sizeof(job->mime_type), "%s", scaled_mime);
+    } else if (!image_scale_accepts(&job->scale, format)) {
+        snprintf(job->error, sizeof(job->error), "%s images are not accepted by this provider and could not be converted.", image_format_name(format));
+        munmap(data, size); return;
+    }
+
+    size_t out_len = base64_encoded_length(size);
+    char *out = malloc(out_len + 1);
+    if (!out) {
+        snprintf(job->error, sizeof(job->error), "Could not Base64 encode image.");
+        attach_drop_source(data, size, scaled != NULL); return;
+    }
+    unsigned int last_percent = 0;
+    for (size_t done = 0; done < size;) {
+        if (attach_is_cancelled(job)) { free(out); attach_drop_source(data, size, scaled != NULL); return; }
+        size_t n = size - done < ATTACH_CHUNK_SIZE ? size - done : ATTACH_CHUNK_SIZE;
+        base64_encode_to(out + done / 3 * 4, data + done, n);
+        // Chunks are page multiples, so the encoded part of the file can leave RSS right away
+        if (!scaled) madvise(data + done, n, MADV_DONTNEED);
+        done += n;
+        unsigned int percent = (unsigned int)(done * 100 / size);
+        if (done < size && percent != last_percent) {
+            attach_post(job, PIPE_MSG_ATTACH_PROGRESS, percent);
+            last_percent = percent;
+        }
+    }
+    out[out_len] = '\0';
+    attach_drop_source(data, size, scaled != NULL);
+    job->base64_len = out_len;
+    // Once the store has it, history only needs the key
+    if (image_store_put(out, out_len, job->image_key) == 0) {
+        free(out);
+    } else {
+        job->image_key[0] = '\0';
+        job->base64 = out;
+    }
+}
+
+void attach_job_run(worker_t *self, void *arg) {
+    attach_job_t *job = (attach_job_t *)arg;
+    attach_encode(job);
+    if (!attach_is_cancelled(job)) attach_post(job, PIPE_MSG_ATTACH_DONE, 100);
+    attach_job_release(job);
+}
+
+void attach_job_cancel(attach_job_t *job) {
+    if (!job) return;
+    __atomic_store_n(&job->cancelled, 1, __ATOMIC_RELEASE);
+    attach_job_release(job);
+}
+
+void attach_job_release(attach_job_t *job) {
+    if (!job || __atomic_sub_fetch(&job->refcount, 1, __ATOMIC_ACQ_REL) > 0) return;
+    free(job->base64);
+    free(job);
+}
+
+int attach_batch_add(attach_batch_t *batch, attach_job_t *job) {
+    if (batch->count >= ATTACH_MAX_IMAGES) return -1;
+    batch->jobs[batch->count] = job;
+    batch->percent[batch->count] = 0;
+    batch->ready[batch->count] = false;
+    batch->count++;
+    return 0;
+}
+
+int attach_batch_find(const attach_batch_t *batch, unsigned long id) {
+    for (int i = 0; i < batch->count; i++) {
+        if (batch->jobs[i]->id == id) return i;
+    }
+    return -1;
+}
+
+void attach_batch_remove(attach_batch_t *batch, int index) {
+    if (index < 0 || index >= batch->count) return;
+    if (batch->ready[index]) attach_job_release(batch->jobs[index]);
+    else attach_job_cancel(batch->jobs[index]);
+    int rest = batch->count - index - 1;
+    memmove(&batch->jobs[index], &batch->jobs[index + 1], rest * sizeof(batch->jobs[0]));
+    memmove(&batch->percent[index], &batch->percent[index + 1], rest * sizeof(batch->percent[0]));
+    memmove(&batch->ready[index], &batch->ready[index + 1], rest * sizeof(batch->ready[0]));
+    batch->count--;
+}
+
+void attach_batch_clear(attach_batch_t *batch) {
+    while (batch->count > 0) attach_batch_remove(batch, batch->count - 1);
+}
+
+int attach_batch_pending(const attach_batch_t *batch) {
+    int pending = 0;
+    for (int i = 0; i < batch->count; i++) {
+        if (!batch->ready[i]) pending++;
+    }
+    return pending;
+}
+
+unsigned int attach_batch_progress(const attach_batch_t *batch) {
+    if (batch->count == 0) return 100;
+    unsigned int total = 0;
+    for (int i = 0; i < batch->count; i++) total += batch->ready[i] ? 100 : batch->percent[i];
+    return total / batch->count;
+}
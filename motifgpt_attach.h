@@ -0,0 +1,134 @@
+#ifndef MOTIFGPT_ATTACH_H
+#define MOTIFGPT_ATTACH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <limits.h>
+#include "motifgpt_workers.h"
+#include "motifgpt_imagestore.h"
+#include "motifgpt_imagescale.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define ATTACH_CHUNK_SIZE (3 * 256 * 1024) // Bytes encoded between cancellation checks; a multiple of 3
+#define ATTACH_SNIFF_BYTES 16
+#define ATTACH_MIME_BUF_SIZE 64
+#define ATTACH_ERROR_BUF_SIZE 256
+#define ATTACH_MAX_IMAGES 16
+
+/**
+ * One image being loaded for attachment. The UI thread creates it and hands it
+ * to a worker, which maps the file, checks its type, downscales it if it is
+ * larger than `scale` allows, Base64-encodes it in chunks, reporting over the
+ * pipe as it goes, and puts it in the image store. The result fields belong to the
+ * worker until it posts PIPE_MSG_ATTACH_DONE, then to the UI thread.
+ */
+typedef struct {
+    int refcount;
+    unsigned long id;
+    int cancelled;
+    char path[PATH_MAX];
+    image_scale_options_t scale;
+
+    char mime_type[ATTACH_MIME_BUF_SIZE];
+    char *base64;      // NUL-terminated; only kept when the image store could not take it
+    size_t base64_len; // Length of the encoded image, even when base64 is NULL
+    char image_key[IMAGE_STORE_KEY_SIZE]; // Empty if the image store could not take it
+    char error[ATTACH_ERROR_BUF_SIZE]; // Empty on success, when exactly one of base64 and image_key is set
+} attach_job_t;
+
+/**
+ * The images attached to the message being composed, in the order they were
+ * chosen. Every image has its own job, so a batch is encoded on as many
+ * workers as are free. UI thread only.
+ */
+typedef struct {
+    attach_job_t *jobs[ATTACH_MAX_IMAGES];
+    unsigned int percent[ATTACH_MAX_IMAGES];
+    bool ready[ATTACH_MAX_IMAGES]; // Set once the job's PIPE_MSG_ATTACH_DONE arrived
+    int count;
+} attach_batch_t;
+
+/**
+ * Payload of PIPE_MSG_ATTACH_PROGRESS and PIPE_MSG_ATTACH_DONE.
+ */
+typedef struct {
+    unsigned long id;
+    unsigned int percent;
+} attach_progress_t;
+
+/**
+ * Creates a job with two references: one for the worker that runs it and one
+ * for the UI thread.
+ * @param path The file to load.
+ * @param scale Size limits for the provider the image is for, or NULL to send it untouched.
+ * @return The job, or NULL on allocation failure.
+ */
+attach_job_t *attach_job_create(const char *path, const image_scale_options_t *scale);
+
+/**
+ * Loads and encodes the job's file, posting PIPE_MSG_ATTACH_PROGRESS frames while
+ * it works and PIPE_MSG_ATTACH_DONE at the end unless the job was cancelled.
+ * Drops the worker's reference. Suitable for worker_pool_submit().
+ * @param self The worker; unused.
+ * @param arg The attach_job_t.
+ */
+void attach_job_run(worker_t *self, void *arg);
+
+/**
+ * Tells the worker to stop at the next chunk and drops the UI thread's
+ * reference. No PIPE_MSG_ATTACH_DONE frame follows a cancellation that the
+ * worker sees in time; any frame that still arrives should be ignored.
+ * @param job The job; NULL is ignored.
+ */
+void attach_job_cancel(attach_job_t *job);
+
+/**
+ * Drops a reference, freeing the job and any result still in it.
+ * @param job The job; NULL is ignored.
+ */
+void attach_job_release(attach_job_t *job);
+
+/**
+ * Adds a job to a batch, taking over the UI thread's reference.
+ * @param batch The batch.
+ * @param job The job, already submitted to a worker.
+ * @return 0 on success, -1 if the batch is full.
+ */
+int attach_batch_add(attach_batch_t *batch, attach_job_t *job);
+
+/**
+ * @param batch The batch.
+ * @param id A job id from a pipe frame.
+ * @return The job's position in the batch, or -1 if it is not there.
+ */
+int attach_batch_find(const attach_batch_t *batch, unsigned long id);
+
+/**
+ * Takes a job out of the batch, cancelling it if it is still loading.
+ * @param batch The batch.
+ * @param index The job's position; later jobs move up.
+ */
+void attach_batch_remove(attach_batch_t *batch, int index);
+
+/**
+ * Cancels or releases every job and empties the batch.
+ * @param batch The batch.
+ */
+void attach_batch_clear(attach_batch_t *batch);
+
+/**
+ * @param batch The batch.
+ * @return How many images are still loading.
+ */
+int attach_batch_pending(const attach_batch_t *batch);
+
+/**
+ * @param batch The batch.
+ * @return Overall progress of the whole batch, 0-100.
+ */
+unsigned int attach_batch_progress(const attach_batch_t *batch);
+
+#endif /* MOTIFGPT_ATTACH_H */
@@ -1,5 +1,5 @@
 #include "motifgpt_chat.h"
-#include "buffer_utils.h"
+#include "motifgpt_stream.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,47 +7,99 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
 
 int pipe_fds[2];
-bool assistant_is_replying = false;
-bool prefix_already_added_for_current_reply = false;
 
-void write_pipe_message(pipe_message_type_t type, const char* data) {
-    pipe_message_t msg; msg.type = type;
-    if (data) strncpy(msg.data, data, sizeof(msg.data) - 1); else msg.data[0] = '\0';
-    msg.data[sizeof(msg.data) - 1] = '\0';
-    ssize_t written = write(pipe_fds[1], &msg, sizeof(pipe_message_t));
-    if (written != sizeof(pipe_message_t)) {
+static pthread_mutex_t pipe_write_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int write_pipe_frame(pipe_message_type_t type, const void* data, size_t len) {
+    if (len > PIPE_FRAME_MAX_PAYLOAD) {
+        fprintf(stderr, "write_pipe_frame: Payload of %zu bytes exceeds the frame limit.\n", len);
+        return -1;
+    }
+    pipe_frame_header_t header = { (uint32_t)type, (uint32_t)len };
+    static const char terminator = '\0';
+    struct iovec iov[3] = {
+        { &header, sizeof(header) },
+        { (void *)data, data ? len : 0 },
+        { (void *)&terminator, 1 }
+    };
+    int iovcnt = 3, first = 0;
+    int result = 0;
+    pthread_mutex_lock(&pipe_write_mutex);
+    while (first < iovcnt) {
+        ssize_t written = writev(pipe_fds[1], &iov[first], iovcnt - first);
         if (written == -1) {
-            if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                perror("write_pipe_message");
-            } else {
-                fprintf(stderr, "write_pipe_message: Pipe is full or temporarily unavailable (EAGAIN/EWOULDBLOCK).\n");
-            }
-        } else {
-             fprintf(stderr, "write_pipe_message: Partial write to pipe (%ld bytes instead of %zu).\n", written, sizeof(pipe_message_t));
+            if (errno == EINTR) continue;
+            perror("write_pipe_frame");
+            result = -1; break;
+        }
+        while (first < iovcnt && (size_t)written >= iov[first].iov_len) {
+            written -= iov[first].iov_len; first++;
+        }
+        if (first < iovcnt) {
+            iov[first].iov_base = (char *)iov[first].iov_base + written;
+            iov[first].iov_len -= written;
         }
     }
+    pthread_mutex_unlock(&pipe_write_mutex);
+    return result;
+}
+
+void write_pipe_message(pipe_message_type_t type, const char* data) {
+    write_pipe_frame(type, data, data ? strlen(data) : 0);
+}
+
+ssize_t pipe_reader_fill(pipe_reader_t *reader, int fd) {
+    if (reader->pos > 0) {
+        memmove(reader->buf, reader->buf + reader->pos, reader->len - reader->pos);
+        reader->len -= reader->pos; reader->pos = 0;
+    }
+    if (reader->cap - reader->len < PIPE_READER_CHUNK_SIZE) {
+        size_t new_cap = reader->cap ? reader->cap * 2 : PIPE_READER_CHUNK_SIZE * 2;
+        char *new_buf = realloc(reader->buf, new_cap);
+        if (!new_buf) { perror("realloc pipe_reader"); errno = ENOMEM; return -1; }
+        reader->buf = new_buf; reader->cap = new_cap;
+    }
+    ssize_t nbytes;
+    do {
+        nbytes = read(fd, reader->buf + reader->len, reader->cap - reader->len);
+    } while (nbytes == -1 && errno == EINTR);
+    if (nbytes > 0) reader->len += nbytes;
+    return nbytes;
+}
+
+bool pipe_reader_next(pipe_reader_t *reader, pipe_message_type_t *type, const char **data, size_t *len) {
+    size_t available = reader->len - reader->pos;
+    pipe_frame_header_t header;
+    if (available < sizeof(header)) return false;
+    memcpy(&header, reader->buf + reader->pos, sizeof(header));
+    size_t frame_len = sizeof(header) + (size_t)header.length + 1;
+    if (available < frame_len) return false;
+    *type = (pipe_message_type_t)header.type;
+    *data = reader->buf + reader->pos + sizeof(header);
+    *len = header.length;
+    reader->pos += frame_len;
+    return true;
+}
+
+void pipe_reader_free(pipe_reader_t *reader) {
+    free(reader->buf);
+    reader->buf = NULL; reader->len = reader->pos = reader->cap = 0;
 }
 
 int stream_handler(const char* token, void* user_data, bool is_final, const char* error_during_stream) {
+    stream_state_t *stream = (stream_state_t *)user_data;
+    if (!stream) return 1;
     if (error_during_stream) {
-        write_pipe_message(PIPE_MSG_ERROR, error_during_stream);
-        assistant_is_replying = false; prefix_already_added_for_current_reply = false;
-        reset_assistant_buffer();
+        stream_end(stream, error_during_stream);
         return 1;
     }
-    if (!assistant_is_replying) {
-        assistant_is_replying = true;
-        prefix_already_added_for_current_reply = false;
-        reset_assistant_buffer();
-    }
-    if (token) {
-        append_to_assistant_buffer(token);
-        write_pipe_message(PIPE_MSG_TOKEN, token);
-    }
-    if (is_final) {
-        write_pipe_message(PIPE_MSG_STREAM_END, NULL);
-    }
+    if (stream_is_abandoned(stream)) return 1;
+    stream->started = true;
+    if (token) stream_push_token(stream, token, strlen(token));
+    if (is_final) stream_end(stream, NULL);
     return 0;
 }
@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 typedef enum {
     PIPE_MSG_TOKEN,
@@ -10,26 +12,39 @@ typedef enum {
     PIPE_MSG_ERROR,
     PIPE_MSG_MODEL_LIST_ITEM,
     PIPE_MSG_MODEL_LIST_END,
-    PIPE_MSG_MODEL_LIST_ERROR
+    PIPE_MSG_MODEL_LIST_ERROR,
+    PIPE_MSG_STREAM_READY, // Payload is the unsigned long id of a stream with queued records
+    PIPE_MSG_ATTACH_PROGRESS, // Payload is an attach_progress_t
+    PIPE_MSG_ATTACH_DONE,     // Payload is an attach_progress_t; the job holds the result
+    PIPE_MSG_CONVERSATION_BATCH, // Payload is the unsigned long id of a convfile job with messages queued
+    PIPE_MSG_CONVERSATION_DONE,  // Payload is the unsigned long id of a convfile job that has finished
+    PIPE_MSG_TOOL_DONE,          // Payload is the unsigned long id of a tool call that finished or timed out
+    PIPE_MSG_TOOL_CALL           // Stream record only: the JSON inside one complete <tool_call>, empty if it was too large
 } pipe_message_type_t;
 
+/**
+ * Every message on the pipe is a header followed by `length` payload bytes and a
+ * terminating NUL, so payloads of any size arrive intact and NUL-terminated.
+ */
 typedef struct {
-    pipe_message_type_t type;
-    char data[512];
-} pipe_message_t;
+    uint32_t type;
+    uint32_t length;
+} pipe_frame_header_t;
 
-extern int pipe_fds[2];
-extern bool assistant_is_replying;
-extern bool prefix_already_added_for_current_reply;
-extern char *current_assistant_response_buffer;
-extern size_t current_assistant_response_len;
-extern size_t current_assistant_response_capacity;
+#define PIPE_FRAME_MAX_PAYLOAD (64 * 1024 * 1024)
+#define PIPE_READER_CHUNK_SIZE (64 * 1024)
 
 /**
- * Appends text to the assistant's response buffer, resizing it if necessary.
- * @param text The text to append.
+ * Reassembles frames from the non-blocking read end of the pipe.
  */
-void append_to_assistant_buffer(const char* text);
+typedef struct {
+    char *buf;
+    size_t len;  // Bytes buffered
+    size_t pos;  // Start of the first unconsumed frame
+    size_t cap;
+} pipe_reader_t;
+
+extern int pipe_fds[2];
 
 /**
  * Writes a message to the internal communication pipe.
@@ -38,10 +53,44 @@ void append_to_assistant_buffer(const char* text);
  */
 void write_pipe_message(pipe_message_type_t type, const char* data);
 
+/**
+ * Writes one frame to the internal communication pipe. Safe to call from several
+ * threads at once; frames are never interleaved.
+ * @param type The type of message.
+ * @param data Payload bytes, or NULL for an empty payload.
+ * @param len Payload length in bytes.
+ * @return 0 on success, -1 on failure.
+ */
+int write_pipe_frame(pipe_message_type_t type, const void* data, size_t len);
+
+/**
+ * Reads whatever is available on `fd` into the reader in a single read() call.
+ * @param reader The reader.
+ * @param fd The non-blocking descriptor to read from.
+ * @return Bytes read, 0 on EOF, or -1 on error (errno is EAGAIN when the pipe is drained).
+ */
+ssize_t pipe_reader_fill(pipe_reader_t *reader, int fd);
+
+/**
+ * Takes the next complete frame out of the reader.
+ * @param reader The reader.
+ * @param type Receives the message type.
+ * @param data Receives the NUL-terminated payload, valid until the next pipe_reader_fill().
+ * @param len Receives the payload length.
+ * @return true if a frame was returned, false if more bytes are needed.
+ */
+bool pipe_reader_next(pipe_reader_t *reader, pipe_message_type_t *type, const char **data, size_t *len);
+
+/**
+ * Releases the reader's buffer.
+ * @param reader The reader.
+ */
+void pipe_reader_free(pipe_reader_t *reader);
+
 /**
  * The callback function used by libdisasterparty to handle streaming tokens.
  * @param token The received token string.
- * @param user_data Optional user-provided data.
+ * @param user_data The stream_state_t the reply is delivered through.
  * @param is_final Whether this is the final token in the stream.
  * @param error_during_stream Optional error message if a failure occurred.
  * @return 0 on success, non-zero to abort the stream.
@@ -0,0 +1,46 @@
+#include "motifgpt_context.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+static pthread_mutex_t current_mutex = PTHREAD_MUTEX_INITIALIZER;
+static llm_context_t *current_ctx = NULL;
+static unsigned long last_version = 0;
+
+llm_context_t *llm_context_create(dp_provider_type_t provider, const char *api_key, const char *model, const char *base_url) {
+    llm_context_t *ctx = calloc(1, sizeof(llm_context_t));
+    if (!ctx) { perror("calloc llm_context"); return NULL; }
+    ctx->refcount = 1;
+    ctx->provider = provider;
+    snprintf(ctx->api_key, sizeof(ctx->api_key), "%s", api_key ? api_key : "");
+    snprintf(ctx->model, sizeof(ctx->model), "%s", model ? model : "");
+    snprintf(ctx->base_url, sizeof(ctx->base_url), "%s", base_url ? base_url : "");
+    return ctx;
+}
+
+unsigned long llm_context_publish(llm_context_t *ctx) {
+    pthread_mutex_lock(&current_mutex);
+    llm_context_t *old = current_ctx;
+    if (ctx) ctx->version = ++last_version;
+    current_ctx = ctx;
+    pthread_mutex_unlock(&current_mutex);
+    llm_context_release(old);
+    return ctx ? ctx->version : 0;
+}
+
+llm_context_t *llm_context_acquire() {
+    pthread_mutex_lock(&current_mutex);
+    llm_context_t *ctx = current_ctx;
+    if (ctx) __atomic_add_fetch(&ctx->refcount, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&current_mutex);
+    return ctx;
+}
+
+void llm_context_release(llm_context_t *ctx) {
+    if (!ctx) return;
+    if (__atomic_sub_fetch(&ctx->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        memset(ctx->api_key, 0, sizeof(ctx->api_key));
+        free(ctx);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef MOTIFGPT_CONTEXT_H
+#define MOTIFGPT_CONTEXT_H
+
+#include "disasterparty.h"
+
+#define LLM_CONTEXT_KEY_BUF_SIZE 256
+#define LLM_CONTEXT_MODEL_BUF_SIZE 128
+#define LLM_CONTEXT_URL_BUF_SIZE 256
+
+/**
+ * An immutable, versioned description of the LLM endpoint a request talks to.
+ * Settings changes publish a new version; requests pin the version current when
+ * they were queued and keep using it until they finish. Workers build their own
+ * dp_context_t from it, so no dp context is ever shared between two streams.
+ */
+typedef struct {
+    int refcount;
+    unsigned long version;
+    dp_provider_type_t provider;
+    char api_key[LLM_CONTEXT_KEY_BUF_SIZE];
+    char model[LLM_CONTEXT_MODEL_BUF_SIZE];
+    char base_url[LLM_CONTEXT_URL_BUF_SIZE]; // Empty for the provider default
+} llm_context_t;
+
+/**
+ * Creates an unpublished context with a reference count of one.
+ * @param provider The API provider.
+ * @param api_key The API key.
+ * @param model The model ID.
+ * @param base_url Optional base URL override, or NULL.
+ * @return The new context, or NULL on allocation failure.
+ */
+llm_context_t *llm_context_create(dp_provider_type_t provider, const char *api_key, const char *model, const char *base_url);
+
+/**
+ * Atomically makes `ctx` the current context and assigns it the next version,
+ * taking over the caller's reference. Requests that pinned the previous context keep it.
+ * @param ctx The new context, or NULL to leave the LLM unconfigured.
+ * @return The version assigned, or 0 when ctx is NULL.
+ */
+unsigned long llm_context_publish(llm_context_t *ctx);
+
+/**
+ * Pins the current context.
+ * @return The current context with an extra reference, or NULL if none is configured.
+ */
+llm_context_t *llm_context_acquire();
+
+/**
+ * Drops a reference taken by llm_context_create() or llm_context_acquire(). May be called from any thread.
+ * @param ctx The context; NULL is ignored.
+ */
+void llm_context_release(llm_context_t *ctx);
+
+#endif /* MOTIFGPT_CONTEXT_H */
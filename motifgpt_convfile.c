@@ -0,0 +1,630 @@
+#include "motifgpt_convfile.h"
+#include "motifgpt_chat.h"
+#include "motifgpt_imagestore.h"
+#include "motifgpt_json.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static unsigned long last_convfile_id = 0;
+
+convfile_format_t convfile_format_for_path(const char *path) {
+    size_t len = strlen(path), ext = strlen(CONVFILE_BINARY_EXTENSION);
+    return len > ext && strcasecmp(path + len - ext, CONVFILE_BINARY_EXTENSION) == 0 ? CONVFILE_FORMAT_BINARY : CONVFILE_FORMAT_JSON;
+}
+
+convfile_job_t *convfile_job_create(const char *path, history_snapshot_t *snapshot) {
+    convfile_job_t *job = calloc(1, sizeof(convfile_job_t));
+    if (!job) { perror("calloc convfile_job"); return NULL; }
+    job->refcount = 2;
+    job->id = __atomic_add_fetch(&last_convfile_id, 1, __ATOMIC_RELAXED);
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    job->snapshot = snapshot;
+    job->format = convfile_format_for_path(path);
+    pthread_mutex_init(&job->lock, NULL);
+    job->batches_tail = &job->batches;
+    return job;
+}
+
+static bool convfile_is_cancelled(convfile_job_t *job) {
+    return __atomic_load_n(&job->cancelled, __ATOMIC_ACQUIRE);
+}
+
+static void convfile_post(convfile_job_t *job, pipe_message_type_t type) {
+    write_pipe_frame(type, &job->id, sizeof(job->id));
+}
+
+void convfile_message_free(convfile_message_t *message) {
+    free(message->text);
+    for (size_t k = 0; k < message->num_images; k++) free(message->images[k].data);
+    free(message->images);
+    memset(message, 0, sizeof(convfile_message_t));
+}
+
+void convfile_batch_free(convfile_batch_t *batch) {
+    while (batch) {
+        convfile_batch_t *next = batch->next;
+        for (size_t i = 0; i < batch->count; i++) convfile_message_free(&batch->messages[i]);
+        free(batch);
+        batch = next;
+    }
+}
+
+convfile_batch_t *convfile_job_take_batches(convfile_job_t *job) {
+    pthread_mutex_lock(&job->lock);
+    convfile_batch_t *batches = job->batches;
+    job->batches = NULL;
+    job->batches_tail = &job->batches;
+    pthread_mutex_unlock(&job->lock);
+    return batches;
+}
+
+// Hands the filled part of a batch to the UI thread.
+static void convfile_publish(convfile_job_t *job, convfile_batch_t **batch) {
+    if (!*batch || (*batch)->count == 0) return;
+    pthread_mutex_lock(&job->lock);
+    *job->batches_tail = *batch;
+    job->batches_tail = &(*batch)->next;
+    pthread_mutex_unlock(&job->lock);
+    *batch = NULL;
+    convfile_post(job, PIPE_MSG_CONVERSATION_BATCH);
+}
+
+// Moves a finished message into the batch being filled, publishing it once full.
+static int convfile_queue_message(convfile_job_t *job, convfile_batch_t **batch, convfile_message_t *message) {
+    if (!*batch && !(*batch = calloc(1, sizeof(convfile_batch_t)))) {
+        perror("calloc convfile_batch");
+        return -1;
+    }
+    (*batch)->messages[(*batch)->count++] = *message;
+    memset(message, 0, sizeof(convfile_message_t));
+    job->num_messages++;
+    if ((*batch)->count == CONVFILE_BATCH_SIZE) convfile_publish(job, batch);
+    return 0;
+}
+
+// Builds messages from parser events. Messages are objects in the top-level
+// array (depth 2 inside them) and parts are objects in their "parts" array
+// (depth 4); anything else is skipped.
+typedef struct {
+    convfile_job_t *job;
+    json_sax_t sax;
+    int depth;
+    bool in_parts;
+    char key[16];              // Last key seen; empty if it is longer than any we use
+    convfile_batch_t *batch;   // Being filled
+    convfile_message_t message;
+    size_t text_cap;
+    size_t images_cap;
+    char part_type[32];
+    char part_mime[64];
+    char *part_text;
+    char *part_data;
+    size_t part_data_len;
+} convfile_reader_t;
+
+static int convfile_reader_error(convfile_reader_t *r, const char *message) {
+    if (!r->job->error[0]) snprintf(r->job->error, sizeof(r->job->error), "%s", message);
+    return -1;
+}
+
+static void convfile_reader_reset_part(convfile_reader_t *r) {
+    free(r->part_text);
+    free(r->part_data);
+    r->part_text = r->part_data = NULL;
+    r->part_data_len = 0;
+    r->part_type[0] = r->part_mime[0] = '\0';
+}
+
+static int convfile_reader_finish_part(convfile_reader_t *r) {
+    convfile_message_t *m = &r->message;
+    if (strcmp(r->part_type, "text") == 0 && r->part_text) {
+        size_t len = m->text ? strlen(m->text) : 0, add = strlen(r->part_text);
+        if (len + add + 1 > r->text_cap) {
+            size_t cap = (len + add + 1) * 2;
+            char *text = realloc(m->text, cap);
+            if (!text) { perror("realloc convfile text"); return convfile_reader_error(r, "Out of memory reading conversation."); }
+            if (!m->text) text[0] = '\0';
+            m->text = text;
+            r->text_cap = cap;
+        }
+        memcpy(m->text + len, r->part_text, add + 1);
+    } else if (strncmp(r->part_type, "image", 5) == 0 && r->part_data) {
+        if (m->num_images == r->images_cap) {
+            size_t cap = r->images_cap ? r->images_cap * 2 : 2;
+            history_image_ref_t *images = realloc(m->images, cap * sizeof(history_image_ref_t));
+            if (!images) { perror("realloc convfile images"); return convfile_reader_error(r, "Out of memory reading conversation."); }
+            m->images = images;
+            r->images_cap = cap;
+        }
+        history_image_ref_t *image = &m->images[m->num_images++];
+        snprintf(image->mime_type, sizeof(image->mime_type), "%s", r->part_mime[0] ? r->part_mime : "image/png");
+        // History only needs the key once the store has the image
+        if (image_store_put(r->part_data, r->part_data_len, image->key) == 0) {
+            image->data = NULL;
+        } else {
+            image->key[0] = '\0';
+            image->data = r->part_data;
+            r->part_data = NULL;
+        }
+    }
+    convfile_reader_reset_part(r);
+    return 0;
+}
+
+static int convfile_reader_finish_message(convfile_reader_t *r) {
+    r->text_cap = r->images_cap = 0;
+    if (convfile_queue_message(r->job, &r->batch, &r->message) != 0) return convfile_reader_error(r, "Out of memory reading conversation.");
+    return 0;
+}
+
+static int convfile_on_begin_object(void *user_data) {
+    convfile_reader_t *r = user_data;
+    if (r->depth == 0) return convfile_reader_error(r, "Not a conversation file.");
+    if (r->depth == 1) r->message.role = DP_ROLE_USER;
+    if (r->depth == 3 && r->in_parts) convfile_reader_reset_part(r);
+    r->depth++;
+    return 0;
+}
+
+static int convfile_on_end_object(void *user_data) {
+    convfile_reader_t *r = user_data;
+    r->depth--;
+    if (r->depth == 3 && r->in_parts) return convfile_reader_finish_part(r);
+    if (r->depth == 1) return convfile_reader_finish_message(r);
+    return 0;
+}
+
+static int convfile_on_begin_array(void *user_data) {
+    convfile_reader_t *r = user_data;
+    if (r->depth == 2 && strcmp(r->key, "parts") == 0) r->in_parts = true;
+    r->depth++;
+    return 0;
+}
+
+static int convfile_on_end_array(void *user_data) {
+    convfile_reader_t *r = user_data;
+    r->depth--;
+    if (r->depth == 2) r->in_parts = false;
+    return 0;
+}
+
+static int convfile_on_key(void *user_data, const char *key, size_t len) {
+    convfile_reader_t *r = user_data;
+    if (len < sizeof(r->key)) memcpy(r->key, key, len + 1);
+    else r->key[0] = '\0';
+    return 0;
+}
+
+static int convfile_on_string(void *user_data, const char *value, size_t len) {
+    convfile_reader_t *r = user_data;
+    if (r->depth == 0) return convfile_reader_error(r, "Not a conversation file.");
+    if (r->depth == 2 && strcmp(r->key, "role") == 0) {
+        r->message.role = strcmp(value, "assistant") == 0 ? DP_ROLE_ASSISTANT : DP_ROLE_USER;
+    } else if (r->depth == 4 && r->in_parts) {
+        if (strcmp(r->key, "type") == 0) snprintf(r->part_type, sizeof(r->part_type), "%s", value);
+        else if (strcmp(r->key, "mime_type") == 0) snprintf(r->part_mime, sizeof(r->part_mime), "%s", value);
+        else if (strcmp(r->key, "text") == 0 || strcmp(r->key, "data") == 0) {
+            // Take the parser's buffer rather than copying what may be a whole image
+            char **slot = r->key[0] == 't' ? &r->part_text : &r->part_data;
+            free(*slot);
+            *slot = json_sax_take_string(&r->sax, NULL);
+            if (!*slot) return convfile_reader_error(r, "Out of memory reading conversation.");
+            if (slot == &r->part_data) r->part_data_len = len;
+        }
+    }
+    return 0;
+}
+
+static int convfile_on_scalar(void *user_data, const char *value, size_t len) {
+    convfile_reader_t *r = user_data;
+    return r->depth == 0 ? convfile_reader_error(r, "Not a conversation file.") : 0;
+}
+
+static const json_sax_callbacks_t convfile_callbacks = {
+    convfile_on_begin_object, convfile_on_end_object,
+    convfile_on_begin_array, convfile_on_end_array,
+    convfile_on_key, convfile_on_string, convfile_on_scalar
+};
+
+static void convfile_read(convfile_job_t *job) {
+    int fd = open(job->path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        snprintf(job->error, sizeof(job->error), "Could not open conversation file: %s", strerror(errno));
+        return;
+    }
+    char *chunk = malloc(CONVFILE_READ_CHUNK_SIZE);
+    if (!chunk) {
+        perror("malloc convfile chunk");
+        snprintf(job->error, sizeof(job->error), "Out of memory reading conversation.");
+        close(fd); return;
+    }
+    convfile_reader_t reader;
+    memset(&reader, 0, sizeof(reader));
+    reader.job = job;
+    json_sax_init(&reader.sax, &convfile_callbacks, &reader);
+
+    int status = 0;
+    for (;;) {
+        if (convfile_is_cancelled(job)) { status = -1; break; }
+        ssize_t n = read(fd, chunk, CONVFILE_READ_CHUNK_SIZE);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1) {
+            snprintf(job->error, sizeof(job->error), "Could not read conversation file: %s", strerror(errno));
+            status = -1; break;
+        }
+        if (n == 0) break;
+        if (json_sax_feed(&reader.sax, chunk, (size_t)n) != 0) {
+            if (!job->error[0]) snprintf(job->error, sizeof(job->error), "Conversation file is not valid after %zu messages.", job->num_messages);
+            status = -1; break;
+        }
+    }
+    if (status == 0 && json_sax_finish(&reader.sax) != 0) {
+        snprintf(job->error, sizeof(job->error), "Conversation file ends early after %zu messages.", job->num_messages);
+    }
+    // Whatever was read in full is still shown
+    if (!convfile_is_cancelled(job)) convfile_publish(job, &reader.batch);
+    convfile_batch_free(reader.batch);
+    convfile_message_free(&reader.message);
+    convfile_reader_reset_part(&reader);
+    json_sax_free(&reader.sax);
+    free(chunk);
+    close(fd);
+}
+
+static void convfile_put_u32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void convfile_put_u64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t convfile_get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t convfile_get_u64(const unsigned char *p) {
+    return (uint64_t)convfile_get_u32(p) | (uint64_t)convfile_get_u32(p + 4) << 32;
+}
+
+// Sequential output that remembers the first failure, so callers check once at the end.
+typedef struct {
+    FILE *f;
+    uint64_t offset;
+    bool failed;
+} convfile_writer_t;
+
+static void convfile_write(convfile_writer_t *w, const void *data, size_t len) {
+    if (!w->failed && len > 0 && fwrite(data, 1, len, w->f) != len) w->failed = true;
+    w->offset += len;
+}
+
+static void convfile_write_u32(convfile_writer_t *w, uint32_t v) {
+    unsigned char b[4];
+    convfile_put_u32(b, v);
+    convfile_write(w, b, sizeof(b));
+}
+
+static void convfile_write_u64(convfile_writer_t *w, uint64_t v) {
+    unsigned char b[8];
+    convfile_put_u64(b, v);
+    convfile_write(w, b, sizeof(b));
+}
+
+// An image blob already in the file.
+typedef struct {
+    char key[IMAGE_STORE_KEY_SIZE];
+    uint64_t offset;
+    uint64_t length;
+} convfile_blob_t;
+
+typedef struct {
+    convfile_blob_t *items;
+    size_t count;
+    size_t cap;
+} convfile_blobs_t;
+
+// Writes an image's bytes unless the same image was written before; returns its blob.
+static const convfile_blob_t *convfile_write_blob(convfile_writer_t *w, convfile_blobs_t *blobs, const history_image_ref_t *ref) {
+    size_t b64_len = 0;
+    char *loaded = ref->key[0] ? image_store_load(ref->key, &b64_len) : NULL;
+    const char *b64 = ref->key[0] ? loaded : ref->data;
+    if (!b64) return NULL;
+    if (!loaded) b64_len = strlen(b64);
+    char key[IMAGE_STORE_KEY_SIZE];
+    if (ref->key[0]) snprintf(key, sizeof(key), "%s", ref->key);
+    else image_store_hash(b64, b64_len, key);
+
+    for (size_t i = 0; i < blobs->count; i++) {
+        if (strcmp(blobs->items[i].key, key) == 0) { free(loaded); return &blobs->items[i]; }
+    }
+    if (blobs->count == blobs->cap) {
+        size_t cap = blobs->cap ? blobs->cap * 2 : 8;
+        convfile_blob_t *items = realloc(blobs->items, cap * sizeof(convfile_blob_t));
+        if (!items) { perror("realloc convfile blobs"); free(loaded); return NULL; }
+        blobs->items = items;
+        blobs->cap = cap;
+    }
+    unsigned char *bytes = malloc(base64_decoded_length(b64_len) + 1);
+    size_t len;
+    if (!bytes || base64_decode_to(bytes, b64, b64_len, &len) != 0) {
+        if (bytes) fprintf(stderr, "Image data is not valid Base64; cannot save it.\n");
+        else perror("malloc convfile blob");
+        free(bytes); free(loaded); return NULL;
+    }
+    convfile_blob_t *blob = &blobs->items[blobs->count++];
+    snprintf(blob->key, sizeof(blob->key), "%s", key);
+    blob->offset = w->offset;
+    blob->length = len;
+    convfile_write(w, bytes, len);
+    free(bytes);
+    free(loaded);
+    return blob;
+}
+
+// Writes the blobs a message needs, then its record; returns the record's offset.
+static int convfile_write_record(convfile_writer_t *w, convfile_blobs_t *blobs, const dp_message_t *m,
+                                 const history_image_ref_t *images, uint64_t *offset) {
+    size_t num_images = 0;
+    for (size_t k = 0; k < m->num_parts; k++) if (m->parts[k].type == DP_CONTENT_PART_IMAGE_BASE64) num_images++;
+    size_t *blob_index = calloc(num_images ? num_images : 1, sizeof(size_t));
+    if (!blob_index) { perror("calloc convfile blob index"); return -1; }
+    for (size_t k = 0; k < num_images; k++) {
+        const convfile_blob_t *blob = images ? convfile_write_blob(w, blobs, &images[k]) : NULL;
+        if (!blob) { free(blob_index); return -1; }
+        blob_index[k] = (size_t)(blob - blobs->items);
+    }
+
+    *offset = w->offset;
+    convfile_write_u32(w, m->role == DP_ROLE_ASSISTANT ? 1 : 0);
+    convfile_write_u32(w, (uint32_t)m->num_parts);
+    size_t image = 0;
+    for (size_t k = 0; k < m->num_parts; k++) {
+        if (m->parts[k].type == DP_CONTENT_PART_IMAGE_BASE64) {
+            const history_image_ref_t *ref = &images[image];
+            const convfile_blob_t *blob = &blobs->items[blob_index[image++]];
+            convfile_write_u32(w, 1);
+            convfile_write_u32(w, (uint32_t)strlen(ref->mime_type));
+            convfile_write(w, ref->mime_type, strlen(ref->mime_type));
+            convfile_write_u64(w, blob->offset);
+            convfile_write_u64(w, blob->length);
+        } else {
+            const char *text = m->parts[k].text ? m->parts[k].text : "";
+            convfile_write_u32(w, 0);
+            convfile_write_u32(w, (uint32_t)strlen(text));
+            convfile_write(w, text, strlen(text));
+        }
+    }
+    free(blob_index);
+    return 0;
+}
+
+int convfile_write_binary(const history_snapshot_t *snapshot, const char *path) {
+    convfile_writer_t w = { fopen(path, "wb"), 0, false };
+    if (!w.f) { perror("fopen conversation"); return -1; }
+    unsigned char header[CONVFILE_BINARY_HEADER_SIZE] = {0};
+    uint64_t *index = malloc((snapshot->count ? snapshot->count : 1) * 2 * sizeof(uint64_t));
+    convfile_blobs_t blobs = {0};
+    int status = index ? 0 : -1;
+    if (!index) perror("malloc convfile index");
+
+    // Room for the header, filled in once the index offset is known
+    convfile_write(&w, header, sizeof(header));
+    for (size_t i = 0; i < snapshot->count && status == 0; i++) {
+        const history_image_ref_t *images = snapshot->images ? snapshot->images[i] : NULL;
+        status = convfile_write_record(&w, &blobs, &snapshot->messages[i], images, &index[2 * i]);
+        index[2 * i + 1] = w.offset - index[2 * i];
+    }
+    if (status == 0) {
+        uint64_t index_offset = w.offset;
+        for (size_t i = 0; i < 2 * snapshot->count; i++) convfile_write_u64(&w, index[i]);
+        memcpy(header, CONVFILE_BINARY_MAGIC, CONVFILE_BINARY_MAGIC_SIZE);
+        convfile_put_u32(header + 8, CONVFILE_BINARY_VERSION);
+        convfile_put_u32(header + 12, (uint32_t)snapshot->count);
+        convfile_put_u64(header + 16, index_offset);
+        if (fseek(w.f, 0, SEEK_SET) != 0) w.failed = true;
+        convfile_write(&w, header, sizeof(header));
+        if (w.failed) { perror("write conversation"); status = -1; }
+    }
+    if (fclose(w.f) != 0) { perror("fclose conversation"); status = -1; }
+    if (status != 0) unlink(path);
+    free(blobs.items);
+    free(index);
+    return status;
+}
+
+int convfile_view_open(convfile_view_t *view, const char *path, char *error, size_t error_size) {
+    memset(view, 0, sizeof(convfile_view_t));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        snprintf(error, error_size, "Could not open conversation file: %s", strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < CONVFILE_BINARY_HEADER_SIZE || (uint64_t)st.st_size > SIZE_MAX) {
+        snprintf(error, error_size, "Not a conversation file.");
+        close(fd); return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        snprintf(error, error_size, "Could not map conversation file: %s", strerror(errno));
+        return -1;
+    }
+    view->map = map;
+    view->size = (size_t)st.st_size;
+
+    if (memcmp(view->map, CONVFILE_BINARY_MAGIC, CONVFILE_BINARY_MAGIC_SIZE) != 0) {
+        snprintf(error, error_size, "Not a conversation file.");
+        convfile_view_close(view); return -1;
+    }
+    uint32_t version = convfile_get_u32(view->map + 8);
+    if (version != CONVFILE_BINARY_VERSION) {
+        snprintf(error, error_size, "Conversation file version %u is not supported.", (unsigned int)version);
+        convfile_view_close(view); return -1;
+    }
+    uint64_t count = convfile_get_u32(view->map + 12), index_offset = convfile_get_u64(view->map + 16);
+    if (index_offset < CONVFILE_BINARY_HEADER_SIZE || index_offset > view->size || (view->size - index_offset) / 16 < count) {
+        snprintf(error, error_size, "Conversation file is damaged.");
+        convfile_view_close(view); return -1;
+    }
+    view->count = (size_t)count;
+    view->index = view->map + index_offset;
+    return 0;
+}
+
+int convfile_view_message(const convfile_view_t *view, size_t n, convfile_message_t *message) {
+    memset(message, 0, sizeof(convfile_message_t));
+    if (n >= view->count) return -1;
+    uint64_t offset = convfile_get_u64(view->index + 16 * n), length = convfile_get_u64(view->index + 16 * n + 8);
+    if (offset > view->size || length > view->size - offset || length < 8) return -1;
+    const unsigned char *p = view->map + offset, *end = p + length;
+    message->role = convfile_get_u32(p) == 1 ? DP_ROLE_ASSISTANT : DP_ROLE_USER;
+    uint32_t num_parts = convfile_get_u32(p + 4);
+    p += 8;
+
+    size_t text_len = 0;
+    for (uint32_t k = 0; k < num_parts; k++) {
+        if (end - p < 8) goto damaged;
+        uint32_t type = convfile_get_u32(p), len = convfile_get_u32(p + 4);
+        p += 8;
+        if ((size_t)(end - p) < len) goto damaged;
+        if (type == 0) {
+            char *text = realloc(message->text, text_len + len + 1);
+            if (!text) { perror("realloc convfile text"); goto damaged; }
+            memcpy(text + text_len, p, len);
+            text_len += len;
+            text[text_len] = '\0';
+            message->text = text;
+            p += len;
+        } else if (type == 1) {
+            const unsigned char *mime = p;
+            p += len;
+            if (end - p < 16) goto damaged;
+            uint64_t blob_offset = convfile_get_u64(p), blob_length = convfile_get_u64(p + 8);
+            p += 16;
+            if (blob_offset > view->size || blob_length > view->size - blob_offset) goto damaged;
+            history_image_ref_t *images = realloc(message->images, (message->num_images + 1) * sizeof(history_image_ref_t));
+            if (!images) { perror("realloc convfile images"); goto damaged; }
+            message->images = images;
+            char *data = base64_encode(view->map + blob_offset, (size_t)blob_length);
+            if (!data) goto damaged;
+            history_image_ref_t *image = &images[message->num_images++];
+            int mime_len = len < HISTORY_MIME_BUF_SIZE ? (int)len : HISTORY_MIME_BUF_SIZE - 1;
+            if (mime_len > 0) snprintf(image->mime_type, sizeof(image->mime_type), "%.*s", mime_len, (const char *)mime);
+            else snprintf(image->mime_type, sizeof(image->mime_type), "image/png");
+            if (image_store_put(data, strlen(data), image->key) == 0) {
+                free(data);
+                image->data = NULL;
+            } else {
+                image->key[0] = '\0';
+                image->data = data;
+            }
+        } else {
+            goto damaged;
+        }
+    }
+    return 0;
+
+damaged:
+    convfile_message_free(message);
+    return -1;
+}
+
+void convfile_view_close(convfile_view_t *view) {
+    if (view->map) munmap((void *)view->map, view->size);
+    memset(view, 0, sizeof(convfile_view_t));
+}
+
+// Decodes the last `max_messages` messages straight from the mapping.
+static void convfile_read_binary(convfile_job_t *job) {
+    convfile_view_t view;
+    if (convfile_view_open(&view, job->path, job->error, sizeof(job->error)) != 0) return;
+    size_t first = job->max_messages && view.count > job->max_messages ? view.count - job->max_messages : 0;
+    job->num_skipped = first;
+    convfile_batch_t *batch = NULL;
+    for (size_t n = first; n < view.count && !convfile_is_cancelled(job); n++) {
+        convfile_message_t message;
+        if (convfile_view_message(&view, n, &message) != 0) {
+            snprintf(job->error, sizeof(job->error), "Conversation file is damaged at message %zu.", n + 1);
+            break;
+        }
+        if (convfile_queue_message(job, &batch, &message) != 0) {
+            convfile_message_free(&message);
+            snprintf(job->error, sizeof(job->error), "Out of memory reading conversation.");
+            break;
+        }
+    }
+    if (!convfile_is_cancelled(job)) convfile_publish(job, &batch);
+    convfile_batch_free(batch);
+    convfile_view_close(&view);
+}
+
+static bool convfile_is_binary(const char *path) {
+    char magic[CONVFILE_BINARY_MAGIC_SIZE];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    bool binary = read(fd, magic, sizeof(magic)) == (ssize_t)sizeof(magic) && memcmp(magic, CONVFILE_BINARY_MAGIC, sizeof(magic)) == 0;
+    close(fd);
+    return binary;
+}
+
+static int convfile_write_json(const history_snapshot_t *snapshot, const char *path) {
+    dp_message_t *payload = NULL;
+    if (history_snapshot_expand(snapshot, &payload) != 0) return -1;
+    int status = dp_serialize_messages_to_file(payload, snapshot->count, path);
+    history_payload_free(snapshot, payload);
+    return status;
+}
+
+void convfile_open_run(worker_t *self, void *arg) {
+    convfile_job_t *job = (convfile_job_t *)arg;
+    if (convfile_is_binary(job->path)) convfile_read_binary(job);
+    else convfile_read(job);
+    if (!convfile_is_cancelled(job)) convfile_post(job, PIPE_MSG_CONVERSATION_DONE);
+    convfile_job_release(job);
+}
+
+void convfile_save_run(worker_t *self, void *arg) {
+    convfile_job_t *job = (convfile_job_t *)arg;
+    char temp_path[PATH_MAX + 8];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", job->path);
+    int status = !job->snapshot ? -1 : job->format == CONVFILE_FORMAT_BINARY ? convfile_write_binary(job->snapshot, temp_path)
+                                                                             : convfile_write_json(job->snapshot, temp_path);
+    if (status != 0) {
+        snprintf(job->error, sizeof(job->error), "Failed to save conversation to file.");
+        unlink(temp_path);
+    } else if (rename(temp_path, job->path) != 0) {
+        snprintf(job->error, sizeof(job->error), "Failed to save conversation to file: %s", strerror(errno));
+        unlink(temp_path);
+    } else {
+        job->num_messages = job->snapshot->count;
+    }
+    history_snapshot_release(job->snapshot);
+    job->snapshot = NULL;
+    if (!convfile_is_cancelled(job)) convfile_post(job, PIPE_MSG_CONVERSATION_DONE);
+    convfile_job_release(job);
+}
+
+void convfile_job_cancel(convfile_job_t *job) {
+    if (!job) return;
+    __atomic_store_n(&job->cancelled, 1, __ATOMIC_RELEASE);
+    convfile_job_release(job);
+}
+
+void convfile_job_release(convfile_job_t *job) {
+    if (!job || __atomic_sub_fetch(&job->refcount, 1, __ATOMIC_ACQ_REL) > 0) return;
+    convfile_batch_free(job->batches);
+    history_snapshot_release(job->snapshot);
+    pthread_mutex_destroy(&job->lock);
+    free(job);
+}
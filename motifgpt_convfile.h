@@ -0,0 +1,195 @@
+#ifndef MOTIFGPT_CONVFILE_H
+#define MOTIFGPT_CONVFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <limits.h>
+#include <pthread.h>
+#include "motifgpt_history.h"
+#include "motifgpt_workers.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define CONVFILE_READ_CHUNK_SIZE (64 * 1024)
+#define CONVFILE_BATCH_SIZE 32 // Messages handed to the UI thread at a time
+#define CONVFILE_ERROR_BUF_SIZE 256
+
+#define CONVFILE_BINARY_MAGIC "MGPTCONV"
+#define CONVFILE_BINARY_MAGIC_SIZE 8
+#define CONVFILE_BINARY_VERSION 1
+#define CONVFILE_BINARY_HEADER_SIZE 32
+#define CONVFILE_BINARY_EXTENSION ".mgpt" // Saving to a name ending in this writes the binary format
+
+typedef enum {
+    CONVFILE_FORMAT_JSON,
+    CONVFILE_FORMAT_BINARY
+} convfile_format_t;
+
+/**
+ * One message read from a conversation file, ready for
+ * add_image_message_to_history(). Text parts are joined into one.
+ */
+typedef struct {
+    dp_message_role_t role;
+    char *text;                  // NULL if the message has no text
+    history_image_ref_t *images; // The image store key, or the Base64 data when the store is unavailable
+    size_t num_images;
+} convfile_message_t;
+
+typedef struct convfile_batch {
+    convfile_message_t messages[CONVFILE_BATCH_SIZE];
+    size_t count;
+    struct convfile_batch *next;
+} convfile_batch_t;
+
+/**
+ * A binary conversation file mapped into memory. Every value is little-endian:
+ *
+ *   header:  magic[8] "MGPTCONV", u32 version, u32 message count,
+ *            u64 index offset, u64 reserved
+ *   blobs:   raw image bytes, each written once however many messages use it
+ *   records: u32 role (0 user, 1 assistant), u32 part count, then per part
+ *            u32 type 0 (text): u32 length, UTF-8 bytes
+ *            u32 type 1 (image): u32 MIME length, MIME bytes, u64 blob offset, u64 blob length
+ *   index:   per message, u64 record offset and u64 record length
+ *
+ * The index is what makes any one message readable without the ones before it.
+ */
+typedef struct {
+    const unsigned char *map;
+    size_t size;
+    size_t count;
+    const unsigned char *index;
+} convfile_view_t;
+
+/**
+ * Opening or saving a conversation file on a worker. An open job reads the
+ * file in chunks through a streaming JSON parser and queues the messages in
+ * batches, posting PIPE_MSG_CONVERSATION_BATCH as each fills so the UI thread
+ * can show the start of a long conversation while the rest is still being
+ * read. A save job writes a history snapshot. Both post
+ * PIPE_MSG_CONVERSATION_DONE at the end; the frames carry the job id.
+ *
+ * The file is a JSON array of messages as libdisasterparty writes them:
+ * {"role": "user", "parts": [{"type": "text", "text": "..."},
+ * {"type": "image_base64", "mime_type": "image/png", "data": "..."}]},
+ * or the binary format above, told apart by its magic. A binary file is
+ * mapped and only its last `max_messages` messages are decoded.
+ */
+typedef struct {
+    int refcount;
+    unsigned long id;
+    int cancelled;
+    char path[PATH_MAX];
+    history_snapshot_t *snapshot; // What a save job writes; NULL for an open job
+    convfile_format_t format;     // What a save job writes; set from the path's extension
+    size_t max_messages;          // The most an open job reads from the end of a binary file; 0 for all
+
+    pthread_mutex_t lock;          // Guards the batch queue
+    convfile_batch_t *batches;     // Read but not yet taken, oldest first
+    convfile_batch_t **batches_tail;
+
+    // Worker only until PIPE_MSG_CONVERSATION_DONE is posted
+    size_t num_messages;                 // Messages read so far
+    size_t num_skipped;                  // Messages before those, left unread
+    char error[CONVFILE_ERROR_BUF_SIZE]; // Empty on success
+} convfile_job_t;
+
+/**
+ * @param path A file name.
+ * @return CONVFILE_FORMAT_BINARY if it ends in CONVFILE_BINARY_EXTENSION, otherwise CONVFILE_FORMAT_JSON.
+ */
+convfile_format_t convfile_format_for_path(const char *path);
+
+/**
+ * Writes messages in the binary format.
+ * @param snapshot The messages and their images.
+ * @param path The file to create or replace.
+ * @return 0 on success, -1 on failure, with nothing left at `path`.
+ */
+int convfile_write_binary(const history_snapshot_t *snapshot, const char *path);
+
+/**
+ * Maps a binary conversation file and checks its header and index.
+ * @param view Filled in on success.
+ * @param path The file.
+ * @param error Receives a message on failure.
+ * @param error_size Size of `error`.
+ * @return 0 on success, -1 on failure.
+ */
+int convfile_view_open(convfile_view_t *view, const char *path, char *error, size_t error_size);
+
+/**
+ * Decodes one message of a mapped file without touching the others. Its images
+ * go to the image store, or stay as Base64 in the message if the store cannot take them.
+ * @param view The mapped file.
+ * @param n The message number, below `view->count`.
+ * @param message Receives the message; free its text and images when done.
+ * @return 0 on success, -1 if the record is damaged.
+ */
+int convfile_view_message(const convfile_view_t *view, size_t n, convfile_message_t *message);
+
+/**
+ * Unmaps the file.
+ * @param view The view; closing one that failed to open is harmless.
+ */
+void convfile_view_close(convfile_view_t *view);
+
+/**
+ * Creates a job with two references: one for the worker and one for the UI thread.
+ * @param path The file to read or write.
+ * @param snapshot For a save job, the history to write; the job takes over the reference. NULL for an open job.
+ * @return The job, or NULL on allocation failure.
+ */
+convfile_job_t *convfile_job_create(const char *path, history_snapshot_t *snapshot);
+
+/**
+ * Reads the job's file. Suitable for worker_pool_submit(); drops the worker's reference.
+ * @param self The worker; unused.
+ * @param arg The convfile_job_t.
+ */
+void convfile_open_run(worker_t *self, void *arg);
+
+/**
+ * Writes the job's snapshot in the job's format, through a temporary file so an existing
+ * conversation is only replaced once the new one is complete. Suitable for
+ * worker_pool_submit(); drops the worker's reference.
+ * @param self The worker; unused.
+ * @param arg The convfile_job_t.
+ */
+void convfile_save_run(worker_t *self, void *arg);
+
+/**
+ * Takes every batch read so far. UI thread side.
+ * @param job The job.
+ * @return The batches, oldest first and linked through `next`, or NULL if there are none.
+ */
+convfile_batch_t *convfile_job_take_batches(convfile_job_t *job);
+
+/**
+ * Frees a message's text and any images it still owns, and clears it.
+ * @param message The message.
+ */
+void convfile_message_free(convfile_message_t *message);
+
+/**
+ * Frees a list of batches along with any text and images still in them.
+ * @param batch The first batch; NULL is ignored.
+ */
+void convfile_batch_free(convfile_batch_t *batch);
+
+/**
+ * Tells the worker to stop after the current chunk and drops the UI thread's reference.
+ * @param job The job; NULL is ignored.
+ */
+void convfile_job_cancel(convfile_job_t *job);
+
+/**
+ * Drops a reference, freeing the job and any batches still queued.
+ * @param job The job; NULL is ignored.
+ */
+void convfile_job_release(convfile_job_t *job);
+
+#endif /* MOTIFGPT_CONVFILE_H */
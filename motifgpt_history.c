@@ -2,21 +2,170 @@
 #include <stdlib.h>
 #include <string.h>
 #include "motifgpt_history.h"
+#include "motifgpt_arena.h"
+#include "motifgpt_imagestore.h"
 #include "disasterparty.h"
 
-dp_message_t *chat_history = NULL;
+// The live history is a ring of message structs owned by the UI thread: the
+// oldest message sits at ring_head and eviction just advances it. Snapshots copy
+// the structs out in order, so they never see the ring itself, but they share the
+// message content. Content ownership is tracked by a reference-counted block: the
+// UI thread holds one reference and every outstanding snapshot holds another.
+// Messages dropped while the block is shared are handed to it and the UI thread
+// moves on to a fresh block. The old block keeps a reference to its successor,
+// since its snapshots can also see messages that are still live, so nothing is
+// freed before the last snapshot that could see it is released.
+//
+// Messages are built as a single allocation from the conversation's arena. An
+// attached image is kept in the image store, or failing that in a Base64 buffer
+// the entry takes over: the message holds a placeholder part and the entry a
+// reference, which history_snapshot_expand() turns back into Base64 for
+// requests.
+typedef struct {
+    dp_message_t message;
+    arena_slab_t *slab;
+    history_image_ref_t *images; // One per image part, in the same allocation as the parts; NULL if none
+    size_t num_images;
+} history_entry_t;
+
+struct history_block {
+    int refcount;
+    history_entry_t *retired;
+    size_t retired_count;
+    history_block_t *next;
+};
+
 int chat_history_count = 0;
-int chat_history_capacity = 0;
+
+static history_entry_t *ring = NULL;
+static int ring_capacity = 0;
+static int ring_head = 0;
+static history_block_t *live_block = NULL;
+static arena_t history_arena = { NULL, ARENA_SLAB_SIZE };
+static history_append_hook_t append_hook = NULL;
+
+void history_set_append_hook(history_append_hook_t hook) {
+    append_hook = hook;
+}
+
+// Frees the content of `count` entries, releasing runs from one slab together.
+static void history_free_entries(const history_entry_t *entries, size_t count) {
+    size_t i = 0;
+    while (i < count) {
+        arena_slab_t *slab = entries[i].slab;
+        size_t run = 1;
+        while (i + run < count && entries[i + run].slab == slab) run++;
+        for (size_t j = i; j < i + run; j++) {
+            for (size_t k = 0; k < entries[j].num_images; k++) free(entries[j].images[k].data);
+        }
+        arena_release(slab, (int)run);
+        i += run;
+    }
+}
+
+static history_block_t *history_block_new() {
+    history_block_t *block = malloc(sizeof(history_block_t));
+    if (!block) { perror("malloc history_block"); return NULL; }
+    block->refcount = 1; block->retired = NULL; block->retired_count = 0; block->next = NULL;
+    return block;
+}
+
+static void history_block_release(history_block_t *block) {
+    while (block && __atomic_sub_fetch(&block->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        history_block_t *next = block->next;
+        if (block->retired) {
+            history_free_entries(block->retired, block->retired_count);
+            free(block->retired);
+        }
+        free(block);
+        block = next;
+    }
+}
+
+static bool history_block_is_shared(const history_block_t *block) {
+    return block && __atomic_load_n(&block->refcount, __ATOMIC_ACQUIRE) > 1;
+}
+
+// Copies `count` entries starting at logical index `first` into `out`, unwrapping the ring.
+static void history_copy_range(history_entry_t *out, int first, int count) {
+    int start = (ring_head + first) % ring_capacity;
+    int leading = ring_capacity - start < count ? ring_capacity - start : count;
+    memcpy(out, &ring[start], leading * sizeof(history_entry_t));
+    if (count > leading) memcpy(&out[leading], ring, (count - leading) * sizeof(history_entry_t));
+}
+
+// Gives up the oldest `count` messages. If a snapshot may still be reading them
+// they go to the current block, which the UI thread then lets go of.
+static bool history_retire(int count) {
+    if (history_block_is_shared(live_block)) {
+        history_block_t *fresh = history_block_new();
+        if (!fresh) return false;
+        history_entry_t *retired = malloc(count * sizeof(history_entry_t));
+        if (!retired) { perror("malloc retired history"); free(fresh); return false; }
+        history_copy_range(retired, 0, count);
+        fresh->refcount = 2;
+        live_block->retired = retired; live_block->retired_count = count; live_block->next = fresh;
+        history_block_release(live_block);
+        live_block = fresh;
+    } else {
+        int start = ring_head;
+        int leading = ring_capacity - start < count ? ring_capacity - start : count;
+        history_free_entries(&ring[start], leading);
+        if (count > leading) history_free_entries(ring, count - leading);
+    }
+    return true;
+}
 
 void remove_oldest_history_messages(int count_to_remove) {
     if (count_to_remove <= 0 || count_to_remove > chat_history_count) return;
-    dp_free_messages(chat_history, count_to_remove);
-    int remaining_count = chat_history_count - count_to_remove;
-    if (remaining_count > 0) memmove(chat_history, &chat_history[count_to_remove], remaining_count * sizeof(dp_message_t));
-    chat_history_count = remaining_count;
+    if (!history_retire(count_to_remove)) return;
+    ring_head = (ring_head + count_to_remove) % ring_capacity;
+    chat_history_count -= count_to_remove;
+    if (chat_history_count == 0) ring_head = 0;
 }
 
-void add_message_to_history(dp_message_role_t role, const char* text_content, const char* img_mime_type, const char* img_base64_data) {
+// Moves the ring into a larger array, unwrapping it so the oldest message is at 0.
+static bool history_grow(int new_capacity) {
+    history_entry_t *entries = malloc(new_capacity * sizeof(history_entry_t));
+    if (!entries) { perror("malloc chat_history"); return false; }
+    if (chat_history_count > 0) history_copy_range(entries, 0, chat_history_count);
+    free(ring);
+    ring = entries; ring_capacity = new_capacity; ring_head = 0;
+    return true;
+}
+
+dp_message_t *history_at(int index) {
+    if (index < 0 || index >= chat_history_count) return NULL;
+    return &ring[(ring_head + index) % ring_capacity].message;
+}
+
+// Builds a message as one arena allocation: the parts array, then the image
+// references, then the text. The entry takes over each image's `data` once
+// the message is built.
+static bool history_build_message(history_entry_t *entry, const char *text, const history_image_ref_t *images, size_t num_images) {
+    size_t num_parts = (text ? 1 : 0) + num_images;
+    size_t len = text ? strlen(text) : 0;
+    size_t size = num_parts * sizeof(dp_content_part_t) + num_images * sizeof(history_image_ref_t) + (text ? len + 1 : 0);
+    dp_content_part_t *parts = arena_alloc(&history_arena, size, &entry->slab);
+    if (!parts) return false;
+    memset(parts, 0, num_parts * sizeof(dp_content_part_t));
+    char *tail = (char *)(parts + num_parts);
+    if (text) parts[0].type = DP_CONTENT_PART_TEXT;
+    if (num_images > 0) {
+        entry->images = memcpy(tail, images, num_images * sizeof(history_image_ref_t));
+        entry->num_images = num_images;
+        for (size_t k = 0; k < num_images; k++) {
+            parts[num_parts - num_images + k].type = DP_CONTENT_PART_IMAGE_BASE64; // Placeholder; nothing else is set
+        }
+        tail += num_images * sizeof(history_image_ref_t);
+    }
+    if (text) parts[0].text = memcpy(tail, text, len + 1);
+    entry->message.parts = parts; entry->message.num_parts = num_parts;
+    return true;
+}
+
+// Evicts as the limit requires and returns the slot for the next message, or NULL.
+static history_entry_t *history_next_entry(dp_message_role_t role) {
     int effective_max_history = history_limits_disabled ? INTERNAL_MAX_HISTORY_CAPACITY : current_max_history_messages;
     if (chat_history_count >= effective_max_history && effective_max_history > 0 && !history_limits_disabled ) {
         int messages_to_remove = (chat_history_count - effective_max_history) + 1;
@@ -26,45 +175,154 @@ void add_message_to_history(dp_message_role_t role, const char* text_content, co
              remove_oldest_history_messages(messages_to_remove);
         }
     }
-    if (chat_history_count >= chat_history_capacity) {
-        chat_history_capacity = (chat_history_capacity == 0) ? 10 : chat_history_capacity * 2;
-        if (chat_history_capacity > INTERNAL_MAX_HISTORY_CAPACITY) chat_history_capacity = INTERNAL_MAX_HISTORY_CAPACITY;
-        if (chat_history_count >= chat_history_capacity) {
-            fprintf(stderr, "Cannot expand history further due to internal capacity limit.\n"); return;
+    if (!live_block && !(live_block = history_block_new())) return NULL;
+    if (chat_history_count >= ring_capacity) {
+        int new_capacity = (ring_capacity == 0) ? 10 : ring_capacity * 2;
+        if (new_capacity > INTERNAL_MAX_HISTORY_CAPACITY) new_capacity = INTERNAL_MAX_HISTORY_CAPACITY;
+        if (chat_history_count >= new_capacity) {
+            fprintf(stderr, "Cannot expand history further due to internal capacity limit.\n"); return NULL;
         }
-        dp_message_t *new_history = realloc(chat_history, chat_history_capacity * sizeof(dp_message_t));
-        if (!new_history) { perror("realloc chat_history"); return; }
-        chat_history = new_history;
+        if (!history_grow(new_capacity)) return NULL;
     }
-    dp_message_t *new_msg = &chat_history[chat_history_count];
-    new_msg->role = role; new_msg->num_parts = 0; new_msg->parts = NULL;
-    bool success = true;
-    if ((text_content && strlen(text_content) > 0) || (role == DP_ROLE_ASSISTANT && text_content != NULL) ) {
-        if (!dp_message_add_text_part(new_msg, text_content)) {
-            fprintf(stderr, "Failed to add text part to history.\n"); success = false;
+    history_entry_t *entry = &ring[(ring_head + chat_history_count) % ring_capacity];
+    entry->message.role = role; entry->message.num_parts = 0; entry->message.parts = NULL;
+    entry->slab = NULL; entry->images = NULL; entry->num_images = 0;
+    return entry;
+}
+
+static bool history_has_text(dp_message_role_t role, const char *text_content) {
+    return (text_content && strlen(text_content) > 0) || (role == DP_ROLE_ASSISTANT && text_content != NULL);
+}
+
+void add_image_message_to_history(dp_message_role_t role, const char* text_content, const history_image_ref_t* images, size_t num_images) {
+    bool has_text = history_has_text(role, text_content);
+    history_entry_t *entry = (has_text || num_images > 0) ? history_next_entry(role) : NULL;
+    if (entry && history_build_message(entry, has_text ? text_content : NULL, images, num_images)) {
+        chat_history_count++;
+        if (append_hook) append_hook(&entry->message, entry->images, entry->num_images);
+        return;
+    }
+    if (has_text || num_images > 0) fprintf(stderr, "Failed to add message to history.\n");
+    for (size_t k = 0; k < num_images; k++) free(images[k].data);
+}
+
+void add_stored_image_message_to_history(dp_message_role_t role, const char* text_content, const char* img_mime_type, const char* image_key) {
+    history_image_ref_t image = { "", "", NULL };
+    if (image_key) {
+        snprintf(image.key, sizeof(image.key), "%s", image_key);
+        snprintf(image.mime_type, sizeof(image.mime_type), "%s", img_mime_type);
+    }
+    add_image_message_to_history(role, text_content, &image, image_key ? 1 : 0);
+}
+
+void add_adopted_image_message_to_history(dp_message_role_t role, const char* text_content, const char* img_mime_type, char* img_base64_data) {
+    history_image_ref_t image = { "", "", img_base64_data };
+    if (img_base64_data) snprintf(image.mime_type, sizeof(image.mime_type), "%s", img_mime_type);
+    add_image_message_to_history(role, text_content, &image, img_base64_data ? 1 : 0);
+}
+
+void add_message_to_history(dp_message_role_t role, const char* text_content, const char* img_mime_type, const char* img_base64_data) {
+    bool has_image = img_base64_data && img_mime_type;
+    char key[IMAGE_STORE_KEY_SIZE];
+    if (!has_image || image_store_put(img_base64_data, strlen(img_base64_data), key) == 0) {
+        add_stored_image_message_to_history(role, text_content, img_mime_type, has_image ? key : NULL);
+        return;
+    }
+
+    // The store is unavailable: the message keeps its own copy
+    char *copy = strdup(img_base64_data);
+    if (!copy) { perror("strdup history image"); return; }
+    add_adopted_image_message_to_history(role, text_content, img_mime_type, copy);
+}
+
+void free_chat_history() {
+    if (chat_history_count > 0 && !history_retire(chat_history_count)) {
+        // A snapshot may still be reading the content; leaking it is the only safe option.
+        fprintf(stderr, "Failed to retire chat history; leaking %d message(s).\n", chat_history_count);
+    }
+    history_block_release(live_block);
+    live_block = NULL;
+    arena_destroy(&history_arena);
+    free(ring);
+    ring = NULL;
+    chat_history_count = 0; ring_capacity = 0; ring_head = 0;
+}
+
+history_snapshot_t *history_snapshot_acquire() {
+    history_snapshot_t *snapshot = malloc(sizeof(history_snapshot_t));
+    if (!snapshot) { perror("malloc history_snapshot"); return NULL; }
+    snapshot->messages = NULL;
+    snapshot->images = NULL;
+    snapshot->count = chat_history_count;
+    if (chat_history_count > 0) {
+        snapshot->messages = malloc(chat_history_count * sizeof(dp_message_t));
+        if (!snapshot->messages) { perror("malloc history_snapshot messages"); free(snapshot); return NULL; }
+        int start = ring_head;
+        for (int i = 0; i < chat_history_count; i++) {
+            snapshot->messages[i] = ring[start].message;
+            if (ring[start].images && !snapshot->images) {
+                snapshot->images = calloc(chat_history_count, sizeof(history_image_ref_t *));
+                if (!snapshot->images) { perror("calloc history_snapshot images"); free(snapshot->messages); free(snapshot); return NULL; }
+            }
+            if (snapshot->images) snapshot->images[i] = ring[start].images;
+            if (++start == ring_capacity) start = 0;
         }
     }
-    if (success && img_base64_data && img_mime_type) {
-        if (!dp_message_add_base64_image_part(new_msg, img_mime_type, img_base64_data)) {
-            fprintf(stderr, "Failed to add image part to history.\n"); success = false;
+    snapshot->block = live_block;
+    if (live_block) __atomic_add_fetch(&live_block->refcount, 1, __ATOMIC_RELAXED);
+    return snapshot;
+}
+
+void history_snapshot_release(history_snapshot_t *snapshot) {
+    if (!snapshot) return;
+    history_block_release(snapshot->block);
+    free(snapshot->messages);
+    free(snapshot->images);
+    free(snapshot);
+}
+
+// Rebuilds one message with its images inlined, owned by libdisasterparty.
+static bool history_expand_message(const dp_message_t *msg, const history_image_ref_t *images, dp_message_t *out) {
+    out->role = msg->role; out->num_parts = 0; out->parts = NULL;
+    const history_image_ref_t *image = images;
+    for (size_t j = 0; j < msg->num_parts; j++) {
+        const dp_content_part_t *part = &msg->parts[j];
+        if (part->type == DP_CONTENT_PART_TEXT) {
+            if (!dp_message_add_text_part(out, part->text ? part->text : "")) return false;
+        } else if (part->type == DP_CONTENT_PART_IMAGE_BASE64) {
+            char *loaded = image->data ? NULL : image_store_load(image->key, NULL);
+            if (!image->data && !loaded) return false;
+            bool ok = dp_message_add_base64_image_part(out, image->mime_type, image->data ? image->data : loaded);
+            free(loaded);
+            image++;
+            if (!ok) return false;
         }
     }
-    if (success && new_msg->num_parts > 0) {
-        chat_history_count++;
-    } else if (new_msg->parts) {
-        for (size_t i = 0; i < new_msg->num_parts; i++) {
-            if (new_msg->parts[i].text) free(new_msg->parts[i].text);
+    return true;
+}
+
+int history_snapshot_expand(const history_snapshot_t *snapshot, dp_message_t **payload) {
+    *payload = snapshot->messages;
+    if (!snapshot->images) return 0;
+    dp_message_t *expanded = malloc(snapshot->count * sizeof(dp_message_t));
+    if (!expanded) { perror("malloc history payload"); return -1; }
+    for (size_t i = 0; i < snapshot->count; i++) {
+        if (!snapshot->images[i]) { expanded[i] = snapshot->messages[i]; continue; }
+        if (!history_expand_message(&snapshot->messages[i], snapshot->images[i], &expanded[i])) {
+            dp_free_messages(&expanded[i], 1);
+            while (i-- > 0) if (snapshot->images[i]) dp_free_messages(&expanded[i], 1);
+            free(expanded);
+            return -1;
         }
-        free(new_msg->parts);
-        new_msg->parts = NULL;
-        new_msg->num_parts = 0;
-    } else if (!text_content && !img_base64_data && role == DP_ROLE_USER) { return; }
+    }
+    *payload = expanded;
+    return 0;
 }
 
-void free_chat_history() {
-    if (chat_history) {
-        dp_free_messages(chat_history, chat_history_count);
-        free(chat_history); chat_history = NULL;
+void history_payload_free(const history_snapshot_t *snapshot, dp_message_t *payload) {
+    if (!payload || payload == snapshot->messages) return;
+    for (size_t i = 0; i < snapshot->count; i++) {
+        if (snapshot->images[i]) dp_free_messages(&payload[i], 1);
     }
-    chat_history_count = 0; chat_history_capacity = 0;
+    free(payload);
 }
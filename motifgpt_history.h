@@ -4,24 +4,71 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include "disasterparty.h"
+#include "motifgpt_imagestore.h"
 
 // Define max history capacity if not already defined
 #ifndef INTERNAL_MAX_HISTORY_CAPACITY
 #define INTERNAL_MAX_HISTORY_CAPACITY 10000
 #endif
 
-// Global state for chat history
-extern dp_message_t *chat_history;
+typedef struct history_block history_block_t;
+
+#define HISTORY_MIME_BUF_SIZE 64
+
+/**
+ * Where a message's image lives: in the image store, or in a buffer the
+ * message owns when the store could not take it.
+ */
+typedef struct {
+    char key[IMAGE_STORE_KEY_SIZE]; // Empty when `data` is set
+    char mime_type[HISTORY_MIME_BUF_SIZE];
+    char *data; // NUL-terminated Base64, or NULL if the image is in the store
+} history_image_ref_t;
+
+/**
+ * An immutable, reference-counted view of the chat history at the time it was
+ * taken. `messages` is the snapshot's own array of message structs in
+ * conversation order; the content they point to is shared with the live history.
+ * Worker threads may read `messages[0..count)` without locking while the UI
+ * thread keeps appending to, evicting from or clearing the live history.
+ *
+ * A message with images has placeholder image parts with only their type
+ * set, and `images[i]` points at one reference per image part, in order. Use
+ * history_snapshot_expand() before handing messages to libdisasterparty.
+ */
+typedef struct {
+    dp_message_t *messages;
+    const history_image_ref_t **images; // NULL when no message has an image
+    size_t count;
+    history_block_t *block;
+} history_snapshot_t;
+
+// Global state for chat history. The messages themselves live in a ring; use
+// history_at() to reach them, or take a snapshot for a contiguous array.
 extern int chat_history_count;
-extern int chat_history_capacity;
 
 // Configuration variables (defined elsewhere, e.g., in motifgpt.c or tests)
 extern int current_max_history_messages;
 extern bool history_limits_disabled;
 
+/**
+ * Called on the UI thread after a message is added to the history.
+ * @param message The message as stored, with placeholder image parts.
+ * @param images One reference per image part, in order; NULL if there are none.
+ * @param num_images How many images there are.
+ */
+typedef void (*history_append_hook_t)(const dp_message_t *message, const history_image_ref_t *images, size_t num_images);
+
 // Function prototypes
 /**
- * Adds a message to the chat history.
+ * Sets the function told about every message added, e.g. to journal it.
+ * @param hook The function, or NULL for none.
+ */
+void history_set_append_hook(history_append_hook_t hook);
+
+/**
+ * Adds a message to the chat history. An image is put in the image store and
+ * copied into the message only if the store cannot take it.
  * @param role The role of the message sender.
  * @param text_content The text content of the message.
  * @param img_mime_type The MIME type of the attached image, or NULL if none.
@@ -30,7 +77,45 @@ extern bool history_limits_disabled;
 void add_message_to_history(dp_message_role_t role, const char* text_content, const char* img_mime_type, const char* img_base64_data);
 
 /**
- * Removes the specified number of oldest messages from the chat history.
+ * Adds a message whose image is already in the image store, e.g. put there by
+ * the worker that loaded it.
+ * @param role The role of the message sender.
+ * @param text_content The text content of the message.
+ * @param img_mime_type The MIME type of the image, or NULL if none.
+ * @param image_key The image's store key, or NULL if none.
+ */
+void add_stored_image_message_to_history(dp_message_role_t role, const char* text_content, const char* img_mime_type, const char* image_key);
+
+/**
+ * Adds a message with any number of images, one image part each, after the text.
+ * @param role The role of the message sender.
+ * @param text_content The text content of the message.
+ * @param images Where each image is. The history takes over every `data` buffer, even on failure.
+ * @param num_images How many images there are.
+ */
+void add_image_message_to_history(dp_message_role_t role, const char* text_content, const history_image_ref_t* images, size_t num_images);
+
+/**
+ * Adds a message that takes over an image buffer instead of copying it, for
+ * images the store could not take.
+ * @param role The role of the message sender.
+ * @param text_content The text content of the message.
+ * @param img_mime_type The MIME type of the image.
+ * @param img_base64_data Heap-allocated, NUL-terminated Base64; freed by the history, even on failure.
+ */
+void add_adopted_image_message_to_history(dp_message_role_t role, const char* text_content, const char* img_mime_type, char* img_base64_data);
+
+/**
+ * Returns a message by its position in the conversation. Iterate the history
+ * with `for (int i = 0; i < chat_history_count; i++) history_at(i)`.
+ * @param index 0 for the oldest message, chat_history_count - 1 for the newest.
+ * @return The message, or NULL if index is out of range. Valid until the history is next modified.
+ */
+dp_message_t *history_at(int index);
+
+/**
+ * Removes the specified number of oldest messages from the chat history. Costs
+ * O(count_to_remove) regardless of the history's length.
  * @param count_to_remove The number of messages to remove.
  */
 void remove_oldest_history_messages(int count_to_remove);
@@ -40,4 +125,33 @@ void remove_oldest_history_messages(int count_to_remove);
  */
 void free_chat_history();
 
+/**
+ * Takes a snapshot of the current chat history. Copies the message structs, never their content.
+ * @return The snapshot, or NULL on allocation failure. Release it with history_snapshot_release().
+ */
+history_snapshot_t *history_snapshot_acquire();
+
+/**
+ * Releases a snapshot. May be called from any thread.
+ * @param snapshot The snapshot to release; NULL is ignored.
+ */
+void history_snapshot_release(history_snapshot_t *snapshot);
+
+/**
+ * Builds the message array to send or save: the snapshot's messages with every
+ * stored image read back from the image store. May be called from any thread.
+ * @param snapshot The snapshot.
+ * @param payload Receives `snapshot->count` messages; free them with
+ * history_payload_free() before releasing the snapshot.
+ * @return 0 on success, -1 if an image could not be read back.
+ */
+int history_snapshot_expand(const history_snapshot_t *snapshot, dp_message_t **payload);
+
+/**
+ * Frees what history_snapshot_expand() built.
+ * @param snapshot The snapshot it was built from.
+ * @param payload The messages; NULL is ignored.
+ */
+void history_payload_free(const history_snapshot_t *snapshot, dp_message_t *payload);
+
 #endif /* MOTIFGPT_HISTORY_H */
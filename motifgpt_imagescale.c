@@ -0,0 +1,432 @@
+#include "motifgpt_imagescale.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool image_scale_accepts(const image_scale_options_t *options, image_format_t format) {
+    return !options || options->accepted_formats == 0 || (options->accepted_formats & format) != 0;
+}
+
+#ifdef HAVE_IMAGE_SCALING
+#include <limits.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <png.h>
+#include <jpeglib.h>
+
+// Area-averaging resampler. Source rows are pushed one at a time, so a JPEG
+// never has to be decoded into a full-size buffer.
+typedef struct {
+    int src_w, src_h, dst_w, dst_h, channels;
+    double y_scale;
+    int *x_first;       // First source column of each destination column
+    int *x_count;       // Source columns it covers
+    float *x_weights;   // x_count weights per destination column, summing to 1
+    int x_stride;       // Weights reserved per destination column
+    float *row;         // Current source row, resampled horizontally
+    float *acc;         // Destination row being accumulated
+    double acc_weight;
+    int src_y, dst_y;
+    unsigned char *dst; // dst_w * dst_h * channels
+} resampler_t;
+
+static void resampler_free(resampler_t *r) {
+    if (!r) return;
+    free(r->x_first); free(r->x_count); free(r->x_weights);
+    free(r->row); free(r->acc); free(r->dst);
+    free(r);
+}
+
+static resampler_t *resampler_create(int src_w, int src_h, int dst_w, int dst_h, int channels) {
+    resampler_t *r = calloc(1, sizeof(resampler_t));
+    if (!r) { perror("calloc resampler"); return NULL; }
+    r->src_w = src_w; r->src_h = src_h; r->dst_w = dst_w; r->dst_h = dst_h; r->channels = channels;
+    r->y_scale = (double)src_h / dst_h;
+    double x_scale = (double)src_w / dst_w;
+    r->x_stride = (int)x_scale + 2;
+    r->x_first = malloc(dst_w * sizeof(int));
+    r->x_count = malloc(dst_w * sizeof(int));
+    r->x_weights = malloc((size_t)dst_w * r->x_stride * sizeof(float));
+    r->row = malloc((size_t)dst_w * channels * sizeof(float));
+    r->acc = calloc((size_t)dst_w * channels, sizeof(float));
+    r->dst = malloc((size_t)dst_w * dst_h * channels);
+    if (!r->x_first || !r->x_count || !r->x_weights || !r->row || !r->acc || !r->dst) {
+        perror("malloc resampler"); resampler_free(r); return NULL;
+    }
+    for (int dx = 0; dx < dst_w; dx++) {
+        double left = dx * x_scale, right = left + x_scale;
+        int first = (int)left, count = 0;
+        float *w = r->x_weights + (size_t)dx * r->x_stride;
+        for (int sx = first; sx < src_w && sx < right && count < r->x_stride; sx++) {
+            double lo = sx > left ? sx : left, hi = sx + 1 < right ? sx + 1 : right;
+            w[count++] = (float)((hi - lo) / x_scale);
+        }
+        r->x_first[dx] = first;
+        r->x_count[dx] = count;
+    }
+    return r;
+}
+
+static void resampler_emit(resampler_t *r) {
+    unsigned char *out = r->dst + (size_t)r->dst_y * r->dst_w * r->channels;
+    size_t n = (size_t)r->dst_w * r->channels;
+    float inv = r->acc_weight > 0 ? (float)(1.0 / r->acc_weight) : 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        float v = r->acc[i] * inv + 0.5f;
+        out[i] = v >= 255.0f ? 255 : (unsigned char)v;
+        r->acc[i] = 0.0f;
+    }
+    r->acc_weight = 0.0;
+    r->dst_y++;
+}
+
+static void resampler_push_row(resampler_t *r, const unsigned char *src) {
+    int c = r->channels;
+    for (int dx = 0; dx < r->dst_w; dx++) {
+        const unsigned char *p = src + (size_t)r->x_first[dx] * c;
+        const float *w = r->x_weights + (size_t)dx * r->x_stride;
+        float sum[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < r->x_count[dx]; i++, p += c) {
+            for (int ch = 0; ch < c; ch++) sum[ch] += w[i] * p[ch];
+        }
+        for (int ch = 0; ch < c; ch++) r->row[dx * c + ch] = sum[ch];
+    }
+
+    // Spread the row over the destination rows it overlaps
+    double top = r->src_y, bottom = top + 1.0;
+    size_t n = (size_t)r->dst_w * c;
+    while (r->dst_y < r->dst_h) {
+        double dst_top = r->dst_y * r->y_scale, dst_bottom = dst_top + r->y_scale;
+        double w = (dst_bottom < bottom ? dst_bottom : bottom) - (dst_top > top ? dst_top : top);
+        if (w > 0) {
+            for (size_t i = 0; i < n; i++) r->acc[i] += (float)w * r->row[i];
+            r->acc_weight += w;
+        }
+        if (dst_bottom > bottom + 1e-9) break;
+        resampler_emit(r);
+    }
+    r->src_y++;
+    if (r->src_y == r->src_h) {
+        while (r->dst_y < r->dst_h) resampler_emit(r);
+    }
+}
+
+typedef struct {
+    unsigned char *pixels; // w * h * channels, RGB or RGBA
+    int w, h, channels;
+} image_pixels_t;
+
+// Takes the finished rows out of a resampler and frees the rest.
+static void resampler_take(resampler_t *r, image_pixels_t *img) {
+    img->pixels = r->dst;
+    img->w = r->dst_w;
+    img->h = r->dst_h;
+    img->channels = r->channels;
+    r->dst = NULL;
+    resampler_free(r);
+}
+
+// Fits the longer side to max_dimension, keeping the aspect ratio.
+static void fit_dimensions(int w, int h, int max_dimension, int *dst_w, int *dst_h) {
+    if (w >= h) {
+        *dst_w = max_dimension;
+        *dst_h = (int)((double)h * max_dimension / w + 0.5);
+    } else {
+        *dst_h = max_dimension;
+        *dst_w = (int)((double)w * max_dimension / h + 0.5);
+    }
+    if (*dst_w < 1) *dst_w = 1;
+    if (*dst_h < 1) *dst_h = 1;
+}
+
+// Brings fully decoded pixels within max_dimension. Takes ownership of `pixels`.
+static int fit_pixels(unsigned char *pixels, int w, int h, int channels, int max_dimension, image_pixels_t *img) {
+    if (w <= max_dimension && h <= max_dimension) {
+        img->pixels = pixels; img->w = w; img->h = h; img->channels = channels;
+        return 1;
+    }
+    int dst_w, dst_h;
+    fit_dimensions(w, h, max_dimension, &dst_w, &dst_h);
+    resampler_t *r = resampler_create(w, h, dst_w, dst_h, channels);
+    if (!r) { free(pixels); return -1; }
+    for (int y = 0; y < h; y++) resampler_push_row(r, pixels + (size_t)y * w * channels);
+    free(pixels);
+    resampler_take(r, img);
+    return 1;
+}
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+} jpeg_error_t;
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+    char msg[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, msg);
+    fprintf(stderr, "JPEG error: %s\n", msg);
+    longjmp(((jpeg_error_t *)cinfo->err)->jump, 1);
+}
+
+static void jpeg_silent_message(j_common_ptr cinfo) {
+    (void)cinfo;
+}
+
+static int encode_jpeg(const unsigned char *pixels, int w, int h, int quality, unsigned char **out, size_t *out_len) {
+    struct jpeg_compress_struct cinfo;
+    jpeg_error_t jerr;
+    unsigned char *volatile buf = NULL;
+    unsigned long buf_len = 0;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    if (setjmp(jerr.jump)) {
+        jpeg_destroy_compress(&cinfo);
+        free(buf);
+        return -1;
+    }
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, (unsigned char **)&buf, &buf_len);
+    cinfo.image_width = w;
+    cinfo.image_height = h;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality < 1 ? 1 : quality > 100 ? 100 : quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)(pixels + (size_t)cinfo.next_scanline * w * 3);
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    *out = buf;
+    *out_len = buf_len;
+    return 0;
+}
+
+static int encode_png(const unsigned char *pixels, int w, int h, int channels, unsigned char **out, size_t *out_len) {
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    image.width = w;
+    image.height = h;
+    image.format = channels == 4 ? PNG_FORMAT_RGBA : PNG_FORMAT_RGB;
+    png_alloc_size_t size = 0;
+    if (!png_image_write_to_memory(&image, NULL, &size, 0, pixels, 0, NULL)) {
+        fprintf(stderr, "PNG error: %s\n", image.message);
+        return -1;
+    }
+    unsigned char *buf = malloc(size);
+    if (!buf) { perror("malloc scaled png"); return -1; }
+    if (!png_image_write_to_memory(&image, buf, &size, 0, pixels, 0, NULL)) {
+        fprintf(stderr, "PNG error: %s\n", image.message);
+        free(buf); return -1;
+    }
+    *out = buf;
+    *out_len = size;
+    return 0;
+}
+
+// The decoders return 1 with *img set, 0 if the image should be left alone
+// (it fits and needs no conversion, or it can't be handled), -1 on error.
+
+static int scale_png(const unsigned char *data, size_t len, int max_dimension, bool convert, image_pixels_t *img) {
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_memory(&image, data, len)) {
+        fprintf(stderr, "PNG error: %s\n", image.message);
+        return -1;
+    }
+    int w = (int)image.width, h = (int)image.height;
+    if ((!convert && w <= max_dimension && h <= max_dimension) || (size_t)w * h > IMAGE_SCALE_MAX_PIXELS) {
+        png_image_free(&image);
+        return 0;
+    }
+    image.format = (image.format & PNG_FORMAT_FLAG_ALPHA) ? PNG_FORMAT_RGBA : PNG_FORMAT_RGB;
+    int channels = PNG_IMAGE_PIXEL_CHANNELS(image.format);
+    unsigned char *pixels = malloc(PNG_IMAGE_SIZE(image));
+    if (!pixels) { perror("malloc png pixels"); png_image_free(&image); return -1; }
+    if (!png_image_finish_read(&image, NULL, pixels, 0, NULL)) {
+        fprintf(stderr, "PNG error: %s\n", image.message);
+        free(pixels); return -1;
+    }
+    return fit_pixels(pixels, w, h, channels, max_dimension, img);
+}
+
+// Decodes a JPEG straight into a resampler, letting libjpeg drop whole powers
+// of two in the DCT first so the large intermediate rows are never produced.
+static int scale_jpeg(const unsigned char *data, size_t len, int max_dimension, bool convert, image_pixels_t *img) {
+    struct jpeg_decompress_struct cinfo;
+    jpeg_error_t jerr;
+    resampler_t *volatile r = NULL;
+    unsigned char *volatile row = NULL;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    jerr.pub.output_message = jpeg_silent_message;
+    if (setjmp(jerr.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        resampler_free(r);
+        free(row);
+        return -1;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char *)data, (unsigned long)len);
+    jpeg_read_header(&cinfo, TRUE);
+    int w = (int)cinfo.image_width, h = (int)cinfo.image_height;
+    bool fits = w <= max_dimension && h <= max_dimension;
+    if ((!convert && fits) || (size_t)w * h > IMAGE_SCALE_MAX_PIXELS ||
+        cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK) {
+        jpeg_destroy_decompress(&cinfo);
+        return 0;
+    }
+    int dst_w = w, dst_h = h;
+    if (!fits) fit_dimensions(w, h, max_dimension, &dst_w, &dst_h);
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    for (int denom = 8; denom > 1; denom /= 2) {
+        if ((w + denom - 1) / denom >= dst_w && (h + denom - 1) / denom >= dst_h) {
+            cinfo.scale_denom = denom;
+            break;
+        }
+    }
+    jpeg_start_decompress(&cinfo);
+    r = resampler_create((int)cinfo.output_width, (int)cinfo.output_height, dst_w, dst_h, 3);
+    row = malloc((size_t)cinfo.output_width * cinfo.output_components);
+    if (!r || !row) longjmp(jerr.jump, 1);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW rows[1] = { row };
+        jpeg_read_scanlines(&cinfo, rows, 1);
+        resampler_push_row(r, row);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    free(row);
+    resampler_take(r, img);
+    return 1;
+}
+
+static uint32_t read_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Decodes an uncompressed BMP: 8-bit paletted, 24-bit, or 32-bit with the
+// standard masks. RLE and the rarer bit depths are left alone.
+static int scale_bmp(const unsigned char *data, size_t len, int max_dimension, bool convert, image_pixels_t *img) {
+    if (len < 54) return -1;
+    size_t offset = read_le32(data + 10), header = read_le32(data + 14);
+    int32_t w = (int32_t)read_le32(data + 18), h = (int32_t)read_le32(data + 22);
+    int bpp = data[28] | data[29] << 8;
+    uint32_t compression = read_le32(data + 30);
+    bool top_down = h < 0;
+    if (header < 40 || header > len - 14 || w <= 0 || h == 0 || h == INT32_MIN) return -1;
+    if (top_down) h = -h;
+    if ((!convert && w <= max_dimension && h <= max_dimension) || (size_t)w * h > IMAGE_SCALE_MAX_PIXELS) return 0;
+
+    bool alpha = false;
+    if (compression == 3 && bpp == 32) {
+        // BI_BITFIELDS: the masks follow a 40-byte header and sit inside larger ones
+        if (len < 70) return -1;
+        if (read_le32(data + 54) != 0x00FF0000 || read_le32(data + 58) != 0x0000FF00 || read_le32(data + 62) != 0x000000FF) return 0;
+        alpha = header >= 56 && read_le32(data + 66) == 0xFF000000;
+    } else if (compression != 0 || (bpp != 8 && bpp != 24 && bpp != 32)) {
+        return 0;
+    }
+    const unsigned char *palette = data + 14 + header;
+    size_t colours = 0;
+    if (bpp == 8) {
+        colours = read_le32(data + 46);
+        if (colours == 0 || colours > 256) colours = 256;
+        if (colours * 4 > len - 14 - header) return -1;
+    }
+    size_t stride = ((size_t)w * bpp + 31) / 32 * 4;
+    if (offset > len || stride * h > len - offset) return -1;
+
+    int channels = alpha ? 4 : 3;
+    unsigned char *pixels = malloc((size_t)w * h * channels);
+    if (!pixels) { perror("malloc bmp pixels"); return -1; }
+    for (int y = 0; y < h; y++) {
+        // Rows are stored bottom-up unless the height is negative
+        const unsigned char *src = data + offset + stride * (top_down ? y : h - 1 - y);
+        unsigned char *dst = pixels + (size_t)y * w * channels;
+        for (int x = 0; x < w; x++, dst += channels) {
+            const unsigned char *p = bpp == 8 ? palette + (src[x] < colours ? src[x] : 0) * 4 : src + (size_t)x * (bpp / 8);
+            dst[0] = p[2]; dst[1] = p[1]; dst[2] = p[0];
+            if (alpha) dst[3] = p[3];
+        }
+    }
+    return fit_pixels(pixels, w, h, channels, max_dimension, img);
+}
+
+// Encodes in every format the provider takes and keeps the smallest. Photos
+// usually win as JPEG and screenshots as PNG; JPEG can't carry transparency.
+static int encode_smallest(const image_pixels_t *img, const image_scale_options_t *options,
+                           unsigned char **out, size_t *out_len, const char **out_mime_type) {
+    unsigned char *best = NULL, *png = NULL;
+    size_t best_len = 0, png_len = 0;
+    const char *best_mime = NULL;
+    if (img->channels == 3 && image_scale_accepts(options, IMAGE_FORMAT_JPEG) &&
+        encode_jpeg(img->pixels, img->w, img->h, options->jpeg_quality, &best, &best_len) == 0) {
+        best_mime = "image/jpeg";
+    }
+    if (image_scale_accepts(options, IMAGE_FORMAT_PNG) &&
+        encode_png(img->pixels, img->w, img->h, img->channels, &png, &png_len) == 0) {
+        if (!best || png_len < best_len) {
+            free(best);
+            best = png; best_len = png_len; best_mime = "image/png";
+        } else {
+            free(png);
+        }
+    }
+    if (!best) return -1;
+    *out = best;
+    *out_len = best_len;
+    *out_mime_type = best_mime;
+    return 0;
+}
+
+bool image_scale_available() {
+    return true;
+}
+
+int image_scale(const unsigned char *data, size_t len, const char *mime_type, const image_scale_options_t *options,
+                unsigned char **out, size_t *out_len, const char **out_mime_type) {
+    if (!options || !mime_type) return 0;
+    image_format_t format = image_format_from_mime_type(mime_type);
+    bool convert = !image_scale_accepts(options, format);
+    if (!convert && options->max_dimension <= 0) return 0;
+    int max_dimension = options->max_dimension > 0 ? options->max_dimension : INT_MAX;
+    image_pixels_t img = { NULL, 0, 0, 0 };
+    int status;
+    if (format == IMAGE_FORMAT_PNG) status = scale_png(data, len, max_dimension, convert, &img);
+    else if (format == IMAGE_FORMAT_JPEG) status = scale_jpeg(data, len, max_dimension, convert, &img);
+    else if (format == IMAGE_FORMAT_BMP) status = scale_bmp(data, len, max_dimension, convert, &img);
+    else return 0;
+    if (status <= 0) return status;
+
+    unsigned char *encoded = NULL;
+    size_t encoded_len = 0;
+    const char *encoded_mime = NULL;
+    status = encode_smallest(&img, options, &encoded, &encoded_len, &encoded_mime);
+    free(img.pixels);
+    if (status != 0) return -1;
+    // Resampling can't make a well-compressed image much smaller; keep the original then
+    if (!convert && encoded_len >= len) { free(encoded); return 0; }
+    *out = encoded;
+    *out_len = encoded_len;
+    *out_mime_type = encoded_mime;
+    return 1;
+}
+
+#else
+
+bool image_scale_available() {
+    return false;
+}
+
+int image_scale(const unsigned char *data, size_t len, const char *mime_type, const image_scale_options_t *options,
+                unsigned char **out, size_t *out_len, const char **out_mime_type) {
+    return 0;
+}
+
+#endif /* HAVE_IMAGE_SCALING */
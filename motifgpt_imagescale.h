@@ -0,0 +1,52 @@
+#ifndef MOTIFGPT_IMAGESCALE_H
+#define MOTIFGPT_IMAGESCALE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "utils.h"
+
+#define IMAGE_SCALE_DEFAULT_QUALITY 85
+#define IMAGE_SCALE_MAX_PIXELS (64 * 1024 * 1024) // Larger images are sent as they are
+
+/**
+ * How an attachment is prepared for a provider. Images whose longer side is
+ * above `max_dimension`, or whose format is not in `accepted_formats`, are
+ * decoded, resampled to fit and re-encoded in whichever accepted format comes
+ * out smallest: JPEG at `jpeg_quality` or PNG, which also keeps transparency.
+ */
+typedef struct {
+    int max_dimension;             // 0 sends images at full size
+    int jpeg_quality;              // 1-100
+    unsigned int accepted_formats; // image_format_t bits; 0 accepts every format
+} image_scale_options_t;
+
+/**
+ * @return true if MotifGPT was built with libpng and libjpeg, so images can be scaled.
+ */
+bool image_scale_available();
+
+/**
+ * @param options The provider's options, or NULL.
+ * @param format An image format.
+ * @return true if the provider takes the format as it is.
+ */
+bool image_scale_accepts(const image_scale_options_t *options, image_format_t format);
+
+/**
+ * Downscales an image if it is larger than the options allow, and converts it
+ * if its format is not accepted. PNG, JPEG and BMP can be decoded; other types
+ * are left alone, so callers must still check image_scale_accepts() when this
+ * does not return 1. Safe to call from any thread.
+ * @param data The encoded image.
+ * @param len Its length.
+ * @param mime_type Its MIME type, as returned by get_image_mime_type().
+ * @param options The limits to apply.
+ * @param out Receives the re-encoded image, to be freed by the caller.
+ * @param out_len Receives its length.
+ * @param out_mime_type Receives its MIME type, a static string.
+ * @return 1 if the image was re-encoded, 0 if it should be sent as is, -1 if it could not be decoded.
+ */
+int image_scale(const unsigned char *data, size_t len, const char *mime_type, const image_scale_options_t *options,
+                unsigned char **out, size_t *out_len, const char **out_mime_type);
+
+#endif /* MOTIFGPT_IMAGESCALE_H */
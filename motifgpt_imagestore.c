@@ -0,0 +1,189 @@
+#include "motifgpt_imagestore.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define IMAGE_STORE_DIR_MODE 0755
+#define IMAGE_STORE_TEMP_SUFFIX_SIZE 48 // ".<pid>.<counter>.tmp" with 64-bit numbers, plus the NUL
+// Room for the directory, a slash and a key, and then for the temporary suffix
+#define IMAGE_STORE_ENTRY_PATH_SIZE (PATH_MAX + IMAGE_STORE_KEY_SIZE)
+#define IMAGE_STORE_TEMP_PATH_SIZE (IMAGE_STORE_ENTRY_PATH_SIZE + IMAGE_STORE_TEMP_SUFFIX_SIZE)
+
+static char store_dir[PATH_MAX] = "";
+static unsigned long temp_counter = 0;
+
+// SHA-256 as specified in FIPS 180-4.
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    size_t block_len;
+} sha256_t;
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_compress(uint32_t state[8], const unsigned char *block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16) | ((uint32_t)block[4 * i + 2] << 8) | block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static void sha256_init(sha256_t *ctx) {
+    static const uint32_t initial[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0; ctx->block_len = 0;
+}
+
+static void sha256_update(sha256_t *ctx, const unsigned char *data, size_t len) {
+    ctx->length += len;
+    if (ctx->block_len > 0) {
+        size_t take = 64 - ctx->block_len < len ? 64 - ctx->block_len : len;
+        memcpy(ctx->block + ctx->block_len, data, take);
+        ctx->block_len += take; data += take; len -= take;
+        if (ctx->block_len < 64) return;
+        sha256_compress(ctx->state, ctx->block);
+        ctx->block_len = 0;
+    }
+    for (; len >= 64; data += 64, len -= 64) sha256_compress(ctx->state, data);
+    memcpy(ctx->block, data, len);
+    ctx->block_len = len;
+}
+
+static void sha256_final(sha256_t *ctx, unsigned char digest[32]) {
+    uint64_t bits = ctx->length * 8;
+    unsigned char pad = 0x80;
+    sha256_update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->block_len != 56) sha256_update(ctx, &pad, 1);
+    unsigned char length_be[8];
+    for (int i = 0; i < 8; i++) length_be[i] = (unsigned char)(bits >> (56 - 8 * i));
+    sha256_update(ctx, length_be, 8);
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = (unsigned char)(ctx->state[i] >> 24); digest[4 * i + 1] = (unsigned char)(ctx->state[i] >> 16);
+        digest[4 * i + 2] = (unsigned char)(ctx->state[i] >> 8); digest[4 * i + 3] = (unsigned char)ctx->state[i];
+    }
+}
+
+void image_store_hash(const void *data, size_t len, char key[IMAGE_STORE_KEY_SIZE]) {
+    static const char hex[] = "0123456789abcdef";
+    sha256_t ctx;
+    unsigned char digest[32];
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, digest);
+    for (int i = 0; i < 32; i++) { key[2 * i] = hex[digest[i] >> 4]; key[2 * i + 1] = hex[digest[i] & 0xF]; }
+    key[64] = '\0';
+}
+
+int image_store_init(const char *dir) {
+    store_dir[0] = '\0';
+    // Every path in the store, temporary ones included, must fit in PATH_MAX
+    if (!dir || !dir[0] || strlen(dir) + 1 + IMAGE_STORE_KEY_SIZE + IMAGE_STORE_TEMP_SUFFIX_SIZE > sizeof(store_dir)) return -1;
+    if (mkdir(dir, IMAGE_STORE_DIR_MODE) == -1 && errno != EEXIST) {
+        perror("mkdir image store"); return -1;
+    }
+    snprintf(store_dir, sizeof(store_dir), "%s", dir);
+    return 0;
+}
+
+static bool image_store_path(char path[IMAGE_STORE_ENTRY_PATH_SIZE], const char *key) {
+    if (!store_dir[0] || strlen(key) != IMAGE_STORE_KEY_SIZE - 1) return false;
+    return snprintf(path, IMAGE_STORE_ENTRY_PATH_SIZE, "%s/%s", store_dir, key) < IMAGE_STORE_ENTRY_PATH_SIZE;
+}
+
+// Makes a rename in the store survive a crash.
+static int image_store_sync_dir() {
+    int fd = open(store_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) { perror("open image store"); return -1; }
+    int result = fsync(fd);
+    if (result == -1) perror("fsync image store");
+    close(fd);
+    return result;
+}
+
+int image_store_put(const char *data, size_t len, char key[IMAGE_STORE_KEY_SIZE]) {
+    if (len == 0) return -1; // No image is empty, and load() treats an empty entry as damaged
+    image_store_hash(data, len, key);
+    char path[IMAGE_STORE_ENTRY_PATH_SIZE];
+    if (!image_store_path(path, key)) return -1;
+    struct stat st;
+    if (stat(path, &st) == 0 && (size_t)st.st_size == len) return 0; // Already stored
+
+    // Write under a private name, sync and rename, so neither readers nor a
+    // journal replayed after a crash ever see a partial entry.
+    char temp_path[IMAGE_STORE_TEMP_PATH_SIZE];
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.%lu.tmp", path, (long)getpid(), __atomic_add_fetch(&temp_counter, 1, __ATOMIC_RELAXED));
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd == -1) { perror("open image store entry"); return -1; }
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(fd, data + written, len - written);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) { perror("write image store entry"); close(fd); unlink(temp_path); return -1; }
+        written += (size_t)n;
+    }
+    bool synced = fdatasync(fd) == 0;
+    if (close(fd) == -1 || !synced || rename(temp_path, path) == -1) {
+        perror("store image entry"); unlink(temp_path); return -1;
+    }
+    return image_store_sync_dir();
+}
+
+char *image_store_load(const char *key, size_t *len) {
+    char path[IMAGE_STORE_ENTRY_PATH_SIZE];
+    if (!image_store_path(path, key)) return NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) { fprintf(stderr, "Image %s is missing from the store.\n", key); return NULL; }
+    struct stat st;
+    if (fstat(fd, &st) == -1) { close(fd); return NULL; }
+    size_t size = (size_t)st.st_size;
+    if (size == 0) { fprintf(stderr, "Image %s is empty in the store.\n", key); close(fd); return NULL; }
+    char *data = malloc(size + 1);
+    if (!data) { perror("malloc image store entry"); close(fd); return NULL; }
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = read(fd, data + got, size - got);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) { perror("read image store entry"); close(fd); free(data); return NULL; }
+        got += (size_t)n;
+    }
+    close(fd);
+    data[size] = '\0';
+    if (len) *len = size;
+    return data;
+}
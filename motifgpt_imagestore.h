@@ -0,0 +1,51 @@
+#ifndef MOTIFGPT_IMAGESTORE_H
+#define MOTIFGPT_IMAGESTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IMAGE_STORE_KEY_SIZE 65 // Hex SHA-256 plus the terminating NUL
+#define IMAGE_STORE_SUBDIR "images"
+
+/**
+ * Content-addressed store for attached images. Each image's Base64 text is
+ * written once to a file named after its SHA-256, so history only needs to
+ * carry the key and identical images share one file.
+ */
+
+/**
+ * Points the store at a directory, creating it if needed. Call once at
+ * startup, before any other thread uses the store.
+ * @param dir The directory, e.g. the cache directory plus IMAGE_STORE_SUBDIR.
+ * @return 0 on success, -1 if the directory cannot be used; the store then refuses puts.
+ */
+int image_store_init(const char *dir);
+
+/**
+ * Computes the key for some data.
+ * @param data The bytes to hash.
+ * @param len Their length.
+ * @param key Receives the lowercase hex SHA-256.
+ */
+void image_store_hash(const void *data, size_t len, char key[IMAGE_STORE_KEY_SIZE]);
+
+/**
+ * Stores data under its key unless it is already there. The entry is synced
+ * to disk before this returns, so anything recorded with the key afterwards
+ * can rely on it. Safe to call from any thread.
+ * @param data The Base64 text.
+ * @param len Its length.
+ * @param key Receives the key.
+ * @return 0 on success, -1 on failure or if `len` is 0.
+ */
+int image_store_put(const char *data, size_t len, char key[IMAGE_STORE_KEY_SIZE]);
+
+/**
+ * Reads an entry back. Safe to call from any thread.
+ * @param key The key returned by image_store_put().
+ * @param len Receives the length, excluding the terminating NUL; may be NULL.
+ * @return The NUL-terminated data, to be freed by the caller, or NULL if it is missing or empty.
+ */
+char *image_store_load(const char *key, size_t *len);
+
+#endif /* MOTIFGPT_IMAGESTORE_H */
@@ -0,0 +1,338 @@
+#include "motifgpt_journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+// journal_fd, journal_records and journal_size are only changed by the UI
+// thread; the lock is for the syncer, which reads the fd and the dirty time.
+static pthread_mutex_t journal_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t journal_cond;
+static int journal_fd = -1;
+static char journal_path[PATH_MAX];
+static size_t journal_records = 0;
+static off_t journal_size = 0;
+static uint64_t dirty_since_ns = 0; // When the oldest unsynced record was written; 0 if none
+static bool syncer_running = false;
+static pthread_t syncer_tid;
+
+static uint64_t now_ns() {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t journal_checksum(const unsigned char *data, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) { hash ^= data[i]; hash *= 16777619u; }
+    return hash;
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n; len -= (size_t)n;
+    }
+    return 0;
+}
+
+static unsigned char *put_u32(unsigned char *p, uint32_t v) { memcpy(p, &v, 4); return p + 4; }
+
+static unsigned char *put_bytes(unsigned char *p, const void *data, uint32_t len) {
+    p = put_u32(p, len);
+    if (len) memcpy(p, data, len);
+    return p + len;
+}
+
+// Encodes one message as a whole record, header included.
+static unsigned char *journal_encode(const dp_message_t *message, const history_image_ref_t *images, size_t num_images, size_t *out_len) {
+    size_t text_len = 0;
+    for (size_t k = 0; k < message->num_parts; k++) {
+        if (message->parts[k].type == DP_CONTENT_PART_TEXT && message->parts[k].text) text_len += strlen(message->parts[k].text);
+    }
+    size_t payload = 12 + text_len;
+    for (size_t k = 0; k < num_images; k++) {
+        const char *ref = images[k].key[0] ? images[k].key : images[k].data;
+        payload += 12 + strlen(images[k].mime_type) + (ref ? strlen(ref) : 0);
+    }
+    if (payload > UINT32_MAX) { fprintf(stderr, "Message too large to journal.\n"); return NULL; }
+    unsigned char *record = malloc(8 + payload);
+    if (!record) { perror("malloc journal record"); return NULL; }
+
+    unsigned char *p = put_u32(record + 8, (uint32_t)message->role);
+    p = put_u32(p, (uint32_t)text_len);
+    for (size_t k = 0; k < message->num_parts; k++) {
+        if (message->parts[k].type != DP_CONTENT_PART_TEXT || !message->parts[k].text) continue;
+        size_t len = strlen(message->parts[k].text);
+        memcpy(p, message->parts[k].text, len);
+        p += len;
+    }
+    p = put_u32(p, (uint32_t)num_images);
+    for (size_t k = 0; k < num_images; k++) {
+        const char *ref = images[k].key[0] ? images[k].key : images[k].data;
+        p = put_u32(p, images[k].key[0] ? 0 : 1);
+        p = put_bytes(p, images[k].mime_type, (uint32_t)strlen(images[k].mime_type));
+        p = put_bytes(p, ref, ref ? (uint32_t)strlen(ref) : 0);
+    }
+    put_u32(record, (uint32_t)payload);
+    put_u32(record + 4, journal_checksum(record + 8, payload));
+    *out_len = 8 + payload;
+    return record;
+}
+
+static void journal_mark_dirty() {
+    if (!syncer_running) { fdatasync(journal_fd); return; }
+    pthread_mutex_lock(&journal_mutex);
+    if (!dirty_since_ns) {
+        dirty_since_ns = now_ns();
+        pthread_cond_signal(&journal_cond);
+    }
+    pthread_mutex_unlock(&journal_mutex);
+}
+
+// Replaces the journal with one record per message now in the history.
+static int journal_rewrite() {
+    history_snapshot_t *snapshot = history_snapshot_acquire();
+    if (!snapshot) return -1;
+    char temp_path[PATH_MAX + 8];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", journal_path);
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (fd == -1) { perror("open journal"); history_snapshot_release(snapshot); return -1; }
+    int status = write_all(fd, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE);
+    off_t size = JOURNAL_MAGIC_SIZE;
+    for (size_t i = 0; i < snapshot->count && status == 0; i++) {
+        const dp_message_t *m = &snapshot->messages[i];
+        size_t num_images = 0;
+        for (size_t k = 0; k < m->num_parts; k++) if (m->parts[k].type == DP_CONTENT_PART_IMAGE_BASE64) num_images++;
+        size_t len;
+        unsigned char *record = journal_encode(m, snapshot->images ? snapshot->images[i] : NULL, snapshot->images ? num_images : 0, &len);
+        status = record ? write_all(fd, record, len) : -1;
+        size += (off_t)len;
+        free(record);
+    }
+    if (status == 0 && fdatasync(fd) != 0) status = -1;
+    if (status == 0 && rename(temp_path, journal_path) != 0) status = -1;
+    if (status != 0) {
+        perror("rewrite journal");
+        close(fd); unlink(temp_path);
+        history_snapshot_release(snapshot);
+        return -1;
+    }
+    pthread_mutex_lock(&journal_mutex);
+    close(journal_fd);
+    journal_fd = fd;
+    dirty_since_ns = 0;
+    pthread_mutex_unlock(&journal_mutex);
+    journal_records = snapshot->count;
+    journal_size = size;
+    history_snapshot_release(snapshot);
+    return 0;
+}
+
+static void journal_append(const dp_message_t *message, const history_image_ref_t *images, size_t num_images) {
+    if (journal_fd == -1) return;
+    // Evicted messages would otherwise pile up; the rewrite includes this message
+    if (journal_records + 1 > 2 * (size_t)chat_history_count + JOURNAL_COMPACT_SLACK && journal_rewrite() == 0) return;
+    size_t len;
+    unsigned char *record = journal_encode(message, images, num_images, &len);
+    if (!record) return;
+    if (write_all(journal_fd, record, len) != 0) {
+        perror("write journal");
+        // Cut off a partial record so later ones still replay
+        if (ftruncate(journal_fd, journal_size) != 0) perror("ftruncate journal");
+    } else {
+        journal_records++;
+        journal_size += (off_t)len;
+        journal_mark_dirty();
+    }
+    free(record);
+}
+
+static void *journal_syncer_main(void *arg) {
+    pthread_mutex_lock(&journal_mutex);
+    while (syncer_running) {
+        if (!dirty_since_ns) { pthread_cond_wait(&journal_cond, &journal_mutex); continue; }
+        uint64_t due = dirty_since_ns + (uint64_t)JOURNAL_SYNC_INTERVAL_MS * 1000000ULL;
+        if (now_ns() < due) {
+            struct timespec deadline = { (time_t)(due / 1000000000ULL), (long)(due % 1000000000ULL) };
+            pthread_cond_timedwait(&journal_cond, &journal_mutex, &deadline);
+            continue;
+        }
+        // Sync a duplicate so the UI thread can swap or close the journal meanwhile
+        int fd = journal_fd == -1 ? -1 : dup(journal_fd);
+        dirty_since_ns = 0;
+        pthread_mutex_unlock(&journal_mutex);
+        if (fd != -1) { if (fdatasync(fd) != 0) perror("fdatasync journal"); close(fd); }
+        pthread_mutex_lock(&journal_mutex);
+    }
+    pthread_mutex_unlock(&journal_mutex);
+    return NULL;
+}
+
+static uint32_t get_u32(const unsigned char *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+// Takes `len` bytes from the payload cursor; NULL if they run past its end.
+static const unsigned char *take(const unsigned char **p, const unsigned char *end, size_t len) {
+    if ((size_t)(end - *p) < len) return NULL;
+    const unsigned char *start = *p;
+    *p += len;
+    return start;
+}
+
+static const unsigned char *take_bytes(const unsigned char **p, const unsigned char *end, uint32_t *len) {
+    const unsigned char *field = take(p, end, 4);
+    if (!field) return NULL;
+    *len = get_u32(field);
+    return take(p, end, *len);
+}
+
+// Adds one record's message to the history; -1 if the payload does not parse.
+static int journal_replay_record(const unsigned char *p, const unsigned char *end) {
+    const unsigned char *field = take(&p, end, 4);
+    uint32_t text_len, num_images;
+    if (!field) return -1;
+    dp_message_role_t role = (dp_message_role_t)get_u32(field);
+    const unsigned char *text = take_bytes(&p, end, &text_len);
+    if (!text || !(field = take(&p, end, 4))) return -1;
+    num_images = get_u32(field);
+    if (num_images > (size_t)(end - p) / 12) return -1;
+    history_image_ref_t *images = calloc(num_images ? num_images : 1, sizeof(history_image_ref_t));
+    char *text_copy = malloc(text_len + 1);
+    int status = images && text_copy ? 0 : -1;
+    size_t k = 0;
+    for (; k < num_images && status == 0; k++) {
+        uint32_t mime_len, ref_len;
+        const unsigned char *kind = take(&p, end, 4);
+        const unsigned char *mime = kind ? take_bytes(&p, end, &mime_len) : NULL;
+        const unsigned char *ref = mime ? take_bytes(&p, end, &ref_len) : NULL;
+        if (!ref) { status = -1; break; }
+        snprintf(images[k].mime_type, sizeof(images[k].mime_type), "%.*s", (int)(mime_len < HISTORY_MIME_BUF_SIZE ? mime_len : HISTORY_MIME_BUF_SIZE - 1), (const char *)mime);
+        if (get_u32(kind) == 0) {
+            snprintf(images[k].key, sizeof(images[k].key), "%.*s", (int)(ref_len < IMAGE_STORE_KEY_SIZE ? ref_len : IMAGE_STORE_KEY_SIZE - 1), (const char *)ref);
+        } else if ((images[k].data = malloc(ref_len + 1))) {
+            memcpy(images[k].data, ref, ref_len);
+            images[k].data[ref_len] = '\0';
+        } else {
+            status = -1;
+        }
+    }
+    if (status == 0) {
+        memcpy(text_copy, text, text_len);
+        text_copy[text_len] = '\0';
+        // History takes over the image data
+        add_image_message_to_history(role, text_len || role == DP_ROLE_ASSISTANT ? text_copy : NULL, images, num_images);
+    } else if (images) {
+        while (k-- > 0) free(images[k].data);
+    }
+    free(text_copy);
+    free(images);
+    return status;
+}
+
+// Reads the whole journal, replays its records and returns where the good ones end.
+static off_t journal_replay(int fd, size_t *records) {
+    struct stat st;
+    *records = 0;
+    if (fstat(fd, &st) != 0 || st.st_size < JOURNAL_MAGIC_SIZE) return 0;
+    unsigned char *data = malloc((size_t)st.st_size);
+    if (!data) { perror("malloc journal"); return 0; }
+    size_t have = 0;
+    while (have < (size_t)st.st_size) {
+        ssize_t n = pread(fd, data + have, (size_t)st.st_size - have, (off_t)have);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        have += (size_t)n;
+    }
+    size_t offset = 0;
+    if (have >= JOURNAL_MAGIC_SIZE && memcmp(data, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE) == 0) {
+        offset = JOURNAL_MAGIC_SIZE;
+        while (have - offset >= 8) {
+            uint32_t len = get_u32(data + offset), checksum = get_u32(data + offset + 4);
+            // A crash mid-append leaves a short or mismatched record at the end
+            if (have - offset - 8 < len || journal_checksum(data + offset + 8, len) != checksum) break;
+            if (journal_replay_record(data + offset + 8, data + offset + 8 + len) != 0) break;
+            offset += 8 + len;
+            (*records)++;
+        }
+    }
+    free(data);
+    return (off_t)offset;
+}
+
+int journal_open(const char *path) {
+    if (journal_fd != -1) return -1;
+    snprintf(journal_path, sizeof(journal_path), "%s", path);
+    int fd = open(journal_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd == -1) { perror("open journal"); return -1; }
+    int before = chat_history_count;
+    journal_size = journal_replay(fd, &journal_records);
+    int recovered = chat_history_count - before;
+    // Drop the torn tail, or start a fresh journal
+    if (journal_size == 0 && (ftruncate(fd, 0) != 0 || write_all(fd, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE) != 0)) {
+        perror("initialize journal"); close(fd); return -1;
+    }
+    if (journal_size == 0) journal_size = JOURNAL_MAGIC_SIZE;
+    else if (ftruncate(fd, journal_size) != 0) perror("ftruncate journal");
+    journal_fd = fd;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&journal_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    syncer_running = true;
+    if (pthread_create(&syncer_tid, NULL, journal_syncer_main, NULL) != 0) {
+        perror("pthread_create journal syncer");
+        syncer_running = false; // Appends then sync as they go
+    }
+    if (journal_records > 2 * (size_t)chat_history_count + JOURNAL_COMPACT_SLACK) journal_rewrite();
+    history_set_append_hook(journal_append);
+    return recovered;
+}
+
+void journal_reset() {
+    if (journal_fd == -1) return;
+    if (ftruncate(journal_fd, 0) != 0 || write_all(journal_fd, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE) != 0) perror("reset journal");
+    journal_records = 0;
+    journal_size = JOURNAL_MAGIC_SIZE;
+    journal_mark_dirty();
+}
+
+void journal_sync() {
+    if (journal_fd == -1) return;
+    pthread_mutex_lock(&journal_mutex);
+    dirty_since_ns = 0;
+    pthread_mutex_unlock(&journal_mutex);
+    if (fdatasync(journal_fd) != 0) perror("fdatasync journal");
+}
+
+void journal_close(bool discard) {
+    if (journal_fd == -1) return;
+    history_set_append_hook(NULL);
+    pthread_mutex_lock(&journal_mutex);
+    bool was_running = syncer_running;
+    syncer_running = false;
+    if (was_running) pthread_cond_signal(&journal_cond);
+    pthread_mutex_unlock(&journal_mutex);
+    if (was_running) pthread_join(syncer_tid, NULL);
+    pthread_cond_destroy(&journal_cond);
+    if (discard) unlink(journal_path);
+    else journal_sync();
+    close(journal_fd);
+    journal_fd = -1;
+    journal_records = 0;
+    dirty_since_ns = 0;
+}
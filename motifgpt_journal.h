@@ -0,0 +1,57 @@
+#ifndef MOTIFGPT_JOURNAL_H
+#define MOTIFGPT_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "motifgpt_history.h"
+
+#define JOURNAL_FILE_NAME "session.journal" // In the cache directory
+#define JOURNAL_MAGIC "MGPTJNL1"
+#define JOURNAL_MAGIC_SIZE 8
+#define JOURNAL_SYNC_INTERVAL_MS 500 // How long an appended message may wait for fdatasync()
+#define JOURNAL_COMPACT_SLACK 64     // Records beyond twice the history before the journal is rewritten
+
+/**
+ * Write-ahead journal of the live conversation, so a crash loses at most the
+ * last JOURNAL_SYNC_INTERVAL_MS of it. Every message added to the history is
+ * appended as one checksummed record, costing O(message) however long the
+ * conversation is; a syncer thread batches the fdatasync() calls. Once
+ * eviction leaves the journal holding many more messages than the history,
+ * it is rewritten from a snapshot. Images in the image store are recorded by
+ * key only.
+ *
+ * Records are a u32 payload length, a u32 FNV-1a checksum of the payload and
+ * the payload: u32 role, u32 text length and text, u32 image count, then per
+ * image a u32 kind (0 store key, 1 Base64 data), u32 MIME length and MIME,
+ * u32 length and the key or data. The journal never leaves this machine, so
+ * values are in host byte order.
+ *
+ * Everything but the syncer runs on the UI thread.
+ */
+
+/**
+ * Replays the journal left by a session that did not exit cleanly into the
+ * history, drops any torn record at its end, and starts journaling.
+ * @param path The journal file; created if missing.
+ * @return How many messages were recovered, or -1 if the journal cannot be used.
+ */
+int journal_open(const char *path);
+
+/**
+ * Empties the journal, for when the conversation is cleared or replaced.
+ * Messages added afterwards are journaled as usual.
+ */
+void journal_reset();
+
+/**
+ * Writes out anything not yet synced and waits for it to reach the disk.
+ */
+void journal_sync();
+
+/**
+ * Stops journaling.
+ * @param discard true to delete the journal, on a clean exit; false to keep it for the next journal_open().
+ */
+void journal_close(bool discard);
+
+#endif /* MOTIFGPT_JOURNAL_H */
@@ -0,0 +1,251 @@
+#include "motifgpt_json.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void json_sax_init(json_sax_t *p, const json_sax_callbacks_t *callbacks, void *user_data) {
+    memset(p, 0, sizeof(json_sax_t));
+    p->callbacks = callbacks;
+    p->user_data = user_data;
+    p->expect = JSON_EXPECT_VALUE;
+    p->lex = JSON_LEX_NONE;
+}
+
+void json_sax_free(json_sax_t *p) {
+    free(p->token);
+    p->token = NULL;
+    p->token_len = p->token_cap = 0;
+}
+
+static int json_sax_fail(json_sax_t *p) {
+    p->failed = true;
+    return -1;
+}
+
+// Makes room for `len` more bytes plus a terminating NUL.
+static int json_sax_reserve(json_sax_t *p, size_t len) {
+    if (p->token_len + len + 1 <= p->token_cap) return 0;
+    size_t cap = p->token_cap ? p->token_cap : 256;
+    while (cap < p->token_len + len + 1) cap *= 2;
+    char *token = realloc(p->token, cap);
+    if (!token) { perror("realloc json token"); return -1; }
+    p->token = token;
+    p->token_cap = cap;
+    return 0;
+}
+
+static int json_sax_append_raw(json_sax_t *p, const char *data, size_t len) {
+    if (json_sax_reserve(p, len) != 0) return -1;
+    memcpy(p->token + p->token_len, data, len);
+    p->token_len += len;
+    return 0;
+}
+
+static int json_sax_append_codepoint(json_sax_t *p, unsigned int cp) {
+    char utf8[4];
+    size_t n;
+    if (cp < 0x80) { utf8[0] = (char)cp; n = 1; }
+    else if (cp < 0x800) { utf8[0] = (char)(0xC0 | cp >> 6); utf8[1] = (char)(0x80 | (cp & 0x3F)); n = 2; }
+    else if (cp < 0x10000) {
+        utf8[0] = (char)(0xE0 | cp >> 12); utf8[1] = (char)(0x80 | ((cp >> 6) & 0x3F)); utf8[2] = (char)(0x80 | (cp & 0x3F)); n = 3;
+    } else {
+        utf8[0] = (char)(0xF0 | cp >> 18); utf8[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((cp >> 6) & 0x3F)); utf8[3] = (char)(0x80 | (cp & 0x3F)); n = 4;
+    }
+    return json_sax_append_raw(p, utf8, n);
+}
+
+// A high surrogate not followed by its low half becomes U+FFFD.
+static int json_sax_flush_surrogate(json_sax_t *p) {
+    if (!p->high_surrogate) return 0;
+    p->high_surrogate = 0;
+    return json_sax_append_codepoint(p, 0xFFFD);
+}
+
+static int json_sax_append(json_sax_t *p, const char *data, size_t len) {
+    if (json_sax_flush_surrogate(p) != 0) return -1;
+    return json_sax_append_raw(p, data, len);
+}
+
+static int json_sax_unicode_done(json_sax_t *p) {
+    unsigned int cp = p->unicode;
+    if (cp >= 0xDC00 && cp <= 0xDFFF && p->high_surrogate) {
+        cp = 0x10000 + ((p->high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+        p->high_surrogate = 0;
+        return json_sax_append_codepoint(p, cp);
+    }
+    if (json_sax_flush_surrogate(p) != 0) return -1;
+    if (cp >= 0xD800 && cp <= 0xDBFF) { p->high_surrogate = cp; return 0; }
+    return json_sax_append_codepoint(p, cp >= 0xDC00 && cp <= 0xDFFF ? 0xFFFD : cp);
+}
+
+static void json_sax_value_done(json_sax_t *p) {
+    p->expect = p->depth == 0 ? JSON_EXPECT_NOTHING : JSON_EXPECT_COMMA_OR_END;
+}
+
+static int json_sax_string_done(json_sax_t *p) {
+    if (json_sax_flush_surrogate(p) != 0 || json_sax_reserve(p, 0) != 0) return -1;
+    p->token[p->token_len] = '\0';
+    const json_sax_callbacks_t *cb = p->callbacks;
+    int (*fn)(void *, const char *, size_t) = p->string_is_key ? cb->key : cb->string;
+    if (fn && fn(p->user_data, p->token ? p->token : "", p->token_len) != 0) return -1;
+    p->token_len = 0;
+    if (p->string_is_key) p->expect = JSON_EXPECT_COLON;
+    else json_sax_value_done(p);
+    return 0;
+}
+
+static int json_sax_scalar_done(json_sax_t *p) {
+    p->token[p->token_len] = '\0';
+    const char *s = p->token;
+    bool number = s[0] == '-' || (s[0] >= '0' && s[0] <= '9');
+    if (!number && strcmp(s, "true") != 0 && strcmp(s, "false") != 0 && strcmp(s, "null") != 0) return -1;
+    if (p->callbacks->scalar && p->callbacks->scalar(p->user_data, s, p->token_len) != 0) return -1;
+    p->token_len = 0;
+    json_sax_value_done(p);
+    return 0;
+}
+
+static bool json_sax_expects_value(const json_sax_t *p) {
+    return p->expect == JSON_EXPECT_VALUE || p->expect == JSON_EXPECT_VALUE_OR_END;
+}
+
+// Handles one character outside any token.
+static int json_sax_structural(json_sax_t *p, char c) {
+    const json_sax_callbacks_t *cb = p->callbacks;
+    switch (c) {
+    case ' ': case '\t': case '\n': case '\r':
+        return 0;
+    case '"':
+        if (json_sax_expects_value(p)) p->string_is_key = false;
+        else if (p->expect == JSON_EXPECT_KEY || p->expect == JSON_EXPECT_KEY_OR_END) p->string_is_key = true;
+        else return -1;
+        p->token_len = 0;
+        p->lex = JSON_LEX_STRING;
+        return 0;
+    case '{': case '[':
+        if (!json_sax_expects_value(p) || p->depth == JSON_SAX_MAX_DEPTH) return -1;
+        p->stack[p->depth++] = c;
+        p->expect = c == '{' ? JSON_EXPECT_KEY_OR_END : JSON_EXPECT_VALUE_OR_END;
+        if (c == '{') return cb->begin_object ? cb->begin_object(p->user_data) : 0;
+        return cb->begin_array ? cb->begin_array(p->user_data) : 0;
+    case '}': case ']': {
+        char open = c == '}' ? '{' : '[';
+        json_expect_t empty = c == '}' ? JSON_EXPECT_KEY_OR_END : JSON_EXPECT_VALUE_OR_END;
+        if (p->depth == 0 || p->stack[p->depth - 1] != open) return -1;
+        if (p->expect != empty && p->expect != JSON_EXPECT_COMMA_OR_END) return -1;
+        p->depth--;
+        json_sax_value_done(p);
+        if (c == '}') return cb->end_object ? cb->end_object(p->user_data) : 0;
+        return cb->end_array ? cb->end_array(p->user_data) : 0;
+    }
+    case ':':
+        if (p->expect != JSON_EXPECT_COLON) return -1;
+        p->expect = JSON_EXPECT_VALUE;
+        return 0;
+    case ',':
+        if (p->expect != JSON_EXPECT_COMMA_OR_END) return -1;
+        p->expect = p->stack[p->depth - 1] == '{' ? JSON_EXPECT_KEY : JSON_EXPECT_VALUE;
+        return 0;
+    default:
+        if (!json_sax_expects_value(p) || !(c == '-' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z'))) return -1;
+        p->token_len = 0;
+        p->lex = JSON_LEX_SCALAR;
+        return json_sax_append_raw(p, &c, 1);
+    }
+}
+
+static int json_sax_hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+int json_sax_feed(json_sax_t *p, const char *data, size_t len) {
+    if (p->failed) return -1;
+    size_t i = 0;
+    while (i < len) {
+        char c = data[i];
+        switch (p->lex) {
+        case JSON_LEX_STRING: {
+            // Copy the run up to the next quote, escape or control character at once
+            size_t run = i;
+            while (run < len && data[run] != '"' && data[run] != '\\' && (unsigned char)data[run] >= 0x20) run++;
+            if (run > i && json_sax_append(p, data + i, run - i) != 0) return json_sax_fail(p);
+            i = run;
+            if (i == len) break;
+            c = data[i++];
+            if (c == '"') {
+                p->lex = JSON_LEX_NONE;
+                if (json_sax_string_done(p) != 0) return json_sax_fail(p);
+            } else if (c == '\\') {
+                p->lex = JSON_LEX_ESCAPE;
+            } else {
+                return json_sax_fail(p);
+            }
+            break;
+        }
+        case JSON_LEX_ESCAPE: {
+            i++;
+            const char *from = "\"\\/bfnrt", *to = "\"\\/\b\f\n\r\t";
+            const char *match = c ? strchr(from, c) : NULL;
+            if (c == 'u') {
+                p->unicode = 0;
+                p->unicode_digits = 0;
+                p->lex = JSON_LEX_UNICODE;
+            } else if (match) {
+                if (json_sax_append(p, &to[match - from], 1) != 0) return json_sax_fail(p);
+                p->lex = JSON_LEX_STRING;
+            } else {
+                return json_sax_fail(p);
+            }
+            break;
+        }
+        case JSON_LEX_UNICODE: {
+            i++;
+            int digit = json_sax_hex(c);
+            if (digit < 0) return json_sax_fail(p);
+            p->unicode = p->unicode * 16 + (unsigned int)digit;
+            if (++p->unicode_digits == 4) {
+                p->lex = JSON_LEX_STRING;
+                if (json_sax_unicode_done(p) != 0) return json_sax_fail(p);
+            }
+            break;
+        }
+        case JSON_LEX_SCALAR:
+            if (c == '-' || c == '+' || c == '.' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+                if (json_sax_append_raw(p, &c, 1) != 0) return json_sax_fail(p);
+                i++;
+            } else {
+                // The delimiter is handled as a structural character next time round
+                p->lex = JSON_LEX_NONE;
+                if (json_sax_scalar_done(p) != 0) return json_sax_fail(p);
+            }
+            break;
+        case JSON_LEX_NONE:
+            i++;
+            if (json_sax_structural(p, c) != 0) return json_sax_fail(p);
+            break;
+        }
+    }
+    return 0;
+}
+
+int json_sax_finish(json_sax_t *p) {
+    if (p->failed) return -1;
+    if (p->lex == JSON_LEX_SCALAR) {
+        p->lex = JSON_LEX_NONE;
+        if (json_sax_scalar_done(p) != 0) return json_sax_fail(p);
+    }
+    return p->lex == JSON_LEX_NONE && p->expect == JSON_EXPECT_NOTHING ? 0 : -1;
+}
+
+char *json_sax_take_string(json_sax_t *p, size_t *len) {
+    char *s = p->token ? p->token : strdup("");
+    if (!s) { perror("strdup json string"); return NULL; }
+    if (len) *len = p->token_len;
+    p->token = NULL;
+    p->token_len = p->token_cap = 0;
+    return s;
+}
@@ -0,0 +1,105 @@
+#ifndef MOTIFGPT_JSON_H
+#define MOTIFGPT_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSON_SAX_MAX_DEPTH 64
+
+/**
+ * Events reported by json_sax_feed(). Any callback may be NULL. Strings are
+ * unescaped UTF-8 and NUL-terminated; they stay valid until the callback
+ * returns unless taken with json_sax_take_string(). Numbers, true, false and
+ * null arrive through `scalar` as their literal text. A non-zero return stops
+ * the parser, and json_sax_feed() then fails.
+ */
+typedef struct {
+    int (*begin_object)(void *user_data);
+    int (*end_object)(void *user_data);
+    int (*begin_array)(void *user_data);
+    int (*end_array)(void *user_data);
+    int (*key)(void *user_data, const char *key, size_t len);
+    int (*string)(void *user_data, const char *value, size_t len);
+    int (*scalar)(void *user_data, const char *value, size_t len);
+} json_sax_callbacks_t;
+
+typedef enum {
+    JSON_EXPECT_VALUE,
+    JSON_EXPECT_VALUE_OR_END,  // After '['
+    JSON_EXPECT_KEY,           // After ',' in an object
+    JSON_EXPECT_KEY_OR_END,    // After '{'
+    JSON_EXPECT_COLON,
+    JSON_EXPECT_COMMA_OR_END,
+    JSON_EXPECT_NOTHING        // The top-level value is complete
+} json_expect_t;
+
+typedef enum {
+    JSON_LEX_NONE,
+    JSON_LEX_STRING,
+    JSON_LEX_ESCAPE,
+    JSON_LEX_UNICODE,
+    JSON_LEX_SCALAR
+} json_lex_t;
+
+/**
+ * A push parser: the document is fed in chunks of any size, split anywhere,
+ * and events fire as soon as each token is complete. Only the token being
+ * read is buffered, so memory does not grow with the document.
+ */
+typedef struct {
+    const json_sax_callbacks_t *callbacks;
+    void *user_data;
+    json_expect_t expect;
+    json_lex_t lex;
+    char stack[JSON_SAX_MAX_DEPTH]; // '{' or '[' for each open container
+    int depth;
+    bool string_is_key;
+    char *token;
+    size_t token_len;
+    size_t token_cap;
+    unsigned int unicode;        // \u escape being read
+    int unicode_digits;
+    unsigned int high_surrogate; // First half of a pair, waiting for the second
+    bool failed;
+} json_sax_t;
+
+/**
+ * Initialises a parser for one document.
+ * @param p The parser.
+ * @param callbacks The events to report; must outlive the parser.
+ * @param user_data Passed to every callback.
+ */
+void json_sax_init(json_sax_t *p, const json_sax_callbacks_t *callbacks, void *user_data);
+
+/**
+ * Releases the parser's token buffer.
+ * @param p The parser.
+ */
+void json_sax_free(json_sax_t *p);
+
+/**
+ * Parses the next piece of the document.
+ * @param p The parser.
+ * @param data The bytes.
+ * @param len Their length.
+ * @return 0 on success, -1 on a syntax error or when a callback stopped the parser.
+ */
+int json_sax_feed(json_sax_t *p, const char *data, size_t len);
+
+/**
+ * Ends the document.
+ * @param p The parser.
+ * @return 0 if exactly one complete value was fed, -1 otherwise.
+ */
+int json_sax_finish(json_sax_t *p);
+
+/**
+ * Takes over the string being reported, so a large value need not be copied.
+ * Only valid inside the `key` and `string` callbacks.
+ * @param p The parser.
+ * @param len Receives its length; may be NULL.
+ * @return The NUL-terminated string, to be freed by the caller, or NULL on allocation failure.
+ */
+char *json_sax_take_string(json_sax_t *p, size_t *len);
+
+#endif /* MOTIFGPT_JSON_H */
@@ -5,16 +5,54 @@
 extern "C" {
 #endif
 
+// Bumped whenever motifgpt_tool_t changes layout, so the loader can tell which
+// layout a plugin's tools array uses. Plugins that export no version are
+// taken to be version 1.
+#define MOTIFGPT_PLUGIN_ABI_VERSION 3
+
+// Plugins put this at file scope to export the version they were built against.
+#define MOTIFGPT_PLUGIN_EXPORT_ABI_VERSION \
+    const int motifgpt_plugin_abi_version = MOTIFGPT_PLUGIN_ABI_VERSION
+
+extern const int motifgpt_plugin_abi_version;
+
+// motifgpt_tool_t as of ABI version 1.
+typedef struct {
+    const char* name;
+    const char* description;
+    const char* parameters_schema;
+    char* (*execute)(const char* args_json);
+} motifgpt_tool_v1_t;
+
+// motifgpt_tool_t as of ABI version 2, which added timeouts and cancellation.
+typedef struct {
+    const char* name;
+    const char* description;
+    const char* parameters_schema;
+    char* (*execute)(const char* args_json);
+    int timeout_ms;
+    char* (*execute_cancellable)(const char* args_json, const int* cancelled);
+} motifgpt_tool_v2_t;
+
 typedef struct {
     const char* name;
     const char* description;
     const char* parameters_schema; // JSON schema string
     char* (*execute)(const char* args_json); // Returns allocated string with result, must be free()able
+    int timeout_ms; // How long a call may take before the model is told it timed out; 0 for the default
+    // Optional; called instead of execute() when set. Long-running tools should
+    // check *cancelled now and then and return early once it is nonzero.
+    char* (*execute_cancellable)(const char* args_json, const int* cancelled);
+    int cache_ttl_ms; // How long a result may be reused for identical arguments; 0 never caches
+    // Optional, for cached tools whose result depends on more than the
+    // arguments. Returns a stamp that changes whenever the result would, such
+    // as a file's modification time, or -1 if the result must not be cached.
+    long long (*cache_validator)(const char* args_json);
 } motifgpt_tool_t;
 
 typedef struct {
     const char* plugin_name;
-    motifgpt_tool_t* tools;
+    motifgpt_tool_t* tools; // In the layout of the plugin's ABI version
     int num_tools;
 } motifgpt_plugin_t;
 
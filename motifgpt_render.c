@@ -0,0 +1,118 @@
+#include "motifgpt_render.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_SEED 0xcbf29ce484222325ULL
+#define HASH_MULTIPLIER 0x517cc1b727220a95ULL
+
+static const char img_msg[] = " [Image Attached]";
+
+// Multiply-rotate hash over 8-byte words; hashing must stay much cheaper than
+// re-copying the text or the cache stops paying for itself.
+static uint64_t hash_bytes(uint64_t hash, const char *data, size_t len) {
+    uint64_t word;
+    while (len >= sizeof(word)) {
+        memcpy(&word, data, sizeof(word));
+        hash = (((hash << 5) | (hash >> 59)) ^ word) * HASH_MULTIPLIER;
+        data += sizeof(word); len -= sizeof(word);
+    }
+    word = (uint64_t)len << 56;
+    for (size_t i = 0; i < len; i++) word |= (uint64_t)(unsigned char)data[i] << (8 * i);
+    return (((hash << 5) | (hash >> 59)) ^ word) * HASH_MULTIPLIER;
+}
+
+uint64_t render_message_hash(const dp_message_t *msg) {
+    uint64_t hash = hash_bytes(HASH_SEED, msg->role == DP_ROLE_USER ? "U" : "A", 1);
+    for (size_t j = 0; j < msg->num_parts; j++) {
+        const dp_content_part_t *part = &msg->parts[j];
+        if (part->type == DP_CONTENT_PART_TEXT && part->text) {
+            hash = hash_bytes(hash, "T", 1);
+            hash = hash_bytes(hash, part->text, strlen(part->text));
+        } else if (part->type == DP_CONTENT_PART_IMAGE_BASE64) {
+            hash = hash_bytes(hash, "I", 1);
+        }
+    }
+    return hash;
+}
+
+static int render_message(transcript_t *t, const dp_message_t *msg) {
+    const char *nick = (msg->role == DP_ROLE_USER) ? USER_NICKNAME : ASSISTANT_NICKNAME;
+    if (transcript_append(t, nick, strlen(nick)) != 0 || transcript_append(t, ": ", 2) != 0) return -1;
+    for (size_t j = 0; j < msg->num_parts; j++) {
+        const dp_content_part_t *part = &msg->parts[j];
+        int ret = 0;
+        if (part->type == DP_CONTENT_PART_TEXT && part->text) {
+            ret = transcript_append(t, part->text, strlen(part->text));
+        } else if (part->type == DP_CONTENT_PART_IMAGE_BASE64) {
+            ret = transcript_append(t, img_msg, sizeof(img_msg) - 1);
+        }
+        if (ret != 0) return -1;
+    }
+    return transcript_append(t, "\n", 1);
+}
+
+int render_history(transcript_t *t, render_cache_t *cache, const dp_message_t *messages, size_t count, render_stats_t *stats) {
+    render_stats_t local = {0, 0, 0};
+    if (cache->generation != t->generation) cache->count = 0;
+
+    // Find the longest run of cached messages that still opens the history;
+    // the cache entries before it are messages evicted since the last render.
+    size_t skip = cache->count, run = 0;
+    if (count > 0) {
+        uint64_t first_hash = render_message_hash(&messages[0]);
+        for (size_t d = 0; d < cache->count; d++) {
+            if (cache->entries[d].hash != first_hash) continue;
+            size_t k = 1;
+            while (d + k < cache->count && k < count && cache->entries[d + k].hash == render_message_hash(&messages[k])) k++;
+            skip = d; run = k;
+            break;
+        }
+    }
+
+    if (run == 0) {
+        local.dropped = cache->count;
+        transcript_clear(t);
+        cache->count = 0;
+    } else {
+        local.dropped = skip + (cache->count - skip - run);
+        transcript_drop_before(t, cache->entries[skip].start);
+        transcript_truncate(t, cache->entries[skip + run - 1].end);
+        memmove(cache->entries, cache->entries + skip, run * sizeof(render_cache_entry_t));
+        cache->count = run;
+        local.reused = run;
+    }
+
+    if (cache->cap < count) {
+        render_cache_entry_t *new_entries = realloc(cache->entries, count * sizeof(render_cache_entry_t));
+        if (!new_entries) {
+            perror("realloc render cache");
+            transcript_clear(t);
+            cache->count = 0; cache->generation = t->generation;
+            return -1;
+        }
+        cache->entries = new_entries; cache->cap = count;
+    }
+    for (size_t i = run; i < count; i++) {
+        render_cache_entry_t *entry = &cache->entries[i];
+        entry->hash = render_message_hash(&messages[i]);
+        entry->start = transcript_end(t);
+        if (render_message(t, &messages[i]) != 0) {
+            transcript_clear(t);
+            cache->count = 0; cache->generation = t->generation;
+            return -1;
+        }
+        entry->end = transcript_end(t);
+        local.rendered++;
+    }
+    cache->count = count;
+    cache->generation = t->generation;
+    if (stats) *stats = local;
+    return 0;
+}
+
+void render_cache_free(render_cache_t *cache) {
+    free(cache->entries);
+    cache->entries = NULL;
+    cache->count = cache->cap = 0;
+}
@@ -0,0 +1,70 @@
+#ifndef MOTIFGPT_RENDER_H
+#define MOTIFGPT_RENDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "disasterparty.h"
+#include "motifgpt_transcript.h"
+
+#ifndef USER_NICKNAME
+#define USER_NICKNAME "User"
+#endif
+#ifndef ASSISTANT_NICKNAME
+#define ASSISTANT_NICKNAME "Assistant"
+#endif
+
+/**
+ * Where one history message was rendered in the transcript.
+ */
+typedef struct {
+    uint64_t hash;  // render_message_hash() of the message
+    size_t start;   // Transcript positions of the rendered text
+    size_t end;
+} render_cache_entry_t;
+
+/**
+ * Remembers how the last history render was laid out so the next one only
+ * touches what changed.
+ */
+typedef struct {
+    render_cache_entry_t *entries;
+    size_t count;
+    size_t cap;
+    unsigned long generation; // Transcript generation the positions belong to
+} render_cache_t;
+
+typedef struct {
+    size_t reused;   // Messages whose rendered text was kept
+    size_t rendered; // Messages rendered from scratch
+    size_t dropped;  // Cached messages that were removed from the transcript
+} render_stats_t;
+
+/**
+ * Hashes everything that affects how a message is rendered.
+ * @param msg The message.
+ * @return A 64-bit hash.
+ */
+uint64_t render_message_hash(const dp_message_t *msg);
+
+/**
+ * Renders `messages` into the transcript as "Nick: text\n" lines, reusing the
+ * cached text of any run of messages that is unchanged since the last call.
+ * Old messages evicted from the front are dropped from the transcript, messages
+ * added at the end are appended, and anything after the reused run, including
+ * text appended since the last render, is replaced.
+ * @param t The transcript.
+ * @param cache The cache from the previous render of this transcript.
+ * @param messages The history to show.
+ * @param count Number of messages.
+ * @param stats Receives what was reused; may be NULL.
+ * @return 0 on success, -1 on allocation failure (the transcript is then cleared).
+ */
+int render_history(transcript_t *t, render_cache_t *cache, const dp_message_t *messages, size_t count, render_stats_t *stats);
+
+/**
+ * Releases the cache's memory.
+ * @param cache The cache.
+ */
+void render_cache_free(render_cache_t *cache);
+
+#endif /* MOTIFGPT_RENDER_H */
@@ -0,0 +1,316 @@
+#include "motifgpt_stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#define STREAM_MAX_CHUNK (STREAM_RING_CAPACITY / 4)
+#define FLUSHER_BATCH 32
+
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t registry_cond;
+static stream_state_t *registry = NULL;
+static unsigned long last_stream_id = 0;
+static bool flusher_running = false;
+static pthread_t flusher_tid;
+static int flush_interval_ms = STREAM_FLUSH_DEFAULT_MS;
+static size_t flush_max_bytes = STREAM_FLUSH_DEFAULT_BYTES;
+
+static uint64_t now_ns() {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int spsc_ring_init(spsc_ring_t *ring, size_t cap) {
+    if (cap == 0 || (cap & (cap - 1)) != 0) { fprintf(stderr, "spsc_ring_init: capacity %zu is not a power of two.\n", cap); return -1; }
+    ring->buf = malloc(cap);
+    if (!ring->buf) { perror("malloc spsc_ring"); return -1; }
+    ring->cap = cap; ring->head = ring->tail = 0;
+    return 0;
+}
+
+void spsc_ring_free(spsc_ring_t *ring) {
+    free(ring->buf);
+    ring->buf = NULL; ring->cap = ring->head = ring->tail = 0;
+}
+
+static void ring_copy_in(spsc_ring_t *ring, size_t pos, const void *src, size_t n) {
+    size_t off = pos & (ring->cap - 1);
+    size_t first = n < ring->cap - off ? n : ring->cap - off;
+    memcpy(ring->buf + off, src, first);
+    memcpy(ring->buf, (const char *)src + first, n - first);
+}
+
+static void ring_copy_out(const spsc_ring_t *ring, size_t pos, void *dst, size_t n) {
+    size_t off = pos & (ring->cap - 1);
+    size_t first = n < ring->cap - off ? n : ring->cap - off;
+    memcpy(dst, ring->buf + off, first);
+    memcpy((char *)dst + first, ring->buf, n - first);
+}
+
+bool spsc_ring_push(spsc_ring_t *ring, uint32_t type, const void *data, size_t len) {
+    pipe_frame_header_t header = { type, (uint32_t)len };
+    size_t need = sizeof(header) + len;
+    size_t head = ring->head;
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (need > ring->cap - (head - tail)) return false;
+    ring_copy_in(ring, head, &header, sizeof(header));
+    if (len) ring_copy_in(ring, head + sizeof(header), data, len);
+    __atomic_store_n(&ring->head, head + need, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool spsc_ring_pop(spsc_ring_t *ring, uint32_t *type, char *out, size_t *len) {
+    size_t tail = ring->tail;
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == tail) return false;
+    pipe_frame_header_t header;
+    ring_copy_out(ring, tail, &header, sizeof(header));
+    ring_copy_out(ring, tail + sizeof(header), out, header.length);
+    out[header.length] = '\0';
+    *type = header.type; *len = header.length;
+    __atomic_store_n(&ring->tail, tail + sizeof(header) + header.length, __ATOMIC_RELEASE);
+    return true;
+}
+
+stream_state_t *stream_open(const char *prefix) {
+    stream_state_t *stream = calloc(1, sizeof(stream_state_t));
+    if (!stream) { perror("calloc stream_state"); return NULL; }
+    stream->scratch = malloc(STREAM_RING_CAPACITY + 1);
+    if (!stream->scratch || spsc_ring_init(&stream->ring, STREAM_RING_CAPACITY) != 0) {
+        if (!stream->scratch) perror("malloc stream scratch");
+        free(stream->scratch); free(stream);
+        return NULL;
+    }
+    stream->refcount = 2;
+    snprintf(stream->prefix, sizeof(stream->prefix), "%s", prefix ? prefix : "");
+    pthread_mutex_lock(&registry_mutex);
+    stream->id = ++last_stream_id;
+    stream->next = registry;
+    registry = stream;
+    if (flusher_running) pthread_cond_signal(&registry_cond);
+    pthread_mutex_unlock(&registry_mutex);
+    return stream;
+}
+
+void stream_release(stream_state_t *stream) {
+    if (!stream) return;
+    if (__atomic_sub_fetch(&stream->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        spsc_ring_free(&stream->ring);
+        free(stream->response);
+        free(stream->scratch);
+        free(stream);
+    }
+}
+
+static void ring_doorbell(stream_state_t *stream) {
+    __atomic_store_n(&stream->pending_since_ns, 0, __ATOMIC_RELAXED);
+    // Pairs with the fence in stream_claim(): either the consumer sees our
+    // records on its next drain or we see the cleared flag and write a frame.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&stream->doorbell_pending, 1, __ATOMIC_SEQ_CST) == 0) {
+        write_pipe_frame(PIPE_MSG_STREAM_READY, &stream->id, sizeof(stream->id));
+    }
+}
+
+static void push_record(stream_state_t *stream, uint32_t type, const char *data, size_t len) {
+    if (sizeof(pipe_frame_header_t) + len > stream->ring.cap) {
+        // Waiting would never help; callers keep records to STREAM_MAX_CHUNK
+        fprintf(stderr, "push_record: %zu-byte record can never fit the stream ring.\n", len);
+        return;
+    }
+    while (!spsc_ring_push(&stream->ring, type, data, len)) {
+        // Ring is full: make sure the UI thread knows, then wait for it to drain.
+        if (__atomic_load_n(&stream->abandoned, __ATOMIC_ACQUIRE)) return;
+        ring_doorbell(stream);
+        struct timespec pause = { 0, 1000000L };
+        nanosleep(&pause, NULL);
+    }
+}
+
+// Largest prefix of `text` no longer than `max` that does not split a UTF-8 character.
+static size_t utf8_clamp(const char *text, size_t len, size_t max) {
+    if (len <= max) return len;
+    while (max > 1 && ((unsigned char)text[max] & 0xC0) == 0x80) max--;
+    return max;
+}
+
+// Advances the tool call matcher over response[from..], queuing each call that closes.
+static void scan_tool_calls(stream_state_t *stream, size_t from) {
+    for (size_t i = from; i < stream->response_len; i++) {
+        const char *tag = stream->in_tool_call ? STREAM_TOOL_CALL_CLOSE_TAG : STREAM_TOOL_CALL_OPEN_TAG;
+        char c = stream->response[i];
+        // '<' only ever starts a tag, so a mismatch can only restart the match there
+        if (c == tag[stream->tool_tag_matched]) stream->tool_tag_matched++;
+        else stream->tool_tag_matched = c == '<';
+        if (tag[stream->tool_tag_matched] != '\0') continue;
+        stream->tool_tag_matched = 0;
+        if (!stream->in_tool_call) {
+            stream->in_tool_call = true;
+            stream->tool_call_start = i + 1;
+            continue;
+        }
+        stream->in_tool_call = false;
+        size_t len = i + 1 - strlen(STREAM_TOOL_CALL_CLOSE_TAG) - stream->tool_call_start;
+        if (len > STREAM_MAX_CHUNK) len = 0;
+        push_record(stream, PIPE_MSG_TOOL_CALL, stream->response + stream->tool_call_start, len);
+        ring_doorbell(stream);
+    }
+}
+
+void stream_push_token(stream_state_t *stream, const char *token, size_t len) {
+    if (!stream || stream->closed || __atomic_load_n(&stream->abandoned, __ATOMIC_ACQUIRE)) return;
+    stream->started = true;
+
+    size_t required = stream->response_len + len + 1;
+    if (required > stream->response_cap) {
+        size_t new_cap = stream->response_cap ? stream->response_cap : 1024;
+        while (new_cap < required) new_cap *= 2;
+        char *new_buf = realloc(stream->response, new_cap);
+        if (!new_buf) { perror("realloc stream response"); return; }
+        stream->response = new_buf; stream->response_cap = new_cap;
+    }
+    size_t scan_from = stream->response_len;
+    memcpy(stream->response + stream->response_len, token, len);
+    stream->response_len += len;
+    stream->response[stream->response_len] = '\0';
+
+    while (len > 0) {
+        // Split oversized tokens on UTF-8 character boundaries.
+        size_t chunk = utf8_clamp(token, len, STREAM_MAX_CHUNK);
+        push_record(stream, PIPE_MSG_TOKEN, token, chunk);
+        token += chunk; len -= chunk;
+        if (__atomic_load_n(&stream->pending_since_ns, __ATOMIC_RELAXED) == 0) {
+            __atomic_store_n(&stream->pending_since_ns, now_ns(), __ATOMIC_RELAXED);
+            stream->pending_bytes = 0;
+            if (__atomic_load_n(&flusher_running, __ATOMIC_RELAXED)) pthread_cond_signal(&registry_cond);
+        }
+        stream->pending_bytes += chunk;
+    }
+    scan_tool_calls(stream, scan_from);
+
+    int interval_ms = __atomic_load_n(&flush_interval_ms, __ATOMIC_RELAXED);
+    size_t max_bytes = __atomic_load_n(&flush_max_bytes, __ATOMIC_RELAXED);
+    uint64_t since = __atomic_load_n(&stream->pending_since_ns, __ATOMIC_RELAXED);
+    if (interval_ms == 0 || stream->pending_bytes >= max_bytes ||
+        (since && now_ns() - since >= (uint64_t)interval_ms * 1000000ULL)) {
+        ring_doorbell(stream);
+    }
+}
+
+void stream_end(stream_state_t *stream, const char *error) {
+    if (!stream || stream->closed) return;
+    stream->closed = true;
+    // Errors come from the provider library with no bound on their length
+    if (error) push_record(stream, PIPE_MSG_ERROR, error, utf8_clamp(error, strlen(error), STREAM_MAX_CHUNK));
+    else push_record(stream, PIPE_MSG_STREAM_END, NULL, 0);
+    ring_doorbell(stream);
+}
+
+bool stream_is_abandoned(stream_state_t *stream) {
+    return stream && __atomic_load_n(&stream->abandoned, __ATOMIC_ACQUIRE);
+}
+
+stream_state_t *stream_claim(unsigned long id) {
+    pthread_mutex_lock(&registry_mutex);
+    stream_state_t *stream = registry;
+    while (stream && stream->id != id) stream = stream->next;
+    pthread_mutex_unlock(&registry_mutex);
+    if (stream) {
+        __atomic_store_n(&stream->doorbell_pending, 0, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+    return stream;
+}
+
+bool stream_next_record(stream_state_t *stream, pipe_message_type_t *type, const char **data, size_t *len) {
+    uint32_t record_type;
+    if (!spsc_ring_pop(&stream->ring, &record_type, stream->scratch, len)) return false;
+    *type = (pipe_message_type_t)record_type;
+    *data = stream->scratch;
+    return true;
+}
+
+void stream_close(stream_state_t *stream) {
+    if (!stream) return;
+    pthread_mutex_lock(&registry_mutex);
+    stream_state_t **link = &registry;
+    while (*link && *link != stream) link = &(*link)->next;
+    if (*link) *link = stream->next;
+    pthread_mutex_unlock(&registry_mutex);
+    __atomic_store_n(&stream->abandoned, 1, __ATOMIC_RELEASE);
+    stream_release(stream);
+}
+
+static void *flusher_main(void *arg) {
+    pthread_mutex_lock(&registry_mutex);
+    while (flusher_running) {
+        stream_state_t *due[FLUSHER_BATCH];
+        int num_due = 0;
+        uint64_t now = now_ns(), next = 0;
+        uint64_t interval_ns = (uint64_t)flush_interval_ms * 1000000ULL;
+        for (stream_state_t *s = registry; s; s = s->next) {
+            uint64_t since = __atomic_load_n(&s->pending_since_ns, __ATOMIC_RELAXED);
+            if (since == 0) continue;
+            if (now - since >= interval_ns && num_due < FLUSHER_BATCH) {
+                __atomic_add_fetch(&s->refcount, 1, __ATOMIC_RELAXED);
+                due[num_due++] = s;
+            } else if (!next || since + interval_ns < next) {
+                next = since + interval_ns;
+            }
+        }
+        if (num_due > 0) {
+            // Pipe writes can block, so never hold the registry lock across them.
+            pthread_mutex_unlock(&registry_mutex);
+            for (int i = 0; i < num_due; i++) { ring_doorbell(due[i]); stream_release(due[i]); }
+            pthread_mutex_lock(&registry_mutex);
+            continue;
+        }
+        if (!registry) { pthread_cond_wait(&registry_cond, &registry_mutex); continue; }
+        // Producers signal without the lock, so never sleep longer than one interval.
+        if (!next || next > now + interval_ns) next = now + (interval_ns ? interval_ns : 1000000ULL);
+        struct timespec deadline = { (time_t)(next / 1000000000ULL), (long)(next % 1000000000ULL) };
+        pthread_cond_timedwait(&registry_cond, &registry_mutex, &deadline);
+    }
+    pthread_mutex_unlock(&registry_mutex);
+    return NULL;
+}
+
+int stream_coalescer_start() {
+    pthread_mutex_lock(&registry_mutex);
+    if (flusher_running) { pthread_mutex_unlock(&registry_mutex); return 0; }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&registry_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    flusher_running = true;
+    if (pthread_create(&flusher_tid, NULL, flusher_main, NULL) != 0) {
+        perror("pthread_create stream flusher");
+        flusher_running = false;
+        pthread_cond_destroy(&registry_cond);
+        pthread_mutex_unlock(&registry_mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&registry_mutex);
+    return 0;
+}
+
+void stream_coalescer_stop() {
+    pthread_mutex_lock(&registry_mutex);
+    bool was_running = flusher_running;
+    flusher_running = false;
+    if (was_running) pthread_cond_signal(&registry_cond);
+    pthread_mutex_unlock(&registry_mutex);
+    if (was_running) pthread_join(flusher_tid, NULL);
+}
+
+void stream_set_flush_budget(int interval_ms, size_t max_bytes) {
+    pthread_mutex_lock(&registry_mutex);
+    __atomic_store_n(&flush_interval_ms, interval_ms < 0 ? 0 : interval_ms, __ATOMIC_RELAXED);
+    __atomic_store_n(&flush_max_bytes, max_bytes, __ATOMIC_RELAXED);
+    if (flusher_running) pthread_cond_signal(&registry_cond);
+    pthread_mutex_unlock(&registry_mutex);
+}
@@ -0,0 +1,183 @@
+#ifndef MOTIFGPT_STREAM_H
+#define MOTIFGPT_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "motifgpt_chat.h"
+
+#define STREAM_RING_CAPACITY (64 * 1024) // Must be a power of two
+#define STREAM_PREFIX_BUF_SIZE 64
+
+#define STREAM_TOOL_CALL_OPEN_TAG "<tool_call>"
+#define STREAM_TOOL_CALL_CLOSE_TAG "</tool_call>"
+
+// Default budget for announcing buffered tokens to the UI thread
+#define STREAM_FLUSH_DEFAULT_MS 16
+#define STREAM_FLUSH_DEFAULT_BYTES 4096
+
+/**
+ * Lock-free single-producer/single-consumer byte ring. Records are a
+ * pipe_frame_header_t followed by the payload and never straddle a push, so the
+ * consumer only ever sees whole records.
+ */
+typedef struct {
+    char *buf;
+    size_t cap;   // Power of two
+    size_t head;  // Total bytes written; only the producer stores it
+    size_t tail;  // Total bytes consumed; only the consumer stores it
+} spsc_ring_t;
+
+/**
+ * Everything the worker and the UI thread share about one streamed reply. The
+ * producer (the worker running the request) and the consumer (the Xt main loop)
+ * each own the fields marked for them; the ring is the only thing both touch.
+ */
+typedef struct stream_state {
+    int refcount;
+    unsigned long id;
+    spsc_ring_t ring;
+    int doorbell_pending;      // Set by whoever rings, cleared by the consumer
+    int abandoned;             // Set by the consumer; makes the producer drop its output
+    uint64_t pending_since_ns; // Age of the oldest unannounced byte, 0 when none
+
+    // Producer only, until the terminal record is pushed; then consumer only.
+    size_t pending_bytes;
+    char *response;
+    size_t response_len;
+    size_t response_cap;
+    bool started;
+    bool closed;
+    size_t tool_tag_matched; // How much of the tag being looked for the response ends with
+    size_t tool_call_start;  // Offset in `response` of the open call's JSON
+    bool in_tool_call;
+
+    // Set before the stream is handed to the producer, then consumer only.
+    char prefix[STREAM_PREFIX_BUF_SIZE];
+    bool prefix_added;
+    char *scratch;
+
+    struct stream_state *next;
+} stream_state_t;
+
+/**
+ * Allocates a ring.
+ * @param ring The ring to initialise.
+ * @param cap Capacity in bytes; must be a power of two.
+ * @return 0 on success, -1 on failure.
+ */
+int spsc_ring_init(spsc_ring_t *ring, size_t cap);
+
+/**
+ * Releases a ring's buffer.
+ * @param ring The ring.
+ */
+void spsc_ring_free(spsc_ring_t *ring);
+
+/**
+ * Appends one record. Producer side only; never blocks.
+ * @param ring The ring.
+ * @param type Record type.
+ * @param data Payload bytes, or NULL when len is 0.
+ * @param len Payload length.
+ * @return true if the record was written, false if there is not enough free space.
+ */
+bool spsc_ring_push(spsc_ring_t *ring, uint32_t type, const void *data, size_t len);
+
+/**
+ * Removes the next record. Consumer side only; never blocks.
+ * @param ring The ring.
+ * @param type Receives the record type.
+ * @param out Receives the payload and a terminating NUL; must hold ring->cap + 1 bytes.
+ * @param len Receives the payload length.
+ * @return true if a record was returned, false if the ring is empty.
+ */
+bool spsc_ring_pop(spsc_ring_t *ring, uint32_t *type, char *out, size_t *len);
+
+/**
+ * Creates a stream and registers it so its doorbells can be resolved. The stream
+ * starts with two references: one for the producer and one for the consumer.
+ * @param prefix Text shown before the first token of the reply.
+ * @return The new stream, or NULL on allocation failure.
+ */
+stream_state_t *stream_open(const char *prefix);
+
+/**
+ * Queues token text for the UI thread and rings the doorbell when the flush
+ * budget is spent. The text is also scanned for tool calls: as soon as a
+ * </tool_call> completes one, its JSON is queued as a PIPE_MSG_TOOL_CALL
+ * record and the doorbell rung, so the call can start while the reply is
+ * still streaming. Producer side only.
+ * @param stream The stream.
+ * @param token The token text.
+ * @param len Its length in bytes.
+ */
+void stream_push_token(stream_state_t *stream, const char *token, size_t len);
+
+/**
+ * Queues the terminal record, PIPE_MSG_ERROR when `error` is set and
+ * PIPE_MSG_STREAM_END otherwise, and rings the doorbell. Only the first call
+ * has any effect. Producer side only.
+ * @param stream The stream.
+ * @param error Error text, or NULL for a normal end; cut short on a character boundary if it is too long for one record.
+ */
+void stream_end(stream_state_t *stream, const char *error);
+
+/**
+ * @param stream The stream.
+ * @return true once the consumer has given up on the stream.
+ */
+bool stream_is_abandoned(stream_state_t *stream);
+
+/**
+ * Resolves a PIPE_MSG_STREAM_READY frame: finds the stream and re-arms its
+ * doorbell. UI thread only; the stream stays valid until the UI thread closes it.
+ * @param id The id carried by the frame.
+ * @return The stream, or NULL if it has already been closed.
+ */
+stream_state_t *stream_claim(unsigned long id);
+
+/**
+ * Takes the next record queued by the producer. Consumer side only. After
+ * stream_claim(), call it until it returns false.
+ * @param stream The stream.
+ * @param type Receives PIPE_MSG_TOKEN, PIPE_MSG_STREAM_END or PIPE_MSG_ERROR.
+ * @param data Receives the NUL-terminated payload, valid until the next call.
+ * @param len Receives the payload length.
+ * @return true if a record was returned.
+ */
+bool stream_next_record(stream_state_t *stream, pipe_message_type_t *type, const char **data, size_t *len);
+
+/**
+ * Unregisters the stream and drops the consumer's reference. If the producer is
+ * still running it is told to stop. Consumer side only.
+ * @param stream The stream.
+ */
+void stream_close(stream_state_t *stream);
+
+/**
+ * Drops a reference. The producer calls this once it is done with the stream.
+ * @param stream The stream; NULL is ignored.
+ */
+void stream_release(stream_state_t *stream);
+
+/**
+ * Starts the thread that rings the doorbell for streams whose buffered tokens
+ * have waited out the time budget, so a pause never strands text.
+ * @return 0 on success, -1 on failure.
+ */
+int stream_coalescer_start();
+
+/**
+ * Stops the flusher thread.
+ */
+void stream_coalescer_stop();
+
+/**
+ * Sets how long and how many bytes tokens may wait before the UI thread is woken.
+ * @param interval_ms Maximum age of the oldest unannounced token; 0 disables coalescing.
+ * @param max_bytes Unannounced bytes that force an immediate doorbell.
+ */
+void stream_set_flush_budget(int interval_ms, size_t max_bytes);
+
+#endif /* MOTIFGPT_STREAM_H */
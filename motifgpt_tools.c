@@ -0,0 +1,569 @@
+#include "motifgpt_tools.h"
+#include "motifgpt_chat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define TOOL_REGISTRY_MIN_SLOTS 64
+#define TOOL_CACHE_BUCKETS 512
+
+static unsigned long last_tool_call_id = 0;
+
+// Calls whose deadline has not passed, each holding a reference
+static pthread_mutex_t watch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t watch_cond;
+static tool_call_t *watched = NULL;
+static bool watchdog_running = false;
+static pthread_t watchdog_tid;
+
+// Calls waiting for a tool thread, each holding the reference tool_call_run() drops
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static tool_call_t *queue_head = NULL, *queue_tail = NULL;
+static int queue_len = 0;
+static int tool_threads = 0, idle_tool_threads = 0;
+static bool queue_stopped = false;
+
+static void tool_call_run(tool_call_t *call);
+
+typedef struct tool_cache_entry {
+    struct tool_cache_entry *next;
+    const motifgpt_tool_t *tool;
+    char *args_json;
+    char *result;
+    long long stamp;
+    uint64_t expires_ns;
+} tool_cache_entry_t;
+
+// Results of cacheable tools, keyed by tool and arguments; shared by the tool threads
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static tool_cache_entry_t *cache_buckets[TOOL_CACHE_BUCKETS];
+static int cache_entries = 0;
+
+static uint64_t now_ns() {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t tool_name_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) hash = (hash ^ (unsigned char)*name) * 16777619u;
+    return hash;
+}
+
+static tool_cache_entry_t **tool_cache_bucket(const motifgpt_tool_t *tool, const char *args_json) {
+    uint32_t hash = tool_name_hash(tool->name) * 16777619u ^ tool_name_hash(args_json);
+    return &cache_buckets[hash % TOOL_CACHE_BUCKETS];
+}
+
+static void tool_cache_entry_free(tool_cache_entry_t *entry) {
+    free(entry->args_json);
+    free(entry->result);
+    free(entry);
+}
+
+// Returns a copy of the cached result, dropping the entry if it is stale.
+static char *tool_cache_lookup(const motifgpt_tool_t *tool, const char *args_json, long long stamp) {
+    char *result = NULL;
+    pthread_mutex_lock(&cache_mutex);
+    tool_cache_entry_t **link = tool_cache_bucket(tool, args_json);
+    while (*link && ((*link)->tool != tool || strcmp((*link)->args_json, args_json) != 0)) link = &(*link)->next;
+    tool_cache_entry_t *entry = *link;
+    if (entry && (entry->expires_ns <= now_ns() || entry->stamp != stamp)) {
+        *link = entry->next;
+        tool_cache_entry_free(entry);
+        cache_entries--;
+    } else if (entry) {
+        result = strdup(entry->result);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    return result;
+}
+
+// Makes room for one more entry: expired ones go first, then the one closest to expiring.
+static void tool_cache_evict() {
+    uint64_t now = now_ns();
+    tool_cache_entry_t **soonest = NULL;
+    for (int i = 0; i < TOOL_CACHE_BUCKETS; i++) {
+        tool_cache_entry_t **link = &cache_buckets[i];
+        while (*link) {
+            tool_cache_entry_t *entry = *link;
+            if (entry->expires_ns <= now) {
+                *link = entry->next;
+                tool_cache_entry_free(entry);
+                cache_entries--;
+                continue;
+            }
+            if (!soonest || entry->expires_ns < (*soonest)->expires_ns) soonest = link;
+            link = &entry->next;
+        }
+    }
+    if (cache_entries >= TOOL_CACHE_MAX_ENTRIES && soonest) {
+        tool_cache_entry_t *entry = *soonest;
+        *soonest = entry->next;
+        tool_cache_entry_free(entry);
+        cache_entries--;
+    }
+}
+
+static void tool_cache_store(const motifgpt_tool_t *tool, const char *args_json, long long stamp, const char *result) {
+    tool_cache_entry_t *entry = calloc(1, sizeof(tool_cache_entry_t));
+    if (!entry || !(entry->args_json = strdup(args_json)) || !(entry->result = strdup(result))) {
+        perror("tool cache entry");
+        if (entry) tool_cache_entry_free(entry);
+        return;
+    }
+    entry->tool = tool;
+    entry->stamp = stamp;
+    entry->expires_ns = now_ns() + (uint64_t)tool->cache_ttl_ms * 1000000ULL;
+    pthread_mutex_lock(&cache_mutex);
+    tool_cache_entry_t **link = tool_cache_bucket(tool, args_json);
+    // Two tool threads may have raced to run the same call; keep the newer result
+    while (*link && ((*link)->tool != tool || strcmp((*link)->args_json, args_json) != 0)) link = &(*link)->next;
+    if (*link) {
+        tool_cache_entry_t *old = *link;
+        *link = old->next;
+        tool_cache_entry_free(old);
+        cache_entries--;
+    }
+    if (cache_entries >= TOOL_CACHE_MAX_ENTRIES) tool_cache_evict();
+    link = tool_cache_bucket(tool, args_json);
+    entry->next = *link;
+    *link = entry;
+    cache_entries++;
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void tool_cache_clear() {
+    pthread_mutex_lock(&cache_mutex);
+    for (int i = 0; i < TOOL_CACHE_BUCKETS; i++) {
+        while (cache_buckets[i]) {
+            tool_cache_entry_t *entry = cache_buckets[i];
+            cache_buckets[i] = entry->next;
+            tool_cache_entry_free(entry);
+        }
+    }
+    cache_entries = 0;
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+tool_call_t *tool_call_create(const motifgpt_tool_t *tool, const char *args_json) {
+    tool_call_t *call = calloc(1, sizeof(tool_call_t));
+    if (!call) { perror("calloc tool_call"); return NULL; }
+    call->args_json = strdup(args_json ? args_json : "{}");
+    if (!call->args_json) { perror("strdup tool args"); free(call); return NULL; }
+    call->refcount = 1;
+    call->id = __atomic_add_fetch(&last_tool_call_id, 1, __ATOMIC_RELAXED);
+    call->tool = tool;
+    call->state = TOOL_CALL_RUNNING;
+    return call;
+}
+
+// Settles the call once; a result that comes second is freed.
+static void tool_call_finish(tool_call_t *call, tool_call_state_t state, char *result) {
+    int expected = TOOL_CALL_RUNNING;
+    if (!__atomic_compare_exchange_n(&call->state, &expected, (int)state, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(result);
+        return;
+    }
+    call->result = result;
+    if (!__atomic_load_n(&call->abandoned, __ATOMIC_ACQUIRE)) write_pipe_frame(PIPE_MSG_TOOL_DONE, &call->id, sizeof(call->id));
+}
+
+// Takes the call off the watch list; true if it was there, so its reference is the caller's to drop.
+static bool tool_call_unwatch(tool_call_t *call) {
+    pthread_mutex_lock(&watch_mutex);
+    tool_call_t **link = &watched;
+    while (*link && *link != call) link = &(*link)->next_watched;
+    bool found = *link != NULL;
+    if (found) *link = call->next_watched;
+    pthread_mutex_unlock(&watch_mutex);
+    return found;
+}
+
+static void tool_call_time_out(tool_call_t *call) {
+    int timeout_ms = call->tool->timeout_ms > 0 ? call->tool->timeout_ms : TOOL_DEFAULT_TIMEOUT_MS;
+    char message[256];
+    snprintf(message, sizeof(message), "{\"error\": \"Tool %s timed out after %d ms\"}", call->tool->name, timeout_ms);
+    tool_call_finish(call, TOOL_CALL_TIMED_OUT, strdup(message));
+    // Only now, so a tool that gives up early cannot beat the timeout to the result
+    __atomic_store_n(&call->cancelled, 1, __ATOMIC_RELEASE);
+}
+
+static void *tool_watchdog_main(void *arg) {
+    pthread_mutex_lock(&watch_mutex);
+    while (watchdog_running) {
+        uint64_t now = now_ns(), next = 0;
+        tool_call_t *expired = NULL;
+        tool_call_t **link = &watched;
+        while (*link) {
+            tool_call_t *call = *link;
+            if (call->deadline_ns <= now) {
+                *link = call->next_watched;
+                call->next_watched = expired;
+                expired = call;
+            } else {
+                if (!next || call->deadline_ns < next) next = call->deadline_ns;
+                link = &call->next_watched;
+            }
+        }
+        if (expired) {
+            // Pipe writes can block, so never hold the lock across them
+            pthread_mutex_unlock(&watch_mutex);
+            while (expired) {
+                tool_call_t *call = expired;
+                expired = call->next_watched;
+                tool_call_time_out(call);
+                tool_call_release(call);
+            }
+            pthread_mutex_lock(&watch_mutex);
+            continue;
+        }
+        if (!next) { pthread_cond_wait(&watch_cond, &watch_mutex); continue; }
+        struct timespec deadline = { (time_t)(next / 1000000000ULL), (long)(next % 1000000000ULL) };
+        pthread_cond_timedwait(&watch_cond, &watch_mutex, &deadline);
+    }
+    pthread_mutex_unlock(&watch_mutex);
+    return NULL;
+}
+
+static void *tool_thread_main(void *arg) {
+    pthread_mutex_lock(&queue_mutex);
+    for (;;) {
+        idle_tool_threads++;
+        while (!queue_stopped && !queue_head) pthread_cond_wait(&queue_cond, &queue_mutex);
+        idle_tool_threads--;
+        if (queue_stopped) break;
+        tool_call_t *call = queue_head;
+        queue_head = call->next_queued;
+        if (!queue_head) queue_tail = NULL;
+        queue_len--;
+        pthread_mutex_unlock(&queue_mutex);
+        tool_call_run(call);
+        pthread_mutex_lock(&queue_mutex);
+    }
+    tool_threads--;
+    pthread_mutex_unlock(&queue_mutex);
+    return NULL;
+}
+
+static int tool_queue_push(tool_call_t *call) {
+    pthread_mutex_lock(&queue_mutex);
+    if (queue_stopped) { pthread_mutex_unlock(&queue_mutex); return -1; }
+    if (queue_len >= idle_tool_threads && tool_threads < TOOL_MAX_THREADS) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, tool_thread_main, NULL) == 0) {
+            pthread_detach(tid);
+            tool_threads++;
+        } else {
+            perror("pthread_create tool thread");
+            if (tool_threads == 0) { pthread_mutex_unlock(&queue_mutex); return -1; }
+        }
+    }
+    call->next_queued = NULL;
+    if (queue_tail) queue_tail->next_queued = call; else queue_head = call;
+    queue_tail = call;
+    queue_len++;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+    return 0;
+}
+
+int tool_executor_start() {
+    pthread_mutex_lock(&queue_mutex);
+    queue_stopped = false;
+    pthread_mutex_unlock(&queue_mutex);
+    pthread_mutex_lock(&watch_mutex);
+    if (watchdog_running) { pthread_mutex_unlock(&watch_mutex); return 0; }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&watch_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    watchdog_running = true;
+    if (pthread_create(&watchdog_tid, NULL, tool_watchdog_main, NULL) != 0) {
+        perror("pthread_create tool watchdog");
+        watchdog_running = false;
+        pthread_cond_destroy(&watch_cond);
+        pthread_mutex_unlock(&watch_mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&watch_mutex);
+    return 0;
+}
+
+void tool_executor_stop() {
+    pthread_mutex_lock(&queue_mutex);
+    queue_stopped = true;
+    tool_call_t *queued = queue_head;
+    queue_head = queue_tail = NULL;
+    queue_len = 0;
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+    while (queued) {
+        tool_call_t *next = queued->next_queued;
+        tool_call_release(queued);
+        queued = next;
+    }
+
+    pthread_mutex_lock(&watch_mutex);
+    bool was_running = watchdog_running;
+    watchdog_running = false;
+    if (was_running) pthread_cond_signal(&watch_cond);
+    tool_call_t *left = watched;
+    watched = NULL;
+    pthread_mutex_unlock(&watch_mutex);
+    if (was_running) {
+        pthread_join(watchdog_tid, NULL);
+        pthread_cond_destroy(&watch_cond);
+    }
+    while (left) {
+        tool_call_t *next = left->next_watched;
+        tool_call_release(left);
+        left = next;
+    }
+}
+
+int tool_call_submit(tool_call_t *call) {
+    int timeout_ms = call->tool->timeout_ms > 0 ? call->tool->timeout_ms : TOOL_DEFAULT_TIMEOUT_MS;
+    __atomic_add_fetch(&call->refcount, 1, __ATOMIC_RELAXED); // The tool thread's
+    pthread_mutex_lock(&watch_mutex);
+    if (watchdog_running) {
+        __atomic_add_fetch(&call->refcount, 1, __ATOMIC_RELAXED); // The watchdog's
+        call->deadline_ns = now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+        call->next_watched = watched;
+        watched = call;
+        pthread_cond_signal(&watch_cond);
+    }
+    pthread_mutex_unlock(&watch_mutex);
+    if (tool_queue_push(call) == 0) return 0;
+    if (tool_call_unwatch(call)) tool_call_release(call);
+    tool_call_release(call);
+    return -1;
+}
+
+// Runs the tool, or serves its result from the cache; drops the tool thread's reference.
+static void tool_call_run(tool_call_t *call) {
+    char *result = NULL;
+    if (!__atomic_load_n(&call->cancelled, __ATOMIC_ACQUIRE)) {
+        const motifgpt_tool_t *tool = call->tool;
+        bool cacheable = tool->cache_ttl_ms > 0;
+        long long stamp = 0;
+        if (cacheable && tool->cache_validator) {
+            stamp = tool->cache_validator(call->args_json);
+            cacheable = stamp != -1;
+        }
+        if (cacheable) result = tool_cache_lookup(tool, call->args_json, stamp);
+        if (!result) {
+            result = tool->execute_cancellable ? tool->execute_cancellable(call->args_json, &call->cancelled) : tool->execute(call->args_json);
+            // A cancelled tool may have stopped short, so only a complete result is kept
+            if (cacheable && result && !__atomic_load_n(&call->cancelled, __ATOMIC_ACQUIRE)) tool_cache_store(tool, call->args_json, stamp, result);
+        }
+    }
+    tool_call_finish(call, TOOL_CALL_FINISHED, result);
+    if (tool_call_unwatch(call)) tool_call_release(call);
+    tool_call_release(call);
+}
+
+char *tool_call_take_result(tool_call_t *call) {
+    char *result = call->result;
+    call->result = NULL;
+    return result;
+}
+
+void tool_call_cancel(tool_call_t *call) {
+    if (!call) return;
+    __atomic_store_n(&call->abandoned, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&call->cancelled, 1, __ATOMIC_RELEASE);
+    tool_call_release(call);
+}
+
+void tool_call_release(tool_call_t *call) {
+    if (!call || __atomic_sub_fetch(&call->refcount, 1, __ATOMIC_ACQ_REL) > 0) return;
+    free(call->args_json);
+    free(call->result);
+    free(call);
+}
+
+// Makes room for one more slot.
+static int tool_batch_reserve(tool_batch_t *batch) {
+    if (batch->count < batch->capacity) return 0;
+    int capacity = batch->capacity ? batch->capacity * 2 : 4;
+    tool_batch_slot_t *slots = realloc(batch->slots, (size_t)capacity * sizeof(tool_batch_slot_t));
+    if (!slots) { perror("realloc tool batch"); return -1; }
+    batch->slots = slots;
+    batch->capacity = capacity;
+    return 0;
+}
+
+int tool_batch_add_result(tool_batch_t *batch, const char *name, const char *result) {
+    if (tool_batch_reserve(batch) != 0) return -1;
+    char *copy = strdup(result);
+    if (!copy) { perror("strdup tool result"); return -1; }
+    tool_batch_slot_t *slot = &batch->slots[batch->count++];
+    slot->name = name;
+    slot->call = NULL;
+    slot->result = copy;
+    return 0;
+}
+
+int tool_batch_add_call(tool_batch_t *batch, tool_call_t *call) {
+    if (tool_batch_reserve(batch) != 0) return -1;
+    tool_batch_slot_t *slot = &batch->slots[batch->count++];
+    slot->name = call->tool->name;
+    slot->call = call;
+    slot->result = NULL;
+    batch->pending++;
+    return 0;
+}
+
+bool tool_batch_finish_call(tool_batch_t *batch, unsigned long id) {
+    for (int i = 0; i < batch->count; i++) {
+        tool_batch_slot_t *slot = &batch->slots[i];
+        if (!slot->call || slot->call->id != id) continue;
+        char *result = tool_call_take_result(slot->call);
+        slot->result = result ? result : strdup("{\"error\": \"Tool returned no result\"}");
+        tool_call_release(slot->call);
+        slot->call = NULL;
+        batch->pending--;
+        return true;
+    }
+    return false;
+}
+
+// Writes `s` as a JSON string into `out`, which needs room for 6 bytes per input byte plus 3; returns the length.
+static size_t json_quote(char *out, const char *s) {
+    char *p = out;
+    *p++ = '"';
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') { *p++ = '\\'; *p++ = (char)c; }
+        else if (c == '\n') { *p++ = '\\'; *p++ = 'n'; }
+        else if (c == '\t') { *p++ = '\\'; *p++ = 't'; }
+        else if (c == '\r') { *p++ = '\\'; *p++ = 'r'; }
+        else if (c < 0x20) p += sprintf(p, "\\u%04x", c);
+        else *p++ = (char)c;
+    }
+    *p++ = '"';
+    *p = '\0';
+    return (size_t)(p - out);
+}
+
+char *tool_batch_join(const tool_batch_t *batch) {
+    static const char open_tag[] = "<tool_result>", close_tag[] = "</tool_result>";
+    const char *missing = "{\"error\": \"Out of memory\"}";
+    size_t size = sizeof(open_tag) + sizeof(close_tag) + 2;
+    for (int i = 0; i < batch->count; i++) {
+        const char *name = batch->slots[i].name ? batch->slots[i].name : "";
+        const char *result = batch->slots[i].result ? batch->slots[i].result : missing;
+        size += 6 * (strlen(name) + strlen(result)) + 32;
+    }
+    char *message = malloc(size);
+    if (!message) { perror("malloc tool results"); return NULL; }
+    char *p = message + sprintf(message, "%s", open_tag);
+    if (batch->count == 1) {
+        p += sprintf(p, "%s", batch->slots[0].result ? batch->slots[0].result : missing);
+    } else {
+        *p++ = '[';
+        for (int i = 0; i < batch->count; i++) {
+            p += sprintf(p, "%s{\"name\": ", i ? ", " : "");
+            p += json_quote(p, batch->slots[i].name ? batch->slots[i].name : "");
+            p += sprintf(p, ", \"result\": ");
+            p += json_quote(p, batch->slots[i].result ? batch->slots[i].result : missing);
+            *p++ = '}';
+        }
+        *p++ = ']';
+    }
+    sprintf(p, "%s", close_tag);
+    return message;
+}
+
+void tool_batch_clear(tool_batch_t *batch) {
+    for (int i = 0; i < batch->count; i++) {
+        tool_call_cancel(batch->slots[i].call);
+        free(batch->slots[i].result);
+    }
+    free(batch->slots);
+    memset(batch, 0, sizeof(tool_batch_t));
+}
+
+// Finds the slot holding `name`, or the empty slot where it would go.
+static size_t tool_registry_probe(const tool_registry_t *registry, const char *name) {
+    size_t mask = registry->num_slots - 1;
+    size_t i = tool_name_hash(name) & mask;
+    while (registry->slots[i] && strcmp(registry->tools[registry->slots[i] - 1]->name, name) != 0) i = (i + 1) & mask;
+    return i;
+}
+
+// Rebuilds the index at twice the size, keeping it at most half full.
+static int tool_registry_grow_index(tool_registry_t *registry) {
+    size_t num_slots = registry->num_slots ? registry->num_slots * 2 : TOOL_REGISTRY_MIN_SLOTS;
+    int *slots = calloc(num_slots, sizeof(int));
+    if (!slots) { perror("calloc tool registry index"); return -1; }
+    free(registry->slots);
+    registry->slots = slots;
+    registry->num_slots = num_slots;
+    for (int i = 0; i < registry->count; i++) registry->slots[tool_registry_probe(registry, registry->tools[i]->name)] = i + 1;
+    return 0;
+}
+
+int tool_registry_add(tool_registry_t *registry, const motifgpt_tool_t *tool) {
+    if ((size_t)(registry->count + 1) * 2 > registry->num_slots && tool_registry_grow_index(registry) != 0) return -1;
+    size_t slot = tool_registry_probe(registry, tool->name);
+    if (registry->slots[slot]) return 1;
+    if (registry->count == registry->capacity) {
+        int capacity = registry->capacity ? registry->capacity * 2 : 16;
+        const motifgpt_tool_t **tools = realloc(registry->tools, (size_t)capacity * sizeof(*tools));
+        if (!tools) { perror("realloc tool registry"); return -1; }
+        registry->tools = tools;
+        registry->capacity = capacity;
+    }
+    registry->tools[registry->count++] = tool;
+    registry->slots[slot] = registry->count;
+    return 0;
+}
+
+const motifgpt_tool_t *tool_registry_find(const tool_registry_t *registry, const char *name) {
+    if (registry->num_slots == 0) return NULL;
+    int index = registry->slots[tool_registry_probe(registry, name)];
+    return index ? registry->tools[index - 1] : NULL;
+}
+
+const motifgpt_tool_t *tool_registry_adapt_tools(tool_registry_t *registry, const void *tools, int num_tools, int abi_version) {
+    if (abi_version == MOTIFGPT_PLUGIN_ABI_VERSION) return (const motifgpt_tool_t *)tools;
+    if (abi_version < 1 || abi_version > MOTIFGPT_PLUGIN_ABI_VERSION || num_tools < 0) return NULL;
+    motifgpt_tool_t **adapted = realloc(registry->adapted, (size_t)(registry->num_adapted + 1) * sizeof(*adapted));
+    if (!adapted) { perror("realloc adapted tools"); return NULL; }
+    registry->adapted = adapted;
+    motifgpt_tool_t *copy = calloc(num_tools > 0 ? num_tools : 1, sizeof(motifgpt_tool_t));
+    if (!copy) { perror("calloc adapted tools"); return NULL; }
+    for (int i = 0; i < num_tools; i++) {
+        if (abi_version == 1) {
+            const motifgpt_tool_v1_t *old = &((const motifgpt_tool_v1_t *)tools)[i];
+            copy[i].name = old->name;
+            copy[i].description = old->description;
+            copy[i].parameters_schema = old->parameters_schema;
+            copy[i].execute = old->execute;
+        } else {
+            const motifgpt_tool_v2_t *old = &((const motifgpt_tool_v2_t *)tools)[i];
+            copy[i].name = old->name;
+            copy[i].description = old->description;
+            copy[i].parameters_schema = old->parameters_schema;
+            copy[i].execute = old->execute;
+            copy[i].timeout_ms = old->timeout_ms;
+            copy[i].execute_cancellable = old->execute_cancellable;
+        }
+    }
+    registry->adapted[registry->num_adapted++] = copy;
+    return copy;
+}
+
+void tool_registry_free(tool_registry_t *registry) {
+    for (int i = 0; i < registry->num_adapted; i++) free(registry->adapted[i]);
+    free(registry->adapted);
+    free(registry->tools);
+    free(registry->slots);
+    memset(registry, 0, sizeof(tool_registry_t));
+}
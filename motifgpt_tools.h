@@ -0,0 +1,217 @@
+#ifndef MOTIFGPT_TOOLS_H
+#define MOTIFGPT_TOOLS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "motifgpt_plugin.h"
+
+#define TOOL_DEFAULT_TIMEOUT_MS 30000
+#define TOOL_MAX_THREADS 8 // Tool calls get their own threads, so a stuck tool never holds up the worker pool
+#define TOOL_CACHE_MAX_ENTRIES 256
+
+typedef enum {
+    TOOL_CALL_RUNNING,
+    TOOL_CALL_FINISHED,
+    TOOL_CALL_TIMED_OUT
+} tool_call_state_t;
+
+/**
+ * One tool call, run on a tool thread so a slow tool never holds up the UI
+ * thread. A watchdog thread enforces the tool's timeout: whichever of the
+ * tool thread and the watchdog finishes the call first sets `result` and
+ * posts PIPE_MSG_TOOL_DONE with the call's id, unless the UI thread
+ * cancelled it. Timing out or cancelling sets `cancelled`, which tools with
+ * execute_cancellable() can poll; a tool that ignores it keeps its tool
+ * thread until it returns, and its late result is dropped. Tool threads are
+ * separate from the worker pool and capped at TOOL_MAX_THREADS, so stuck
+ * tools can only delay other tool calls.
+ */
+typedef struct tool_call {
+    int refcount;
+    unsigned long id;
+    int cancelled; // Set on timeout or cancellation; what tools poll
+    int abandoned; // Set by tool_call_cancel(); nothing is posted after it
+    int state; // A tool_call_state_t; leaves TOOL_CALL_RUNNING exactly once
+    const motifgpt_tool_t *tool;
+    char *args_json;
+    char *result; // Belongs to the UI thread once PIPE_MSG_TOOL_DONE arrives; NULL if the tool returned nothing
+
+    // Watchdog only
+    uint64_t deadline_ns;
+    struct tool_call *next_watched;
+
+    struct tool_call *next_queued; // Waiting for a tool thread
+} tool_call_t;
+
+/**
+ * Every tool the plugins provide, in load order, with an open-addressing
+ * index on name so lookups stay constant-time however many are loaded.
+ * Zero-initialised it is empty and ready to use. UI thread only.
+ */
+typedef struct {
+    const motifgpt_tool_t **tools;
+    int count;
+    int capacity;
+    int *slots; // Index into `tools` plus one, 0 when empty; a power of two in size
+    size_t num_slots;
+    motifgpt_tool_t **adapted; // Copies of older plugins' tools in the current layout
+    int num_adapted;
+} tool_registry_t;
+
+/**
+ * One call in a tool_batch_t: a running call or, once it is done or could not
+ * be started, its result.
+ */
+typedef struct {
+    const char *name; // The tool called, for the joined results
+    tool_call_t *call; // NULL once the slot has its result
+    char *result;
+} tool_batch_slot_t;
+
+/**
+ * The tool calls from one reply, run concurrently. Calls join the batch as
+ * they stream in, and it grows to hold however many the reply makes. When the
+ * reply has ended and every slot has a result they are sent back together as
+ * one message. Zero-initialised it is empty and ready to use. UI thread only.
+ */
+typedef struct {
+    tool_batch_slot_t *slots;
+    int count;
+    int capacity;
+    int pending; // Slots still waiting for their call
+    bool streaming; // The reply is still coming in, so more calls may join
+} tool_batch_t;
+
+/**
+ * Adds a slot whose result is already known, e.g. an error for a call that could not be parsed.
+ * @param batch The batch.
+ * @param name The tool name, or NULL if there was none; must outlive the batch.
+ * @param result The result, copied.
+ * @return 0 on success, -1 if out of memory.
+ */
+int tool_batch_add_result(tool_batch_t *batch, const char *name, const char *result);
+
+/**
+ * Adds a slot for a submitted call, taking over the UI thread's reference.
+ * @param batch The batch.
+ * @param call The call.
+ * @return 0 on success, -1 if out of memory; the reference is then still the caller's.
+ */
+int tool_batch_add_call(tool_batch_t *batch, tool_call_t *call);
+
+/**
+ * Collects the result of a call that posted PIPE_MSG_TOOL_DONE.
+ * @param batch The batch.
+ * @param id The call's id.
+ * @return true if the call was in the batch.
+ */
+bool tool_batch_finish_call(tool_batch_t *batch, unsigned long id);
+
+/**
+ * Joins the results into the message that answers the reply: one
+ * <tool_result> holding the single result as is, or for several calls a JSON
+ * array of {"name": ..., "result": ...} in call order.
+ * @param batch A batch with no pending slots.
+ * @return The message, to be freed by the caller, or NULL on allocation failure.
+ */
+char *tool_batch_join(const tool_batch_t *batch);
+
+/**
+ * Cancels any calls still running, frees the results and slots and empties the batch.
+ * @param batch The batch.
+ */
+void tool_batch_clear(tool_batch_t *batch);
+
+/**
+ * Adds a tool.
+ * @param registry The registry.
+ * @param tool The tool; must outlive the registry.
+ * @return 0 on success, 1 if a tool by that name is already registered, -1 on allocation failure.
+ */
+int tool_registry_add(tool_registry_t *registry, const motifgpt_tool_t *tool);
+
+/**
+ * Looks a tool up by name.
+ * @param registry The registry.
+ * @param name The tool name.
+ * @return The tool, or NULL if there is none by that name.
+ */
+const motifgpt_tool_t *tool_registry_find(const tool_registry_t *registry, const char *name);
+
+/**
+ * Returns a plugin's tools in the current motifgpt_tool_t layout. Tools built
+ * against an older plugin ABI are copied, with the fields that version lacks
+ * left zero; the registry keeps the copy until it is freed.
+ * @param registry The registry.
+ * @param tools The plugin's tools array, in the layout of `abi_version`.
+ * @param num_tools The number of tools in it.
+ * @param abi_version The plugin ABI version the plugin was built against.
+ * @return The tools, or NULL if the version is not supported or on allocation failure.
+ */
+const motifgpt_tool_t *tool_registry_adapt_tools(tool_registry_t *registry, const void *tools, int num_tools, int abi_version);
+
+/**
+ * Frees the registry's storage and adapted tools, leaving it empty. The plugins' own tools are not touched.
+ * @param registry The registry.
+ */
+void tool_registry_free(tool_registry_t *registry);
+
+/**
+ * Starts the watchdog thread, and lets tool threads take calls again after
+ * tool_executor_stop(). Without the watchdog calls run with no timeout.
+ * @return 0 on success, -1 on failure.
+ */
+int tool_executor_start();
+
+/**
+ * Stops the watchdog thread and lets go of the calls it was watching, and drops
+ * the calls still waiting for a tool thread. Tool threads are detached, so any
+ * stuck in a tool are not waited for; they exit once it returns.
+ */
+void tool_executor_stop();
+
+/**
+ * Creates a call with one reference, for the UI thread.
+ * @param tool The tool; must outlive the call.
+ * @param args_json The arguments, copied.
+ * @return The call, or NULL on allocation failure.
+ */
+tool_call_t *tool_call_create(const motifgpt_tool_t *tool, const char *args_json);
+
+/**
+ * Starts the call's timeout and queues it for a tool thread, starting one if
+ * none is idle and there are fewer than TOOL_MAX_THREADS. The tool runs there,
+ * or for a tool with a cache_ttl_ms an identical earlier call's result is
+ * served from memory while it is fresh and its cache_validator still agrees.
+ * @param call The call.
+ * @return 0 if queued, -1 if the executor is stopped or no thread could be started;
+ *         the UI thread's reference stays either way.
+ */
+int tool_call_submit(tool_call_t *call);
+
+/**
+ * Takes the result. UI thread, after PIPE_MSG_TOOL_DONE.
+ * @param call The call.
+ * @return The result, to be freed by the caller, or NULL if the tool returned none.
+ */
+char *tool_call_take_result(tool_call_t *call);
+
+/**
+ * Forgets every cached result.
+ */
+void tool_cache_clear();
+
+/**
+ * Tells the tool to stop, suppresses PIPE_MSG_TOOL_DONE and drops the UI thread's reference.
+ * @param call The call; NULL is ignored.
+ */
+void tool_call_cancel(tool_call_t *call);
+
+/**
+ * Drops a reference, freeing the call with the last one.
+ * @param call The call; NULL is ignored.
+ */
+void tool_call_release(tool_call_t *call);
+
+#endif /* MOTIFGPT_TOOLS_H */
@@ -0,0 +1,133 @@
+#include "motifgpt_transcript.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINE_COMPACT_THRESHOLD 1024
+
+static int add_line_start(transcript_t *t, size_t pos) {
+    if (t->num_lines == t->lines_cap) {
+        size_t new_cap = t->lines_cap ? t->lines_cap * 2 : 256;
+        size_t *new_lines = realloc(t->line_starts, new_cap * sizeof(size_t));
+        if (!new_lines) { perror("realloc transcript lines"); return -1; }
+        t->line_starts = new_lines; t->lines_cap = new_cap;
+    }
+    t->line_starts[t->num_lines++] = pos;
+    return 0;
+}
+
+void transcript_init(transcript_t *t) {
+    memset(t, 0, sizeof(*t));
+}
+
+void transcript_free(transcript_t *t) {
+    for (size_t i = 0; i < t->num_chunks; i++) free(t->chunks[i]);
+    free(t->chunks);
+    free(t->line_starts);
+    unsigned long generation = t->generation;
+    transcript_init(t);
+    t->generation = generation + 1;
+}
+
+void transcript_clear(transcript_t *t) {
+    for (size_t i = 0; i < t->num_chunks; i++) { free(t->chunks[i]); t->chunks[i] = NULL; }
+    t->num_chunks = 0;
+    t->start = t->length = 0;
+    t->first_line = t->num_lines = 0;
+    t->generation++;
+}
+
+int transcript_append(transcript_t *t, const char *text, size_t len) {
+    if (t->num_lines == t->first_line && add_line_start(t, t->start + t->length) != 0) return -1;
+    while (len > 0) {
+        size_t pos = t->start + t->length;
+        size_t chunk_idx = pos / TRANSCRIPT_CHUNK_SIZE;
+        size_t chunk_off = pos % TRANSCRIPT_CHUNK_SIZE;
+        if (chunk_idx == t->num_chunks) {
+            if (t->num_chunks == t->chunks_cap) {
+                size_t new_cap = t->chunks_cap ? t->chunks_cap * 2 : 8;
+                char **new_chunks = realloc(t->chunks, new_cap * sizeof(char *));
+                if (!new_chunks) { perror("realloc transcript chunks"); return -1; }
+                t->chunks = new_chunks; t->chunks_cap = new_cap;
+            }
+            t->chunks[t->num_chunks] = malloc(TRANSCRIPT_CHUNK_SIZE);
+            if (!t->chunks[t->num_chunks]) { perror("malloc transcript chunk"); return -1; }
+            t->num_chunks++;
+        }
+        size_t n = TRANSCRIPT_CHUNK_SIZE - chunk_off;
+        if (n > len) n = len;
+        char *dst = t->chunks[chunk_idx] + chunk_off;
+        memcpy(dst, text, n);
+        for (const char *nl = memchr(dst, '\n', n); nl; nl = memchr(nl + 1, '\n', n - (size_t)(nl + 1 - dst))) {
+            if (add_line_start(t, pos + (size_t)(nl - dst) + 1) != 0) return -1;
+        }
+        t->length += n; text += n; len -= n;
+    }
+    return 0;
+}
+
+size_t transcript_end(const transcript_t *t) {
+    return t->start + t->length;
+}
+
+void transcript_truncate(transcript_t *t, size_t pos) {
+    if (pos < t->start) pos = t->start;
+    if (pos >= t->start + t->length) return;
+    size_t keep_chunks = (pos + TRANSCRIPT_CHUNK_SIZE - 1) / TRANSCRIPT_CHUNK_SIZE;
+    for (size_t i = keep_chunks; i < t->num_chunks; i++) { free(t->chunks[i]); t->chunks[i] = NULL; }
+    if (keep_chunks < t->num_chunks) t->num_chunks = keep_chunks;
+    t->length = pos - t->start;
+    while (t->num_lines > t->first_line && t->line_starts[t->num_lines - 1] > pos) t->num_lines--;
+    if (t->length == 0) t->num_lines = t->first_line;
+}
+
+void transcript_drop_before(transcript_t *t, size_t pos) {
+    if (pos <= t->start) return;
+    if (pos > t->start + t->length) pos = t->start + t->length;
+    for (size_t i = t->start / TRANSCRIPT_CHUNK_SIZE; i < pos / TRANSCRIPT_CHUNK_SIZE; i++) {
+        free(t->chunks[i]); t->chunks[i] = NULL;
+    }
+    t->length -= pos - t->start;
+    t->start = pos;
+    while (t->first_line < t->num_lines && t->line_starts[t->first_line] < pos) t->first_line++;
+    if (t->length == 0) {
+        t->first_line = t->num_lines;
+    } else if (t->first_line == t->num_lines || t->line_starts[t->first_line] != pos) {
+        // The old first line always started before pos, so there is a free slot.
+        t->line_starts[--t->first_line] = pos;
+    }
+    if (t->first_line > LINE_COMPACT_THRESHOLD && t->first_line > t->num_lines / 2) {
+        memmove(t->line_starts, t->line_starts + t->first_line, (t->num_lines - t->first_line) * sizeof(size_t));
+        t->num_lines -= t->first_line;
+        t->first_line = 0;
+    }
+}
+
+size_t transcript_line_count(const transcript_t *t) {
+    return t->num_lines - t->first_line;
+}
+
+size_t transcript_line_offset(const transcript_t *t, size_t line) {
+    return line < transcript_line_count(t) ? t->line_starts[t->first_line + line] - t->start : t->length;
+}
+
+char *transcript_copy_lines(const transcript_t *t, size_t first_line, size_t num_lines, size_t *out_len) {
+    size_t total = transcript_line_count(t);
+    size_t start = transcript_line_offset(t, first_line);
+    size_t end = (num_lines > total || first_line >= total - num_lines)
+                 ? t->length : transcript_line_offset(t, first_line + num_lines);
+    size_t len = end - start;
+    char *out = malloc(len + 1);
+    if (!out) { perror("malloc transcript copy"); return NULL; }
+    size_t copied = 0;
+    while (copied < len) {
+        size_t pos = t->start + start + copied;
+        size_t n = TRANSCRIPT_CHUNK_SIZE - pos % TRANSCRIPT_CHUNK_SIZE;
+        if (n > len - copied) n = len - copied;
+        memcpy(out + copied, t->chunks[pos / TRANSCRIPT_CHUNK_SIZE] + pos % TRANSCRIPT_CHUNK_SIZE, n);
+        copied += n;
+    }
+    out[len] = '\0';
+    if (out_len) *out_len = len;
+    return out;
+}
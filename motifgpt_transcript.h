@@ -0,0 +1,100 @@
+#ifndef MOTIFGPT_TRANSCRIPT_H
+#define MOTIFGPT_TRANSCRIPT_H
+
+#include <stddef.h>
+
+#define TRANSCRIPT_CHUNK_SIZE (64 * 1024)
+
+/**
+ * The full conversation transcript as a rope of fixed-size chunks with a line
+ * index. Appends never move existing text and any byte offset maps straight to
+ * its chunk, so appending and copying out a window of lines cost time
+ * proportional to the text involved, not to the length of the transcript.
+ *
+ * Text is addressed by position: a byte offset that stays valid while text is
+ * dropped from the front, so callers can remember where things were rendered.
+ */
+typedef struct {
+    char **chunks;       // Indexed by position / TRANSCRIPT_CHUNK_SIZE; dropped chunks are NULL
+    size_t num_chunks;
+    size_t chunks_cap;
+    size_t start;        // Position of the first byte
+    size_t length;
+    size_t *line_starts; // Position of each line start; live lines begin at first_line
+    size_t first_line;
+    size_t num_lines;
+    size_t lines_cap;
+    unsigned long generation; // Bumped whenever positions are reset
+} transcript_t;
+
+/**
+ * Initialises an empty transcript.
+ * @param t The transcript.
+ */
+void transcript_init(transcript_t *t);
+
+/**
+ * Releases all memory held by the transcript and leaves it empty.
+ * @param t The transcript.
+ */
+void transcript_free(transcript_t *t);
+
+/**
+ * Empties the transcript. Positions restart from zero and the generation changes.
+ * @param t The transcript.
+ */
+void transcript_clear(transcript_t *t);
+
+/**
+ * @param t The transcript.
+ * @return The position just past the last byte, where the next append will go.
+ */
+size_t transcript_end(const transcript_t *t);
+
+/**
+ * Discards everything from `pos` to the end.
+ * @param t The transcript.
+ * @param pos A position returned by transcript_end().
+ */
+void transcript_truncate(transcript_t *t, size_t pos);
+
+/**
+ * Discards everything before `pos`. Later positions are unaffected.
+ * @param t The transcript.
+ * @param pos A position returned by transcript_end().
+ */
+void transcript_drop_before(transcript_t *t, size_t pos);
+
+/**
+ * Appends text to the end of the transcript.
+ * @param t The transcript.
+ * @param text The text to append.
+ * @param len Its length in bytes.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int transcript_append(transcript_t *t, const char *text, size_t len);
+
+/**
+ * @param t The transcript.
+ * @return The number of lines. Text after the last newline, even if empty, counts as a line.
+ */
+size_t transcript_line_count(const transcript_t *t);
+
+/**
+ * @param t The transcript.
+ * @param line A line number.
+ * @return The offset of the line from the start of the transcript, or the transcript length if line is past the end.
+ */
+size_t transcript_line_offset(const transcript_t *t, size_t line);
+
+/**
+ * Copies a run of lines out of the transcript.
+ * @param t The transcript.
+ * @param first_line The first line to copy.
+ * @param num_lines How many lines to copy; clamped to the end of the transcript.
+ * @param out_len Receives the length of the result; may be NULL.
+ * @return A newly allocated NUL-terminated string, or NULL on allocation failure.
+ */
+char *transcript_copy_lines(const transcript_t *t, size_t first_line, size_t num_lines, size_t *out_len);
+
+#endif /* MOTIFGPT_TRANSCRIPT_H */
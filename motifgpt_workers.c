@@ -0,0 +1,156 @@
+#include "motifgpt_workers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#define WORKER_KEY_BUF_SIZE 256
+#define WORKER_URL_BUF_SIZE 256
+
+typedef struct {
+    worker_job_fn fn;
+    void *arg;
+    worker_discard_fn discard;
+    struct timespec enqueued_at;
+} worker_job_t;
+
+struct worker {
+    pthread_t tid;
+    double current_wait_ms;
+    dp_context_t *ctx;
+    dp_provider_type_t ctx_provider;
+    char ctx_api_key[WORKER_KEY_BUF_SIZE];
+    char ctx_base_url[WORKER_URL_BUF_SIZE];
+};
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_not_empty = PTHREAD_COND_INITIALIZER;
+static worker_job_t job_queue[WORKER_QUEUE_CAPACITY];
+static size_t queue_head = 0, queue_len = 0;
+static bool pool_running = false;
+static worker_t *workers = NULL;
+static int num_workers_started = 0;
+static worker_pool_stats_t pool_stats;
+
+static double elapsed_ms(const struct timespec *from, const struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) * 1000.0 + (to->tv_nsec - from->tv_nsec) / 1000000.0;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *self = (worker_t *)arg;
+    for (;;) {
+        pthread_mutex_lock(&pool_mutex);
+        while (pool_running && queue_len == 0) pthread_cond_wait(&pool_not_empty, &pool_mutex);
+        if (!pool_running) { pthread_mutex_unlock(&pool_mutex); break; }
+        worker_job_t job = job_queue[queue_head];
+        queue_head = (queue_head + 1) % WORKER_QUEUE_CAPACITY; queue_len--;
+        struct timespec now; clock_gettime(CLOCK_MONOTONIC, &now);
+        self->current_wait_ms = elapsed_ms(&job.enqueued_at, &now);
+        pool_stats.queue_depth = queue_len;
+        pool_stats.total_wait_ms += self->current_wait_ms;
+        if (self->current_wait_ms > pool_stats.max_wait_ms) pool_stats.max_wait_ms = self->current_wait_ms;
+        pthread_mutex_unlock(&pool_mutex);
+
+        job.fn(self, job.arg);
+
+        pthread_mutex_lock(&pool_mutex);
+        pool_stats.jobs_completed++;
+        pthread_mutex_unlock(&pool_mutex);
+    }
+    if (self->ctx) { dp_destroy_context(self->ctx); self->ctx = NULL; }
+    return NULL;
+}
+
+int worker_pool_start(int num_workers) {
+    if (num_workers < 1) num_workers = WORKER_POOL_SIZE;
+    pthread_mutex_lock(&pool_mutex);
+    if (pool_running || workers) { pthread_mutex_unlock(&pool_mutex); return -1; }
+    workers = calloc(num_workers, sizeof(worker_t));
+    if (!workers) { perror("calloc workers"); pthread_mutex_unlock(&pool_mutex); return -1; }
+    pool_running = true;
+    queue_head = queue_len = 0;
+    memset(&pool_stats, 0, sizeof(pool_stats));
+    for (num_workers_started = 0; num_workers_started < num_workers; num_workers_started++) {
+        worker_t *w = &workers[num_workers_started];
+        if (pthread_create(&w->tid, NULL, worker_main, w) != 0) {
+            perror("pthread_create worker");
+            break;
+        }
+        pthread_detach(w->tid);
+    }
+    if (num_workers_started == 0) {
+        pool_running = false;
+        free(workers); workers = NULL;
+        pthread_mutex_unlock(&pool_mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    return 0;
+}
+
+void worker_pool_shutdown() {
+    worker_job_t dropped[WORKER_QUEUE_CAPACITY];
+    size_t num_dropped;
+    pthread_mutex_lock(&pool_mutex);
+    pool_running = false;
+    for (num_dropped = 0; num_dropped < queue_len; num_dropped++) {
+        dropped[num_dropped] = job_queue[(queue_head + num_dropped) % WORKER_QUEUE_CAPACITY];
+    }
+    queue_len = 0; pool_stats.queue_depth = 0;
+    pthread_cond_broadcast(&pool_not_empty);
+    pthread_mutex_unlock(&pool_mutex);
+    for (size_t i = 0; i < num_dropped; i++) {
+        if (dropped[i].discard) dropped[i].discard(dropped[i].arg);
+    }
+    // Detached workers still reference their worker_t until they notice the flag,
+    // so the array is deliberately not freed here.
+}
+
+int worker_pool_submit(worker_job_fn fn, void *arg, worker_discard_fn discard) {
+    if (!fn) return -1;
+    pthread_mutex_lock(&pool_mutex);
+    if (!pool_running || queue_len >= WORKER_QUEUE_CAPACITY) {
+        pool_stats.jobs_rejected++;
+        pthread_mutex_unlock(&pool_mutex);
+        return -1;
+    }
+    worker_job_t *job = &job_queue[(queue_head + queue_len) % WORKER_QUEUE_CAPACITY];
+    job->fn = fn; job->arg = arg; job->discard = discard;
+    clock_gettime(CLOCK_MONOTONIC, &job->enqueued_at);
+    queue_len++;
+    pool_stats.jobs_submitted++;
+    pool_stats.queue_depth = queue_len;
+    if (queue_len > pool_stats.max_queue_depth) pool_stats.max_queue_depth = queue_len;
+    pthread_cond_signal(&pool_not_empty);
+    pthread_mutex_unlock(&pool_mutex);
+    return 0;
+}
+
+void worker_pool_get_stats(worker_pool_stats_t *stats) {
+    if (!stats) return;
+    pthread_mutex_lock(&pool_mutex);
+    *stats = pool_stats;
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+double worker_job_wait_ms(const worker_t *self) {
+    return self ? self->current_wait_ms : 0.0;
+}
+
+dp_context_t *worker_get_context(worker_t *self, dp_provider_type_t provider, const char *api_key, const char *base_url) {
+    if (!self || !api_key) return NULL;
+    if (!base_url) base_url = "";
+    if (self->ctx && self->ctx_provider == provider &&
+        strcmp(self->ctx_api_key, api_key) == 0 && strcmp(self->ctx_base_url, base_url) == 0) {
+        return self->ctx;
+    }
+    if (self->ctx) { dp_destroy_context(self->ctx); self->ctx = NULL; }
+    self->ctx = dp_init_context(provider, api_key, base_url[0] ? base_url : NULL);
+    if (!self->ctx) return NULL;
+    self->ctx_provider = provider;
+    snprintf(self->ctx_api_key, sizeof(self->ctx_api_key), "%s", api_key);
+    snprintf(self->ctx_base_url, sizeof(self->ctx_base_url), "%s", base_url);
+    return self->ctx;
+}
@@ -0,0 +1,84 @@
+#ifndef MOTIFGPT_WORKERS_H
+#define MOTIFGPT_WORKERS_H
+
+#include <stddef.h>
+#include "disasterparty.h"
+
+#define WORKER_POOL_SIZE 4
+#define WORKER_POOL_MAX_SIZE 16 // Upper bound when the pool is sized to the CPU count
+#define WORKER_QUEUE_CAPACITY 32
+
+typedef struct worker worker_t;
+
+/**
+ * A unit of work run on a pool thread.
+ * @param self The worker running the job, for per-worker resources such as dp contexts.
+ * @param arg The argument passed to worker_pool_submit(); the job owns it.
+ */
+typedef void (*worker_job_fn)(worker_t *self, void *arg);
+
+/**
+ * Frees a job's argument when the job is dropped from the queue without running.
+ * @param arg The argument passed to worker_pool_submit().
+ */
+typedef void (*worker_discard_fn)(void *arg);
+
+typedef struct {
+    size_t queue_depth;          // Jobs waiting right now
+    size_t max_queue_depth;      // Highest queue_depth seen
+    unsigned long jobs_submitted;
+    unsigned long jobs_completed;
+    unsigned long jobs_rejected; // Refused because the queue was full or the pool stopped
+    double total_wait_ms;        // Sum of time jobs spent queued before a worker picked them up
+    double max_wait_ms;
+} worker_pool_stats_t;
+
+/**
+ * Starts the worker threads. Must be called once before worker_pool_submit().
+ * @param num_workers Number of threads; values < 1 fall back to WORKER_POOL_SIZE.
+ * @return 0 on success, -1 on failure.
+ */
+int worker_pool_start(int num_workers);
+
+/**
+ * Stops accepting jobs, drops anything still queued (calling each job's discard
+ * function) and tells the workers to exit once their current job returns. Does not
+ * wait for running jobs.
+ */
+void worker_pool_shutdown();
+
+/**
+ * Queues a job without blocking.
+ * @param fn The job function.
+ * @param arg Argument handed to the job.
+ * @param discard Called with arg if the job is dropped at shutdown instead of run; may be
+ *        NULL. Not called when the submit itself fails.
+ * @return 0 if queued, -1 if the queue is full or the pool is not running.
+ */
+int worker_pool_submit(worker_job_fn fn, void *arg, worker_discard_fn discard);
+
+/**
+ * Copies the pool's queue metrics.
+ * @param stats Destination for the metrics.
+ */
+void worker_pool_get_stats(worker_pool_stats_t *stats);
+
+/**
+ * Returns how long the job currently running on this worker waited in the queue.
+ * @param self The worker passed to the job.
+ * @return Wait time in milliseconds.
+ */
+double worker_job_wait_ms(const worker_t *self);
+
+/**
+ * Returns a dp context owned by this worker for the given credentials, reusing the
+ * one from the previous job when they match so its connections stay warm.
+ * @param self The worker passed to the job.
+ * @param provider The API provider.
+ * @param api_key The API key.
+ * @param base_url Optional base URL override, or NULL.
+ * @return The context (owned by the worker; do not destroy it), or NULL on failure.
+ */
+dp_context_t *worker_get_context(worker_t *self, dp_provider_type_t provider, const char *api_key, const char *base_url);
+
+#endif /* MOTIFGPT_WORKERS_H */
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include "motifgpt_plugin.h"
 #include <cjson/cJSON.h>
 
@@ -37,12 +38,29 @@ char* filereader_execute(const char* args_json) {
     return string;
 }
 
+// A cached read is good until the file changes.
+long long filereader_mtime(const char* args_json) {
+    cJSON* json = cJSON_Parse(args_json);
+    if (!json) return -1;
+    cJSON* file_param = cJSON_GetObjectItemCaseSensitive(json, "filename");
+    struct stat st;
+    long long stamp = -1;
+    if (cJSON_IsString(file_param) && file_param->valuestring && stat(file_param->valuestring, &st) == 0) {
+        stamp = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    }
+    cJSON_Delete(json);
+    return stamp;
+}
+
 static motifgpt_tool_t tools[] = {
     {
         "read_file",
         "Read the contents of a file on the local filesystem.",
         "{\"type\": \"object\", \"properties\": {\"filename\": {\"type\": \"string\", \"description\": \"The path to the file to read\"}}, \"required\": [\"filename\"]}",
-        filereader_execute
+        filereader_execute,
+        0, NULL,
+        5 * 60 * 1000,
+        filereader_mtime
     }
 };
 
@@ -52,6 +70,8 @@ static motifgpt_plugin_t plugin = {
     1
 };
 
+MOTIFGPT_PLUGIN_EXPORT_ABI_VERSION;
+
 motifgpt_plugin_t* motifgpt_plugin_init(void) {
     return &plugin;
 }
@@ -27,7 +27,9 @@ static motifgpt_tool_t tools[] = {
         "get_stock_price",
         "Get the current stock price for a given ticker symbol.",
         "{\"type\": \"object\", \"properties\": {\"symbol\": {\"type\": \"string\", \"description\": \"The stock ticker symbol, e.g., AAPL\"}}, \"required\": [\"symbol\"]}",
-        stock_execute
+        stock_execute,
+        0, NULL,
+        60 * 1000
     }
 };
 
@@ -37,6 +39,8 @@ static motifgpt_plugin_t plugin = {
     1
 };
 
+MOTIFGPT_PLUGIN_EXPORT_ABI_VERSION;
+
 motifgpt_plugin_t* motifgpt_plugin_init(void) {
     return &plugin;
 }
@@ -27,7 +27,9 @@ static motifgpt_tool_t tools[] = {
         "get_weather",
         "Get the current weather for a specified location.",
         "{\"type\": \"object\", \"properties\": {\"location\": {\"type\": \"string\", \"description\": \"The city and state, e.g., San Francisco, CA\"}}, \"required\": [\"location\"]}",
-        weather_execute
+        weather_execute,
+        0, NULL,
+        10 * 60 * 1000 // Weather does not change by the second
     }
 };
 
@@ -37,6 +39,8 @@ static motifgpt_plugin_t plugin = {
     1
 };
 
+MOTIFGPT_PLUGIN_EXPORT_ABI_VERSION;
+
 motifgpt_plugin_t* motifgpt_plugin_init(void) {
     return &plugin;
 }
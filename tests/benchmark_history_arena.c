@@ -0,0 +1,100 @@
+#include "../motifgpt_history.h"
+#include "../motifgpt_arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Memory footprint of a 10k-message session, with every message's parts and
+// text malloc'd piecemeal by libdisasterparty (how history was built before the
+// arena) and built from the history arena. Each mode runs in its own process so
+// RSS is not shared between them. "Heap free" is memory malloc holds but cannot
+// use for anything else, which is where fragmentation shows. Results go to
+// stderr, since add_message_to_history() logs every eviction to stdout.
+
+int current_max_history_messages = 0;
+bool history_limits_disabled = true;
+
+#define SESSION_MESSAGES 10000
+#define CHURN_LIMIT 1000
+
+static unsigned int rng_state = 12345;
+
+static const char *next_text(char *buf) {
+    rng_state = rng_state * 1103515245 + 12345;
+    size_t len = 20 + (rng_state >> 8) % 2000;
+    memset(buf, 'a' + (rng_state >> 4) % 26, len);
+    buf[len] = '\0';
+    return buf;
+}
+
+static void report(const char *mode, const char *phase) {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) { if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0; fclose(f); }
+    struct mallinfo2 mi = mallinfo2();
+    fprintf(stderr, "%-8s %-22s %10.1f %12.1f %12.1f\n", mode, phase,
+           resident * (sysconf(_SC_PAGESIZE) / 1024.0) / 1024.0,
+           mi.uordblks / (1024.0 * 1024.0), mi.fordblks / (1024.0 * 1024.0));
+}
+
+// The previous layout: a flat array, parts and text allocated per message, memmove on eviction.
+static dp_message_t *flat = NULL;
+static size_t flat_count = 0;
+
+static void flat_add(dp_message_role_t role, const char *text, size_t limit) {
+    if (limit && flat_count >= limit) {
+        size_t drop = flat_count - limit + 1;
+        dp_free_messages(flat, drop);
+        memmove(flat, flat + drop, (flat_count - drop) * sizeof(dp_message_t));
+        flat_count -= drop;
+    }
+    dp_message_t *msg = &flat[flat_count];
+    msg->role = role; msg->num_parts = 0; msg->parts = NULL;
+    if (dp_message_add_text_part(msg, text)) flat_count++;
+}
+
+static void run_malloc() {
+    char *buf = malloc(4096);
+    flat = malloc(SESSION_MESSAGES * sizeof(dp_message_t));
+    report("malloc", "start");
+    for (int i = 0; i < SESSION_MESSAGES; i++) flat_add(i % 2 ? DP_ROLE_ASSISTANT : DP_ROLE_USER, next_text(buf), 0);
+    report("malloc", "10k messages");
+    for (int i = 0; i < SESSION_MESSAGES; i++) flat_add(i % 2 ? DP_ROLE_ASSISTANT : DP_ROLE_USER, next_text(buf), CHURN_LIMIT);
+    report("malloc", "10k more, limit 1000");
+    dp_free_messages(flat, flat_count);
+    free(flat);
+    report("malloc", "cleared");
+    free(buf);
+}
+
+static void run_arena() {
+    char *buf = malloc(4096);
+    arena_stats_t stats;
+    report("arena", "start");
+    for (int i = 0; i < SESSION_MESSAGES; i++) add_message_to_history(i % 2 ? DP_ROLE_ASSISTANT : DP_ROLE_USER, next_text(buf), NULL, NULL);
+    report("arena", "10k messages");
+    arena_get_stats(&stats);
+    fprintf(stderr, "         %zu slabs, %.1f MiB reserved, %.1f MiB allocated\n", stats.live_slabs,
+           stats.reserved_bytes / (1024.0 * 1024.0), stats.allocated_bytes / (1024.0 * 1024.0));
+    history_limits_disabled = false;
+    current_max_history_messages = CHURN_LIMIT;
+    for (int i = 0; i < SESSION_MESSAGES; i++) add_message_to_history(i % 2 ? DP_ROLE_ASSISTANT : DP_ROLE_USER, next_text(buf), NULL, NULL);
+    report("arena", "10k more, limit 1000");
+    free_chat_history();
+    report("arena", "cleared");
+    free(buf);
+}
+
+int main() {
+    fprintf(stderr, "%-8s %-22s %10s %12s %12s\n", "mode", "phase", "RSS (MiB)", "heap used", "heap free");
+    void (*modes[])() = { run_malloc, run_arena };
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        pid_t pid = fork();
+        if (pid == 0) { modes[m](); _exit(0); }
+        waitpid(pid, NULL, 0);
+    }
+    return 0;
+}
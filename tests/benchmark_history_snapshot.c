@@ -0,0 +1,113 @@
+#include "../motifgpt_history.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+// Compares the per-turn cost of handing chat_history to the request thread:
+// the old mkstemp + dp_serialize_messages_to_file + dp_deserialize_messages_from_file
+// round trip against history_snapshot_acquire()/history_snapshot_release(),
+// then the cost of appending once the history is full and every turn evicts.
+
+int current_max_history_messages = 0;
+bool history_limits_disabled = true;
+
+#define IMAGE_EVERY_N_MESSAGES 50
+#define IMAGE_BASE64_LEN (64 * 1024)
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void setup_history(int num_messages, const char *image_data) {
+    free_chat_history();
+    for (int i = 0; i < num_messages; i++) {
+        bool with_image = (i % IMAGE_EVERY_N_MESSAGES) == 0;
+        add_message_to_history(i % 2 == 0 ? DP_ROLE_USER : DP_ROLE_ASSISTANT,
+                               "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore et dolore magna aliqua.",
+                               with_image ? "image/png" : NULL, with_image ? image_data : NULL);
+    }
+}
+
+static int temp_file_round_trip() {
+    char temp_filename[] = "/tmp/motifgpt_hist_XXXXXX";
+    int fd = mkstemp(temp_filename);
+    if (fd == -1) { perror("mkstemp"); return -1; }
+    close(fd);
+    history_snapshot_t *snap = history_snapshot_acquire();
+    int saved = snap ? dp_serialize_messages_to_file(snap->messages, snap->count, temp_filename) : -1;
+    history_snapshot_release(snap);
+    if (saved != 0) {
+        unlink(temp_filename); return -1;
+    }
+    dp_message_t *loaded = NULL; size_t num_loaded = 0;
+    if (dp_deserialize_messages_from_file(temp_filename, &loaded, &num_loaded) != 0) {
+        unlink(temp_filename); return -1;
+    }
+    unlink(temp_filename);
+    int ok = (num_loaded == (size_t)chat_history_count) ? 0 : -1;
+    dp_free_messages(loaded, num_loaded);
+    free(loaded);
+    return ok;
+}
+
+static int snapshot_round_trip() {
+    history_snapshot_t *snap = history_snapshot_acquire();
+    if (!snap) return -1;
+    volatile size_t parts = 0;
+    for (size_t i = 0; i < snap->count; i++) parts += snap->messages[i].num_parts;
+    int ok = (snap->count == (size_t)chat_history_count) ? 0 : -1;
+    history_snapshot_release(snap);
+    return ok;
+}
+
+int main() {
+    const int sizes[] = {100, 1000, 10000};
+    char *image_data = malloc(IMAGE_BASE64_LEN + 1);
+    if (!image_data) { perror("malloc"); return 1; }
+    memset(image_data, 'A', IMAGE_BASE64_LEN);
+    image_data[IMAGE_BASE64_LEN] = '\0';
+
+    printf("%10s %20s %20s %10s\n", "messages", "temp file (ms/turn)", "snapshot (ms/turn)", "speedup");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int n = sizes[s];
+        setup_history(n, image_data);
+        int file_iterations = n >= 10000 ? 5 : 20;
+        int snapshot_iterations = 1000;
+
+        double start = now_ms();
+        for (int i = 0; i < file_iterations; i++) {
+            if (temp_file_round_trip() != 0) { fprintf(stderr, "Temp file round trip failed.\n"); return 1; }
+        }
+        double file_ms = (now_ms() - start) / file_iterations;
+
+        start = now_ms();
+        for (int i = 0; i < snapshot_iterations; i++) {
+            if (snapshot_round_trip() != 0) { fprintf(stderr, "Snapshot round trip failed.\n"); return 1; }
+        }
+        double snapshot_ms = (now_ms() - start) / snapshot_iterations;
+
+        printf("%10d %20.3f %20.6f %9.0fx\n", n, file_ms, snapshot_ms, snapshot_ms > 0 ? file_ms / snapshot_ms : 0.0);
+    }
+
+    // Steady state at the limit: each append evicts the oldest message.
+    printf("\n%10s %20s\n", "limit", "evicting add (us)");
+    history_limits_disabled = false;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        current_max_history_messages = sizes[s];
+        setup_history(sizes[s], image_data);
+        int iterations = 20000;
+        double start = now_ms();
+        for (int i = 0; i < iterations; i++) {
+            add_message_to_history(DP_ROLE_USER, "Lorem ipsum dolor sit amet.", NULL, NULL);
+        }
+        printf("%10d %20.3f\n", sizes[s], (now_ms() - start) * 1000.0 / iterations);
+    }
+
+    free_chat_history();
+    free(image_data);
+    return 0;
+}
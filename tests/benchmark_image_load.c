@@ -1,12 +1,19 @@
-#include "../buffer_utils.h"
+#include "../utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
 
 #define BENCH_FILE_SIZE (10 * 1024 * 1024)
+#define ENCODE_ITERATIONS 20
 #define TEMP_FILENAME "temp_bench_file.dat"
 
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 int main() {
     printf("Creating %d MB test file...\n", BENCH_FILE_SIZE / 1024 / 1024);
     FILE *f = fopen(TEMP_FILENAME, "wb");
@@ -21,24 +28,30 @@ int main() {
     free(dummy);
     fclose(f);
 
-    printf("Benchmarking read_file_to_buffer + base64_encode...\n");
-
-    clock_t start = clock();
-
+    printf("Benchmarking read_file_to_buffer...\n");
+    double start = now_seconds();
     size_t file_size = 0;
     unsigned char *buffer = read_file_to_buffer(TEMP_FILENAME, &file_size);
     if (!buffer) { fprintf(stderr, "read_file failed\n"); remove(TEMP_FILENAME); return 1; }
+    printf("Read: %f seconds\n", now_seconds() - start);
+    remove(TEMP_FILENAME);
 
-    char *b64 = base64_encode(buffer, file_size);
-    if (!b64) { fprintf(stderr, "base64 failed\n"); free(buffer); remove(TEMP_FILENAME); return 1; }
-
-    clock_t end = clock();
-    double cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
-
-    printf("Time taken: %f seconds\n", cpu_time_used);
+    printf("Benchmarking base64_encode (%d runs of %zu bytes)...\n", ENCODE_ITERATIONS, file_size);
+    printf("%-8s %12s %10s\n", "encoder", "ms/encode", "GB/s");
+    for (int impl = BASE64_IMPL_SCALAR; impl < BASE64_IMPL_COUNT; impl++) {
+        if (!base64_set_impl(impl)) continue;
+        start = now_seconds();
+        for (int i = 0; i < ENCODE_ITERATIONS; i++) {
+            char *b64 = base64_encode(buffer, file_size);
+            if (!b64) { fprintf(stderr, "base64 failed\n"); free(buffer); return 1; }
+            free(b64);
+        }
+        double seconds = (now_seconds() - start) / ENCODE_ITERATIONS;
+        printf("%-8s %12.3f %10.2f\n", base64_impl_name(), seconds * 1000.0, file_size / seconds / 1e9);
+    }
+    base64_set_impl(BASE64_IMPL_AUTO);
+    printf("base64_encode() uses: %s\n", base64_impl_name());
 
     free(buffer);
-    free(b64);
-    remove(TEMP_FILENAME);
     return 0;
 }
@@ -4,31 +4,8 @@
 #include <time.h>
 #include <stdbool.h>
 
-typedef enum {
-    DP_ROLE_USER,
-    DP_ROLE_ASSISTANT
-} dp_message_role_t;
-
-typedef enum {
-    DP_CONTENT_PART_TEXT,
-    DP_CONTENT_PART_IMAGE_BASE64
-} dp_content_part_type_t;
-
-typedef struct {
-    dp_content_part_type_t type;
-    char *text;
-    char *image_mime_type;
-    char *image_base64_data;
-} dp_content_part_t;
-
-typedef struct {
-    dp_message_role_t role;
-    size_t num_parts;
-    dp_content_part_t *parts;
-} dp_message_t;
-
-#define USER_NICKNAME "User"
-#define ASSISTANT_NICKNAME "Assistant"
+// Build: gcc -O2 -I. -Itests tests/benchmark_render.c motifgpt_render.c motifgpt_transcript.c
+#include "../motifgpt_render.h"
 
 dp_message_t *chat_history = NULL;
 int chat_history_count = 0;
@@ -192,38 +169,81 @@ void optimized_render_all_history() {
     free(part_lengths);
 }
 
-int main() {
-    const int NUM_MESSAGES = 1000;
-    const int PARTS_PER_MESSAGE = 10;
-    const int ITERATIONS = 500;
+static double run_timed(void (*fn)(void), int iterations) {
+    clock_t start = clock();
+    for (int i = 0; i < iterations; i++) fn();
+    return ((double) (clock() - start)) / CLOCKS_PER_SEC * 1000 / iterations;
+}
+
+static transcript_t bench_transcript;
+static render_cache_t bench_cache;
+
+static void cached_render() {
+    render_history(&bench_transcript, &bench_cache, chat_history, chat_history_count, NULL);
+}
+
+static void cold_cached_render() {
+    transcript_clear(&bench_transcript);
+    cached_render();
+}
 
-    printf("Setting up history with %d messages, %d parts each...\n", NUM_MESSAGES, PARTS_PER_MESSAGE);
-    setup_history(NUM_MESSAGES, PARTS_PER_MESSAGE);
+static void run_size(int num_messages, int parts_per_message, int iterations) {
+    printf("\n=== %d messages, %d parts each ===\n", num_messages, parts_per_message);
+    setup_history(num_messages, parts_per_message);
 
-    printf("Running current implementation for %d iterations...\n", ITERATIONS);
+    double current_ms = run_timed(current_render_all_history, iterations);
+    double optimized_ms = run_timed(optimized_render_all_history, iterations);
+    printf("Current full render:    %10.3f ms\n", current_ms);
+    printf("Optimized full render:  %10.3f ms\n", optimized_ms);
+
+    transcript_init(&bench_transcript);
+    double cold_ms = run_timed(cold_cached_render, iterations);
+    double unchanged_ms = run_timed(cached_render, iterations);
+    printf("Render cache, cold:     %10.3f ms (full transcript rebuild)\n", cold_ms);
+    printf("Render cache, reload:   %10.3f ms (unchanged history)\n", unchanged_ms);
+
+    // One new message per render: only the suffix is emitted
+    chat_history_count--;
+    cached_render();
     clock_t start = clock();
-    for (int i = 0; i < ITERATIONS; i++) {
-        current_render_all_history();
+    for (int i = 0; i < iterations; i++) {
+        chat_history_count++;
+        cached_render();
+        chat_history_count--;
+        cached_render();
     }
-    clock_t end = clock();
-    double cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
-    printf("Current Implementation total time: %f seconds\n", cpu_time_used);
-    printf("Average time per iteration: %f ms\n", (cpu_time_used * 1000) / ITERATIONS);
-
-    printf("\nRunning optimized implementation for %d iterations...\n", ITERATIONS);
+    double append_ms = ((double) (clock() - start)) / CLOCKS_PER_SEC * 1000 / (2 * iterations);
+    chat_history_count++;
+    printf("Render cache, append:   %10.3f ms per add/remove of the last message\n", append_ms);
+
+    // FIFO eviction: the oldest message is dropped and a new one shows up
+    dp_message_t *full_history = chat_history;
+    int full_count = chat_history_count;
+    chat_history_count = full_count - iterations;
+    cached_render();
     start = clock();
-    for (int i = 0; i < ITERATIONS; i++) {
-        optimized_render_all_history();
+    for (int i = 0; i < iterations; i++) {
+        chat_history++;
+        cached_render();
     }
-    end = clock();
-    double cpu_time_used_opt = ((double) (end - start)) / CLOCKS_PER_SEC;
-    printf("Optimized Implementation total time: %f seconds\n", cpu_time_used_opt);
-    printf("Average time per iteration: %f ms\n", (cpu_time_used_opt * 1000) / ITERATIONS);
-
-    if (cpu_time_used_opt > 0) {
-        printf("\nSpeedup: %.2fx\n", cpu_time_used / cpu_time_used_opt);
+    double evict_ms = ((double) (clock() - start)) / CLOCKS_PER_SEC * 1000 / iterations;
+    chat_history = full_history;
+    chat_history_count = full_count;
+    printf("Render cache, eviction: %10.3f ms per evicted + appended message\n", evict_ms);
+
+    if (unchanged_ms > 0 && append_ms > 0 && evict_ms > 0) {
+        printf("Speedup over a full transcript rebuild: reload %.2fx, append %.2fx, eviction %.2fx\n",
+               cold_ms / unchanged_ms, cold_ms / append_ms, cold_ms / evict_ms);
     }
 
+    render_cache_free(&bench_cache);
+    transcript_free(&bench_transcript);
     teardown_history();
+}
+
+int main() {
+    const int PARTS_PER_MESSAGE = 10;
+    run_size(1000, PARTS_PER_MESSAGE, 200);
+    run_size(10000, PARTS_PER_MESSAGE, 20);
     return 0;
 }
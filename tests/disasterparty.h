@@ -4,6 +4,14 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+typedef enum {
+    DP_PROVIDER_GOOGLE_GEMINI,
+    DP_PROVIDER_OPENAI_COMPATIBLE,
+    DP_PROVIDER_ANTHROPIC
+} dp_provider_type_t;
+
+typedef struct dp_context_t dp_context_t;
+
 typedef enum {
     DP_ROLE_USER,
     DP_ROLE_ASSISTANT,
@@ -30,8 +38,11 @@ typedef struct {
 } dp_message_t;
 
 // Mock functions
+dp_context_t* dp_init_context(dp_provider_type_t provider, const char *api_key, const char *base_url);
+void dp_destroy_context(dp_context_t *ctx);
 bool dp_message_add_text_part(dp_message_t *msg, const char *text);
 bool dp_message_add_base64_image_part(dp_message_t *msg, const char *mime_type, const char *base64_data);
 void dp_free_messages(dp_message_t *messages, size_t count);
+int dp_serialize_messages_to_file(dp_message_t *msgs, size_t count, const char *filename);
 
 #endif
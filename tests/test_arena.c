@@ -0,0 +1,93 @@
+#include "../motifgpt_arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+void test_bump_and_release() {
+    printf("Testing bump allocation and slab release...\n");
+    arena_t arena;
+    arena_init(&arena, 1024);
+    arena_stats_t stats;
+
+    arena_slab_t *a_slab, *b_slab, *c_slab;
+    char *a = arena_alloc(&arena, 100, &a_slab);
+    char *b = arena_alloc(&arena, 3, &b_slab);
+    assert(a && b && a_slab == b_slab);
+    assert((uintptr_t)b % alignof(max_align_t) == 0);
+    assert(b >= a + 100);
+    memset(a, 'a', 100); memset(b, 'b', 3);
+
+    // Filling the slab moves on to a new one; the old one lives while it is referenced
+    for (int i = 0; i < 10; i++) {
+        assert(arena_alloc(&arena, 200, &c_slab));
+        arena_release(c_slab, 1);
+    }
+    assert(c_slab != a_slab);
+    arena_get_stats(&stats);
+    assert(stats.live_slabs >= 2);
+    assert(a[99] == 'a' && b[2] == 'b');
+
+    arena_release(a_slab, 1);
+    arena_release(b_slab, 1);
+    arena_destroy(&arena);
+    arena_get_stats(&stats);
+    assert(stats.live_slabs == 0 && stats.reserved_bytes == 0 && stats.allocated_bytes == 0);
+    printf("Bump allocation and slab release passed.\n");
+}
+
+void test_large_allocation() {
+    printf("Testing oversized allocations...\n");
+    arena_t arena;
+    arena_init(&arena, 1024);
+    arena_slab_t *small_slab, *big_slab;
+    assert(arena_alloc(&arena, 16, &small_slab));
+    char *big = arena_alloc(&arena, 4096, &big_slab);
+    assert(big && big_slab != small_slab && big_slab->size >= 4096);
+    memset(big, 0, 4096);
+    // The big slab is not shared, so the next small allocation still uses the first slab
+    arena_slab_t *again;
+    assert(arena_alloc(&arena, 16, &again) && again == small_slab);
+    arena_release(big_slab, 1);
+    arena_release(small_slab, 2);
+    arena_destroy(&arena);
+    arena_stats_t stats;
+    arena_get_stats(&stats);
+    assert(stats.live_slabs == 0);
+    printf("Oversized allocations passed.\n");
+}
+
+#define RELEASE_COUNT 20000
+
+static arena_slab_t *pending[RELEASE_COUNT];
+
+static void *release_thread(void *arg) {
+    for (int i = 0; i < RELEASE_COUNT; i += 2) arena_release(pending[i], 1);
+    return NULL;
+}
+
+void test_cross_thread_release() {
+    printf("Testing releases from another thread...\n");
+    arena_t arena;
+    arena_init(&arena, 4096);
+    for (int i = 0; i < RELEASE_COUNT; i++) assert(arena_alloc(&arena, 48, &pending[i]));
+    pthread_t thread;
+    pthread_create(&thread, NULL, release_thread, NULL);
+    for (int i = 1; i < RELEASE_COUNT; i += 2) arena_release(pending[i], 1);
+    pthread_join(thread, NULL);
+    arena_destroy(&arena);
+    arena_stats_t stats;
+    arena_get_stats(&stats);
+    assert(stats.live_slabs == 0);
+    printf("Releases from another thread passed.\n");
+}
+
+int main() {
+    test_bump_and_release();
+    test_large_allocation();
+    test_cross_thread_release();
+    printf("All arena tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,314 @@
+#include "../motifgpt_attach.h"
+#include "../motifgpt_chat.h"
+#include "../utils.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define TEST_IMAGE_PATH "test_attach_image.png"
+#define PEAK_TEST_IMAGE_SIZE (20 * 1024 * 1024)
+
+// Sanitizer shadow memory makes RSS meaningless, so the peak is only checked without one
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define RSS_IS_MEANINGFUL 0
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#define RSS_IS_MEANINGFUL 0
+#endif
+#endif
+#ifndef RSS_IS_MEANINGFUL
+#define RSS_IS_MEANINGFUL 1
+#endif
+
+static void open_test_pipe() {
+    if (pipe(pipe_fds) == -1) {
+        perror("pipe");
+        exit(1);
+    }
+    int flags = fcntl(pipe_fds[0], F_GETFL, 0);
+    fcntl(pipe_fds[0], F_SETFL, flags | O_NONBLOCK);
+}
+
+static void close_test_pipe() {
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+}
+
+// Writes a file that sniffs as PNG, followed by `size - 8` bytes of noise.
+static unsigned char *write_test_image_to(const char *path, size_t size) {
+    unsigned char *data = malloc(size);
+    assert(data);
+    memcpy(data, "\x89PNG\r\n\x1a\n", 8);
+    for (size_t i = 8; i < size; i++) data[i] = (unsigned char)(i * 7 + (i >> 9) + size);
+    FILE *f = fopen(path, "wb");
+    assert(f);
+    assert(fwrite(data, 1, size, f) == size);
+    fclose(f);
+    return data;
+}
+
+static unsigned char *write_test_image(size_t size) {
+    return write_test_image_to(TEST_IMAGE_PATH, size);
+}
+
+// Drains the pipe; returns the number of progress frames and checks that they only go up.
+static int read_attach_frames(unsigned long id, bool *done) {
+    pipe_reader_t reader = {0};
+    pipe_message_type_t type;
+    const char *data;
+    size_t len;
+    int progress_frames = 0;
+    unsigned int last_percent = 0;
+    *done = false;
+    while (pipe_reader_fill(&reader, pipe_fds[0]) > 0) {
+        while (pipe_reader_next(&reader, &type, &data, &len)) {
+            attach_progress_t progress;
+            assert(len == sizeof(progress));
+            memcpy(&progress, data, sizeof(progress));
+            assert(progress.id == id);
+            assert(!*done);
+            if (type == PIPE_MSG_ATTACH_PROGRESS) {
+                assert(progress.percent > last_percent && progress.percent < 100);
+                last_percent = progress.percent;
+                progress_frames++;
+            } else {
+                assert(type == PIPE_MSG_ATTACH_DONE);
+                *done = true;
+            }
+        }
+    }
+    pipe_reader_free(&reader);
+    return progress_frames;
+}
+
+void test_attach_encodes_in_chunks() {
+    printf("Testing chunked attach...\n");
+    open_test_pipe();
+    size_t size = 4 * ATTACH_CHUNK_SIZE + 1000; // Not a multiple of 3
+    unsigned char *data = write_test_image(size);
+
+    attach_job_t *job = attach_job_create(TEST_IMAGE_PATH, NULL);
+    assert(job);
+    attach_job_run(NULL, job);
+    bool done;
+    assert(read_attach_frames(job->id, &done) == 4);
+    assert(done);
+    assert(job->error[0] == '\0');
+    assert(strcmp(job->mime_type, "image/png") == 0);
+
+    char *expected = base64_encode(data, size);
+    assert(job->base64_len == strlen(expected));
+    assert(strcmp(job->base64, expected) == 0);
+    free(expected);
+    free(data);
+    attach_job_release(job);
+    close_test_pipe();
+    printf("Chunked attach passed.\n");
+}
+
+void test_attach_errors() {
+    printf("Testing attach errors...\n");
+    open_test_pipe();
+    bool done;
+
+    attach_job_t *job = attach_job_create("/nonexistent/image.png", NULL);
+    attach_job_run(NULL, job);
+    assert(read_attach_frames(job->id, &done) == 0 && done);
+    assert(job->error[0] != '\0' && job->base64 == NULL);
+    attach_job_release(job);
+
+    FILE *f = fopen(TEST_IMAGE_PATH, "wb");
+    fputs("plain text, not an image", f);
+    fclose(f);
+    job = attach_job_create(TEST_IMAGE_PATH, NULL);
+    attach_job_run(NULL, job);
+    assert(read_attach_frames(job->id, &done) == 0 && done);
+    assert(strstr(job->error, "Unsupported") && job->base64 == NULL);
+    attach_job_release(job);
+
+    // A format the provider doesn't take, and that can't be decoded, is refused
+    f = fopen(TEST_IMAGE_PATH, "wb");
+    fwrite("\0\0\0\x1c" "ftypavif" "\0\0\0\0" "mif1avif", 1, 24, f);
+    fclose(f);
+    image_scale_options_t options = { 1024, IMAGE_SCALE_DEFAULT_QUALITY, IMAGE_FORMAT_PNG | IMAGE_FORMAT_JPEG };
+    job = attach_job_create(TEST_IMAGE_PATH, &options);
+    attach_job_run(NULL, job);
+    assert(read_attach_frames(job->id, &done) == 0 && done);
+    assert(strstr(job->error, "AVIF images are not accepted") && job->base64 == NULL);
+    attach_job_release(job);
+    options.accepted_formats |= IMAGE_FORMAT_AVIF;
+    job = attach_job_create(TEST_IMAGE_PATH, &options);
+    attach_job_run(NULL, job);
+    assert(read_attach_frames(job->id, &done) == 0 && done);
+    assert(job->error[0] == '\0' && strcmp(job->mime_type, "image/avif") == 0);
+    attach_job_release(job);
+
+    // Too large: checked from the size alone, nothing is read
+    int fd = open(TEST_IMAGE_PATH, O_WRONLY | O_TRUNC);
+    assert(fd != -1 && ftruncate(fd, MAX_FILE_SIZE_BYTES + 1) == 0);
+    close(fd);
+    job = attach_job_create(TEST_IMAGE_PATH, NULL);
+    attach_job_run(NULL, job);
+    assert(read_attach_frames(job->id, &done) == 0 && done);
+    assert(strstr(job->error, "too large"));
+    attach_job_release(job);
+
+    close_test_pipe();
+    printf("Attach errors passed.\n");
+}
+
+static void *run_attach_thread(void *arg) {
+    attach_job_run(NULL, arg);
+    return NULL;
+}
+
+void test_attach_batch() {
+    printf("Testing parallel batch attach...\n");
+    open_test_pipe();
+    enum { BATCH_SIZE = 3 };
+    const char *paths[BATCH_SIZE] = { "test_attach_batch_0.png", "test_attach_batch_1.png", "test_attach_batch_2.png" };
+    unsigned char *data[BATCH_SIZE];
+    size_t sizes[BATCH_SIZE] = { 2 * ATTACH_CHUNK_SIZE, ATTACH_CHUNK_SIZE + 7, 100 };
+    attach_batch_t batch = {0};
+    pthread_t threads[BATCH_SIZE];
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        data[i] = write_test_image_to(paths[i], sizes[i]);
+        assert(attach_batch_add(&batch, attach_job_create(paths[i], NULL)) == 0);
+    }
+    assert(attach_batch_pending(&batch) == BATCH_SIZE);
+    assert(attach_batch_progress(&batch) == 0);
+
+    // Every image is encoded on its own thread at the same time
+    for (int i = 0; i < BATCH_SIZE; i++) assert(pthread_create(&threads[i], NULL, run_attach_thread, batch.jobs[i]) == 0);
+    for (int i = 0; i < BATCH_SIZE; i++) pthread_join(threads[i], NULL);
+
+    pipe_reader_t reader = {0};
+    pipe_message_type_t type;
+    const char *frame;
+    size_t len;
+    while (pipe_reader_fill(&reader, pipe_fds[0]) > 0) {
+        while (pipe_reader_next(&reader, &type, &frame, &len)) {
+            attach_progress_t progress;
+            memcpy(&progress, frame, sizeof(progress));
+            int index = attach_batch_find(&batch, progress.id);
+            assert(index >= 0);
+            if (type == PIPE_MSG_ATTACH_DONE) batch.ready[index] = true;
+            else batch.percent[index] = progress.percent;
+        }
+    }
+    pipe_reader_free(&reader);
+    assert(attach_batch_pending(&batch) == 0);
+    assert(attach_batch_progress(&batch) == 100);
+    assert(attach_batch_find(&batch, 0) == -1);
+
+    // Results stay in selection order, whichever job finished first
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        char *expected = base64_encode(data[i], sizes[i]);
+        assert(strcmp(batch.jobs[i]->path, paths[i]) == 0);
+        assert(strcmp(batch.jobs[i]->base64, expected) == 0);
+        free(expected);
+    }
+
+    unsigned long last_id = batch.jobs[2]->id;
+    attach_batch_remove(&batch, 1);
+    assert(batch.count == 2 && batch.jobs[1]->id == last_id && batch.ready[1]);
+    attach_batch_clear(&batch);
+    assert(batch.count == 0);
+
+    for (int i = 0; i < BATCH_SIZE; i++) { free(data[i]); remove(paths[i]); }
+    close_test_pipe();
+    printf("Parallel batch attach passed.\n");
+}
+
+static long peak_rss_kb() {
+    struct rusage ru;
+    assert(getrusage(RUSAGE_SELF, &ru) == 0);
+    return ru.ru_maxrss;
+}
+
+static void attach_peak_memory_child() {
+    char dir[] = "/tmp/motifgpt_attach_XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    assert(image_store_init(dir) == 0);
+
+    // Written a megabyte at a time so the test itself never holds the image
+    FILE *f = fopen(TEST_IMAGE_PATH, "wb");
+    assert(f);
+    unsigned char block[1024 * 1024];
+    for (size_t i = 0; i < sizeof(block); i++) block[i] = (unsigned char)(i * 31 + (i >> 11));
+    memcpy(block, "\x89PNG\r\n\x1a\n", 8);
+    for (size_t written = 0; written < PEAK_TEST_IMAGE_SIZE; written += sizeof(block)) {
+        assert(fwrite(block, 1, sizeof(block), f) == sizeof(block));
+        block[0] = 0;
+    }
+    fclose(f);
+
+    open_test_pipe();
+    long before = peak_rss_kb();
+    attach_job_t *job = attach_job_create(TEST_IMAGE_PATH, NULL);
+    attach_job_run(NULL, job);
+    long grown = peak_rss_kb() - before;
+    bool done;
+    read_attach_frames(job->id, &done);
+    assert(done && job->error[0] == '\0');
+
+    // The store has the image, so nothing is left in memory for history
+    size_t encoded = base64_encoded_length(PEAK_TEST_IMAGE_SIZE);
+    assert(job->base64 == NULL && job->base64_len == encoded && job->image_key[0]);
+    printf("Peak RSS grew by %ld KB attaching a %d MB image (%zu KB encoded).\n",
+           grown, PEAK_TEST_IMAGE_SIZE / (1024 * 1024), encoded / 1024);
+    // One encoded copy plus a few chunks of the mapping; never the whole file or a second copy.
+#if RSS_IS_MEANINGFUL
+    assert((size_t)grown * 1024 < encoded + 4 * ATTACH_CHUNK_SIZE);
+#endif
+    attach_job_release(job);
+    close_test_pipe();
+}
+
+// Runs in a child, whose peak RSS starts from its size at fork rather than from earlier tests.
+void test_attach_peak_memory() {
+    printf("Testing attach peak memory...\n");
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        attach_peak_memory_child();
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    printf("Attach peak memory passed.\n");
+}
+
+void test_attach_cancel() {
+    printf("Testing attach cancellation...\n");
+    open_test_pipe();
+    free(write_test_image(2 * ATTACH_CHUNK_SIZE));
+    attach_job_t *job = attach_job_create(TEST_IMAGE_PATH, NULL);
+    unsigned long id = job->id;
+    attach_job_cancel(job); // The UI thread gives up before the worker starts
+    attach_job_run(NULL, job);
+    bool done;
+    assert(read_attach_frames(id, &done) == 0 && !done);
+    close_test_pipe();
+    printf("Attach cancellation passed.\n");
+}
+
+int main() {
+    test_attach_encodes_in_chunks();
+    test_attach_errors();
+    test_attach_cancel();
+    test_attach_batch();
+    test_attach_peak_memory();
+    remove(TEST_IMAGE_PATH);
+    printf("All attach tests passed!\n");
+    return 0;
+}
@@ -2,9 +2,94 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include "../utils.h"
 
+// Every implementation must produce exactly what the scalar encoder does, for
+// every tail length and for inputs long enough to run the vector loops.
+static void test_implementations_match() {
+    printf("Running base64 implementation comparison...\n");
+    size_t max_len = 1024 * 1024 + 7;
+    unsigned char *data = malloc(max_len);
+    assert(data);
+    unsigned int seed = 1;
+    for (size_t i = 0; i < max_len; i++) { seed = seed * 1103515245 + 12345; data[i] = (unsigned char)(seed >> 16); }
+
+    size_t lengths[300];
+    size_t num_lengths = 0;
+    for (size_t len = 0; len < 200; len++) lengths[num_lengths++] = len;
+    lengths[num_lengths++] = 4096;
+    lengths[num_lengths++] = 65536 + 1;
+    lengths[num_lengths++] = max_len;
+
+    for (int impl = BASE64_IMPL_SSSE3; impl < BASE64_IMPL_COUNT; impl++) {
+        if (!base64_impl_supported(impl)) continue;
+        for (size_t n = 0; n < num_lengths; n++) {
+            // Encode from an unaligned offset too
+            for (size_t offset = 0; offset < 2; offset++) {
+                size_t len = lengths[n] - (lengths[n] > 0 ? offset : 0);
+                assert(base64_set_impl(BASE64_IMPL_SCALAR));
+                char *expected = base64_encode(data + offset, len);
+                assert(base64_set_impl(impl));
+                char *actual = base64_encode(data + offset, len);
+                assert(expected && actual);
+                assert(strcmp(expected, actual) == 0);
+                free(expected);
+                free(actual);
+            }
+        }
+        printf("  %s matches scalar\n", base64_impl_name());
+    }
+    assert(base64_set_impl(BASE64_IMPL_AUTO));
+    free(data);
+}
+
+static void test_decode() {
+    printf("Running base64_decode_to tests...\n");
+    const char *plain[] = { "", "f", "fo", "foo", "foob", "fooba", "foobar" };
+    for (size_t i = 0; i < sizeof(plain) / sizeof(plain[0]); i++) {
+        char *encoded = base64_encode((const unsigned char *)plain[i], strlen(plain[i]));
+        assert(encoded);
+        unsigned char out[16];
+        size_t len = 0;
+        assert(base64_decoded_length(strlen(encoded)) <= sizeof(out));
+        assert(base64_decode_to(out, encoded, strlen(encoded), &len) == 0);
+        assert(len == strlen(plain[i]) && memcmp(out, plain[i], len) == 0);
+        free(encoded);
+    }
+    unsigned char out[16];
+    size_t len;
+    assert(base64_decode_to(out, "Zm9", 3, &len) == -1);
+    assert(base64_decode_to(out, "Zm9*", 4, &len) == -1);
+    assert(base64_decode_to(out, "Z===", 4, &len) == -1);
+    assert(base64_decode_to(out, "Zg==Zg==", 8, &len) == -1);
+    printf("base64_decode_to tests passed.\n");
+}
+
+static void *decode_worker(void *arg) {
+    const char *encoded = "QmFzZTY0IGZyb20gdHdvIHRocmVhZHMgYXQgb25jZQ==";
+    for (int i = 0; i < 1000; i++) {
+        unsigned char out[64];
+        size_t len = 0;
+        assert(base64_decode_to(out, encoded, strlen(encoded), &len) == 0);
+        assert(len == 31 && memcmp(out, "Base64 from two threads at once", 31) == 0);
+    }
+    return NULL;
+}
+
+// Save jobs decode on several workers at once, starting with the very first call.
+static void test_decode_concurrently() {
+    printf("Running concurrent base64_decode_to tests...\n");
+    pthread_t threads[2];
+    for (int i = 0; i < 2; i++) assert(pthread_create(&threads[i], NULL, decode_worker, NULL) == 0);
+    for (int i = 0; i < 2; i++) pthread_join(threads[i], NULL);
+    printf("Concurrent base64_decode_to tests passed.\n");
+}
+
 int main() {
+    // Before anything else decodes, so the two threads make the first calls
+    test_decode_concurrently();
+
     printf("Running base64_encode tests...\n");
 
     // Test case 1: Empty string
@@ -46,6 +131,9 @@ int main() {
     assert(strcmp(result, "Zm9vYmFy") == 0);
     free(result);
 
+    test_implementations_match();
+    test_decode();
+
     printf("All base64_encode tests passed!\n");
     return 0;
 }
@@ -0,0 +1,51 @@
+#include "../motifgpt_context.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+void test_unconfigured() {
+    printf("Testing acquire with no context...\n");
+    assert(llm_context_acquire() == NULL);
+    assert(llm_context_publish(NULL) == 0);
+    assert(llm_context_acquire() == NULL);
+    printf("Unconfigured passed.\n");
+}
+
+void test_publish_and_pin() {
+    printf("Testing publish and pin...\n");
+    llm_context_t *first = llm_context_create(DP_PROVIDER_OPENAI_COMPATIBLE, "key-1", "model-1", NULL);
+    assert(first != NULL);
+    assert(strcmp(first->base_url, "") == 0);
+    unsigned long v1 = llm_context_publish(first);
+    assert(v1 > 0);
+
+    llm_context_t *pinned = llm_context_acquire();
+    assert(pinned == first);
+    assert(pinned->version == v1);
+
+    // A settings change swaps in a new version; the in-flight request keeps its pin.
+    llm_context_t *second = llm_context_create(DP_PROVIDER_ANTHROPIC, "key-2", "model-2", "http://localhost/v1");
+    unsigned long v2 = llm_context_publish(second);
+    assert(v2 > v1);
+    assert(strcmp(pinned->model, "model-1") == 0);
+    assert(strcmp(pinned->api_key, "key-1") == 0);
+
+    llm_context_t *current = llm_context_acquire();
+    assert(current == second);
+    assert(strcmp(current->base_url, "http://localhost/v1") == 0);
+
+    llm_context_release(pinned);
+    llm_context_release(current);
+
+    llm_context_publish(NULL);
+    assert(llm_context_acquire() == NULL);
+    printf("Publish and pin passed.\n");
+}
+
+int main() {
+    test_unconfigured();
+    test_publish_and_pin();
+    printf("All context tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,406 @@
+#define _GNU_SOURCE // memmem
+#include "../motifgpt_convfile.h"
+#include "../motifgpt_chat.h"
+#include "../motifgpt_imagestore.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_CONVERSATION_PATH "test_conversation.json"
+#define TEST_BINARY_PATH "test_conversation.mgpt"
+
+int current_max_history_messages = 1000;
+bool history_limits_disabled = false;
+
+// Mock disasterparty functions, as in test_history; image data is kept in `text`
+bool dp_message_add_text_part(dp_message_t *msg, const char *text) {
+    dp_content_part_t *parts = realloc(msg->parts, (msg->num_parts + 1) * sizeof(dp_content_part_t));
+    if (!parts) return false;
+    msg->parts = parts;
+    msg->parts[msg->num_parts].type = DP_CONTENT_PART_TEXT;
+    msg->parts[msg->num_parts].text = strdup(text);
+    msg->num_parts++;
+    return true;
+}
+
+bool dp_message_add_base64_image_part(dp_message_t *msg, const char *mime_type, const char *base64_data) {
+    if (!dp_message_add_text_part(msg, base64_data)) return false;
+    msg->parts[msg->num_parts - 1].type = DP_CONTENT_PART_IMAGE_BASE64;
+    return true;
+}
+
+void dp_free_messages(dp_message_t *messages, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < messages[i].num_parts; j++) free(messages[i].parts[j].text);
+        free(messages[i].parts);
+    }
+}
+
+// Writes the same layout as libdisasterparty; texts in these tests need no escaping.
+int dp_serialize_messages_to_file(dp_message_t *msgs, size_t count, const char *filename) {
+    FILE *f = fopen(filename, "w");
+    if (!f) return -1;
+    fputc('[', f);
+    for (size_t i = 0; i < count; i++) {
+        fprintf(f, "%s{\"role\": \"%s\", \"parts\": [", i ? ", " : "", msgs[i].role == DP_ROLE_ASSISTANT ? "assistant" : "user");
+        for (size_t j = 0; j < msgs[i].num_parts; j++) {
+            const dp_content_part_t *part = &msgs[i].parts[j];
+            if (part->type == DP_CONTENT_PART_TEXT) fprintf(f, "%s{\"type\": \"text\", \"text\": \"%s\"}", j ? ", " : "", part->text);
+            else fprintf(f, "%s{\"type\": \"image_base64\", \"mime_type\": \"image/png\", \"data\": \"%s\"}", j ? ", " : "", part->text);
+        }
+        fputs("]}", f);
+    }
+    fputc(']', f);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static void open_test_pipe() {
+    assert(pipe(pipe_fds) == 0);
+    fcntl(pipe_fds[0], F_SETFL, fcntl(pipe_fds[0], F_GETFL, 0) | O_NONBLOCK);
+}
+
+static void close_test_pipe() {
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+}
+
+// Drains the pipe; returns the number of batch frames for the job and whether it finished.
+static int read_convfile_frames(unsigned long id, bool *done) {
+    pipe_reader_t reader = {0};
+    int batches = 0;
+    *done = false;
+    pipe_reader_fill(&reader, pipe_fds[0]);
+    pipe_message_type_t type;
+    const char *data;
+    size_t len;
+    while (pipe_reader_next(&reader, &type, &data, &len)) {
+        unsigned long frame_id;
+        assert(len == sizeof(frame_id));
+        memcpy(&frame_id, data, sizeof(frame_id));
+        assert(frame_id == id && !*done);
+        if (type == PIPE_MSG_CONVERSATION_BATCH) batches++;
+        else if (type == PIPE_MSG_CONVERSATION_DONE) *done = true;
+    }
+    pipe_reader_free(&reader);
+    return batches;
+}
+
+static void write_file(const char *text) {
+    FILE *f = fopen(TEST_CONVERSATION_PATH, "w");
+    assert(f);
+    fputs(text, f);
+    fclose(f);
+}
+
+// Runs an open job to completion and returns its batches.
+static convfile_batch_t *load(convfile_job_t **out_job, int *frames) {
+    convfile_job_t *job = convfile_job_create(TEST_CONVERSATION_PATH, NULL);
+    assert(job);
+    convfile_open_run(NULL, job);
+    bool done;
+    *frames = read_convfile_frames(job->id, &done);
+    assert(done);
+    *out_job = job;
+    return convfile_job_take_batches(job);
+}
+
+void test_open_in_batches() {
+    printf("Testing batched open...\n");
+    open_test_pipe();
+    size_t count = CONVFILE_BATCH_SIZE * 2 + 5;
+    FILE *f = fopen(TEST_CONVERSATION_PATH, "w");
+    fputs("[", f);
+    for (size_t i = 0; i < count; i++) {
+        fprintf(f, "%s\n\t{\"role\":\t\"%s\", \"extra\": {\"role\": \"ignored\", \"n\": [1, 2]},\n\t\t\"parts\": [{\"type\": \"text\", \"text\": \"Message %zu \\u00e9\"}]}",
+                i ? "," : "", i % 2 ? "assistant" : "user", i);
+    }
+    fputs("]", f);
+    fclose(f);
+
+    convfile_job_t *job;
+    int frames;
+    convfile_batch_t *batches = load(&job, &frames);
+    assert(frames == 3 && job->error[0] == '\0' && job->num_messages == count);
+    size_t seen = 0;
+    for (convfile_batch_t *b = batches; b; b = b->next) {
+        assert(b->count == (b->next ? CONVFILE_BATCH_SIZE : 5));
+        for (size_t i = 0; i < b->count; i++, seen++) {
+            char expected[64];
+            snprintf(expected, sizeof(expected), "Message %zu \xc3\xa9", seen);
+            assert(strcmp(b->messages[i].text, expected) == 0);
+            assert(b->messages[i].role == (seen % 2 ? DP_ROLE_ASSISTANT : DP_ROLE_USER));
+            assert(b->messages[i].num_images == 0);
+        }
+    }
+    assert(seen == count);
+    // Nothing is left once taken
+    assert(convfile_job_take_batches(job) == NULL);
+    convfile_batch_free(batches);
+    convfile_job_release(job);
+    close_test_pipe();
+    printf("Batched open passed.\n");
+}
+
+void test_open_parts() {
+    printf("Testing message parts...\n");
+    open_test_pipe();
+    // Text parts are joined; images keep their Base64 while the store is unavailable
+    write_file("[{\"parts\": [{\"text\": \"Look \", \"type\": \"text\"}, {\"type\": \"image_base64\", \"mime_type\": \"image/jpeg\", \"data\": \"QUJD\"},"
+               " {\"type\": \"text\", \"text\": \"here\"}, {\"type\": \"unknown\", \"text\": \"skipped\"}], \"role\": \"user\"},"
+               " {\"role\": \"assistant\", \"parts\": []}]");
+    convfile_job_t *job;
+    int frames;
+    convfile_batch_t *batches = load(&job, &frames);
+    assert(frames == 1 && job->error[0] == '\0' && batches->count == 2);
+    convfile_message_t *m = &batches->messages[0];
+    assert(m->role == DP_ROLE_USER && strcmp(m->text, "Look here") == 0);
+    assert(m->num_images == 1 && strcmp(m->images[0].mime_type, "image/jpeg") == 0);
+    assert(strcmp(m->images[0].data, "QUJD") == 0 && m->images[0].key[0] == '\0');
+    m = &batches->messages[1];
+    assert(m->role == DP_ROLE_ASSISTANT && m->text == NULL && m->num_images == 0);
+    convfile_batch_free(batches);
+    convfile_job_release(job);
+
+    // With the store the image is kept by key only
+    char dir[] = "/tmp/motifgpt_convfile_XXXXXX";
+    assert(mkdtemp(dir));
+    assert(image_store_init(dir) == 0);
+    batches = load(&job, &frames);
+    m = &batches->messages[0];
+    assert(m->images[0].data == NULL && m->images[0].key[0] != '\0');
+    size_t len;
+    char *data = image_store_load(m->images[0].key, &len);
+    assert(data && len == 4 && memcmp(data, "QUJD", 4) == 0);
+    free(data);
+    convfile_batch_free(batches);
+    convfile_job_release(job);
+    close_test_pipe();
+    printf("Message parts passed.\n");
+}
+
+void test_open_errors() {
+    printf("Testing open errors...\n");
+    open_test_pipe();
+    convfile_job_t *job;
+    int frames;
+
+    write_file("{\"role\": \"user\"}");
+    convfile_batch_t *batches = load(&job, &frames);
+    assert(batches == NULL && strstr(job->error, "Not a conversation"));
+    convfile_job_release(job);
+
+    // Messages read in full before the damage are still delivered
+    write_file("[{\"role\": \"user\", \"parts\": [{\"type\": \"text\", \"text\": \"ok\"}]}, {\"role\": \"user\", \"parts\": [{\"type\": \"te");
+    batches = load(&job, &frames);
+    assert(frames == 1 && batches && batches->count == 1 && strstr(job->error, "ends early after 1"));
+    convfile_batch_free(batches);
+    convfile_job_release(job);
+
+    write_file("[{\"role\" \"user\"}]");
+    batches = load(&job, &frames);
+    assert(batches == NULL && strstr(job->error, "not valid after 0"));
+    convfile_job_release(job);
+
+    job = convfile_job_create("/nonexistent/conversation.json", NULL);
+    convfile_open_run(NULL, job);
+    bool done;
+    read_convfile_frames(job->id, &done);
+    assert(done && strstr(job->error, "Could not open"));
+    convfile_job_release(job);
+
+    // A cancelled job posts nothing
+    job = convfile_job_create(TEST_CONVERSATION_PATH, NULL);
+    job->refcount++;
+    convfile_job_cancel(job);
+    convfile_open_run(NULL, job);
+    assert(read_convfile_frames(job->id, &done) == 0 && !done);
+    convfile_job_release(job);
+    close_test_pipe();
+    printf("Open errors passed.\n");
+}
+
+void test_save_round_trip() {
+    printf("Testing save round trip...\n");
+    open_test_pipe();
+    add_message_to_history(DP_ROLE_USER, "What is this?", "image/png", "iVBORw0K");
+    add_message_to_history(DP_ROLE_ASSISTANT, "A picture.", NULL, NULL);
+    convfile_job_t *job = convfile_job_create(TEST_CONVERSATION_PATH, history_snapshot_acquire());
+    assert(job);
+    // The history can change while the save runs; the snapshot is what gets written
+    free_chat_history();
+    convfile_save_run(NULL, job);
+    bool done;
+    assert(read_convfile_frames(job->id, &done) == 0 && done);
+    assert(job->error[0] == '\0' && job->num_messages == 2 && job->snapshot == NULL);
+    assert(access(TEST_CONVERSATION_PATH ".tmp", F_OK) != 0);
+    convfile_job_release(job);
+
+    int frames;
+    convfile_batch_t *batches = load(&job, &frames);
+    assert(batches->count == 2);
+    assert(strcmp(batches->messages[0].text, "What is this?") == 0 && batches->messages[0].num_images == 1);
+    assert(strcmp(batches->messages[1].text, "A picture.") == 0 && batches->messages[1].role == DP_ROLE_ASSISTANT);
+    char *image = batches->messages[0].images[0].data ? strdup(batches->messages[0].images[0].data)
+                                                      : image_store_load(batches->messages[0].images[0].key, NULL);
+    assert(image && strcmp(image, "iVBORw0K") == 0);
+    free(image);
+    convfile_batch_free(batches);
+    convfile_job_release(job);
+
+    job = convfile_job_create("/nonexistent/dir/conversation.json", history_snapshot_acquire());
+    convfile_save_run(NULL, job);
+    assert(read_convfile_frames(job->id, &done) == 0 && done && job->error[0] != '\0');
+    convfile_job_release(job);
+    close_test_pipe();
+    remove(TEST_CONVERSATION_PATH);
+    printf("Save round trip passed.\n");
+}
+
+// Saves the history through a job, as the Save dialog does.
+static void save_history(const char *path) {
+    convfile_job_t *job = convfile_job_create(path, history_snapshot_acquire());
+    assert(job);
+    convfile_save_run(NULL, job);
+    bool done;
+    assert(read_convfile_frames(job->id, &done) == 0 && done && job->error[0] == '\0');
+    convfile_job_release(job);
+}
+
+static char *image_data(const history_image_ref_t *image) {
+    return image->data ? strdup(image->data) : image_store_load(image->key, NULL);
+}
+
+void test_binary_round_trip() {
+    printf("Testing binary round trip...\n");
+    open_test_pipe();
+    assert(convfile_format_for_path("a.MGPT") == CONVFILE_FORMAT_BINARY);
+    assert(convfile_format_for_path(".mgpt") == CONVFILE_FORMAT_JSON && convfile_format_for_path("a.json") == CONVFILE_FORMAT_JSON);
+    free_chat_history();
+    add_message_to_history(DP_ROLE_USER, "Two of the same \xc3\xa9", "image/png", "iVBORw0K");
+    add_message_to_history(DP_ROLE_ASSISTANT, "Yes.", NULL, NULL);
+    add_message_to_history(DP_ROLE_USER, "Again", "image/jpeg", "iVBORw0K");
+    save_history(TEST_BINARY_PATH);
+
+    // The image is written once, as bytes
+    FILE *f = fopen(TEST_BINARY_PATH, "rb");
+    char contents[512];
+    size_t size = fread(contents, 1, sizeof(contents), f);
+    fclose(f);
+    assert(memcmp(contents, CONVFILE_BINARY_MAGIC, CONVFILE_BINARY_MAGIC_SIZE) == 0);
+    int copies = 0;
+    for (size_t i = 0; i + 6 <= size; i++) copies += memcmp(contents + i, "\x89PNG\r\n", 6) == 0;
+    assert(copies == 1 && !memmem(contents, size, "iVBORw0K", 8));
+
+    convfile_view_t view;
+    char error[CONVFILE_ERROR_BUF_SIZE];
+    assert(convfile_view_open(&view, TEST_BINARY_PATH, error, sizeof(error)) == 0 && view.count == 3);
+    // Any message can be read on its own, in any order
+    convfile_message_t m;
+    assert(convfile_view_message(&view, 2, &m) == 0);
+    assert(m.role == DP_ROLE_USER && strcmp(m.text, "Again") == 0 && m.num_images == 1);
+    assert(strcmp(m.images[0].mime_type, "image/jpeg") == 0);
+    char *image = image_data(&m.images[0]);
+    assert(image && strcmp(image, "iVBORw0K") == 0);
+    free(image);
+    convfile_message_free(&m);
+    assert(convfile_view_message(&view, 1, &m) == 0);
+    assert(m.role == DP_ROLE_ASSISTANT && strcmp(m.text, "Yes.") == 0 && m.num_images == 0);
+    convfile_message_free(&m);
+    assert(convfile_view_message(&view, 3, &m) == -1);
+    convfile_view_close(&view);
+
+    // The Open dialog tells the formats apart by content, not name
+    assert(rename(TEST_BINARY_PATH, TEST_CONVERSATION_PATH) == 0);
+    convfile_job_t *job;
+    int frames;
+    convfile_batch_t *batches = load(&job, &frames);
+    assert(frames == 1 && job->error[0] == '\0' && batches->count == 3 && job->num_skipped == 0);
+    assert(strcmp(batches->messages[0].text, "Two of the same \xc3\xa9") == 0);
+    assert(strcmp(batches->messages[0].images[0].mime_type, "image/png") == 0);
+    convfile_batch_free(batches);
+    convfile_job_release(job);
+
+    // Only the last max_messages are decoded
+    job = convfile_job_create(TEST_CONVERSATION_PATH, NULL);
+    job->max_messages = 2;
+    convfile_open_run(NULL, job);
+    bool done;
+    assert(read_convfile_frames(job->id, &done) == 1 && done);
+    batches = convfile_job_take_batches(job);
+    assert(batches->count == 2 && job->num_messages == 2 && job->num_skipped == 1);
+    assert(strcmp(batches->messages[0].text, "Yes.") == 0);
+    convfile_batch_free(batches);
+    convfile_job_release(job);
+    free_chat_history();
+    close_test_pipe();
+    remove(TEST_CONVERSATION_PATH);
+    printf("Binary round trip passed.\n");
+}
+
+static void write_bytes(const char *path, const char *data, size_t len) {
+    FILE *f = fopen(path, "wb");
+    assert(f && fwrite(data, 1, len, f) == len);
+    fclose(f);
+}
+
+void test_binary_damage() {
+    printf("Testing damaged binary files...\n");
+    open_test_pipe();
+    add_message_to_history(DP_ROLE_USER, "First", NULL, NULL);
+    add_message_to_history(DP_ROLE_ASSISTANT, "Second", NULL, NULL);
+    save_history(TEST_BINARY_PATH);
+    free_chat_history();
+    FILE *f = fopen(TEST_BINARY_PATH, "rb");
+    char good[256];
+    size_t size = fread(good, 1, sizeof(good), f);
+    fclose(f);
+
+    convfile_view_t view;
+    char error[CONVFILE_ERROR_BUF_SIZE];
+    char bad[256];
+    // Cut short: the index no longer fits
+    write_bytes(TEST_BINARY_PATH, good, size - 1);
+    assert(convfile_view_open(&view, TEST_BINARY_PATH, error, sizeof(error)) == -1 && strstr(error, "damaged"));
+    write_bytes(TEST_BINARY_PATH, good, 10);
+    assert(convfile_view_open(&view, TEST_BINARY_PATH, error, sizeof(error)) == -1 && strstr(error, "Not a conversation"));
+    memcpy(bad, good, size);
+    bad[8] = 2;
+    write_bytes(TEST_BINARY_PATH, bad, size);
+    assert(convfile_view_open(&view, TEST_BINARY_PATH, error, sizeof(error)) == -1 && strstr(error, "version 2"));
+
+    // A text length running past its record spoils that message only
+    memcpy(bad, good, size);
+    bad[CONVFILE_BINARY_HEADER_SIZE + 12] = 100;
+    write_bytes(TEST_BINARY_PATH, bad, size);
+    assert(convfile_view_open(&view, TEST_BINARY_PATH, error, sizeof(error)) == 0);
+    convfile_message_t m;
+    assert(convfile_view_message(&view, 0, &m) == -1 && m.text == NULL);
+    assert(convfile_view_message(&view, 1, &m) == 0 && strcmp(m.text, "Second") == 0);
+    convfile_message_free(&m);
+    convfile_view_close(&view);
+
+    assert(rename(TEST_BINARY_PATH, TEST_CONVERSATION_PATH) == 0);
+    convfile_job_t *job;
+    int frames;
+    convfile_batch_t *batches = load(&job, &frames);
+    assert(batches == NULL && strstr(job->error, "damaged at message 1"));
+    convfile_job_release(job);
+    close_test_pipe();
+    remove(TEST_CONVERSATION_PATH);
+    printf("Damaged binary files passed.\n");
+}
+
+int main() {
+    test_open_in_batches();
+    test_open_parts();
+    test_open_errors();
+    test_save_round_trip();
+    test_binary_round_trip();
+    test_binary_damage();
+    free_chat_history();
+    printf("All conversation file tests passed!\n");
+    return 0;
+}
@@ -1,8 +1,11 @@
 #include "../motifgpt_history.h"
+#include "../motifgpt_arena.h"
+#include "../motifgpt_imagestore.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <unistd.h>
 
 // Configuration variables (defined elsewhere, e.g., in motifgpt.c or tests)
 int current_max_history_messages = 10;
@@ -26,7 +29,7 @@ bool dp_message_add_base64_image_part(dp_message_t *msg, const char *mime_type,
     if (!new_parts) return false;
     msg->parts = new_parts;
     msg->parts[msg->num_parts].type = DP_CONTENT_PART_IMAGE_BASE64;
-    msg->parts[msg->num_parts].text = strdup("[IMAGE]"); // For simplicity in mock
+    msg->parts[msg->num_parts].text = strdup(base64_data); // Keep the data so tests can see what was sent
     msg->num_parts++;
     return true;
 }
@@ -46,8 +49,6 @@ void dp_free_messages(dp_message_t *messages, size_t count) {
 // Helper to reset state
 void reset_history() {
     free_chat_history();
-    chat_history_capacity = 0;
-    chat_history_count = 0;
     current_max_history_messages = 10;
     history_limits_disabled = false;
 }
@@ -59,10 +60,10 @@ void test_add_message_text_only() {
     add_message_to_history(DP_ROLE_USER, "Hello World", NULL, NULL);
 
     assert(chat_history_count == 1);
-    assert(chat_history[0].role == DP_ROLE_USER);
-    assert(chat_history[0].num_parts == 1);
-    assert(chat_history[0].parts[0].type == DP_CONTENT_PART_TEXT);
-    assert(strcmp(chat_history[0].parts[0].text, "Hello World") == 0);
+    assert(history_at(0)->role == DP_ROLE_USER);
+    assert(history_at(0)->num_parts == 1);
+    assert(history_at(0)->parts[0].type == DP_CONTENT_PART_TEXT);
+    assert(strcmp(history_at(0)->parts[0].text, "Hello World") == 0);
 
     printf("test_add_message_text_only passed.\n");
 }
@@ -80,16 +81,294 @@ void test_history_limit_enforcement() {
     add_message_to_history(DP_ROLE_USER, "Msg 3", NULL, NULL);
 
     assert(chat_history_count == 2);
-    assert(strcmp(chat_history[0].parts[0].text, "Msg 2") == 0); // Oldest became Msg 2
-    assert(strcmp(chat_history[1].parts[0].text, "Msg 3") == 0);
+    assert(strcmp(history_at(0)->parts[0].text, "Msg 2") == 0); // Oldest became Msg 2
+    assert(strcmp(history_at(1)->parts[0].text, "Msg 3") == 0);
 
     printf("test_history_limit_enforcement passed.\n");
 }
 
+void test_snapshot_survives_eviction() {
+    printf("Running test_snapshot_survives_eviction...\n");
+    reset_history();
+    current_max_history_messages = 2;
+
+    add_message_to_history(DP_ROLE_USER, "Msg 1", NULL, NULL);
+    add_message_to_history(DP_ROLE_ASSISTANT, "Msg 2", NULL, NULL);
+    history_snapshot_t *snap = history_snapshot_acquire();
+    assert(snap != NULL);
+    assert(snap->count == 2);
+
+    // Evicting "Msg 1" must not disturb the pinned view
+    add_message_to_history(DP_ROLE_USER, "Msg 3", NULL, NULL);
+    assert(chat_history_count == 2);
+    assert(strcmp(history_at(0)->parts[0].text, "Msg 2") == 0);
+    assert(strcmp(history_at(1)->parts[0].text, "Msg 3") == 0);
+    assert(strcmp(snap->messages[0].parts[0].text, "Msg 1") == 0);
+    assert(strcmp(snap->messages[1].parts[0].text, "Msg 2") == 0);
+
+    history_snapshot_release(snap);
+    assert(strcmp(history_at(0)->parts[0].text, "Msg 2") == 0);
+
+    printf("test_snapshot_survives_eviction passed.\n");
+}
+
+void test_snapshot_survives_repeated_eviction() {
+    printf("Running test_snapshot_survives_repeated_eviction...\n");
+    reset_history();
+    current_max_history_messages = 3;
+
+    // Adopted image buffers are freed one by one, so a premature free is visible
+    add_adopted_image_message_to_history(DP_ROLE_USER, "Msg 1", "image/png", strdup("Image 1"));
+    add_adopted_image_message_to_history(DP_ROLE_ASSISTANT, "Msg 2", "image/png", strdup("Image 2"));
+    add_adopted_image_message_to_history(DP_ROLE_USER, "Msg 3", "image/png", strdup("Image 3"));
+    history_snapshot_t *snap = history_snapshot_acquire();
+    assert(snap != NULL && snap->count == 3 && snap->images);
+
+    // Each eviction after the first lands in a block the snapshot only reaches
+    // through its successor, so the messages it still shows must stay alive
+    add_message_to_history(DP_ROLE_ASSISTANT, "Msg 4", NULL, NULL);
+    add_message_to_history(DP_ROLE_USER, "Msg 5", NULL, NULL);
+    add_message_to_history(DP_ROLE_ASSISTANT, "Msg 6", NULL, NULL);
+    assert(chat_history_count == 3);
+    assert(strcmp(history_at(0)->parts[0].text, "Msg 4") == 0);
+    for (int i = 0; i < 3; i++) {
+        char expected[16];
+        snprintf(expected, sizeof(expected), "Msg %d", i + 1);
+        assert(strcmp(snap->messages[i].parts[0].text, expected) == 0);
+        snprintf(expected, sizeof(expected), "Image %d", i + 1);
+        assert(strcmp(snap->images[i][0].data, expected) == 0);
+    }
+
+    free_chat_history();
+    assert(strcmp(snap->images[1][0].data, "Image 2") == 0);
+    assert(strcmp(snap->images[2][0].data, "Image 3") == 0);
+    history_snapshot_release(snap);
+
+    printf("test_snapshot_survives_repeated_eviction passed.\n");
+}
+
+void test_snapshot_survives_growth_and_clear() {
+    printf("Running test_snapshot_survives_growth_and_clear...\n");
+    reset_history();
+    current_max_history_messages = 100;
+
+    for (int i = 0; i < 10; i++) add_message_to_history(DP_ROLE_USER, "Old", NULL, NULL);
+    history_snapshot_t *snap = history_snapshot_acquire();
+    assert(snap->count == 10);
+
+    // Growing past the initial capacity must not move the snapshot's array
+    add_message_to_history(DP_ROLE_USER, "New", NULL, NULL);
+    assert(chat_history_count == 11);
+    assert(strcmp(snap->messages[9].parts[0].text, "Old") == 0);
+
+    history_snapshot_t *second = history_snapshot_acquire();
+    assert(second->count == 11);
+    free_chat_history();
+    assert(chat_history_count == 0);
+    assert(strcmp(second->messages[10].parts[0].text, "New") == 0);
+    assert(strcmp(snap->messages[0].parts[0].text, "Old") == 0);
+
+    history_snapshot_release(snap);
+    history_snapshot_release(second);
+
+    // Once no snapshot is left the history is reusable as before
+    add_message_to_history(DP_ROLE_USER, "After", NULL, NULL);
+    assert(chat_history_count == 1);
+    assert(strcmp(history_at(0)->parts[0].text, "After") == 0);
+
+    printf("test_snapshot_survives_growth_and_clear passed.\n");
+}
+
+void test_ring_wraparound() {
+    printf("Running test_ring_wraparound...\n");
+    reset_history();
+    current_max_history_messages = 7;
+    char text[16];
+
+    // Evicting at the limit keeps advancing the head past the end of the ring
+    for (int i = 0; i < 25; i++) {
+        snprintf(text, sizeof(text), "Msg %d", i);
+        add_message_to_history(DP_ROLE_USER, text, NULL, NULL);
+    }
+    assert(chat_history_count == 7);
+    for (int i = 0; i < 7; i++) {
+        snprintf(text, sizeof(text), "Msg %d", 18 + i);
+        assert(strcmp(history_at(i)->parts[0].text, text) == 0);
+    }
+    assert(history_at(-1) == NULL);
+    assert(history_at(7) == NULL);
+
+    // A snapshot of a wrapped ring is still in conversation order and survives
+    // the slots it came from being reused
+    history_snapshot_t *snap = history_snapshot_acquire();
+    for (int i = 25; i < 40; i++) {
+        snprintf(text, sizeof(text), "Msg %d", i);
+        add_message_to_history(DP_ROLE_ASSISTANT, text, NULL, NULL);
+    }
+    assert(snap->count == 7);
+    for (int i = 0; i < 7; i++) {
+        snprintf(text, sizeof(text), "Msg %d", 18 + i);
+        assert(strcmp(snap->messages[i].parts[0].text, text) == 0);
+        snprintf(text, sizeof(text), "Msg %d", 33 + i);
+        assert(strcmp(history_at(i)->parts[0].text, text) == 0);
+    }
+    history_snapshot_release(snap);
+
+    // Raising the limit grows the ring and unwraps it
+    current_max_history_messages = 20;
+    for (int i = 40; i < 45; i++) {
+        snprintf(text, sizeof(text), "Msg %d", i);
+        add_message_to_history(DP_ROLE_USER, text, NULL, NULL);
+    }
+    assert(chat_history_count == 12);
+    for (int i = 0; i < 12; i++) {
+        snprintf(text, sizeof(text), "Msg %d", 33 + i);
+        assert(strcmp(history_at(i)->parts[0].text, text) == 0);
+    }
+
+    printf("test_ring_wraparound passed.\n");
+}
+
+void test_arena_backed_messages() {
+    printf("Running test_arena_backed_messages...\n");
+    reset_history();
+    current_max_history_messages = 100;
+    arena_stats_t stats;
+    arena_get_stats(&stats);
+    assert(stats.live_slabs == 0);
+
+    char text[32];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(text, sizeof(text), "Message number %d", i);
+        add_message_to_history(i % 2 ? DP_ROLE_ASSISTANT : DP_ROLE_USER, text, NULL, NULL);
+    }
+    add_message_to_history(DP_ROLE_USER, "With image", "image/png", "iVBORw0KGgo=");
+    assert(chat_history_count == 100);
+    assert(history_at(99)->num_parts == 2);
+    assert(history_at(98)->num_parts == 1);
+    assert(strcmp(history_at(98)->parts[0].text, "Message number 999") == 0);
+
+    // Evicted messages give their slabs back; only what the last 100 need stays
+    arena_get_stats(&stats);
+    assert(stats.live_slabs > 0 && stats.live_slabs <= 2);
+
+    // A snapshot keeps cleared messages alive until it is released
+    history_snapshot_t *snap = history_snapshot_acquire();
+    free_chat_history();
+    arena_get_stats(&stats);
+    assert(stats.live_slabs > 0);
+    assert(strcmp(snap->messages[0].parts[0].text, "Message number 901") == 0);
+    history_snapshot_release(snap);
+    arena_get_stats(&stats);
+    assert(stats.live_slabs == 0);
+
+    printf("test_arena_backed_messages passed.\n");
+}
+
+void test_adopted_image_messages() {
+    printf("Running test_adopted_image_messages...\n");
+    reset_history();
+
+    // Without a store the message takes over the caller's buffer
+    char *data = strdup("R0lGODlhAQABAAAAACw=");
+    add_adopted_image_message_to_history(DP_ROLE_USER, "Inline", "image/gif", data);
+    assert(chat_history_count == 1);
+    assert(history_at(0)->num_parts == 2);
+    assert(history_at(0)->parts[1].text == NULL);
+
+    history_snapshot_t *snap = history_snapshot_acquire();
+    assert(snap->images && snap->images[0]->data == data);
+    assert(snap->images[0]->key[0] == '\0');
+    dp_message_t *payload = NULL;
+    assert(history_snapshot_expand(snap, &payload) == 0);
+    assert(strcmp(payload[0].parts[1].text, "R0lGODlhAQABAAAAACw=") == 0);
+    history_payload_free(snap, payload);
+
+    // The buffer outlives eviction until the snapshot lets go
+    free_chat_history();
+    assert(strcmp(snap->images[0]->data, "R0lGODlhAQABAAAAACw=") == 0);
+    history_snapshot_release(snap);
+
+    printf("test_adopted_image_messages passed.\n");
+}
+
+void test_stored_image_messages() {
+    printf("Running test_stored_image_messages...\n");
+    reset_history();
+
+    char dir[] = "/tmp/motifgpt_history_XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    assert(image_store_init(dir) == 0);
+
+    add_message_to_history(DP_ROLE_USER, "Look", "image/png", "iVBORw0KGgo=");
+    add_message_to_history(DP_ROLE_ASSISTANT, "A picture", NULL, NULL);
+    assert(chat_history_count == 2);
+
+    // History only keeps a placeholder; the data lives in the store
+    dp_message_t *msg = history_at(0);
+    assert(msg->num_parts == 2);
+    assert(msg->parts[1].type == DP_CONTENT_PART_IMAGE_BASE64);
+    assert(msg->parts[1].text == NULL);
+
+    history_snapshot_t *snap = history_snapshot_acquire();
+    assert(snap->images != NULL);
+    assert(snap->images[0] != NULL && snap->images[1] == NULL);
+    assert(strcmp(snap->images[0]->mime_type, "image/png") == 0);
+
+    dp_message_t *payload = NULL;
+    assert(history_snapshot_expand(snap, &payload) == 0);
+    assert(payload != snap->messages);
+    assert(payload[0].num_parts == 2);
+    assert(strcmp(payload[0].parts[0].text, "Look") == 0);
+    assert(strcmp(payload[0].parts[1].text, "iVBORw0KGgo=") == 0);
+    assert(strcmp(payload[1].parts[0].text, "A picture") == 0);
+    history_payload_free(snap, payload);
+    history_snapshot_release(snap);
+
+    // Several images in one message, stored and inline, keep their order
+    reset_history();
+    char key[IMAGE_STORE_KEY_SIZE];
+    assert(image_store_put("U1RPUkVE", 8, key) == 0);
+    history_image_ref_t images[2] = { { "", "image/png", NULL }, { "", "image/jpeg", strdup("SU5MSU5F") } };
+    snprintf(images[0].key, sizeof(images[0].key), "%s", key);
+    add_image_message_to_history(DP_ROLE_USER, "Two pictures", images, 2);
+    assert(chat_history_count == 1);
+    assert(history_at(0)->num_parts == 3);
+    snap = history_snapshot_acquire();
+    assert(snap->images[0][0].data == NULL && snap->images[0][1].data != NULL);
+    assert(history_snapshot_expand(snap, &payload) == 0);
+    assert(payload[0].num_parts == 3);
+    assert(strcmp(payload[0].parts[0].text, "Two pictures") == 0);
+    assert(strcmp(payload[0].parts[1].text, "U1RPUkVE") == 0);
+    assert(strcmp(payload[0].parts[2].text, "SU5MSU5F") == 0);
+    history_payload_free(snap, payload);
+    history_snapshot_release(snap);
+
+    // Text-only history is sent as is
+    reset_history();
+    add_message_to_history(DP_ROLE_USER, "Plain", NULL, NULL);
+    snap = history_snapshot_acquire();
+    assert(snap->images == NULL);
+    assert(history_snapshot_expand(snap, &payload) == 0);
+    assert(payload == snap->messages);
+    history_payload_free(snap, payload);
+    history_snapshot_release(snap);
+
+    printf("test_stored_image_messages passed.\n");
+}
+
 int main() {
     printf("Starting tests...\n");
     test_add_message_text_only();
     test_history_limit_enforcement();
+    test_snapshot_survives_eviction();
+    test_snapshot_survives_repeated_eviction();
+    test_snapshot_survives_growth_and_clear();
+    test_ring_wraparound();
+    test_arena_backed_messages();
+    test_adopted_image_messages();
+    test_stored_image_messages();
+    free_chat_history();
     printf("All tests passed successfully.\n");
     return 0;
 }
@@ -0,0 +1,316 @@
+#include "../motifgpt_imagescale.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <png.h>
+#include <jpeglib.h>
+
+// A gradient with noise in the red channel, so it compresses like a photo.
+static unsigned char *make_pixels(int w, int h, int channels) {
+    unsigned char *pixels = malloc((size_t)w * h * channels);
+    assert(pixels);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            unsigned char *p = pixels + ((size_t)y * w + x) * channels;
+            p[0] = (unsigned char)(x * 255 / w) ^ (unsigned char)((x * 7919u ^ y * 104729u) & 31);
+            p[1] = (unsigned char)(y * 255 / h);
+            p[2] = 128;
+            if (channels == 4) p[3] = (unsigned char)(x < w / 2 ? 255 : 64);
+        }
+    }
+    return pixels;
+}
+
+static unsigned char *make_png(int w, int h, int channels, size_t *len) {
+    unsigned char *pixels = make_pixels(w, h, channels);
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    image.width = w;
+    image.height = h;
+    image.format = channels == 4 ? PNG_FORMAT_RGBA : PNG_FORMAT_RGB;
+    png_alloc_size_t size = 0;
+    assert(png_image_write_to_memory(&image, NULL, &size, 0, pixels, 0, NULL));
+    unsigned char *buf = malloc(size);
+    assert(buf);
+    assert(png_image_write_to_memory(&image, buf, &size, 0, pixels, 0, NULL));
+    free(pixels);
+    *len = size;
+    return buf;
+}
+
+static unsigned char *make_jpeg(int w, int h, size_t *len) {
+    unsigned char *pixels = make_pixels(w, h, 3);
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned char *buf = NULL;
+    unsigned long buf_len = 0;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &buf, &buf_len);
+    cinfo.image_width = w;
+    cinfo.image_height = h;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 95, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = pixels + (size_t)cinfo.next_scanline * w * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    free(pixels);
+    *len = buf_len;
+    return buf;
+}
+
+static void put_le32(unsigned char *p, uint32_t v) {
+    p[0] = v & 0xFF; p[1] = (v >> 8) & 0xFF; p[2] = (v >> 16) & 0xFF; p[3] = v >> 24;
+}
+
+// Writes a bottom-up BMP: 24-bit, or 32-bit with an alpha mask in a V3 header.
+static unsigned char *make_bmp(int w, int h, int channels, size_t *len) {
+    unsigned char *pixels = make_pixels(w, h, channels);
+    int bpp = channels * 8;
+    size_t header = channels == 4 ? 56 : 40;
+    size_t offset = 14 + header, stride = ((size_t)w * bpp + 31) / 32 * 4;
+    *len = offset + stride * h;
+    unsigned char *buf = calloc(1, *len);
+    assert(buf);
+    buf[0] = 'B'; buf[1] = 'M';
+    put_le32(buf + 2, (uint32_t)*len);
+    put_le32(buf + 10, (uint32_t)offset);
+    put_le32(buf + 14, (uint32_t)header);
+    put_le32(buf + 18, (uint32_t)w);
+    put_le32(buf + 22, (uint32_t)h);
+    buf[26] = 1; buf[28] = (unsigned char)bpp;
+    if (channels == 4) {
+        put_le32(buf + 30, 3);
+        put_le32(buf + 54, 0x00FF0000); put_le32(buf + 58, 0x0000FF00);
+        put_le32(buf + 62, 0x000000FF); put_le32(buf + 66, 0xFF000000);
+    }
+    for (int y = 0; y < h; y++) {
+        unsigned char *row = buf + offset + stride * (h - 1 - y);
+        for (int x = 0; x < w; x++) {
+            const unsigned char *p = pixels + ((size_t)y * w + x) * channels;
+            unsigned char *q = row + (size_t)x * channels;
+            q[0] = p[2]; q[1] = p[1]; q[2] = p[0];
+            if (channels == 4) q[3] = p[3];
+        }
+    }
+    free(pixels);
+    return buf;
+}
+
+static void jpeg_dimensions(const unsigned char *data, size_t len, int *w, int *h) {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char *)data, len);
+    assert(jpeg_read_header(&cinfo, TRUE) == JPEG_HEADER_OK);
+    *w = (int)cinfo.image_width;
+    *h = (int)cinfo.image_height;
+    jpeg_destroy_decompress(&cinfo);
+}
+
+// Decodes a PNG and returns the pixel at (x, y) as RGBA.
+static void png_pixel(const unsigned char *data, size_t len, int *w, int *h, int x, int y, unsigned char rgba[4]) {
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    assert(png_image_begin_read_from_memory(&image, data, len));
+    image.format = PNG_FORMAT_RGBA;
+    unsigned char *pixels = malloc(PNG_IMAGE_SIZE(image));
+    assert(pixels);
+    assert(png_image_finish_read(&image, NULL, pixels, 0, NULL));
+    *w = (int)image.width;
+    *h = (int)image.height;
+    memcpy(rgba, pixels + ((size_t)y * image.width + x) * 4, 4);
+    free(pixels);
+}
+
+void test_small_images_untouched() {
+    printf("Testing images within the limit...\n");
+    size_t len;
+    unsigned char *png = make_png(640, 480, 3, &len);
+    image_scale_options_t options = { 1024, IMAGE_SCALE_DEFAULT_QUALITY };
+    unsigned char *out = NULL; size_t out_len = 0; const char *mime = NULL;
+    assert(image_scale(png, len, "image/png", &options, &out, &out_len, &mime) == 0);
+    assert(out == NULL);
+
+    // A limit of 0 turns scaling off
+    options.max_dimension = 0;
+    assert(image_scale(png, len, "image/png", &options, &out, &out_len, &mime) == 0);
+    free(png);
+
+    // GIFs are never decoded
+    options.max_dimension = 16;
+    assert(image_scale((const unsigned char *)"GIF89a", 6, "image/gif", &options, &out, &out_len, &mime) == 0);
+    printf("Images within the limit passed.\n");
+}
+
+void test_opaque_png_to_jpeg() {
+    printf("Testing opaque PNG downscale...\n");
+    size_t len;
+    unsigned char *png = make_png(3000, 1000, 3, &len);
+    image_scale_options_t options = { 1200, 80 };
+    unsigned char *out = NULL; size_t out_len = 0; const char *mime = NULL;
+    assert(image_scale(png, len, "image/png", &options, &out, &out_len, &mime) == 1);
+    assert(strcmp(mime, "image/jpeg") == 0);
+    assert(out_len < len);
+    int w, h;
+    jpeg_dimensions(out, out_len, &w, &h);
+    assert(w == 1200 && h == 400);
+    free(out);
+    free(png);
+    printf("Opaque PNG downscale passed.\n");
+}
+
+void test_transparent_png_stays_png() {
+    printf("Testing transparent PNG downscale...\n");
+    size_t len;
+    unsigned char *png = make_png(800, 2400, 4, &len);
+    image_scale_options_t options = { 600, 80 };
+    unsigned char *out = NULL; size_t out_len = 0; const char *mime = NULL;
+    assert(image_scale(png, len, "image/png", &options, &out, &out_len, &mime) == 1);
+    assert(strcmp(mime, "image/png") == 0);
+    int w, h;
+    unsigned char left[4], right[4];
+    png_pixel(out, out_len, &w, &h, 10, 300, left);
+    png_pixel(out, out_len, &w, &h, 190, 300, right);
+    assert(w == 200 && h == 600);
+    // Averaging keeps the colours and the alpha of each half
+    assert(left[3] == 255 && right[3] == 64);
+    assert(left[2] == 128 && right[2] == 128);
+    assert(abs((int)left[1] - 127) <= 2);
+    free(out);
+    free(png);
+    printf("Transparent PNG downscale passed.\n");
+}
+
+void test_jpeg_downscale() {
+    printf("Testing JPEG downscale...\n");
+    size_t len;
+    unsigned char *jpeg = make_jpeg(4000, 3000, &len);
+    image_scale_options_t options = { 1568, IMAGE_SCALE_DEFAULT_QUALITY };
+    unsigned char *out = NULL; size_t out_len = 0; const char *mime = NULL;
+    assert(image_scale(jpeg, len, "image/jpeg", &options, &out, &out_len, &mime) == 1);
+    assert(strcmp(mime, "image/jpeg") == 0);
+    assert(out_len < len);
+    int w, h;
+    jpeg_dimensions(out, out_len, &w, &h);
+    assert(w == 1568 && h == 1176);
+    free(out);
+    free(jpeg);
+    printf("JPEG downscale passed.\n");
+}
+
+void test_corrupt_input() {
+    printf("Testing corrupt input...\n");
+    unsigned char junk[64];
+    memcpy(junk, "\x89PNG\r\n\x1a\n", 8);
+    memset(junk + 8, 0xAB, sizeof(junk) - 8);
+    image_scale_options_t options = { 100, IMAGE_SCALE_DEFAULT_QUALITY };
+    unsigned char *out = NULL; size_t out_len = 0; const char *mime = NULL;
+    assert(image_scale(junk, sizeof(junk), "image/png", &options, &out, &out_len, &mime) == -1);
+    memcpy(junk, "\xFF\xD8\xFF\xE0", 4);
+    assert(image_scale(junk, sizeof(junk), "image/jpeg", &options, &out, &out_len, &mime) == -1);
+    assert(out == NULL);
+    printf("Corrupt input passed.\n");
+}
+
+void test_bmp_conversion() {
+    printf("Testing BMP conversion...\n");
+    image_scale_options_t options = { 1024, IMAGE_SCALE_DEFAULT_QUALITY, IMAGE_FORMAT_PNG | IMAGE_FORMAT_JPEG };
+    unsigned char *out = NULL; size_t out_len = 0; const char *mime = NULL;
+    int w, h;
+
+    // Converted at full size even though it fits, since BMP isn't accepted
+    size_t len;
+    unsigned char *bmp = make_bmp(640, 480, 3, &len);
+    assert(image_scale(bmp, len, "image/bmp", &options, &out, &out_len, &mime) == 1);
+    assert(strcmp(mime, "image/jpeg") == 0 && out_len < len);
+    jpeg_dimensions(out, out_len, &w, &h);
+    assert(w == 640 && h == 480);
+    free(out);
+
+    // Scaling off still converts
+    options.max_dimension = 0;
+    assert(image_scale(bmp, len, "image/bmp", &options, &out, &out_len, &mime) == 1);
+    free(out);
+
+    // Accepted as it is and within the limit: untouched
+    options.accepted_formats = 0;
+    options.max_dimension = 1024;
+    assert(image_scale(bmp, len, "image/bmp", &options, &out, &out_len, &mime) == 0);
+    free(bmp);
+
+    // Transparency survives as PNG, rows the right way up
+    options.accepted_formats = IMAGE_FORMAT_PNG | IMAGE_FORMAT_JPEG;
+    bmp = make_bmp(100, 60, 4, &len);
+    assert(image_scale(bmp, len, "image/bmp", &options, &out, &out_len, &mime) == 1);
+    assert(strcmp(mime, "image/png") == 0);
+    unsigned char top[4], bottom[4];
+    png_pixel(out, out_len, &w, &h, 75, 0, top);
+    png_pixel(out, out_len, &w, &h, 75, 59, bottom);
+    assert(w == 100 && h == 60);
+    assert(top[3] == 64 && top[1] == 0 && bottom[1] == 250);
+    free(out);
+
+    // Truncated pixel data
+    assert(image_scale(bmp, len / 2, "image/bmp", &options, &out, &out_len, &mime) == -1);
+    free(bmp);
+    printf("BMP conversion passed.\n");
+}
+
+void test_smallest_format() {
+    printf("Testing smallest format...\n");
+    // Flat colour, like a screenshot, compresses far better as PNG
+    int w = 2000, h = 1000;
+    unsigned char *pixels = malloc((size_t)w * h * 3);
+    assert(pixels);
+    for (size_t i = 0; i < (size_t)w * h; i++) {
+        pixels[i * 3] = (i / w) < 500 ? 255 : 0; pixels[i * 3 + 1] = 255; pixels[i * 3 + 2] = 255;
+    }
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    image.width = w; image.height = h; image.format = PNG_FORMAT_RGB;
+    png_alloc_size_t size = 0;
+    assert(png_image_write_to_memory(&image, NULL, &size, 0, pixels, 0, NULL));
+    unsigned char *png = malloc(size);
+    assert(png_image_write_to_memory(&image, png, &size, 0, pixels, 0, NULL));
+    free(pixels);
+
+    image_scale_options_t options = { 1000, IMAGE_SCALE_DEFAULT_QUALITY };
+    unsigned char *out = NULL; size_t out_len = 0; const char *mime = NULL;
+    assert(image_scale(png, size, "image/png", &options, &out, &out_len, &mime) == 1);
+    assert(strcmp(mime, "image/png") == 0);
+    free(out);
+
+    // Unless PNG isn't accepted
+    options.accepted_formats = IMAGE_FORMAT_JPEG;
+    assert(image_scale(png, size, "image/png", &options, &out, &out_len, &mime) == 1);
+    assert(strcmp(mime, "image/jpeg") == 0);
+    free(out);
+    free(png);
+    printf("Smallest format passed.\n");
+}
+
+int main() {
+    assert(image_scale_available());
+    test_small_images_untouched();
+    test_opaque_png_to_jpeg();
+    test_transparent_png_stays_png();
+    test_jpeg_downscale();
+    test_corrupt_input();
+    test_bmp_conversion();
+    test_smallest_format();
+    printf("All image scaling tests passed!\n");
+    return 0;
+}
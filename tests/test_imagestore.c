@@ -0,0 +1,101 @@
+#include "../motifgpt_imagestore.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+
+static int count_entries(const char *dir) {
+    DIR *d = opendir(dir);
+    assert(d);
+    int n = 0;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] != '.') n++;
+    }
+    closedir(d);
+    return n;
+}
+
+void test_hash_vectors() {
+    printf("Testing SHA-256 keys...\n");
+    char key[IMAGE_STORE_KEY_SIZE];
+    image_store_hash("", 0, key);
+    assert(strcmp(key, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855") == 0);
+    image_store_hash("abc", 3, key);
+    assert(strcmp(key, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") == 0);
+    // Two blocks of padding
+    const char *long_msg = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    image_store_hash(long_msg, strlen(long_msg), key);
+    assert(strcmp(key, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1") == 0);
+    printf("SHA-256 keys passed.\n");
+}
+
+void test_put_without_init() {
+    printf("Testing put before init...\n");
+    char key[IMAGE_STORE_KEY_SIZE];
+    assert(image_store_put("AAAA", 4, key) == -1);
+    // A directory that leaves no room for a key and a temporary suffix is refused
+    char long_dir[PATH_MAX];
+    memset(long_dir, 'd', PATH_MAX - 100);
+    long_dir[0] = '/';
+    long_dir[PATH_MAX - 100] = '\0';
+    assert(image_store_init(long_dir) == -1);
+    assert(image_store_put("AAAA", 4, key) == -1);
+    printf("Put before init passed.\n");
+}
+
+void test_put_and_load(const char *dir) {
+    printf("Testing put, load and dedup...\n");
+    char key1[IMAGE_STORE_KEY_SIZE], key2[IMAGE_STORE_KEY_SIZE], key3[IMAGE_STORE_KEY_SIZE];
+    const char *data = "iVBORw0KGgoAAAANSUhEUgAAAAEAAAABCAYAAAAfFcSJAAAADUlEQVR42mNk";
+    assert(image_store_put(data, strlen(data), key1) == 0);
+    assert(strlen(key1) == IMAGE_STORE_KEY_SIZE - 1);
+
+    size_t len = 0;
+    char *loaded = image_store_load(key1, &len);
+    assert(loaded && len == strlen(data));
+    assert(strcmp(loaded, data) == 0);
+    free(loaded);
+
+    // The same image is stored once
+    assert(image_store_put(data, strlen(data), key2) == 0);
+    assert(strcmp(key1, key2) == 0);
+    assert(count_entries(dir) == 1);
+
+    assert(image_store_put("R0lGODlh", 8, key3) == 0);
+    assert(strcmp(key1, key3) != 0);
+    assert(count_entries(dir) == 2);
+
+    char missing[IMAGE_STORE_KEY_SIZE];
+    image_store_hash("not stored", 10, missing);
+    assert(image_store_load(missing, NULL) == NULL);
+
+    // An entry a crash left empty reads as missing, and the next put repairs it
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, key3);
+    assert(truncate(path, 0) == 0);
+    assert(image_store_load(key3, NULL) == NULL);
+    assert(image_store_put("R0lGODlh", 8, key3) == 0);
+    loaded = image_store_load(key3, &len);
+    assert(loaded && len == 8 && strcmp(loaded, "R0lGODlh") == 0);
+    free(loaded);
+    assert(image_store_put("", 0, missing) == -1);
+    assert(count_entries(dir) == 2);
+    printf("Put, load and dedup passed.\n");
+}
+
+int main() {
+    test_hash_vectors();
+    test_put_without_init();
+
+    char dir[] = "/tmp/motifgpt_images_XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    assert(image_store_init(dir) == 0);
+    test_put_and_load(dir);
+
+    printf("All image store tests passed!\n");
+    return 0;
+}
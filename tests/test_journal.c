@@ -0,0 +1,179 @@
+#include "../motifgpt_journal.h"
+#include "../motifgpt_history.h"
+#include "../motifgpt_imagestore.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+int current_max_history_messages = 1000;
+bool history_limits_disabled = false;
+
+// Mock disasterparty functions, as in test_history
+bool dp_message_add_text_part(dp_message_t *msg, const char *text) {
+    dp_content_part_t *parts = realloc(msg->parts, (msg->num_parts + 1) * sizeof(dp_content_part_t));
+    if (!parts) return false;
+    msg->parts = parts;
+    msg->parts[msg->num_parts].type = DP_CONTENT_PART_TEXT;
+    msg->parts[msg->num_parts].text = strdup(text);
+    msg->num_parts++;
+    return true;
+}
+
+bool dp_message_add_base64_image_part(dp_message_t *msg, const char *mime_type, const char *base64_data) {
+    if (!dp_message_add_text_part(msg, base64_data)) return false;
+    msg->parts[msg->num_parts - 1].type = DP_CONTENT_PART_IMAGE_BASE64;
+    return true;
+}
+
+void dp_free_messages(dp_message_t *messages, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < messages[i].num_parts; j++) free(messages[i].parts[j].text);
+        free(messages[i].parts);
+    }
+}
+
+static char journal_file[64];
+
+static off_t journal_file_size() {
+    struct stat st;
+    assert(stat(journal_file, &st) == 0);
+    return st.st_size;
+}
+
+static const char *text_at(int i) {
+    dp_message_t *m = history_at(i);
+    return m && m->num_parts > 0 && m->parts[0].type == DP_CONTENT_PART_TEXT ? m->parts[0].text : NULL;
+}
+
+// Simulates a crash and a restart: the history is lost, the journal is not.
+static int restart() {
+    journal_close(false);
+    free_chat_history();
+    return journal_open(journal_file);
+}
+
+void test_replay() {
+    printf("Testing journal replay...\n");
+    assert(journal_open(journal_file) == 0);
+    add_message_to_history(DP_ROLE_USER, "Hello \xc3\xa9", NULL, NULL);
+    add_message_to_history(DP_ROLE_ASSISTANT, "", NULL, NULL);
+    // The store is not initialized yet, so the journal carries the data itself
+    add_message_to_history(DP_ROLE_USER, "Picture", "image/png", "iVBORw0K");
+    assert(restart() == 3);
+    assert(chat_history_count == 3);
+    assert(strcmp(text_at(0), "Hello \xc3\xa9") == 0 && history_at(0)->role == DP_ROLE_USER);
+    assert(strcmp(text_at(1), "") == 0 && history_at(1)->role == DP_ROLE_ASSISTANT);
+    history_snapshot_t *snap = history_snapshot_acquire();
+    assert(snap->images && snap->images[2] && strcmp(snap->images[2][0].data, "iVBORw0K") == 0);
+    assert(strcmp(snap->images[2][0].mime_type, "image/png") == 0);
+    history_snapshot_release(snap);
+
+    // Replayed messages are not journaled twice
+    assert(restart() == 3);
+
+    // With the store, only the key is journaled
+    char dir[] = "/tmp/motifgpt_journal_XXXXXX";
+    assert(mkdtemp(dir) && image_store_init(dir) == 0);
+    off_t before = journal_file_size();
+    add_message_to_history(DP_ROLE_USER, NULL, "image/jpeg", "/9j/4AAQ");
+    assert(journal_file_size() - before < 200);
+    assert(restart() == 4);
+    snap = history_snapshot_acquire();
+    assert(snap->images[3][0].data == NULL && snap->images[3][0].key[0] != '\0');
+    char *data = image_store_load(snap->images[3][0].key, NULL);
+    assert(data && strcmp(data, "/9j/4AAQ") == 0);
+    free(data);
+    history_snapshot_release(snap);
+    journal_close(false);
+    free_chat_history();
+    printf("Journal replay passed.\n");
+}
+
+void test_torn_tail() {
+    printf("Testing torn journal tail...\n");
+    assert(journal_open(journal_file) == 4);
+    journal_reset();
+    add_message_to_history(DP_ROLE_USER, "Kept", NULL, NULL);
+    journal_sync();
+    off_t good = journal_file_size();
+    add_message_to_history(DP_ROLE_ASSISTANT, "Cut short by the crash", NULL, NULL);
+    journal_close(false);
+    free_chat_history();
+    assert(truncate(journal_file, journal_file_size() - 3) == 0);
+
+    assert(journal_open(journal_file) == 1);
+    assert(strcmp(text_at(0), "Kept") == 0);
+    // The damage is dropped, so the next message follows the good records
+    assert(journal_file_size() == good);
+    add_message_to_history(DP_ROLE_ASSISTANT, "After", NULL, NULL);
+    assert(restart() == 2 && strcmp(text_at(1), "After") == 0);
+
+    // A flipped byte fails the checksum
+    journal_close(false);
+    free_chat_history();
+    FILE *f = fopen(journal_file, "r+b");
+    assert(f && fseek(f, -1, SEEK_END) == 0);
+    fputc('X', f);
+    fclose(f);
+    assert(journal_open(journal_file) == 1);
+
+    // Anything that is not a journal is replaced
+    journal_close(false);
+    free_chat_history();
+    f = fopen(journal_file, "wb");
+    fputs("not a journal at all", f);
+    fclose(f);
+    assert(journal_open(journal_file) == 0 && journal_file_size() == JOURNAL_MAGIC_SIZE);
+    journal_close(false);
+    printf("Torn journal tail passed.\n");
+}
+
+void test_compaction() {
+    printf("Testing journal compaction...\n");
+    current_max_history_messages = 4;
+    assert(journal_open(journal_file) == 0);
+    off_t peak = 0;
+    for (int i = 0; i < 1000; i++) {
+        char text[32];
+        snprintf(text, sizeof(text), "Message %d", i);
+        add_message_to_history(i % 2 ? DP_ROLE_ASSISTANT : DP_ROLE_USER, text, NULL, NULL);
+        if (journal_file_size() > peak) peak = journal_file_size();
+    }
+    // Evicted messages do not pile up
+    assert(peak < (2 * 4 + JOURNAL_COMPACT_SLACK + 2) * 40);
+    assert(restart() == 4);
+    assert(strcmp(text_at(0), "Message 996") == 0 && strcmp(text_at(3), "Message 999") == 0);
+    current_max_history_messages = 1000;
+    printf("Journal compaction passed.\n");
+}
+
+void test_reset_and_discard() {
+    printf("Testing journal reset and discard...\n");
+    journal_reset();
+    assert(journal_file_size() == JOURNAL_MAGIC_SIZE);
+    assert(restart() == 0 && chat_history_count == 0);
+    add_message_to_history(DP_ROLE_USER, "Bye", NULL, NULL);
+    journal_close(true);
+    assert(access(journal_file, F_OK) != 0);
+    // Closing twice is harmless, and nothing is journaled once closed
+    journal_close(true);
+    add_message_to_history(DP_ROLE_USER, "Unjournaled", NULL, NULL);
+    assert(access(journal_file, F_OK) != 0);
+    free_chat_history();
+    assert(journal_open("/nonexistent/dir/session.journal") == -1);
+    printf("Journal reset and discard passed.\n");
+}
+
+int main() {
+    snprintf(journal_file, sizeof(journal_file), "test_session_%d.journal", (int)getpid());
+    unlink(journal_file);
+    test_replay();
+    test_torn_tail();
+    test_compaction();
+    test_reset_and_discard();
+    printf("All journal tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "../motifgpt_json.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Records every event as text so runs can be compared.
+typedef struct {
+    char log[4096];
+    json_sax_t *sax;
+    char *taken;
+} recorder_t;
+
+static void record(recorder_t *r, const char *kind, const char *value) {
+    size_t len = strlen(r->log);
+    snprintf(r->log + len, sizeof(r->log) - len, "%s%s%s;", kind, value ? "=" : "", value ? value : "");
+}
+
+static int on_begin_object(void *u) { record(u, "{", NULL); return 0; }
+static int on_end_object(void *u) { record(u, "}", NULL); return 0; }
+static int on_begin_array(void *u) { record(u, "[", NULL); return 0; }
+static int on_end_array(void *u) { record(u, "]", NULL); return 0; }
+static int on_key(void *u, const char *s, size_t len) { assert(strlen(s) == len); record(u, "k", s); return 0; }
+static int on_scalar(void *u, const char *s, size_t len) { record(u, "n", s); return 0; }
+static int on_string(void *u, const char *s, size_t len) {
+    recorder_t *r = u;
+    assert(strlen(s) == len);
+    record(r, "s", s);
+    if (strcmp(s, "take me") == 0) {
+        size_t taken_len;
+        r->taken = json_sax_take_string(r->sax, &taken_len);
+        assert(taken_len == 7);
+    }
+    return 0;
+}
+
+static const json_sax_callbacks_t recorder_callbacks = {
+    on_begin_object, on_end_object, on_begin_array, on_end_array, on_key, on_string, on_scalar
+};
+
+// Parses `doc` fed `step` bytes at a time; returns 0 if it parsed and finished cleanly.
+static int parse(const char *doc, size_t step, recorder_t *r) {
+    json_sax_t sax;
+    memset(r, 0, sizeof(recorder_t));
+    r->sax = &sax;
+    json_sax_init(&sax, &recorder_callbacks, r);
+    size_t len = strlen(doc);
+    int status = 0;
+    for (size_t i = 0; i < len && status == 0; i += step) {
+        status = json_sax_feed(&sax, doc + i, len - i < step ? len - i : step);
+    }
+    if (status == 0) status = json_sax_finish(&sax);
+    json_sax_free(&sax);
+    free(r->taken);
+    return status;
+}
+
+void test_events() {
+    printf("Testing JSON events...\n");
+    const char *doc = "[{\"role\": \"user\", \"parts\": [{\"type\":\"text\",\"text\":\"a\\\"b\\\\c\\n\"}]},\n"
+                      "\t{\"n\": -12.5e3, \"t\": true, \"f\": false, \"z\": null, \"e\": {}, \"a\": []}, \"take me\"]";
+    const char *expected = "[;{;k=role;s=user;k=parts;[;{;k=type;s=text;k=text;s=a\"b\\c\n;};];};"
+                           "{;k=n;n=-12.5e3;k=t;n=true;k=f;n=false;k=z;n=null;k=e;{;};k=a;[;];};s=take me;];";
+    recorder_t whole, split;
+    assert(parse(doc, strlen(doc), &whole) == 0);
+    assert(strcmp(whole.log, expected) == 0);
+    // Chunk boundaries may fall anywhere, even inside escapes and literals
+    for (size_t step = 1; step < 8; step++) {
+        assert(parse(doc, step, &split) == 0);
+        assert(strcmp(split.log, expected) == 0);
+    }
+    assert(parse("42", 1, &whole) == 0 && strcmp(whole.log, "n=42;") == 0);
+    printf("JSON events passed.\n");
+}
+
+void test_unicode_escapes() {
+    printf("Testing unicode escapes...\n");
+    recorder_t r;
+    assert(parse("[\"\\u00e9\\u20ac\"]", 1, &r) == 0);
+    assert(strcmp(r.log, "[;s=\xc3\xa9\xe2\x82\xac;];") == 0);
+    // A surrogate pair is one code point
+    assert(parse("[\"\\ud83d\\ude00\"]", 3, &r) == 0);
+    assert(strcmp(r.log, "[;s=\xf0\x9f\x98\x80;];") == 0);
+    // Unpaired halves become U+FFFD
+    assert(parse("[\"\\ud83dx\", \"\\ude00\"]", 1, &r) == 0);
+    assert(strcmp(r.log, "[;s=\xef\xbf\xbdx;s=\xef\xbf\xbd;];") == 0);
+    // UTF-8 passes through untouched
+    assert(parse("[\"\xe2\x9c\x93\"]", 1, &r) == 0);
+    assert(strcmp(r.log, "[;s=\xe2\x9c\x93;];") == 0);
+    printf("Unicode escapes passed.\n");
+}
+
+void test_syntax_errors() {
+    printf("Testing JSON syntax errors...\n");
+    recorder_t r;
+    const char *bad[] = {
+        "[1,]", "{\"a\" 1}", "{\"a\":1,}", "[1 2]", "[1] [2]", "[\"abc", "[tru]", "[\"\\x\"]",
+        "[\"\\u12g4\"]", "{1:2}", "[}", "[\"a\nb\"]", "", "[", "{\"a\":}",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        assert(parse(bad[i], 1, &r) != 0);
+        assert(parse(bad[i], 64, &r) != 0);
+    }
+    char deep[JSON_SAX_MAX_DEPTH + 2];
+    memset(deep, '[', sizeof(deep) - 1);
+    deep[sizeof(deep) - 1] = '\0';
+    assert(parse(deep, 16, &r) != 0);
+    printf("JSON syntax errors passed.\n");
+}
+
+static int stop_at_key(void *u, const char *s, size_t len) { return strcmp(s, "stop") == 0 ? -1 : 0; }
+
+void test_callback_stops_parser() {
+    printf("Testing callback abort...\n");
+    json_sax_callbacks_t callbacks = { NULL, NULL, NULL, NULL, stop_at_key, NULL, NULL };
+    json_sax_t sax;
+    json_sax_init(&sax, &callbacks, NULL);
+    assert(json_sax_feed(&sax, "{\"go\":1,", 8) == 0);
+    assert(json_sax_feed(&sax, "\"stop\":2}", 9) == -1);
+    // Once failed it stays failed
+    assert(json_sax_feed(&sax, " ", 1) == -1);
+    assert(json_sax_finish(&sax) == -1);
+    json_sax_free(&sax);
+    printf("Callback abort passed.\n");
+}
+
+int main() {
+    test_events();
+    test_unicode_escapes();
+    test_syntax_errors();
+    test_callback_stops_parser();
+    printf("All JSON tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "../motifgpt_render.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define NUM_MESSAGES 6
+
+static dp_content_part_t parts[NUM_MESSAGES];
+static dp_message_t messages[NUM_MESSAGES];
+
+static void setup_messages() {
+    static char texts[NUM_MESSAGES][16];
+    for (int i = 0; i < NUM_MESSAGES; i++) {
+        snprintf(texts[i], sizeof(texts[i]), "message %d", i);
+        parts[i].type = DP_CONTENT_PART_TEXT;
+        parts[i].text = texts[i];
+        messages[i].role = (i % 2 == 0) ? DP_ROLE_USER : DP_ROLE_ASSISTANT;
+        messages[i].parts = &parts[i];
+        messages[i].num_parts = 1;
+    }
+}
+
+static char *transcript_text(transcript_t *t) {
+    return transcript_copy_lines(t, 0, transcript_line_count(t), NULL);
+}
+
+void test_full_then_unchanged() {
+    printf("Testing cold and unchanged renders...\n");
+    transcript_t t; transcript_init(&t);
+    render_cache_t cache = {0};
+    render_stats_t stats;
+
+    assert(render_history(&t, &cache, messages, 3, &stats) == 0);
+    assert(stats.rendered == 3 && stats.reused == 0);
+    char *text = transcript_text(&t);
+    assert(strcmp(text, "User: message 0\nAssistant: message 1\nUser: message 2\n") == 0);
+    free(text);
+
+    // Live text appended after a render is replaced by the next one
+    transcript_append(&t, "Assistant: partial", 18);
+    assert(render_history(&t, &cache, messages, 3, &stats) == 0);
+    assert(stats.rendered == 0 && stats.reused == 3);
+    text = transcript_text(&t);
+    assert(strcmp(text, "User: message 0\nAssistant: message 1\nUser: message 2\n") == 0);
+    free(text);
+
+    render_cache_free(&cache);
+    transcript_free(&t);
+    printf("Cold and unchanged renders passed.\n");
+}
+
+void test_suffix_and_prefix_deltas() {
+    printf("Testing appended and evicted messages...\n");
+    transcript_t t; transcript_init(&t);
+    render_cache_t cache = {0};
+    render_stats_t stats;
+
+    assert(render_history(&t, &cache, messages, 4, &stats) == 0);
+
+    // Two new messages: only they are rendered
+    assert(render_history(&t, &cache, messages, 6, &stats) == 0);
+    assert(stats.reused == 4 && stats.rendered == 2 && stats.dropped == 0);
+
+    // FIFO eviction of the two oldest: their text is dropped, nothing re-rendered
+    assert(render_history(&t, &cache, messages + 2, 4, &stats) == 0);
+    assert(stats.reused == 4 && stats.rendered == 0 && stats.dropped == 2);
+    char *text = transcript_text(&t);
+    assert(strcmp(text, "User: message 2\nAssistant: message 3\nUser: message 4\nAssistant: message 5\n") == 0);
+    free(text);
+
+    // An edited message re-renders it and everything after it
+    parts[4].text = "edited";
+    assert(render_history(&t, &cache, messages + 2, 4, &stats) == 0);
+    assert(stats.reused == 2 && stats.rendered == 2 && stats.dropped == 2);
+    text = transcript_text(&t);
+    assert(strcmp(text, "User: message 2\nAssistant: message 3\nUser: edited\nAssistant: message 5\n") == 0);
+    free(text);
+
+    // Clearing the transcript invalidates every cached position
+    transcript_clear(&t);
+    assert(render_history(&t, &cache, messages + 2, 2, &stats) == 0);
+    assert(stats.reused == 0 && stats.rendered == 2);
+
+    // An empty history empties the transcript
+    assert(render_history(&t, &cache, messages, 0, &stats) == 0);
+    assert(t.length == 0 && cache.count == 0);
+
+    render_cache_free(&cache);
+    transcript_free(&t);
+    printf("Appended and evicted messages passed.\n");
+}
+
+void test_hash() {
+    printf("Testing message hash...\n");
+    dp_content_part_t image = { DP_CONTENT_PART_IMAGE_BASE64, NULL };
+    dp_message_t with_image = { DP_ROLE_USER, &image, 1 };
+    dp_content_part_t text = { DP_CONTENT_PART_TEXT, " [Image Attached]" };
+    dp_message_t with_text = { DP_ROLE_USER, &text, 1 };
+    assert(render_message_hash(&with_image) != render_message_hash(&with_text));
+    with_text.role = DP_ROLE_ASSISTANT;
+    dp_message_t same_text = { DP_ROLE_ASSISTANT, &text, 1 };
+    assert(render_message_hash(&with_text) == render_message_hash(&same_text));
+    printf("Message hash passed.\n");
+}
+
+int main() {
+    setup_messages();
+    test_full_then_unchanged();
+    test_suffix_and_prefix_deltas();
+    test_hash();
+    printf("All render tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,270 @@
+#include "../motifgpt_stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define PRODUCER_RECORDS 100000
+
+static int count_doorbells() {
+    pipe_reader_t reader = {0};
+    pipe_message_type_t type;
+    const char *data;
+    size_t len;
+    int doorbells = 0;
+    while (pipe_reader_fill(&reader, pipe_fds[0]) > 0) {
+        while (pipe_reader_next(&reader, &type, &data, &len)) {
+            assert(type == PIPE_MSG_STREAM_READY);
+            doorbells++;
+        }
+    }
+    pipe_reader_free(&reader);
+    return doorbells;
+}
+
+void test_ring_wraparound() {
+    printf("Testing ring records across the wrap point...\n");
+    spsc_ring_t ring;
+    assert(spsc_ring_init(&ring, 100) == -1);
+    assert(spsc_ring_init(&ring, 64) == 0);
+    char out[65];
+    uint32_t type;
+    size_t len;
+    assert(!spsc_ring_pop(&ring, &type, out, &len));
+
+    // 8-byte header + 20-byte payload; three of them force a wrap on the third lap
+    for (int i = 0; i < 10; i++) {
+        char payload[21];
+        snprintf(payload, sizeof(payload), "record-%02d-abcdefghij", i);
+        assert(spsc_ring_push(&ring, PIPE_MSG_TOKEN, payload, 20));
+        assert(spsc_ring_push(&ring, PIPE_MSG_ERROR, payload, 20));
+        assert(!spsc_ring_push(&ring, PIPE_MSG_TOKEN, payload, 20)); // 56 of 64 bytes used
+        assert(spsc_ring_pop(&ring, &type, out, &len));
+        assert(type == PIPE_MSG_TOKEN && len == 20 && memcmp(out, payload, 20) == 0 && out[20] == '\0');
+        assert(spsc_ring_pop(&ring, &type, out, &len));
+        assert(type == PIPE_MSG_ERROR && strcmp(out, payload) == 0);
+    }
+    assert(spsc_ring_push(&ring, PIPE_MSG_STREAM_END, NULL, 0));
+    assert(spsc_ring_pop(&ring, &type, out, &len));
+    assert(type == PIPE_MSG_STREAM_END && len == 0);
+    assert(!spsc_ring_push(&ring, PIPE_MSG_TOKEN, out, 57)); // Can never fit
+    spsc_ring_free(&ring);
+    printf("Ring wraparound passed.\n");
+}
+
+static void *ring_producer(void *arg) {
+    spsc_ring_t *ring = (spsc_ring_t *)arg;
+    for (uint32_t i = 0; i < PRODUCER_RECORDS; i++) {
+        size_t len = i % 37;
+        char payload[37];
+        memset(payload, 'a' + (i % 26), len);
+        while (!spsc_ring_push(ring, i, payload, len)) sched_yield();
+    }
+    return NULL;
+}
+
+void test_ring_concurrent() {
+    printf("Testing ring with a concurrent producer...\n");
+    spsc_ring_t ring;
+    assert(spsc_ring_init(&ring, 256) == 0);
+    pthread_t producer;
+    assert(pthread_create(&producer, NULL, ring_producer, &ring) == 0);
+    char out[257];
+    for (uint32_t expected = 0; expected < PRODUCER_RECORDS; ) {
+        uint32_t type;
+        size_t len;
+        if (!spsc_ring_pop(&ring, &type, out, &len)) { sched_yield(); continue; }
+        assert(type == expected);
+        assert(len == expected % 37);
+        for (size_t i = 0; i < len; i++) assert(out[i] == 'a' + (char)(expected % 26));
+        expected++;
+    }
+    pthread_join(producer, NULL);
+    spsc_ring_free(&ring);
+    printf("Ring concurrent passed.\n");
+}
+
+void test_doorbell_budget() {
+    printf("Testing doorbell coalescing...\n");
+    stream_set_flush_budget(60000, 8);
+    stream_state_t *stream = stream_open("A: ");
+    assert(stream != NULL);
+
+    // Tokens go into the ring straight away but only ring once the byte budget is spent
+    stream_push_token(stream, "ab", 2);
+    stream_push_token(stream, "cd", 2);
+    assert(count_doorbells() == 0);
+    stream_push_token(stream, "efgh", 4);
+    stream_push_token(stream, "ijklmnop", 8);
+    assert(count_doorbells() == 1); // Second ring is suppressed until the UI claims the first
+
+    assert(stream_claim(stream->id) == stream);
+    pipe_message_type_t type;
+    const char *data;
+    size_t len;
+    int tokens = 0;
+    while (stream_next_record(stream, &type, &data, &len)) { assert(type == PIPE_MSG_TOKEN); tokens++; }
+    assert(tokens == 4);
+
+    stream_end(stream, NULL);
+    assert(count_doorbells() == 1);
+    assert(strcmp(stream->response, "abcdefghijklmnop") == 0);
+
+    stream_close(stream);
+    assert(stream_claim(stream->id) == NULL);
+    stream_release(stream);
+    printf("Doorbell coalescing passed.\n");
+}
+
+void test_flusher() {
+    printf("Testing the flusher rings for idle streams...\n");
+    stream_set_flush_budget(10, 4096);
+    assert(stream_coalescer_start() == 0);
+    stream_state_t *stream = stream_open("A: ");
+    stream_push_token(stream, "y", 1);
+    assert(count_doorbells() == 0);
+    usleep(100000);
+    assert(count_doorbells() == 1);
+    stream_coalescer_stop();
+    stream_close(stream);
+    stream_release(stream);
+    stream_set_flush_budget(STREAM_FLUSH_DEFAULT_MS, STREAM_FLUSH_DEFAULT_BYTES);
+    printf("Flusher passed.\n");
+}
+
+// Drains the stream, returning the tool call records in order and checking the text round-trips.
+static int take_tool_calls(stream_state_t *stream, char calls[][64], int max) {
+    pipe_message_type_t type;
+    const char *data;
+    size_t len;
+    int found = 0;
+    while (stream_next_record(stream, &type, &data, &len)) {
+        if (type != PIPE_MSG_TOOL_CALL) continue;
+        assert(found < max && len < 64);
+        memcpy(calls[found++], data, len + 1);
+    }
+    return found;
+}
+
+static void push_text(stream_state_t *stream, const char *text) {
+    stream_push_token(stream, text, strlen(text));
+}
+
+void test_tool_call_detection() {
+    printf("Testing tool call detection while streaming...\n");
+    stream_set_flush_budget(60000, 4096);
+    stream_state_t *stream = stream_open("A: ");
+    char calls[4][64];
+
+    // Tags split across tokens; the call is queued, and rung for, the moment it closes
+    push_text(stream, "Let me look. <to");
+    push_text(stream, "ol_call>{\"name\": \"a\"}</tool_");
+    assert(count_doorbells() == 0);
+    push_text(stream, "call> and <<tool_call>{\"name\": \"b<\"}");
+    assert(count_doorbells() == 1);
+    assert(stream_claim(stream->id) == stream);
+    assert(take_tool_calls(stream, calls, 4) == 1 && strcmp(calls[0], "{\"name\": \"a\"}") == 0);
+
+    push_text(stream, "<</tool_call>");
+    push_text(stream, "<tool_call></tool_call></tool_call> <tool_call>{\"cut");
+    assert(count_doorbells() == 1);
+    assert(stream_claim(stream->id) == stream);
+    assert(take_tool_calls(stream, calls, 4) == 2);
+    assert(strcmp(calls[0], "{\"name\": \"b<\"}<") == 0 && strcmp(calls[1], "") == 0);
+    stream_end(stream, NULL);
+    stream_close(stream);
+    stream_release(stream);
+    count_doorbells();
+    stream_set_flush_budget(STREAM_FLUSH_DEFAULT_MS, STREAM_FLUSH_DEFAULT_BYTES);
+    printf("Tool call detection passed.\n");
+}
+
+void test_oversized_error() {
+    printf("Testing an error longer than the ring...\n");
+    stream_set_flush_budget(60000, 4096);
+    stream_state_t *stream = stream_open("A: ");
+    // Multibyte characters throughout, so the cut has to land between them
+    size_t error_len = 70 * 1024;
+    char *error = malloc(error_len + 1);
+    for (size_t i = 0; i < error_len; i += 2) memcpy(error + i, "\xc3\xa9", 2);
+    error[error_len] = '\0';
+    stream_end(stream, error);
+    assert(count_doorbells() == 1);
+    assert(stream_claim(stream->id) == stream);
+    pipe_message_type_t type;
+    const char *data;
+    size_t len;
+    assert(stream_next_record(stream, &type, &data, &len) && type == PIPE_MSG_ERROR);
+    assert(len > 0 && len <= STREAM_RING_CAPACITY / 4 && len % 2 == 0 && memcmp(data, error, len) == 0);
+    assert(!stream_next_record(stream, &type, &data, &len));
+    free(error);
+    stream_close(stream);
+    stream_release(stream);
+    stream_set_flush_budget(STREAM_FLUSH_DEFAULT_MS, STREAM_FLUSH_DEFAULT_BYTES);
+    printf("Oversized error passed.\n");
+}
+
+static void *slow_stream_producer(void *arg) {
+    stream_state_t *stream = (stream_state_t *)arg;
+    char token[1000];
+    memset(token, 'z', sizeof(token) - 1);
+    token[sizeof(token) - 1] = '\0';
+    // Far more than the ring holds, so the producer has to wait for the consumer
+    for (int i = 0; i < 500; i++) stream_push_token(stream, token, strlen(token));
+    stream_end(stream, NULL);
+    stream_release(stream);
+    return NULL;
+}
+
+void test_backpressure() {
+    printf("Testing a producer that outruns the ring...\n");
+    stream_set_flush_budget(0, 4096);
+    stream_state_t *stream = stream_open("A: ");
+    pthread_t producer;
+    assert(pthread_create(&producer, NULL, slow_stream_producer, stream) == 0);
+
+    pipe_reader_t reader = {0};
+    size_t received = 0;
+    bool ended = false;
+    while (!ended) {
+        pipe_message_type_t type;
+        const char *data;
+        size_t len;
+        if (pipe_reader_fill(&reader, pipe_fds[0]) <= 0) { usleep(1000); continue; }
+        while (pipe_reader_next(&reader, &type, &data, &len)) {
+            unsigned long id;
+            memcpy(&id, data, sizeof(id));
+            assert(type == PIPE_MSG_STREAM_READY && stream_claim(id) == stream);
+            while (stream_next_record(stream, &type, &data, &len)) {
+                if (type == PIPE_MSG_STREAM_END) { ended = true; break; }
+                received += len;
+            }
+        }
+    }
+    pthread_join(producer, NULL);
+    assert(received == 500 * 999);
+    assert(stream->response_len == 500 * 999);
+    stream_close(stream);
+    pipe_reader_free(&reader);
+    stream_set_flush_budget(STREAM_FLUSH_DEFAULT_MS, STREAM_FLUSH_DEFAULT_BYTES);
+    printf("Backpressure passed.\n");
+}
+
+int main() {
+    if (pipe(pipe_fds) == -1) { perror("pipe"); return 1; }
+    fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+    test_ring_wraparound();
+    test_ring_concurrent();
+    test_doorbell_budget();
+    test_flusher();
+    test_backpressure();
+    test_tool_call_detection();
+    test_oversized_error();
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    printf("All stream tests passed!\n");
+    return 0;
+}
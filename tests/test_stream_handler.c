@@ -1,4 +1,5 @@
 #include "../motifgpt_chat.h"
+#include "../motifgpt_stream.h"
 #include <assert.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -6,51 +7,158 @@
 #include <stdlib.h>
 #include <string.h>
 
-void test_stream_handler_error() {
-    // Setup
+static void open_test_pipe() {
     if (pipe(pipe_fds) == -1) {
         perror("pipe");
         exit(1);
     }
-    // Set to non-blocking
     int flags = fcntl(pipe_fds[0], F_GETFL, 0);
     fcntl(pipe_fds[0], F_SETFL, flags | O_NONBLOCK);
+}
 
-    assistant_is_replying = true;
-    prefix_already_added_for_current_reply = true;
-    current_assistant_response_len = 10;
+static void close_test_pipe() {
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+}
+
+// Reads one doorbell frame and returns the stream it names.
+static stream_state_t *claim_doorbell(pipe_reader_t *reader) {
+    pipe_message_type_t type;
+    const char *data;
+    size_t len;
+    unsigned long id;
+    if (!pipe_reader_next(reader, &type, &data, &len)) {
+        if (pipe_reader_fill(reader, pipe_fds[0]) <= 0) return NULL;
+        if (!pipe_reader_next(reader, &type, &data, &len)) return NULL;
+    }
+    assert(type == PIPE_MSG_STREAM_READY);
+    assert(len == sizeof(id));
+    memcpy(&id, data, sizeof(id));
+    return stream_claim(id);
+}
 
-    // Allocate buffer
-    current_assistant_response_capacity = 100;
-    current_assistant_response_buffer = malloc(current_assistant_response_capacity);
-    strcpy(current_assistant_response_buffer, "something");
+void test_stream_handler_error() {
+    open_test_pipe();
+    stream_state_t *stream = stream_open("Assistant: ");
+    assert(stream != NULL);
 
     // Execute
     const char *error_msg = "Stream Error Test";
-    int result = stream_handler(NULL, NULL, false, error_msg);
+    int result = stream_handler(NULL, stream, false, error_msg);
 
     // Verify
     assert(result == 1);
-    assert(assistant_is_replying == false);
-    assert(prefix_already_added_for_current_reply == false);
-    assert(current_assistant_response_len == 0);
-    assert(current_assistant_response_buffer[0] == '\0');
+    assert(stream->closed);
 
-    pipe_message_t msg;
-    ssize_t n = read(pipe_fds[0], &msg, sizeof(msg));
-    assert(n == sizeof(msg));
-    assert(msg.type == PIPE_MSG_ERROR);
-    assert(strcmp(msg.data, error_msg) == 0);
+    pipe_reader_t reader = {0};
+    assert(claim_doorbell(&reader) == stream);
+    pipe_message_type_t type;
+    const char *data;
+    size_t len;
+    assert(stream_next_record(stream, &type, &data, &len));
+    assert(type == PIPE_MSG_ERROR);
+    assert(len == strlen(error_msg));
+    assert(strcmp(data, error_msg) == 0);
+    assert(!stream_next_record(stream, &type, &data, &len));
+
+    // Later calls from the library are ignored once the stream has ended
+    stream_end(stream, NULL);
+    assert(!stream_next_record(stream, &type, &data, &len));
 
     // Cleanup
-    free(current_assistant_response_buffer);
-    current_assistant_response_buffer = NULL;
-    close(pipe_fds[0]);
-    close(pipe_fds[1]);
+    stream_close(stream);
+    stream_release(stream);
+    pipe_reader_free(&reader);
+    close_test_pipe();
     printf("test_stream_handler_error passed!\n");
 }
 
+void test_stream_handler_reply() {
+    open_test_pipe();
+    stream_set_flush_budget(0, STREAM_FLUSH_DEFAULT_BYTES);
+    stream_state_t *stream = stream_open("Assistant: ");
+
+    assert(stream_handler("Hello", stream, false, NULL) == 0);
+    assert(stream_handler(", world", stream, false, NULL) == 0);
+    assert(stream_handler(NULL, stream, true, NULL) == 0);
+
+    // The whole reply is handed over with the end record
+    assert(stream->started);
+    assert(strcmp(stream->response, "Hello, world") == 0);
+
+    pipe_reader_t reader = {0};
+    assert(claim_doorbell(&reader) == stream);
+    pipe_message_type_t type;
+    const char *data;
+    size_t len;
+    assert(stream_next_record(stream, &type, &data, &len));
+    assert(type == PIPE_MSG_TOKEN && strcmp(data, "Hello") == 0);
+    assert(stream_next_record(stream, &type, &data, &len));
+    assert(type == PIPE_MSG_TOKEN && strcmp(data, ", world") == 0);
+    assert(stream_next_record(stream, &type, &data, &len));
+    assert(type == PIPE_MSG_STREAM_END && len == 0);
+
+    // Once the UI thread gives up, the handler asks the library to abort
+    stream_close(stream);
+    assert(stream_handler("late", stream, false, NULL) == 1);
+    stream_release(stream);
+
+    // Without a stream there is nowhere to deliver tokens
+    assert(stream_handler("x", NULL, false, NULL) == 1);
+
+    pipe_reader_free(&reader);
+    close_test_pipe();
+    stream_set_flush_budget(STREAM_FLUSH_DEFAULT_MS, STREAM_FLUSH_DEFAULT_BYTES);
+    printf("test_stream_handler_reply passed!\n");
+}
+
+void test_pipe_frames() {
+    open_test_pipe();
+
+    // Payloads longer than the old fixed 512-byte message must arrive intact
+    char long_token[2000];
+    memset(long_token, 'x', sizeof(long_token) - 1);
+    long_token[sizeof(long_token) - 1] = '\0';
+    write_pipe_message(PIPE_MSG_TOKEN, "Hi");
+    write_pipe_message(PIPE_MSG_TOKEN, long_token);
+    write_pipe_message(PIPE_MSG_STREAM_END, NULL);
+
+    pipe_reader_t reader = {0};
+    pipe_message_type_t type;
+    const char *data;
+    size_t len;
+    ssize_t n = pipe_reader_fill(&reader, pipe_fds[0]);
+    assert(n == (ssize_t)(3 * (sizeof(pipe_frame_header_t) + 1) + 2 + strlen(long_token)));
+
+    assert(pipe_reader_next(&reader, &type, &data, &len));
+    assert(type == PIPE_MSG_TOKEN && len == 2 && strcmp(data, "Hi") == 0);
+    assert(pipe_reader_next(&reader, &type, &data, &len));
+    assert(type == PIPE_MSG_TOKEN && len == strlen(long_token) && strcmp(data, long_token) == 0);
+    assert(pipe_reader_next(&reader, &type, &data, &len));
+    assert(type == PIPE_MSG_STREAM_END && len == 0 && data[0] == '\0');
+    assert(!pipe_reader_next(&reader, &type, &data, &len));
+
+    // A frame split across reads is held back until the rest arrives
+    pipe_frame_header_t header = { PIPE_MSG_TOKEN, 5 };
+    assert(write(pipe_fds[1], &header, sizeof(header)) == sizeof(header));
+    assert(write(pipe_fds[1], "ab", 2) == 2);
+    assert(pipe_reader_fill(&reader, pipe_fds[0]) > 0);
+    assert(!pipe_reader_next(&reader, &type, &data, &len));
+    assert(write(pipe_fds[1], "cde", 4) == 4);
+    assert(pipe_reader_fill(&reader, pipe_fds[0]) > 0);
+    assert(pipe_reader_next(&reader, &type, &data, &len));
+    assert(len == 5 && strcmp(data, "abcde") == 0);
+
+    assert(pipe_reader_fill(&reader, pipe_fds[0]) == -1);
+
+    pipe_reader_free(&reader);
+    close_test_pipe();
+    printf("test_pipe_frames passed!\n");
+}
+
 int main() {
     test_stream_handler_error();
+    test_stream_handler_reply();
+    test_pipe_frames();
     return 0;
 }
@@ -0,0 +1,400 @@
+#include "../motifgpt_tools.h"
+#include "../motifgpt_chat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+static char *echo_execute(const char *args_json) {
+    return strdup(args_json);
+}
+
+static char *slow_execute(const char *args_json) {
+    usleep(300 * 1000);
+    return strdup("{\"late\": true}");
+}
+
+static int cancellable_saw_cancel = 0;
+
+static char *cancellable_execute(const char *args_json, const int *cancelled) {
+    for (int i = 0; i < 500 && !__atomic_load_n(cancelled, __ATOMIC_ACQUIRE); i++) usleep(2000);
+    __atomic_store_n(&cancellable_saw_cancel, __atomic_load_n(cancelled, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    return strdup("{\"partial\": true}");
+}
+
+static int stuck_gate_open = 0;
+static int stuck_running = 0, stuck_max_running = 0, stuck_finished = 0;
+
+static char *stuck_execute(const char *args_json) {
+    int running = __atomic_add_fetch(&stuck_running, 1, __ATOMIC_ACQ_REL);
+    int max = __atomic_load_n(&stuck_max_running, __ATOMIC_ACQUIRE);
+    while (running > max && !__atomic_compare_exchange_n(&stuck_max_running, &max, running, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {}
+    while (!__atomic_load_n(&stuck_gate_open, __ATOMIC_ACQUIRE)) usleep(2000);
+    __atomic_sub_fetch(&stuck_running, 1, __ATOMIC_ACQ_REL);
+    __atomic_add_fetch(&stuck_finished, 1, __ATOMIC_ACQ_REL);
+    return strdup("{}");
+}
+
+static char *null_execute(const char *args_json) {
+    return NULL;
+}
+
+static int counted_runs = 0;
+static long long counted_stamp = 0;
+
+static char *counted_execute(const char *args_json) {
+    int runs = __atomic_add_fetch(&counted_runs, 1, __ATOMIC_ACQ_REL);
+    char *result = malloc(64);
+    snprintf(result, 64, "{\"run\": %d}", runs);
+    return result;
+}
+
+static long long counted_validator(const char *args_json) {
+    return __atomic_load_n(&counted_stamp, __ATOMIC_ACQUIRE);
+}
+
+static motifgpt_tool_t echo_tool = { "echo", "Echoes its arguments.", "{}", echo_execute, 0, NULL };
+static motifgpt_tool_t slow_tool = { "slow", "Takes too long.", "{}", slow_execute, 50, NULL };
+static motifgpt_tool_t cancellable_tool = { "cancellable", "Stops when told.", "{}", NULL, 50, cancellable_execute };
+static motifgpt_tool_t null_tool = { "null", "Returns nothing.", "{}", null_execute, 0, NULL };
+
+static double now_ms() {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Waits up to `timeout_ms` for one PIPE_MSG_TOOL_DONE; returns its id, or 0 if none came.
+static unsigned long wait_for_done(int timeout_ms) {
+    static pipe_reader_t reader;
+    pipe_message_type_t type;
+    const char *data;
+    size_t len;
+    double deadline = now_ms() + timeout_ms;
+    for (;;) {
+        if (pipe_reader_next(&reader, &type, &data, &len)) {
+            unsigned long id;
+            assert(type == PIPE_MSG_TOOL_DONE && len == sizeof(id));
+            memcpy(&id, data, sizeof(id));
+            return id;
+        }
+        int left = (int)(deadline - now_ms());
+        if (left <= 0) return 0;
+        struct pollfd pfd = { pipe_fds[0], POLLIN, 0 };
+        if (poll(&pfd, 1, left) > 0) pipe_reader_fill(&reader, pipe_fds[0]);
+    }
+}
+
+void test_result_comes_back() {
+    printf("Testing tool results...\n");
+    tool_call_t *call = tool_call_create(&echo_tool, "{\"a\":1}");
+    assert(call && tool_call_submit(call) == 0);
+    assert(wait_for_done(2000) == call->id);
+    char *result = tool_call_take_result(call);
+    assert(result && strcmp(result, "{\"a\":1}") == 0);
+    free(result);
+    tool_call_release(call);
+
+    call = tool_call_create(&null_tool, NULL);
+    assert(call && strcmp(call->args_json, "{}") == 0 && tool_call_submit(call) == 0);
+    assert(wait_for_done(2000) == call->id && tool_call_take_result(call) == NULL);
+    tool_call_release(call);
+    printf("Tool results passed.\n");
+}
+
+void test_timeout() {
+    printf("Testing tool timeouts...\n");
+    double start = now_ms();
+    tool_call_t *call = tool_call_create(&slow_tool, NULL);
+    assert(tool_call_submit(call) == 0);
+    // The timeout answers long before the tool does, and answers once
+    assert(wait_for_done(2000) == call->id);
+    assert(now_ms() - start < 250);
+    assert(__atomic_load_n(&call->state, __ATOMIC_ACQUIRE) == TOOL_CALL_TIMED_OUT);
+    char *result = tool_call_take_result(call);
+    assert(result && strstr(result, "slow timed out after 50 ms"));
+    free(result);
+    tool_call_release(call);
+    assert(wait_for_done(500) == 0);
+
+    // A cancellable tool is told to stop
+    cancellable_saw_cancel = 0;
+    call = tool_call_create(&cancellable_tool, NULL);
+    assert(tool_call_submit(call) == 0);
+    assert(wait_for_done(2000) == call->id);
+    result = tool_call_take_result(call);
+    assert(strstr(result, "timed out"));
+    free(result);
+    tool_call_release(call);
+    usleep(100 * 1000);
+    assert(__atomic_load_n(&cancellable_saw_cancel, __ATOMIC_ACQUIRE) == 1);
+    printf("Tool timeouts passed.\n");
+}
+
+void test_cancel() {
+    printf("Testing tool cancellation...\n");
+    cancellable_saw_cancel = 0;
+    motifgpt_tool_t patient = cancellable_tool;
+    patient.timeout_ms = 5000;
+    tool_call_t *call = tool_call_create(&patient, NULL);
+    assert(tool_call_submit(call) == 0);
+    usleep(20 * 1000);
+    tool_call_cancel(call);
+    // Nothing is posted, and the tool gave up
+    assert(wait_for_done(300) == 0);
+    assert(__atomic_load_n(&cancellable_saw_cancel, __ATOMIC_ACQUIRE) == 1);
+    printf("Tool cancellation passed.\n");
+}
+
+void test_thread_cap() {
+    printf("Testing the tool thread cap...\n");
+    // Tools that ignore their timeout hold their threads, but never more than the cap
+    motifgpt_tool_t stuck = { "stuck", "Ignores its timeout.", "{}", stuck_execute, 50, NULL };
+    tool_call_t *calls[TOOL_MAX_THREADS + 2];
+    for (int i = 0; i < TOOL_MAX_THREADS + 2; i++) {
+        calls[i] = tool_call_create(&stuck, NULL);
+        assert(calls[i] && tool_call_submit(calls[i]) == 0);
+    }
+    // Every call still times out on schedule, queued or not
+    for (int i = 0; i < TOOL_MAX_THREADS + 2; i++) assert(wait_for_done(2000) != 0);
+    assert(__atomic_load_n(&stuck_max_running, __ATOMIC_ACQUIRE) == TOOL_MAX_THREADS);
+    for (int i = 0; i < TOOL_MAX_THREADS + 2; i++) {
+        char *result = tool_call_take_result(calls[i]);
+        assert(result && strstr(result, "timed out"));
+        free(result);
+        tool_call_release(calls[i]);
+    }
+
+    // Once the tools return the threads take new calls; the queued ones timed out, so they are skipped
+    __atomic_store_n(&stuck_gate_open, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < 500 && __atomic_load_n(&stuck_finished, __ATOMIC_ACQUIRE) < TOOL_MAX_THREADS; i++) usleep(2000);
+    assert(wait_for_done(100) == 0);
+    assert(__atomic_load_n(&stuck_finished, __ATOMIC_ACQUIRE) == TOOL_MAX_THREADS);
+    tool_call_t *call = tool_call_create(&echo_tool, "{}");
+    assert(call && tool_call_submit(call) == 0);
+    assert(wait_for_done(2000) == call->id);
+    tool_call_release(call);
+    printf("Tool thread cap passed.\n");
+}
+
+void test_batch() {
+    printf("Testing tool call batches...\n");
+    tool_batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+
+    // One call keeps the plain result
+    assert(tool_batch_add_result(&batch, NULL, "{\"error\": \"Unknown tool\"}") == 0);
+    char *joined = tool_batch_join(&batch);
+    assert(strcmp(joined, "<tool_result>{\"error\": \"Unknown tool\"}</tool_result>") == 0);
+    free(joined);
+    tool_batch_clear(&batch);
+
+    // Several run at once and come back in call order, whichever finishes first
+    motifgpt_tool_t slower = slow_tool;
+    slower.timeout_ms = 5000;
+    double start = now_ms();
+    tool_call_t *first = tool_call_create(&slower, NULL), *second = tool_call_create(&slower, NULL);
+    tool_call_t *third = tool_call_create(&echo_tool, "{\"q\":\"a\\nb\"}");
+    assert(tool_call_submit(first) == 0 && tool_batch_add_call(&batch, first) == 0);
+    assert(tool_call_submit(second) == 0 && tool_batch_add_call(&batch, second) == 0);
+    assert(tool_call_submit(third) == 0 && tool_batch_add_call(&batch, third) == 0);
+    assert(tool_batch_add_result(&batch, NULL, "{\"error\": \"Invalid JSON\"}") == 0);
+    assert(batch.pending == 3);
+    unsigned long third_id = third->id; // The batch frees the call with its result
+    assert(wait_for_done(2000) == third_id && tool_batch_finish_call(&batch, third_id));
+    assert(!tool_batch_finish_call(&batch, third_id));
+    while (batch.pending > 0) {
+        unsigned long id = wait_for_done(2000);
+        assert(id && tool_batch_finish_call(&batch, id));
+    }
+    // The two slow calls overlapped
+    assert(now_ms() - start < 550);
+    joined = tool_batch_join(&batch);
+    assert(strcmp(joined, "<tool_result>[{\"name\": \"slow\", \"result\": \"{\\\"late\\\": true}\"}, "
+                          "{\"name\": \"slow\", \"result\": \"{\\\"late\\\": true}\"}, "
+                          "{\"name\": \"echo\", \"result\": \"{\\\"q\\\":\\\"a\\\\nb\\\"}\"}, "
+                          "{\"name\": \"\", \"result\": \"{\\\"error\\\": \\\"Invalid JSON\\\"}\"}]</tool_result>") == 0);
+    free(joined);
+    tool_batch_clear(&batch);
+
+    // However many calls a reply makes, each gets an answer
+    for (int i = 0; i < 40; i++) {
+        char result[32];
+        snprintf(result, sizeof(result), "{\"i\": %d}", i);
+        assert(tool_batch_add_result(&batch, "echo", result) == 0);
+    }
+    assert(batch.count == 40 && batch.capacity >= 40);
+    joined = tool_batch_join(&batch);
+    assert(strstr(joined, "{\"name\": \"echo\", \"result\": \"{\\\"i\\\": 0}\"}, "));
+    assert(strstr(joined, "{\"name\": \"echo\", \"result\": \"{\\\"i\\\": 39}\"}]</tool_result>"));
+    free(joined);
+    tool_batch_clear(&batch);
+    assert(batch.slots == NULL && batch.capacity == 0);
+
+    // Clearing a batch cancels what is still running
+    cancellable_saw_cancel = 0;
+    motifgpt_tool_t patient = cancellable_tool;
+    patient.timeout_ms = 5000;
+    tool_call_t *call = tool_call_create(&patient, NULL);
+    assert(tool_call_submit(call) == 0 && tool_batch_add_call(&batch, call) == 0);
+    usleep(20 * 1000);
+    tool_batch_clear(&batch);
+    assert(batch.count == 0 && batch.pending == 0);
+    assert(wait_for_done(300) == 0);
+    assert(__atomic_load_n(&cancellable_saw_cancel, __ATOMIC_ACQUIRE) == 1);
+    printf("Tool call batches passed.\n");
+}
+
+void test_registry() {
+    printf("Testing the tool registry...\n");
+    tool_registry_t registry;
+    memset(&registry, 0, sizeof(registry));
+    assert(tool_registry_find(&registry, "echo") == NULL);
+
+    // Far more tools than the index starts with, so it has to grow
+    static motifgpt_tool_t many[300];
+    static char names[300][16];
+    for (int i = 0; i < 300; i++) {
+        snprintf(names[i], sizeof(names[i]), "tool_%d", i);
+        many[i] = echo_tool;
+        many[i].name = names[i];
+        assert(tool_registry_add(&registry, &many[i]) == 0);
+    }
+    assert(tool_registry_add(&registry, &echo_tool) == 0);
+    motifgpt_tool_t impostor = slow_tool;
+    impostor.name = "tool_42";
+    assert(tool_registry_add(&registry, &impostor) == 1);
+    assert(registry.count == 301 && registry.num_slots >= 2 * 301);
+
+    for (int i = 0; i < 300; i++) assert(tool_registry_find(&registry, names[i]) == &many[i]);
+    assert(tool_registry_find(&registry, "echo") == &echo_tool);
+    assert(tool_registry_find(&registry, "tool_300") == NULL && tool_registry_find(&registry, "") == NULL);
+    // Load order is kept for the system prompt
+    assert(registry.tools[0] == &many[0] && registry.tools[300] == &echo_tool);
+    tool_registry_free(&registry);
+    assert(registry.count == 0 && tool_registry_find(&registry, "echo") == NULL);
+    printf("Tool registry passed.\n");
+}
+
+void test_plugin_abi() {
+    printf("Testing tools from older plugin ABIs...\n");
+    tool_registry_t registry;
+    memset(&registry, 0, sizeof(registry));
+    static motifgpt_tool_t current[2];
+    current[0] = echo_tool; current[1] = slow_tool;
+    assert(tool_registry_adapt_tools(&registry, current, 2, MOTIFGPT_PLUGIN_ABI_VERSION) == current);
+
+    // A version 1 array has a shorter stride; the copies get the defaults for the rest
+    static const motifgpt_tool_v1_t v1[2] = {
+        { "v1_echo", "Echoes its arguments.", "{}", echo_execute },
+        { "v1_slow", "Takes too long.", "{}", slow_execute }
+    };
+    const motifgpt_tool_t *adapted = tool_registry_adapt_tools(&registry, v1, 2, 1);
+    assert(adapted && (const void *)adapted != (const void *)v1);
+    assert(strcmp(adapted[1].name, "v1_slow") == 0 && adapted[1].execute == slow_execute);
+    assert(adapted[0].timeout_ms == 0 && adapted[0].execute_cancellable == NULL);
+    assert(adapted[0].cache_ttl_ms == 0 && adapted[0].cache_validator == NULL);
+    assert(tool_registry_add(&registry, &adapted[0]) == 0 && tool_registry_add(&registry, &adapted[1]) == 0);
+    assert(tool_registry_find(&registry, "v1_slow") == &adapted[1]);
+
+    // Version 2 keeps its timeouts and cancellation but never caches
+    static const motifgpt_tool_v2_t v2[2] = {
+        { "v2_slow", "Takes too long.", "{}", slow_execute, 50, NULL },
+        { "v2_cancellable", "Stops when told.", "{}", NULL, 50, cancellable_execute }
+    };
+    adapted = tool_registry_adapt_tools(&registry, v2, 2, 2);
+    assert(adapted && strcmp(adapted[1].name, "v2_cancellable") == 0);
+    assert(adapted[0].execute == slow_execute && adapted[0].timeout_ms == 50);
+    assert(adapted[1].execute_cancellable == cancellable_execute && adapted[1].timeout_ms == 50);
+    assert(adapted[1].cache_ttl_ms == 0 && adapted[1].cache_validator == NULL);
+
+    assert(tool_registry_adapt_tools(&registry, current, 2, 0) == NULL);
+    assert(tool_registry_adapt_tools(&registry, current, 2, MOTIFGPT_PLUGIN_ABI_VERSION + 1) == NULL);
+    tool_registry_free(&registry);
+    assert(registry.num_adapted == 0 && registry.adapted == NULL);
+    printf("Older plugin ABIs passed.\n");
+}
+
+// Runs one call to completion and returns its result.
+static char *run_call(const motifgpt_tool_t *tool, const char *args_json) {
+    tool_call_t *call = tool_call_create(tool, args_json);
+    assert(call && tool_call_submit(call) == 0);
+    assert(wait_for_done(2000) == call->id);
+    char *result = tool_call_take_result(call);
+    tool_call_release(call);
+    return result;
+}
+
+static void assert_result(const motifgpt_tool_t *tool, const char *args_json, const char *expected) {
+    char *result = run_call(tool, args_json);
+    assert(result && strcmp(result, expected) == 0);
+    free(result);
+}
+
+void test_cache() {
+    printf("Testing the tool result cache...\n");
+    motifgpt_tool_t uncached = { "counted", "Counts its runs.", "{}", counted_execute, 0, NULL, 0, NULL };
+    assert_result(&uncached, "{}", "{\"run\": 1}");
+    assert_result(&uncached, "{}", "{\"run\": 2}");
+
+    // Identical arguments are served from memory until the TTL runs out
+    motifgpt_tool_t cached = uncached;
+    cached.cache_ttl_ms = 100;
+    assert_result(&cached, "{\"a\":1}", "{\"run\": 3}");
+    assert_result(&cached, "{\"a\":1}", "{\"run\": 3}");
+    assert_result(&cached, "{\"a\":2}", "{\"run\": 4}");
+    assert_result(&uncached, "{\"a\":1}", "{\"run\": 5}"); // Another tool, another entry
+    usleep(150 * 1000);
+    assert_result(&cached, "{\"a\":1}", "{\"run\": 6}");
+    assert_result(&cached, "{\"a\":1}", "{\"run\": 6}");
+
+    // A changed stamp invalidates, and -1 never caches
+    motifgpt_tool_t validated = cached;
+    validated.cache_ttl_ms = 60000;
+    validated.cache_validator = counted_validator;
+    assert_result(&validated, "{}", "{\"run\": 7}");
+    assert_result(&validated, "{}", "{\"run\": 7}");
+    __atomic_store_n(&counted_stamp, 1, __ATOMIC_RELEASE);
+    assert_result(&validated, "{}", "{\"run\": 8}");
+    assert_result(&validated, "{}", "{\"run\": 8}");
+    __atomic_store_n(&counted_stamp, -1, __ATOMIC_RELEASE);
+    assert_result(&validated, "{}", "{\"run\": 9}");
+    assert_result(&validated, "{}", "{\"run\": 10}");
+    __atomic_store_n(&counted_stamp, 1, __ATOMIC_RELEASE);
+
+    // A full cache makes room instead of growing
+    for (int i = 0; i < TOOL_CACHE_MAX_ENTRIES + 10; i++) {
+        char args[32];
+        snprintf(args, sizeof(args), "{\"i\":%d}", i);
+        free(run_call(&validated, args));
+    }
+    int runs = __atomic_load_n(&counted_runs, __ATOMIC_ACQUIRE);
+    free(run_call(&validated, "{\"i\":265}"));
+    assert(__atomic_load_n(&counted_runs, __ATOMIC_ACQUIRE) == runs);
+
+    tool_cache_clear();
+    assert_result(&validated, "{}", "{\"run\": 277}");
+    tool_cache_clear();
+    printf("Tool result cache passed.\n");
+}
+
+int main() {
+    assert(pipe(pipe_fds) == 0);
+    assert(tool_executor_start() == 0);
+    test_result_comes_back();
+    test_timeout();
+    test_cancel();
+    test_thread_cap();
+    test_batch();
+    test_registry();
+    test_plugin_abi();
+    test_cache();
+    tool_executor_stop();
+    tool_call_t *call = tool_call_create(&echo_tool, "{}");
+    assert(call && tool_call_submit(call) != 0);
+    tool_call_release(call);
+    printf("All tool executor tests passed!\n");
+    return 0;
+}
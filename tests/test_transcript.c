@@ -0,0 +1,171 @@
+#include "../motifgpt_transcript.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+void test_append_and_lines() {
+    printf("Testing append and line index...\n");
+    transcript_t t;
+    transcript_init(&t);
+    assert(transcript_line_count(&t) == 0);
+
+    const char *text = "User: hi\nAssistant: hel";
+    assert(transcript_append(&t, text, strlen(text)) == 0);
+    assert(transcript_append(&t, "lo\n", 3) == 0);
+    assert(transcript_line_count(&t) == 3); // Two full lines and the empty line after them
+    assert(transcript_line_offset(&t, 0) == 0);
+    assert(transcript_line_offset(&t, 1) == 9);
+    assert(transcript_line_offset(&t, 2) == 26);
+    assert(transcript_line_offset(&t, 99) == 26);
+
+    size_t len;
+    char *line = transcript_copy_lines(&t, 1, 1, &len);
+    assert(strcmp(line, "Assistant: hello\n") == 0 && len == 17);
+    free(line);
+    char *all = transcript_copy_lines(&t, 0, 100, NULL);
+    assert(strcmp(all, "User: hi\nAssistant: hello\n") == 0);
+    free(all);
+    char *none = transcript_copy_lines(&t, 5, 2, &len);
+    assert(none[0] == '\0' && len == 0);
+    free(none);
+
+    transcript_clear(&t);
+    assert(transcript_line_count(&t) == 0 && t.length == 0);
+    assert(transcript_append(&t, "again", 5) == 0);
+    all = transcript_copy_lines(&t, 0, 1, NULL);
+    assert(strcmp(all, "again") == 0);
+    free(all);
+    transcript_free(&t);
+    printf("Append and line index passed.\n");
+}
+
+void test_across_chunks() {
+    printf("Testing text spanning chunks...\n");
+    transcript_t t;
+    transcript_init(&t);
+    // Lines of 100 bytes so several straddle each chunk boundary
+    char line[101];
+    memset(line, 'x', 99);
+    line[99] = '\n'; line[100] = '\0';
+    const size_t num_lines = 3 * TRANSCRIPT_CHUNK_SIZE / 100 + 7;
+    for (size_t i = 0; i < num_lines; i++) {
+        line[0] = 'a' + (char)(i % 26);
+        assert(transcript_append(&t, line, 100) == 0);
+    }
+    assert(t.num_chunks == 4);
+    assert(transcript_line_count(&t) == num_lines + 1);
+
+    size_t boundary_line = TRANSCRIPT_CHUNK_SIZE / 100; // Starts just before the first boundary
+    size_t len;
+    char *window = transcript_copy_lines(&t, boundary_line, 3, &len);
+    assert(len == 300);
+    for (int i = 0; i < 3; i++) {
+        assert(window[i * 100] == 'a' + (char)((boundary_line + i) % 26));
+        assert(window[i * 100 + 99] == '\n');
+    }
+    free(window);
+
+    // One append larger than a chunk
+    char *big = malloc(TRANSCRIPT_CHUNK_SIZE * 2);
+    memset(big, 'y', TRANSCRIPT_CHUNK_SIZE * 2);
+    big[TRANSCRIPT_CHUNK_SIZE + 5] = '\n';
+    assert(transcript_append(&t, big, TRANSCRIPT_CHUNK_SIZE * 2) == 0);
+    assert(transcript_line_count(&t) == num_lines + 2);
+    char *tail = transcript_copy_lines(&t, num_lines + 1, 1, &len);
+    assert(len == TRANSCRIPT_CHUNK_SIZE - 6);
+    free(tail);
+    free(big);
+    transcript_free(&t);
+    printf("Text spanning chunks passed.\n");
+}
+
+void test_truncate_and_drop() {
+    printf("Testing truncate and drop...\n");
+    transcript_t t;
+    transcript_init(&t);
+    assert(transcript_append(&t, "one\ntwo\n", 8) == 0);
+    size_t third = transcript_end(&t);
+    assert(transcript_append(&t, "three\nfour", 10) == 0);
+    assert(transcript_line_count(&t) == 4);
+
+    // Truncating at a remembered position drops the suffix and its lines
+    transcript_truncate(&t, third);
+    assert(t.length == 8 && transcript_line_count(&t) == 3);
+    assert(transcript_append(&t, "THREE\n", 6) == 0);
+    char *all = transcript_copy_lines(&t, 0, 10, NULL);
+    assert(strcmp(all, "one\ntwo\nTHREE\n") == 0);
+    free(all);
+
+    // Dropping the front keeps later positions valid
+    size_t end = transcript_end(&t);
+    transcript_drop_before(&t, 4);
+    assert(transcript_line_count(&t) == 3);
+    assert(transcript_line_offset(&t, 1) == 4);
+    assert(transcript_end(&t) == end);
+    all = transcript_copy_lines(&t, 0, 10, NULL);
+    assert(strcmp(all, "two\nTHREE\n") == 0);
+    free(all);
+    transcript_truncate(&t, third);
+    all = transcript_copy_lines(&t, 0, 10, NULL);
+    assert(strcmp(all, "two\n") == 0);
+    free(all);
+
+    // Dropping to the middle of a line starts a new first line there
+    transcript_drop_before(&t, 5);
+    all = transcript_copy_lines(&t, 0, 1, NULL);
+    assert(strcmp(all, "wo\n") == 0);
+    free(all);
+
+    // Dropping everything leaves an empty transcript that can be appended to
+    transcript_drop_before(&t, transcript_end(&t));
+    assert(t.length == 0 && transcript_line_count(&t) == 0);
+    assert(transcript_append(&t, "x", 1) == 0);
+    assert(transcript_line_count(&t) == 1);
+
+    unsigned long generation = t.generation;
+    transcript_clear(&t);
+    assert(t.generation != generation && transcript_end(&t) == 0);
+    transcript_free(&t);
+    printf("Truncate and drop passed.\n");
+}
+
+void test_drop_across_chunks() {
+    printf("Testing drop and truncate across chunks...\n");
+    transcript_t t;
+    transcript_init(&t);
+    char line[101];
+    memset(line, 'x', 99);
+    line[99] = '\n'; line[100] = '\0';
+    size_t positions[2000];
+    for (size_t i = 0; i < 2000; i++) {
+        positions[i] = transcript_end(&t);
+        line[0] = 'a' + (char)(i % 26);
+        assert(transcript_append(&t, line, 100) == 0);
+    }
+    // Drop the first 1500 lines: the first two chunks are released
+    transcript_drop_before(&t, positions[1500]);
+    assert(t.chunks[0] == NULL && t.chunks[1] == NULL && t.chunks[2] != NULL);
+    assert(transcript_line_count(&t) == 501);
+    char *first = transcript_copy_lines(&t, 0, 1, NULL);
+    assert(first[0] == 'a' + (char)(1500 % 26) && strlen(first) == 100);
+    free(first);
+    // Truncate into the middle and keep appending
+    transcript_truncate(&t, positions[1700]);
+    assert(transcript_line_count(&t) == 201);
+    assert(transcript_append(&t, "end", 3) == 0);
+    char *tail = transcript_copy_lines(&t, 200, 1, NULL);
+    assert(strcmp(tail, "end") == 0);
+    free(tail);
+    transcript_free(&t);
+    printf("Drop and truncate across chunks passed.\n");
+}
+
+int main() {
+    test_append_and_lines();
+    test_across_chunks();
+    test_truncate_and_drop();
+    test_drop_across_chunks();
+    printf("All transcript tests passed!\n");
+    return 0;
+}
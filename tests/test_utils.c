@@ -109,10 +109,39 @@ void test_read_file_to_buffer() {
     printf("read_file_to_buffer tests passed!\n");
 }
 
+void test_get_image_format() {
+    printf("Testing get_image_format...\n");
+    assert(get_image_format((const unsigned char *)"\x89PNG\r\n\x1a\n\0\0", 10) == IMAGE_FORMAT_PNG);
+    assert(get_image_format((const unsigned char *)"\xff\xd8\xff\xe0", 4) == IMAGE_FORMAT_JPEG);
+    assert(get_image_format((const unsigned char *)"GIF87a", 6) == IMAGE_FORMAT_GIF);
+    assert(get_image_format((const unsigned char *)"GIF89a", 6) == IMAGE_FORMAT_GIF);
+    assert(get_image_format((const unsigned char *)"RIFF\x24\0\0\0WEBPVP8 ", 16) == IMAGE_FORMAT_WEBP);
+    assert(get_image_format((const unsigned char *)"BM\x36\0\x0c\0\0\0\0\0\x36\0", 12) == IMAGE_FORMAT_BMP);
+    assert(get_image_format((const unsigned char *)"\0\0\0\x1c" "ftypavif", 12) == IMAGE_FORMAT_AVIF);
+    assert(get_image_format((const unsigned char *)"\0\0\0\x18" "ftypheic", 12) == IMAGE_FORMAT_HEIC);
+    assert(get_image_format((const unsigned char *)"\0\0\0\x18" "ftypmif1", 12) == IMAGE_FORMAT_HEIF);
+
+    // Prefixes that only match part of a signature
+    assert(get_image_format((const unsigned char *)"\x89PNG", 4) == IMAGE_FORMAT_UNKNOWN);
+    assert(get_image_format((const unsigned char *)"RIFF\x24\0\0\0WAVEfmt ", 16) == IMAGE_FORMAT_UNKNOWN);
+    assert(get_image_format((const unsigned char *)"RIFF\x24\0\0\0", 8) == IMAGE_FORMAT_UNKNOWN);
+    assert(get_image_format((const unsigned char *)"BMW is a car", 12) == IMAGE_FORMAT_UNKNOWN);
+    assert(get_image_format((const unsigned char *)"\0\0\0\x18" "ftypisom", 12) == IMAGE_FORMAT_UNKNOWN);
+    assert(get_image_format(NULL, 0) == IMAGE_FORMAT_UNKNOWN);
+
+    assert(strcmp(get_image_mime_type((const unsigned char *)"RIFF\x24\0\0\0WEBP", 12), "image/webp") == 0);
+    assert(get_image_mime_type((const unsigned char *)"text", 4) == NULL);
+    assert(image_format_from_mime_type("image/heic") == IMAGE_FORMAT_HEIC);
+    assert(image_format_from_mime_type("text/plain") == IMAGE_FORMAT_UNKNOWN);
+    assert(strcmp(image_format_name(IMAGE_FORMAT_WEBP), "WebP") == 0);
+    printf("get_image_format tests passed!\n");
+}
+
 int main() {
     test_generate_system_prompt();
     test_base64_encode();
     test_read_file_to_buffer();
+    test_get_image_format();
     printf("All tests passed successfully!\n");
     return 0;
 }
@@ -0,0 +1,149 @@
+#include "../motifgpt_workers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// Mock disasterparty context functions; each context is just a counter value.
+static int contexts_created = 0;
+static int contexts_destroyed = 0;
+
+dp_context_t* dp_init_context(dp_provider_type_t provider, const char *api_key, const char *base_url) {
+    __atomic_add_fetch(&contexts_created, 1, __ATOMIC_SEQ_CST);
+    return (dp_context_t*)malloc(1);
+}
+
+void dp_destroy_context(dp_context_t *ctx) {
+    __atomic_add_fetch(&contexts_destroyed, 1, __ATOMIC_SEQ_CST);
+    free(ctx);
+}
+
+static pthread_mutex_t done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static int jobs_done = 0;
+static pthread_mutex_t gate_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+static int gate_open = 1;
+
+static void wait_for_jobs(int n) {
+    pthread_mutex_lock(&done_mutex);
+    while (jobs_done < n) pthread_cond_wait(&done_cond, &done_mutex);
+    pthread_mutex_unlock(&done_mutex);
+}
+
+static void mark_done() {
+    pthread_mutex_lock(&done_mutex);
+    jobs_done++;
+    pthread_cond_broadcast(&done_cond);
+    pthread_mutex_unlock(&done_mutex);
+}
+
+static void counting_job(worker_t *self, void *arg) {
+    pthread_mutex_lock(&gate_mutex);
+    while (!gate_open) pthread_cond_wait(&gate_cond, &gate_mutex);
+    pthread_mutex_unlock(&gate_mutex);
+    __atomic_add_fetch((int *)arg, 1, __ATOMIC_SEQ_CST);
+    mark_done();
+}
+
+static void context_job(worker_t *self, void *arg) {
+    const char *key = (const char *)arg;
+    dp_context_t *first = worker_get_context(self, DP_PROVIDER_OPENAI_COMPATIBLE, key, NULL);
+    dp_context_t *again = worker_get_context(self, DP_PROVIDER_OPENAI_COMPATIBLE, key, "");
+    assert(first != NULL && first == again);
+    dp_context_t *other = worker_get_context(self, DP_PROVIDER_OPENAI_COMPATIBLE, key, "http://localhost:8080/v1");
+    assert(other != NULL);
+    mark_done();
+}
+
+void test_jobs_run() {
+    printf("Testing jobs run on the pool...\n");
+    int counter = 0;
+    for (int i = 0; i < 10; i++) assert(worker_pool_submit(counting_job, &counter, NULL) == 0);
+    wait_for_jobs(10);
+    assert(__atomic_load_n(&counter, __ATOMIC_SEQ_CST) == 10);
+    printf("Jobs run passed.\n");
+}
+
+void test_queue_bound_and_stats() {
+    printf("Testing bounded queue and metrics...\n");
+    int counter = 0;
+    int before = jobs_done;
+    pthread_mutex_lock(&gate_mutex); gate_open = 0; pthread_mutex_unlock(&gate_mutex);
+
+    // Occupy every worker, then fill the queue until it refuses more.
+    int accepted = 0;
+    while (worker_pool_submit(counting_job, &counter, NULL) == 0) {
+        accepted++;
+        assert(accepted <= 2 + WORKER_QUEUE_CAPACITY);
+        if (accepted == 2) usleep(50000); // let both workers pick up a job
+    }
+    assert(accepted == 2 + WORKER_QUEUE_CAPACITY);
+
+    worker_pool_stats_t stats;
+    worker_pool_get_stats(&stats);
+    assert(stats.queue_depth == WORKER_QUEUE_CAPACITY);
+    assert(stats.max_queue_depth == WORKER_QUEUE_CAPACITY);
+    assert(stats.jobs_rejected == 1);
+
+    usleep(20000);
+    pthread_mutex_lock(&gate_mutex); gate_open = 1; pthread_cond_broadcast(&gate_cond); pthread_mutex_unlock(&gate_mutex);
+    wait_for_jobs(before + accepted);
+
+    worker_pool_get_stats(&stats);
+    assert(stats.queue_depth == 0);
+    assert(stats.max_wait_ms >= 20.0);
+    assert(stats.total_wait_ms >= stats.max_wait_ms);
+    printf("Bounded queue and metrics passed.\n");
+}
+
+void test_worker_context_reuse() {
+    printf("Testing per-worker context reuse...\n");
+    int before = jobs_done;
+    assert(worker_pool_submit(context_job, "key-a", NULL) == 0);
+    wait_for_jobs(before + 1);
+    assert(__atomic_load_n(&contexts_created, __ATOMIC_SEQ_CST) == 2);
+    assert(__atomic_load_n(&contexts_destroyed, __ATOMIC_SEQ_CST) == 1);
+    printf("Per-worker context reuse passed.\n");
+}
+
+static int jobs_discarded = 0;
+
+static void discard_job(void *arg) {
+    __atomic_add_fetch(&jobs_discarded, 1, __ATOMIC_SEQ_CST);
+}
+
+void test_shutdown_discards_queued_jobs() {
+    printf("Testing shutdown discards queued jobs...\n");
+    int counter = 0;
+    int before = jobs_done;
+    pthread_mutex_lock(&gate_mutex); gate_open = 0; pthread_mutex_unlock(&gate_mutex);
+    assert(worker_pool_submit(counting_job, &counter, discard_job) == 0);
+    assert(worker_pool_submit(counting_job, &counter, discard_job) == 0);
+    usleep(50000); // let both workers pick up a job
+    for (int i = 0; i < 5; i++) assert(worker_pool_submit(counting_job, &counter, discard_job) == 0);
+
+    worker_pool_shutdown();
+    assert(__atomic_load_n(&jobs_discarded, __ATOMIC_SEQ_CST) == 5);
+    assert(worker_pool_submit(counting_job, &counter, discard_job) != 0);
+    assert(__atomic_load_n(&jobs_discarded, __ATOMIC_SEQ_CST) == 5);
+
+    // The two running jobs still finish
+    pthread_mutex_lock(&gate_mutex); gate_open = 1; pthread_cond_broadcast(&gate_cond); pthread_mutex_unlock(&gate_mutex);
+    wait_for_jobs(before + 2);
+    assert(__atomic_load_n(&counter, __ATOMIC_SEQ_CST) == 2);
+    printf("Shutdown discard passed.\n");
+}
+
+int main() {
+    assert(worker_pool_start(2) == 0);
+    test_jobs_run();
+    test_queue_bound_and_stats();
+    test_worker_context_reuse();
+    test_shutdown_discards_queued_jobs();
+    assert(worker_pool_submit(counting_job, NULL, NULL) != 0);
+    printf("All worker pool tests passed!\n");
+    return 0;
+}
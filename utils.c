@@ -49,43 +49,295 @@ unsigned char* read_file_to_buffer(const char* filename, size_t* file_size) {
     fclose(f); return buffer;
 }
 
+typedef struct {
+    size_t offset;
+    const char *bytes;
+    size_t len;
+} image_magic_t;
+
+// An image matches a signature when every non-empty magic is found at its offset
+typedef struct {
+    image_format_t format;
+    image_magic_t magic[2];
+} image_signature_t;
+
+static const image_signature_t image_signatures[] = {
+    { IMAGE_FORMAT_PNG,  { { 0, "\x89PNG\r\n\x1a\n", 8 } } },
+    { IMAGE_FORMAT_JPEG, { { 0, "\xff\xd8", 2 } } },
+    { IMAGE_FORMAT_GIF,  { { 0, "GIF87a", 6 } } },
+    { IMAGE_FORMAT_GIF,  { { 0, "GIF89a", 6 } } },
+    { IMAGE_FORMAT_WEBP, { { 0, "RIFF", 4 }, { 8, "WEBP", 4 } } },
+    // "BM" alone is too common a prefix; the reserved header fields are always zero
+    { IMAGE_FORMAT_BMP,  { { 0, "BM", 2 }, { 6, "\0\0\0\0", 4 } } },
+    // ISO base media files: the major brand after "ftyp" names the codec
+    { IMAGE_FORMAT_AVIF, { { 4, "ftypavif", 8 } } },
+    { IMAGE_FORMAT_AVIF, { { 4, "ftypavis", 8 } } },
+    { IMAGE_FORMAT_HEIC, { { 4, "ftypheic", 8 } } },
+    { IMAGE_FORMAT_HEIC, { { 4, "ftypheix", 8 } } },
+    { IMAGE_FORMAT_HEIC, { { 4, "ftyphevc", 8 } } },
+    { IMAGE_FORMAT_HEIC, { { 4, "ftyphevx", 8 } } },
+    { IMAGE_FORMAT_HEIF, { { 4, "ftypmif1", 8 } } },
+    { IMAGE_FORMAT_HEIF, { { 4, "ftypmsf1", 8 } } },
+};
+
+static const struct {
+    image_format_t format;
+    const char *mime_type;
+    const char *name;
+} image_format_info[] = {
+    { IMAGE_FORMAT_PNG,  "image/png",  "PNG" },
+    { IMAGE_FORMAT_JPEG, "image/jpeg", "JPEG" },
+    { IMAGE_FORMAT_GIF,  "image/gif",  "GIF" },
+    { IMAGE_FORMAT_WEBP, "image/webp", "WebP" },
+    { IMAGE_FORMAT_BMP,  "image/bmp",  "BMP" },
+    { IMAGE_FORMAT_HEIC, "image/heic", "HEIC" },
+    { IMAGE_FORMAT_HEIF, "image/heif", "HEIF" },
+    { IMAGE_FORMAT_AVIF, "image/avif", "AVIF" },
+};
+
+image_format_t get_image_format(const unsigned char* buffer, size_t len) {
+    if (!buffer) return IMAGE_FORMAT_UNKNOWN;
+    for (size_t i = 0; i < sizeof(image_signatures) / sizeof(image_signatures[0]); i++) {
+        const image_signature_t *sig = &image_signatures[i];
+        bool match = true;
+        for (size_t j = 0; j < sizeof(sig->magic) / sizeof(sig->magic[0]) && match && sig->magic[j].len; j++) {
+            const image_magic_t *m = &sig->magic[j];
+            match = len >= m->offset + m->len && memcmp(buffer + m->offset, m->bytes, m->len) == 0;
+        }
+        if (match) return sig->format;
+    }
+    return IMAGE_FORMAT_UNKNOWN;
+}
+
+const char* image_format_mime_type(image_format_t format) {
+    for (size_t i = 0; i < sizeof(image_format_info) / sizeof(image_format_info[0]); i++) {
+        if (image_format_info[i].format == format) return image_format_info[i].mime_type;
+    }
+    return NULL;
+}
+
+const char* image_format_name(image_format_t format) {
+    for (size_t i = 0; i < sizeof(image_format_info) / sizeof(image_format_info[0]); i++) {
+        if (image_format_info[i].format == format) return image_format_info[i].name;
+    }
+    return "unknown";
+}
+
+image_format_t image_format_from_mime_type(const char* mime_type) {
+    if (!mime_type) return IMAGE_FORMAT_UNKNOWN;
+    for (size_t i = 0; i < sizeof(image_format_info) / sizeof(image_format_info[0]); i++) {
+        if (strcmp(image_format_info[i].mime_type, mime_type) == 0) return image_format_info[i].format;
+    }
+    return IMAGE_FORMAT_UNKNOWN;
+}
+
 const char* get_image_mime_type(const unsigned char* buffer, size_t len) {
-    if (!buffer || len == 0) return NULL;
+    return image_format_mime_type(get_image_format(buffer, len));
+}
+
+static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// A kernel encodes as many whole 3-byte groups as it can handle efficiently and
+// returns how many input bytes it consumed; the scalar loop finishes the rest.
+typedef size_t (*base64_kernel_t)(char *out, const unsigned char *in, size_t len);
+
+static size_t base64_kernel_scalar(char *out, const unsigned char *in, size_t len) {
+    size_t i = 0;
+    for (; i + 3 <= len; i += 3, out += 4) {
+        uint32_t triple = ((uint32_t)in[i] << 16) | ((uint32_t)in[i + 1] << 8) | in[i + 2];
+        out[0] = base64_chars[(triple >> 18) & 0x3F];
+        out[1] = base64_chars[(triple >> 12) & 0x3F];
+        out[2] = base64_chars[(triple >> 6) & 0x3F];
+        out[3] = base64_chars[triple & 0x3F];
+    }
+    return i;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BASE64_HAVE_X86 1
+
+// Both x86 kernels follow Muła and Lemire, "Faster Base64 Encoding and Decoding
+// using AVX2 Instructions": spread each 3-byte group over four bytes holding a
+// 6-bit index each, then turn indices into ASCII by adding an offset looked up
+// from the index range.
+
+__attribute__((target("ssse3")))
+static inline __m128i base64_enc_reshuffle_ssse3(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i base64_enc_translate_ssse3(__m128i indices) {
+    const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0);
+    __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, result), indices);
+}
 
-    // PNG: 89 50 4E 47 0D 0A 1A 0A
-    if (len >= 8 && memcmp(buffer, "\x89PNG\r\n\x1a\n", 8) == 0) {
-        return "image/png";
+__attribute__((target("ssse3")))
+static size_t base64_kernel_ssse3(char *out, const unsigned char *in, size_t len) {
+    size_t i = 0;
+    // Each step reads 16 bytes but consumes 12
+    for (; i + 16 <= len; i += 12, out += 16) {
+        __m128i indices = base64_enc_reshuffle_ssse3(_mm_loadu_si128((const __m128i *)(in + i)));
+        _mm_storeu_si128((__m128i *)out, base64_enc_translate_ssse3(indices));
     }
+    return i;
+}
 
-    // JPEG: FF D8
-    if (len >= 2 && memcmp(buffer, "\xff\xd8", 2) == 0) {
-        return "image/jpeg";
+__attribute__((target("avx2")))
+static size_t base64_kernel_avx2(char *out, const unsigned char *in, size_t len) {
+    const __m256i shuffle = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i shift_lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0,
+                                               'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    // Each step reads 28 bytes (two overlapping 16-byte lanes) but consumes 24
+    for (; i + 28 <= len; i += 24, out += 32) {
+        __m256i in_v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + i))),
+                                               _mm_loadu_si128((const __m128i *)(in + i + 12)), 1);
+        in_v = _mm256_shuffle_epi8(in_v, shuffle);
+        const __m256i t0 = _mm256_and_si256(in_v, _mm256_set1_epi32(0x0fc0fc00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(in_v, _mm256_set1_epi32(0x003f03f0));
+        const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        const __m256i indices = _mm256_or_si256(t1, t3);
+        __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        result = _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, result), indices);
+        _mm256_storeu_si256((__m256i *)out, result);
     }
+    return i;
+}
+#endif
+
+static const base64_kernel_t base64_kernels[BASE64_IMPL_COUNT] = {
+    [BASE64_IMPL_SCALAR] = base64_kernel_scalar,
+#ifdef BASE64_HAVE_X86
+    [BASE64_IMPL_SSSE3] = base64_kernel_ssse3,
+    [BASE64_IMPL_AVX2] = base64_kernel_avx2,
+#endif
+};
+
+static const char *const base64_impl_names[BASE64_IMPL_COUNT] = {
+    [BASE64_IMPL_AUTO] = "auto", [BASE64_IMPL_SCALAR] = "scalar", [BASE64_IMPL_SSSE3] = "ssse3",
+    [BASE64_IMPL_AVX2] = "avx2", [BASE64_IMPL_NEON] = "neon",
+};
 
-    // GIF: GIF87a or GIF89a
-    if (len >= 6 && (memcmp(buffer, "GIF87a", 6) == 0 || memcmp(buffer, "GIF89a", 6) == 0)) {
-        return "image/gif";
+static base64_kernel_t base64_active_kernel = NULL;
+static base64_impl_t base64_active_impl = BASE64_IMPL_AUTO;
+
+bool base64_impl_supported(base64_impl_t impl) {
+    if (impl == BASE64_IMPL_AUTO || impl == BASE64_IMPL_SCALAR) return true;
+    if (impl < 0 || impl >= BASE64_IMPL_COUNT || !base64_kernels[impl]) return false;
+#ifdef BASE64_HAVE_X86
+    if (impl == BASE64_IMPL_SSSE3) return __builtin_cpu_supports("ssse3");
+    if (impl == BASE64_IMPL_AVX2) return __builtin_cpu_supports("avx2");
+#endif
+    return true;
+}
+
+bool base64_set_impl(base64_impl_t impl) {
+    if (!base64_impl_supported(impl)) return false;
+    if (impl == BASE64_IMPL_AUTO) {
+        impl = BASE64_IMPL_SCALAR;
+        const base64_impl_t preferred[] = { BASE64_IMPL_AVX2, BASE64_IMPL_SSSE3, BASE64_IMPL_NEON };
+        for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+            if (base64_kernels[preferred[i]] && base64_impl_supported(preferred[i])) { impl = preferred[i]; break; }
+        }
     }
+    // Racing selections pick the same kernel, so plain atomic stores are enough.
+    __atomic_store_n(&base64_active_impl, impl, __ATOMIC_RELAXED);
+    __atomic_store_n(&base64_active_kernel, base64_kernels[impl], __ATOMIC_RELEASE);
+    return true;
+}
 
-    return NULL;
+const char *base64_impl_name() {
+    if (!__atomic_load_n(&base64_active_kernel, __ATOMIC_ACQUIRE)) base64_set_impl(BASE64_IMPL_AUTO);
+    return base64_impl_names[__atomic_load_n(&base64_active_impl, __ATOMIC_RELAXED)];
+}
+
+size_t base64_encoded_length(size_t input_length) {
+    return 4 * ((input_length + 2) / 3);
+}
+
+size_t base64_encode_to(char *out, const unsigned char *data, size_t input_length) {
+    base64_kernel_t kernel = __atomic_load_n(&base64_active_kernel, __ATOMIC_ACQUIRE);
+    if (!kernel) {
+        base64_set_impl(BASE64_IMPL_AUTO);
+        kernel = __atomic_load_n(&base64_active_kernel, __ATOMIC_ACQUIRE);
+    }
+    size_t done = kernel(out, data, input_length);
+    done += base64_kernel_scalar(out + done / 3 * 4, data + done, input_length - done);
+    size_t rest = input_length - done;
+    if (rest > 0) {
+        char *tail = out + done / 3 * 4;
+        uint32_t octet_a = data[done];
+        uint32_t octet_b = rest > 1 ? data[done + 1] : 0;
+        uint32_t triple = (octet_a << 16) | (octet_b << 8);
+        tail[0] = base64_chars[(triple >> 18) & 0x3F];
+        tail[1] = base64_chars[(triple >> 12) & 0x3F];
+        tail[2] = rest > 1 ? base64_chars[(triple >> 6) & 0x3F] : '=';
+        tail[3] = '=';
+    }
+    return base64_encoded_length(input_length);
 }
 
 char* base64_encode(const unsigned char *data, size_t input_length) {
-    const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    size_t output_length = 4 * ((input_length + 2) / 3);
+    size_t output_length = base64_encoded_length(input_length);
     char *encoded_data = malloc(output_length + 1);
     if (!encoded_data) { perror("malloc base64"); return NULL; }
-    for (size_t i = 0, j = 0; i < input_length;) {
-        uint32_t octet_a = i < input_length ? data[i++] : 0;
-        uint32_t octet_b = i < input_length ? data[i++] : 0;
-        uint32_t octet_c = i < input_length ? data[i++] : 0;
-        uint32_t triple = (octet_a << 16) + (octet_b << 8) + octet_c;
-        encoded_data[j++] = base64_chars[(triple >> 18) & 0x3F];
-        encoded_data[j++] = base64_chars[(triple >> 12) & 0x3F];
-        encoded_data[j++] = base64_chars[(triple >> 6) & 0x3F];
-        encoded_data[j++] = base64_chars[(triple >> 0) & 0x3F];
-    }
-    for (size_t i = 0; i < (3 - input_length % 3) % 3; i++) encoded_data[output_length - 1 - i] = '=';
+    base64_encode_to(encoded_data, data, input_length);
     encoded_data[output_length] = '\0';
     return encoded_data;
 }
+
+size_t base64_decoded_length(size_t input_length) {
+    return input_length / 4 * 3;
+}
+
+// Each Base64 digit's value plus one; 0 marks a byte that is not a digit
+static const unsigned char base64_values[256] = {
+    ['A'] = 1, ['B'] = 2, ['C'] = 3, ['D'] = 4, ['E'] = 5, ['F'] = 6, ['G'] = 7, ['H'] = 8, ['I'] = 9, ['J'] = 10, ['K'] = 11, ['L'] = 12, ['M'] = 13,
+    ['N'] = 14, ['O'] = 15, ['P'] = 16, ['Q'] = 17, ['R'] = 18, ['S'] = 19, ['T'] = 20, ['U'] = 21, ['V'] = 22, ['W'] = 23, ['X'] = 24, ['Y'] = 25, ['Z'] = 26,
+    ['a'] = 27, ['b'] = 28, ['c'] = 29, ['d'] = 30, ['e'] = 31, ['f'] = 32, ['g'] = 33, ['h'] = 34, ['i'] = 35, ['j'] = 36, ['k'] = 37, ['l'] = 38, ['m'] = 39,
+    ['n'] = 40, ['o'] = 41, ['p'] = 42, ['q'] = 43, ['r'] = 44, ['s'] = 45, ['t'] = 46, ['u'] = 47, ['v'] = 48, ['w'] = 49, ['x'] = 50, ['y'] = 51, ['z'] = 52,
+    ['0'] = 53, ['1'] = 54, ['2'] = 55, ['3'] = 56, ['4'] = 57, ['5'] = 58, ['6'] = 59, ['7'] = 60, ['8'] = 61, ['9'] = 62, ['+'] = 63, ['/'] = 64
+};
+
+int base64_decode_to(unsigned char *out, const char *data, size_t input_length, size_t *output_length) {
+    if (input_length % 4 != 0) return -1;
+    size_t padding = 0;
+    if (input_length > 0 && data[input_length - 1] == '=') padding++;
+    if (input_length > 1 && data[input_length - 2] == '=') padding++;
+    size_t written = 0;
+    for (size_t i = 0; i < input_length; i += 4) {
+        bool last = i + 4 == input_length;
+        uint32_t quad = 0;
+        for (int k = 0; k < 4; k++) {
+            unsigned char c = (unsigned char)data[i + k];
+            int v = (last && k >= 4 - (int)padding) ? 0 : base64_values[c] - 1;
+            if (v < 0) return -1;
+            quad = quad << 6 | (uint32_t)v;
+        }
+        out[written++] = (unsigned char)(quad >> 16);
+        if (!last || padding < 2) out[written++] = (unsigned char)(quad >> 8);
+        if (!last || padding < 1) out[written++] = (unsigned char)quad;
+    }
+    *output_length = written;
+    return 0;
+}
@@ -23,6 +23,48 @@ void generate_system_prompt(char *buffer, size_t buffer_size, const char *custom
  */
 unsigned char* read_file_to_buffer(const char* filename, size_t* file_size);
 
+/**
+ * Image formats recognised from their magic numbers. Each is a single bit so a
+ * provider's accepted formats fit in one mask.
+ */
+typedef enum {
+    IMAGE_FORMAT_UNKNOWN = 0,
+    IMAGE_FORMAT_PNG  = 1 << 0,
+    IMAGE_FORMAT_JPEG = 1 << 1,
+    IMAGE_FORMAT_GIF  = 1 << 2,
+    IMAGE_FORMAT_WEBP = 1 << 3,
+    IMAGE_FORMAT_BMP  = 1 << 4,
+    IMAGE_FORMAT_HEIC = 1 << 5,
+    IMAGE_FORMAT_HEIF = 1 << 6,
+    IMAGE_FORMAT_AVIF = 1 << 7
+} image_format_t;
+
+/**
+ * Detects the format of an image buffer from its magic numbers.
+ * @param buffer The image data buffer.
+ * @param len The length of the buffer; 12 bytes are enough for every format.
+ * @return The format, or IMAGE_FORMAT_UNKNOWN if unsupported.
+ */
+image_format_t get_image_format(const unsigned char* buffer, size_t len);
+
+/**
+ * @param format An image format.
+ * @return Its MIME type (e.g., "image/webp"), or NULL for IMAGE_FORMAT_UNKNOWN.
+ */
+const char* image_format_mime_type(image_format_t format);
+
+/**
+ * @param format An image format.
+ * @return A short name for messages (e.g., "WebP").
+ */
+const char* image_format_name(image_format_t format);
+
+/**
+ * @param mime_type A MIME type as returned by image_format_mime_type().
+ * @return The matching format, or IMAGE_FORMAT_UNKNOWN.
+ */
+image_format_t image_format_from_mime_type(const char* mime_type);
+
 /**
  * Detects the MIME type of an image buffer based on its magic numbers.
  * @param buffer The image data buffer.
@@ -31,6 +73,53 @@ unsigned char* read_file_to_buffer(const char* filename, size_t* file_size);
  */
 const char* get_image_mime_type(const unsigned char* buffer, size_t len);
 
+/**
+ * Base64 encoder implementations. base64_encode() picks the fastest one the CPU
+ * supports on first use; all of them produce identical output.
+ */
+typedef enum {
+    BASE64_IMPL_AUTO,
+    BASE64_IMPL_SCALAR,
+    BASE64_IMPL_SSSE3,
+    BASE64_IMPL_AVX2,
+    BASE64_IMPL_NEON, // Reserved for an AArch64 kernel; not built yet
+    BASE64_IMPL_COUNT
+} base64_impl_t;
+
+/**
+ * @param impl An implementation.
+ * @return true if it is built in and the CPU can run it.
+ */
+bool base64_impl_supported(base64_impl_t impl);
+
+/**
+ * Selects the implementation base64_encode() uses, e.g. for tests and benchmarks.
+ * @param impl The implementation, or BASE64_IMPL_AUTO for the fastest supported one.
+ * @return true on success, false if the implementation is not supported.
+ */
+bool base64_set_impl(base64_impl_t impl);
+
+/**
+ * @return The name of the implementation base64_encode() uses.
+ */
+const char *base64_impl_name();
+
+/**
+ * @param input_length Length of the input data.
+ * @return The length of its Base64 encoding, padding included, without a terminator.
+ */
+size_t base64_encoded_length(size_t input_length);
+
+/**
+ * Encodes data into a caller-provided buffer. Encoding a long input in pieces
+ * whose lengths are multiples of 3 gives the same result as encoding it at once.
+ * @param out Destination; must hold base64_encoded_length(input_length) bytes. Not NUL-terminated.
+ * @param data Data to encode.
+ * @param input_length Length of the input data.
+ * @return The number of bytes written.
+ */
+size_t base64_encode_to(char *out, const unsigned char *data, size_t input_length);
+
 /**
  * Encodes data into Base64 format.
  * @param data Data to encode.
@@ -39,4 +128,20 @@ const char* get_image_mime_type(const unsigned char* buffer, size_t len);
  */
 char* base64_encode(const unsigned char *data, size_t input_length);
 
+/**
+ * @param input_length Length of Base64 text, padding included.
+ * @return The most bytes it can decode to.
+ */
+size_t base64_decoded_length(size_t input_length);
+
+/**
+ * Decodes padded Base64 text, as produced by base64_encode().
+ * @param out Destination; must hold base64_decoded_length(input_length) bytes.
+ * @param data The Base64 text.
+ * @param input_length Its length; must be a multiple of 4.
+ * @param output_length Receives the number of bytes written.
+ * @return 0 on success, -1 if the text is not valid Base64.
+ */
+int base64_decode_to(unsigned char *out, const char *data, size_t input_length, size_t *output_length);
+
 #endif /* UTILS_H */